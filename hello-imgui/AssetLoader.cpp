@@ -0,0 +1,334 @@
+//-----------------------------------------------------------------------------
+// AssetLoader.cpp
+//
+// Background asset loading.  Worker threads parse meshes and decode images
+// while the render loop keeps running; the GL objects are created on the
+// render thread by update(), a few per frame within a time budget.
+//-----------------------------------------------------------------------------
+#include "AssetLoader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include <fmt/core.h>
+
+#include "Mesh.h"
+#include "Skybox.h"
+
+namespace
+{
+	double elapsedMs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Constructor, starts the workers
+//-----------------------------------------------------------------------------
+AssetLoader::AssetLoader(unsigned int threadCount)
+	: mStopping(false),
+	  mPending(0),
+	  mLoaded(0),
+	  mWallMs(0.0),
+	  mSerialMs(0.0),
+	  mUploadMs(0.0),
+	  mDecodeMs(0.0)
+{
+	if (threadCount == 0)
+		threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1;	// 0 if unknown
+
+	for (unsigned int i = 0; i < threadCount; i++)
+		mThreads.emplace_back(&AssetLoader::workerMain, this);
+}
+
+//-----------------------------------------------------------------------------
+// Destructor.  Jobs not started yet are dropped, running ones are waited for.
+//-----------------------------------------------------------------------------
+AssetLoader::~AssetLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWorkReady.notify_all();
+
+	for (std::thread& thread : mThreads)
+		thread.join();
+}
+
+//-----------------------------------------------------------------------------
+// Parses the mesh into a staging Mesh on a worker, which is moved into
+// 'mesh' on the render thread when it is uploaded.  'mesh' itself is never
+// touched by a worker, so it can be drawn (as nothing) in the meantime.
+//-----------------------------------------------------------------------------
+void AssetLoader::loadMesh(Mesh& mesh, const std::string& filename, VertexLayout layout)
+{
+	beginAsset();
+	schedule([this, &mesh, filename, layout]() {
+		auto start = Clock::now();
+		std::shared_ptr<Mesh> staging = std::make_shared<Mesh>();
+		bool prepared = staging->prepareOBJ(filename, layout);
+
+		// The upload loads the material textures; start decoding them now
+		// rather than once the mesh reaches the render thread
+		for (size_t m = 0; prepared && m < staging->getMaterialCount(); m++)
+		{
+			const Material& material = staging->getMaterial(m);
+			if (!material.diffuseMapFile.empty())
+				prefetchImage(material.diffuseMapFile, TEXTURE_USAGE_COLOR);
+			if (!material.specularMapFile.empty())
+				prefetchImage(material.specularMapFile, TEXTURE_USAGE_MASK);
+		}
+
+		complete([&mesh, staging, prepared]() {
+			if (prepared)
+			{
+				mesh = std::move(*staging);
+				mesh.upload();
+			}
+		}, elapsedMs(start));
+	});
+}
+
+//-----------------------------------------------------------------------------
+// Uploads the image once a worker has decoded it, which may already have
+// happened if it was prefetched.  Several textures may wait for the same
+// decode; each is uploaded.
+//-----------------------------------------------------------------------------
+void AssetLoader::loadTexture(Texture2D& texture, const std::string& filename, TextureUsage usage, bool generateMipMaps)
+{
+	beginAsset();
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	std::shared_ptr<ImageDecode> decode = requestDecode(filename, usage);
+	if (decode->released)
+	{
+		mDecodes.erase(decodeKey(filename, usage));
+		decode = requestDecode(filename, usage);
+	}
+	decode->uploadsLeft++;
+
+	Job upload = [this, &texture, decode, filename, usage, generateMipMaps]() {
+		if (decode->decoded && !texture.upload(decode->image, generateMipMaps) && decode->image.format != 0)
+		{
+			// A cooked format this GL cannot sample, decoded here as the rare exception
+			TextureImage image;
+			if (Texture2D::decodeImage(filename, true, usage, image))
+				texture.upload(image, generateMipMaps);
+		}
+
+		// The last one drops the image; the entry stays so a later prefetch of
+		// the file is a no-op
+		if (--decode->uploadsLeft == 0)
+		{
+			mDecodeMs += decode->decodeMs;
+			decode->image = TextureImage();
+			decode->released = true;
+		}
+	};
+
+	if (decode->done)
+		mUploads.push_back({ std::move(upload), decode->decodeMs });
+	else
+		decode->waiting.push_back(std::move(upload));
+	lock.unlock();
+	mWorkReady.notify_one();
+}
+
+void AssetLoader::prefetchImage(const std::string& filename, TextureUsage usage)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		requestDecode(filename, usage);
+	}
+	mWorkReady.notify_one();
+}
+
+//-----------------------------------------------------------------------------
+// Finds or starts the decode of 'filename'.  New decodes go to the front of
+// the queue: a texture is wanted as soon as its mesh arrives, while meshes
+// queued behind it may still take long to parse.
+//-----------------------------------------------------------------------------
+std::shared_ptr<AssetLoader::ImageDecode> AssetLoader::requestDecode(const std::string& filename, TextureUsage usage)
+{
+	std::shared_ptr<ImageDecode>& decode = mDecodes[decodeKey(filename, usage)];
+	if (decode)
+		return decode;
+
+	decode = std::make_shared<ImageDecode>();
+	decode->decoded = false;
+	decode->done = false;
+	decode->released = false;
+	decode->decodeMs = 0.0;
+	decode->uploadsLeft = 0;
+
+	mWork.push_front([this, decode, filename, usage]() {
+		auto start = Clock::now();
+		bool decoded = Texture2D::readImage(filename, usage, decode->image);
+		double decodeMs = elapsedMs(start);
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		decode->decoded = decoded;
+		decode->decodeMs = decodeMs;
+		decode->done = true;
+		for (Job& upload : decode->waiting)
+			mUploads.push_back({ std::move(upload), decodeMs });
+		decode->waiting.clear();
+	});
+
+	return decode;
+}
+
+std::string AssetLoader::decodeKey(const std::string& filename, TextureUsage usage)
+{
+	return filename + '#' + std::to_string((int)usage);
+}
+
+//-----------------------------------------------------------------------------
+// Decodes the six faces in parallel; the last one to finish queues the
+// cubemap upload
+//-----------------------------------------------------------------------------
+void AssetLoader::loadSkybox(Skybox& skybox, const std::vector<std::string>& faces)
+{
+	struct Cubemap
+	{
+		std::vector<TextureImage> faces;
+		std::vector<double> faceMs;
+		std::atomic<size_t> remaining;
+	};
+
+	std::shared_ptr<Cubemap> cubemap = std::make_shared<Cubemap>();
+	cubemap->faces.resize(faces.size());
+	cubemap->faceMs.resize(faces.size(), 0.0);
+	cubemap->remaining = faces.size();
+
+	beginAsset();
+	for (size_t i = 0; i < faces.size(); i++)
+	{
+		schedule([this, &skybox, cubemap, i, filename = faces[i]]() {
+			auto start = Clock::now();
+			if (!Texture2D::decodeImage(filename, false, TEXTURE_USAGE_COLOR, cubemap->faces[i]))
+				fmt::println("Cubemap texture failed to load at path: {}", filename);
+			cubemap->faceMs[i] = elapsedMs(start);
+
+			if (cubemap->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+				return;
+
+			double workMs = 0.0;
+			for (double ms : cubemap->faceMs)
+				workMs += ms;
+
+			complete([this, &skybox, cubemap, workMs]() {
+				skybox.setCubemap(cubemap->faces);
+				mDecodeMs += workMs;
+			}, workMs);
+		});
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Runs the GL half of finished assets
+//-----------------------------------------------------------------------------
+void AssetLoader::update(double budgetMs)
+{
+	auto start = Clock::now();
+	while (true)
+	{
+		Upload upload;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mUploads.empty())
+				break;
+			upload = std::move(mUploads.front());
+			mUploads.pop_front();
+		}
+
+		auto uploadStart = Clock::now();
+		upload.upload();
+		double uploadMs = elapsedMs(uploadStart);
+
+		// Uploads may request more assets (a mesh its textures), which are
+		// counted before this one is retired
+		mUploadMs += uploadMs;
+		mSerialMs += upload.workMs + uploadMs;
+		mLoaded++;
+		mPending--;
+
+		if (mPending == 0)
+		{
+			mWallMs = elapsedMs(mStartTime);
+			fmt::println("AssetLoader: {} assets loaded in {:.1f} ms ({:.1f} ms of uploads), {:.1f} ms one by one ({:.1f} ms of image decoding), {:.2f}x",
+				mLoaded, mWallMs, mUploadMs, mSerialMs, mDecodeMs, (mWallMs > 0.0) ? mSerialMs / mWallMs : 1.0);
+		}
+
+		if (elapsedMs(start) >= budgetMs)
+			break;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Load timing so far
+//-----------------------------------------------------------------------------
+AssetLoadStats AssetLoader::getStats() const
+{
+	AssetLoadStats stats;
+	stats.loaded = mLoaded;
+	stats.pending = mPending;
+	stats.wallMs = (mPending == 0) ? mWallMs : elapsedMs(mStartTime);
+	stats.serialMs = mSerialMs;
+	stats.uploadMs = mUploadMs;
+	stats.decodeMs = mDecodeMs;
+	return stats;
+}
+
+//-----------------------------------------------------------------------------
+// Counts a request.  The first one after the loader was idle starts a new
+// measurement.
+//-----------------------------------------------------------------------------
+void AssetLoader::beginAsset()
+{
+	if (mPending == 0)
+	{
+		mStartTime = Clock::now();
+		mLoaded = 0;
+		mWallMs = mSerialMs = mUploadMs = mDecodeMs = 0.0;
+	}
+	mPending++;
+}
+
+void AssetLoader::schedule(Job work)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mWork.push_back(std::move(work));
+	}
+	mWorkReady.notify_one();
+}
+
+void AssetLoader::complete(Job upload, double workMs)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mUploads.push_back({ std::move(upload), workMs });
+}
+
+//-----------------------------------------------------------------------------
+// Worker thread: runs jobs until the loader is destroyed
+//-----------------------------------------------------------------------------
+void AssetLoader::workerMain()
+{
+	while (true)
+	{
+		Job work;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWorkReady.wait(lock, [this]() { return mStopping || !mWork.empty(); });
+			if (mStopping)
+				return;
+			work = std::move(mWork.front());
+			mWork.pop_front();
+		}
+		work();
+	}
+}
@@ -0,0 +1,114 @@
+//-----------------------------------------------------------------------------
+// AssetLoader.h
+//
+// Background asset loading.  Worker threads parse meshes and decode images
+// while the render loop keeps running; the GL objects are created on the
+// render thread by update(), a few per frame within a time budget.
+//-----------------------------------------------------------------------------
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Texture2D.h"
+#include "VertexFormat.h"
+
+class Mesh;
+class Skybox;
+
+// Load timing of the assets requested since the loader was last idle
+struct AssetLoadStats
+{
+	size_t loaded;
+	size_t pending;
+	double wallMs;		// first request until the last upload, valid once nothing is pending
+	double serialMs;	// worker plus upload time summed over the assets, i.e. loading them one by one
+	double uploadMs;	// the part of serialMs spent on the render thread
+	double decodeMs;	// the part of serialMs spent decoding images
+};
+
+class AssetLoader
+{
+public:
+	// 0 threads starts one per hardware thread, less one for rendering
+	explicit AssetLoader(unsigned int threadCount = 0);
+	~AssetLoader();
+
+	// Requests are made and completed on the render thread.  Until update()
+	// has uploaded it, the mesh draws nothing, the texture binds no image
+	// and the skybox does not render.
+	void loadMesh(Mesh& mesh, const std::string& filename, VertexLayout layout = VERTEX_LAYOUT_PACKED_OCT16);
+	void loadTexture(Texture2D& texture, const std::string& filename, TextureUsage usage = TEXTURE_USAGE_COLOR, bool generateMipMaps = true);
+	void loadSkybox(Skybox& skybox, const std::vector<std::string>& faces);
+
+	// Starts decoding an image that loadTexture() will be asked for, e.g.
+	// the textures of a mesh that is still being parsed.  Safe to call from
+	// any thread, including the workers.
+	void prefetchImage(const std::string& filename, TextureUsage usage);
+
+	// Uploads finished assets until 'budgetMs' is spent, at least one per
+	// call so loading always makes progress
+	void update(double budgetMs);
+
+	size_t getPendingCount() const { return mPending; }
+	AssetLoadStats getStats() const;
+
+private:
+	typedef std::function<void()> Job;
+	typedef std::chrono::steady_clock Clock;
+
+	// A finished worker job and the GL work that completes it
+	struct Upload
+	{
+		Job upload;
+		double workMs;
+	};
+
+	// An image decode shared by prefetchImage() and loadTexture(), kept by
+	// file name and usage so every image is decoded once.  The image is
+	// dropped once every texture that asked for it is uploaded.
+	struct ImageDecode
+	{
+		TextureImage image;
+		bool decoded;
+		bool done;
+		bool released;			// image dropped, a new loadTexture decodes again
+		double decodeMs;
+		size_t uploadsLeft;		// loadTexture() calls not uploaded yet, render thread only
+		std::vector<Job> waiting;	// their uploads, queued once done
+	};
+
+	AssetLoader(const AssetLoader& rhs);
+	AssetLoader& operator= (const AssetLoader& rhs) { return *this; }
+
+	void workerMain();
+	void beginAsset();
+	void schedule(Job work);						// render thread -> worker
+	void complete(Job upload, double workMs);		// worker -> render thread
+	std::shared_ptr<ImageDecode> requestDecode(const std::string& filename, TextureUsage usage);	// mMutex held
+	static std::string decodeKey(const std::string& filename, TextureUsage usage);
+
+	std::vector<std::thread> mThreads;
+	std::mutex mMutex;
+	std::condition_variable mWorkReady;
+	std::deque<Job> mWork;
+	std::deque<Upload> mUploads;
+	std::unordered_map<std::string, std::shared_ptr<ImageDecode>> mDecodes;
+	bool mStopping;
+
+	// Render thread only
+	size_t mPending, mLoaded;
+	Clock::time_point mStartTime;
+	double mWallMs, mSerialMs, mUploadMs, mDecodeMs;
+};
+#endif // ASSET_LOADER_H
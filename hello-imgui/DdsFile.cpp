@@ -0,0 +1,246 @@
+//-----------------------------------------------------------------------------
+// DdsFile.cpp
+//
+// Cooked textures: DDS files holding a block compressed image and its mip
+// chain, written by the texture-cooker tool and loaded by Texture2D.
+//-----------------------------------------------------------------------------
+#include "DdsFile.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <fmt/core.h>
+
+#include "TextureCompressor.h"
+
+namespace
+{
+	const char DDS_MAGIC[4] = { 'D', 'D', 'S', ' ' };
+
+	// DDS_HEADER flags
+	const uint32_t DDSD_CAPS = 0x1;
+	const uint32_t DDSD_HEIGHT = 0x2;
+	const uint32_t DDSD_WIDTH = 0x4;
+	const uint32_t DDSD_PIXELFORMAT = 0x1000;
+	const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+	const uint32_t DDSD_LINEARSIZE = 0x80000;
+	const uint32_t DDPF_FOURCC = 0x4;
+	const uint32_t DDSCAPS_COMPLEX = 0x8;
+	const uint32_t DDSCAPS_TEXTURE = 0x1000;
+	const uint32_t DDSCAPS_MIPMAP = 0x400000;
+
+	// DXGI_FORMAT values of the DX10 header
+	const uint32_t DXGI_FORMAT_BC1_UNORM = 71;
+	const uint32_t DXGI_FORMAT_BC3_UNORM = 77;
+	const uint32_t DXGI_FORMAT_BC5_UNORM = 83;
+	const uint32_t DXGI_FORMAT_BC7_UNORM = 98;
+	const uint32_t D3D10_RESOURCE_DIMENSION_TEXTURE2D = 3;
+
+	struct DdsPixelFormat
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t fourCC;
+		uint32_t rgbBitCount;
+		uint32_t bitMasks[4];
+	};
+
+	struct DdsHeader
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t height;
+		uint32_t width;
+		uint32_t pitchOrLinearSize;
+		uint32_t depth;
+		uint32_t mipMapCount;
+		uint32_t reserved1[11];
+		DdsPixelFormat pixelFormat;
+		uint32_t caps[4];
+		uint32_t reserved2;
+	};
+
+	struct DdsHeaderDx10
+	{
+		uint32_t dxgiFormat;
+		uint32_t resourceDimension;
+		uint32_t miscFlag;
+		uint32_t arraySize;
+		uint32_t miscFlags2;
+	};
+
+	constexpr uint32_t fourCC(char a, char b, char c, char d)
+	{
+		return (uint32_t)(unsigned char)a | ((uint32_t)(unsigned char)b << 8) |
+			((uint32_t)(unsigned char)c << 16) | ((uint32_t)(unsigned char)d << 24);
+	}
+
+	GLenum formatFromFourCC(uint32_t code)
+	{
+		switch (code)
+		{
+		case fourCC('D', 'X', 'T', '1'):	return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case fourCC('D', 'X', 'T', '5'):	return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case fourCC('A', 'T', 'I', '2'):
+		case fourCC('B', 'C', '5', 'U'):	return GL_COMPRESSED_RG_RGTC2;
+		default:							return 0;
+		}
+	}
+
+	GLenum formatFromDxgi(uint32_t dxgiFormat)
+	{
+		switch (dxgiFormat)
+		{
+		case DXGI_FORMAT_BC1_UNORM:	return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case DXGI_FORMAT_BC3_UNORM:	return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case DXGI_FORMAT_BC5_UNORM:	return GL_COMPRESSED_RG_RGTC2;
+		case DXGI_FORMAT_BC7_UNORM:	return GL_COMPRESSED_RGBA_BPTC_UNORM;
+		default:					return 0;
+		}
+	}
+
+	// Total bytes of 'mipCount' levels, each half the size of the previous
+	size_t mipChainSize(GLenum format, int width, int height, int mipCount)
+	{
+		size_t size = 0;
+		for (int level = 0; level < mipCount; level++)
+		{
+			size += TextureCompressor::getImageSize(format, width, height);
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+		return size;
+	}
+}
+
+std::string DdsFile::cookedFilename(const std::string& sourceFile)
+{
+	return sourceFile + ".dds";
+}
+
+bool DdsFile::isUpToDate(const std::string& sourceFile)
+{
+	std::error_code error;
+	auto cookedTime = std::filesystem::last_write_time(cookedFilename(sourceFile), error);
+	if (error)
+		return false;
+
+	auto sourceTime = std::filesystem::last_write_time(sourceFile, error);
+	return !error && cookedTime >= sourceTime;
+}
+
+//-----------------------------------------------------------------------------
+// Reads the header and the whole mip chain.  Anything but a single 2D
+// texture in one of the known block formats is rejected.
+//-----------------------------------------------------------------------------
+bool DdsFile::read(const std::string& filename, TextureImage& image)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+		return false;
+
+	char magic[4];
+	DdsHeader header;
+	if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, DDS_MAGIC, sizeof(magic)) != 0 ||
+		!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.size != sizeof(DdsHeader))
+	{
+		fmt::println("'{}' is not a DDS file", filename);
+		return false;
+	}
+
+	GLenum format = 0;
+	if (header.pixelFormat.flags & DDPF_FOURCC)
+	{
+		if (header.pixelFormat.fourCC == fourCC('D', 'X', '1', '0'))
+		{
+			DdsHeaderDx10 dx10;
+			if (file.read(reinterpret_cast<char*>(&dx10), sizeof(dx10)) &&
+				dx10.resourceDimension == D3D10_RESOURCE_DIMENSION_TEXTURE2D && dx10.arraySize == 1)
+				format = formatFromDxgi(dx10.dxgiFormat);
+		}
+		else
+		{
+			format = formatFromFourCC(header.pixelFormat.fourCC);
+		}
+	}
+
+	if (format == 0 || header.width == 0 || header.height == 0)
+	{
+		fmt::println("DDS file '{}' has an unsupported format", filename);
+		return false;
+	}
+
+	int mipCount = (header.flags & DDSD_MIPMAPCOUNT) ? std::max(1, (int)header.mipMapCount) : 1;
+	size_t size = mipChainSize(format, (int)header.width, (int)header.height, mipCount);
+
+	image.width = (int)header.width;
+	image.height = (int)header.height;
+	image.components = (format == GL_COMPRESSED_RG_RGTC2) ? 2 : 4;
+	image.format = format;
+	image.mipCount = mipCount;
+	image.pixels.resize(size);
+	if (!file.read(reinterpret_cast<char*>(image.pixels.data()), (std::streamsize)size))
+	{
+		fmt::println("DDS file '{}' is truncated", filename);
+		image.pixels.clear();
+		return false;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// BC1, BC3 and BC5 use the legacy FourCC header every tool reads, BC7 needs
+// the DX10 one
+//-----------------------------------------------------------------------------
+bool DdsFile::write(const std::string& filename, const TextureImage& image)
+{
+	uint32_t code = 0;
+	uint32_t dxgiFormat = 0;
+	switch (image.format)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:	code = fourCC('D', 'X', 'T', '1'); break;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:	code = fourCC('D', 'X', 'T', '5'); break;
+	case GL_COMPRESSED_RG_RGTC2:			code = fourCC('A', 'T', 'I', '2'); break;
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:		code = fourCC('D', 'X', '1', '0'); dxgiFormat = DXGI_FORMAT_BC7_UNORM; break;
+	default:
+		return false;
+	}
+
+	size_t size = mipChainSize(image.format, image.width, image.height, image.mipCount);
+	if (image.pixels.size() < size)
+		return false;
+
+	DdsHeader header = {};
+	header.size = sizeof(DdsHeader);
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.height = (uint32_t)image.height;
+	header.width = (uint32_t)image.width;
+	header.pitchOrLinearSize = (uint32_t)TextureCompressor::getImageSize(image.format, image.width, image.height);
+	header.mipMapCount = (uint32_t)image.mipCount;
+	header.pixelFormat.size = sizeof(DdsPixelFormat);
+	header.pixelFormat.flags = DDPF_FOURCC;
+	header.pixelFormat.fourCC = code;
+	header.caps[0] = DDSCAPS_TEXTURE | (image.mipCount > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		fmt::println("Cannot write '{}'", filename);
+		return false;
+	}
+
+	file.write(DDS_MAGIC, sizeof(DDS_MAGIC));
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (dxgiFormat != 0)
+	{
+		DdsHeaderDx10 dx10 = { dxgiFormat, D3D10_RESOURCE_DIMENSION_TEXTURE2D, 0, 1, 0 };
+		file.write(reinterpret_cast<const char*>(&dx10), sizeof(dx10));
+	}
+	file.write(reinterpret_cast<const char*>(image.pixels.data()), (std::streamsize)size);
+
+	return (bool)file;
+}
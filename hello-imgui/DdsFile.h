@@ -0,0 +1,31 @@
+//-----------------------------------------------------------------------------
+// DdsFile.h
+//
+// Cooked textures: DDS files holding a block compressed image and its mip
+// chain, written by the texture-cooker tool and loaded by Texture2D.
+//-----------------------------------------------------------------------------
+#ifndef DDS_FILE_H
+#define DDS_FILE_H
+
+#include <string>
+
+#include "Texture2D.h"
+
+class DdsFile
+{
+public:
+	// Cooked files live next to their source, e.g. textures/crate.jpg.dds
+	static std::string cookedFilename(const std::string& sourceFile);
+
+	// True if the cooked file of 'sourceFile' exists and is not older
+	static bool isUpToDate(const std::string& sourceFile);
+
+	// Reads BC1, BC3, BC5 (legacy FourCC or DX10 header) and BC7 (DX10).
+	// Rows are stored bottom up, the way GL expects them and Texture2D
+	// decodes its images, so a cooked file flips like its source.
+	static bool read(const std::string& filename, TextureImage& image);
+
+	// Writes a compressed image, see TextureImage::format
+	static bool write(const std::string& filename, const TextureImage& image);
+};
+#endif // DDS_FILE_H
@@ -0,0 +1,143 @@
+//-----------------------------------------------------------------------------
+// FrameUniforms.cpp
+//
+// The camera, shadow and light uniforms of a frame in one std140 uniform
+// buffer, written once per frame and bound to a binding point that every
+// program's FrameData block reads (shaders/frame_data.glsl).
+//-----------------------------------------------------------------------------
+#include "FrameUniforms.h"
+
+#include <cstddef>
+
+#include <fmt/core.h>
+
+#include "ShaderProgram.h"
+
+namespace
+{
+	const char* BLOCK_NAME = "FrameData";
+
+	GLuint gBuffer = 0;
+
+	// A member of the block as the GL names it, where the C++ structs put it
+	struct BlockMember
+	{
+		const GLchar* name;
+		size_t offset;
+		GLenum type;
+	};
+
+	const size_t LIGHT = offsetof(FrameData, light);
+	const size_t SPOT = offsetof(FrameData, spotLight);
+
+	const BlockMember MEMBERS[] = {
+		{ "view", offsetof(FrameData, view), GL_FLOAT_MAT4 },
+		{ "projection", offsetof(FrameData, projection), GL_FLOAT_MAT4 },
+		{ "skyboxView", offsetof(FrameData, skyboxView), GL_FLOAT_MAT4 },
+		{ "lightSpaceMatrix", offsetof(FrameData, lightSpaceMatrix), GL_FLOAT_MAT4 },
+		{ "viewPos", offsetof(FrameData, viewPos), GL_FLOAT_VEC3 },
+		{ "encodeSrgb", offsetof(FrameData, encodeSrgb), GL_INT },
+		{ "light.position", LIGHT + offsetof(FrameLight, position), GL_FLOAT_VEC3 },
+		{ "light.ambient", LIGHT + offsetof(FrameLight, ambient), GL_FLOAT_VEC3 },
+		{ "light.diffuse", LIGHT + offsetof(FrameLight, diffuse), GL_FLOAT_VEC3 },
+		{ "light.specular", LIGHT + offsetof(FrameLight, specular), GL_FLOAT_VEC3 },
+		{ "spotLight.position", SPOT + offsetof(FrameSpotLight, position), GL_FLOAT_VEC3 },
+		{ "spotLight.direction", SPOT + offsetof(FrameSpotLight, direction), GL_FLOAT_VEC3 },
+		{ "spotLight.cosInnerCone", SPOT + offsetof(FrameSpotLight, cosInnerCone), GL_FLOAT },
+		{ "spotLight.cosOuterCone", SPOT + offsetof(FrameSpotLight, cosOuterCone), GL_FLOAT },
+		{ "spotLight.ambient", SPOT + offsetof(FrameSpotLight, ambient), GL_FLOAT_VEC3 },
+		{ "spotLight.diffuse", SPOT + offsetof(FrameSpotLight, diffuse), GL_FLOAT_VEC3 },
+		{ "spotLight.specular", SPOT + offsetof(FrameSpotLight, specular), GL_FLOAT_VEC3 },
+		{ "spotLight.on", SPOT + offsetof(FrameSpotLight, on), GL_INT },
+		{ "spotLight.constant", SPOT + offsetof(FrameSpotLight, constant), GL_FLOAT },
+		{ "spotLight.linear", SPOT + offsetof(FrameSpotLight, linear), GL_FLOAT },
+		{ "spotLight.exponent", SPOT + offsetof(FrameSpotLight, exponent), GL_FLOAT }
+	};
+	const size_t MEMBER_COUNT = sizeof(MEMBERS) / sizeof(MEMBERS[0]);
+}
+
+void FrameUniforms::create()
+{
+	ShaderProgram::setBlockBinding(BLOCK_NAME, BINDING);
+
+	if (gBuffer == 0)
+		glGenBuffers(1, &gBuffer);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, gBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, gBuffer);
+}
+
+//-----------------------------------------------------------------------------
+// Orphans the previous frame's storage so the write does not wait for the
+// draws still reading it
+//-----------------------------------------------------------------------------
+void FrameUniforms::update(const FrameData& data)
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, gBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+//-----------------------------------------------------------------------------
+// std140 blocks keep all their members active, so each one is found even
+// where the program does not read it
+//-----------------------------------------------------------------------------
+bool FrameUniforms::checkLayout(ShaderProgram& program, const char* label)
+{
+	GLuint handle = program.getProgram();
+	GLuint block = glGetUniformBlockIndex(handle, BLOCK_NAME);
+	if (block == GL_INVALID_INDEX)
+	{
+		fmt::println("Frame uniforms: {} has no {} block", label, BLOCK_NAME);
+		return false;
+	}
+
+	bool matches = true;
+	GLint size = 0;
+	glGetActiveUniformBlockiv(handle, block, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+	if ((size_t)size != sizeof(FrameData))
+	{
+		fmt::println("Frame uniforms: {} block is {} bytes, FrameData is {}", label, size, sizeof(FrameData));
+		matches = false;
+	}
+
+	const GLchar* names[MEMBER_COUNT];
+	for (size_t m = 0; m < MEMBER_COUNT; m++)
+		names[m] = MEMBERS[m].name;
+
+	GLuint indices[MEMBER_COUNT];
+	glGetUniformIndices(handle, (GLsizei)MEMBER_COUNT, names, indices);
+
+	for (size_t m = 0; m < MEMBER_COUNT; m++)
+	{
+		if (indices[m] == GL_INVALID_INDEX)
+		{
+			fmt::println("Frame uniforms: {} has no {}", label, MEMBERS[m].name);
+			matches = false;
+			continue;
+		}
+
+		GLint offset = -1, type = 0, memberBlock = -1;
+		glGetActiveUniformsiv(handle, 1, &indices[m], GL_UNIFORM_OFFSET, &offset);
+		glGetActiveUniformsiv(handle, 1, &indices[m], GL_UNIFORM_TYPE, &type);
+		glGetActiveUniformsiv(handle, 1, &indices[m], GL_UNIFORM_BLOCK_INDEX, &memberBlock);
+
+		if (memberBlock != (GLint)block || offset != (GLint)MEMBERS[m].offset || (GLenum)type != MEMBERS[m].type)
+		{
+			fmt::println("Frame uniforms: {} {} at offset {} type 0x{:x}, the structs put it at {} type 0x{:x}", label, MEMBERS[m].name,
+				offset, type, MEMBERS[m].offset, MEMBERS[m].type);
+			matches = false;
+		}
+	}
+	return matches;
+}
+
+void FrameUniforms::destroy()
+{
+	glDeleteBuffers(1, &gBuffer);
+	gBuffer = 0;
+}
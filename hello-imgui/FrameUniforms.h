@@ -0,0 +1,87 @@
+//-----------------------------------------------------------------------------
+// FrameUniforms.h
+//
+// The camera, shadow and light uniforms of a frame in one std140 uniform
+// buffer, written once per frame and bound to a binding point that every
+// program's FrameData block reads (shaders/frame_data.glsl).
+//-----------------------------------------------------------------------------
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+class ShaderProgram;
+
+// The structs below follow the std140 rules: a vec3 takes 16 bytes unless a
+// scalar fills its last 4, structs and matrices start on 16 bytes.  The
+// padding is spelled out, FrameUniforms::checkLayout asks the GL whether
+// it agrees.
+struct FrameLight
+{
+	glm::vec3 position;
+	float pad0;
+	glm::vec3 ambient;
+	float pad1;
+	glm::vec3 diffuse;
+	float pad2;
+	glm::vec3 specular;
+	float pad3;
+};
+
+struct FrameSpotLight
+{
+	glm::vec3 position;
+	float pad0;
+	glm::vec3 direction;
+	float cosInnerCone;
+	float cosOuterCone;
+	float pad1[3];
+	glm::vec3 ambient;
+	float pad2;
+	glm::vec3 diffuse;
+	float pad3;
+	glm::vec3 specular;
+	GLint on;
+
+	float constant;
+	float linear;
+	float exponent;
+	float pad4;
+};
+
+struct FrameData
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 skyboxView;		// view without the translation
+	glm::mat4 lightSpaceMatrix;
+	glm::vec3 viewPos;
+	GLint encodeSrgb;			// 1 when the default framebuffer is linear
+	FrameLight light;
+	FrameSpotLight spotLight;
+};
+
+static_assert(sizeof(FrameLight) == 64, "FrameLight must match the std140 Light");
+static_assert(sizeof(FrameSpotLight) == 112, "FrameSpotLight must match the std140 SpotLight");
+static_assert(sizeof(FrameData) == 448, "FrameData must match the std140 FrameData block");
+
+class FrameUniforms
+{
+public:
+	static const GLuint BINDING = 0;
+
+	// Creates the buffer at BINDING and has ShaderProgram bind FrameData
+	// blocks to it, call before the shaders are loaded
+	static void create();
+
+	// Replaces the buffer's contents, once per frame before drawing
+	static void update(const FrameData& data);
+
+	// Compares the offsets, types and size the GL gives the program's
+	// FrameData block with the C++ structs.  Prints each difference.
+	static bool checkLayout(ShaderProgram& program, const char* label);
+
+	static void destroy();
+};
+#endif // FRAME_UNIFORMS_H
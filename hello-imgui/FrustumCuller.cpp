@@ -0,0 +1,158 @@
+//-----------------------------------------------------------------------------
+// FrustumCuller.cpp
+//
+// Whole-object visibility against a view frustum.  Instance bounds are kept
+// as world space boxes with a bounding sphere in structure-of-arrays form and
+// tested four at a time with SSE2 where available.
+//-----------------------------------------------------------------------------
+#include "FrustumCuller.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULLER_SSE2
+#include <emmintrin.h>
+#endif
+
+FrustumCuller::FrustumCuller()
+	:mCount(0)
+{
+}
+
+void FrustumCuller::clear()
+{
+	mCenterX.clear(); mCenterY.clear(); mCenterZ.clear();
+	mExtentX.clear(); mExtentY.clear(); mExtentZ.clear();
+	mRadius.clear();
+	mCount = 0;
+}
+
+void FrustumCuller::reserve(size_t instanceCount)
+{
+	mCenterX.reserve(instanceCount); mCenterY.reserve(instanceCount); mCenterZ.reserve(instanceCount);
+	mExtentX.reserve(instanceCount); mExtentY.reserve(instanceCount); mExtentZ.reserve(instanceCount);
+	mRadius.reserve(instanceCount);
+}
+
+//-----------------------------------------------------------------------------
+// The box stays axis aligned in world space: its extents along each world
+// axis are the absolute values of the model matrix applied to the local ones
+//-----------------------------------------------------------------------------
+size_t FrustumCuller::addInstance(const glm::vec3& center, const glm::vec3& extents, float radius, const glm::mat4& model)
+{
+	glm::vec3 worldCenter = glm::vec3(model * glm::vec4(center, 1.0f));
+
+	glm::vec3 worldExtents(0.0f);
+	for (int col = 0; col < 3; col++)
+		for (int row = 0; row < 3; row++)
+			worldExtents[row] += std::abs(model[col][row]) * extents[col];
+
+	float scale = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+	mCenterX.push_back(worldCenter.x); mCenterY.push_back(worldCenter.y); mCenterZ.push_back(worldCenter.z);
+	mExtentX.push_back(worldExtents.x); mExtentY.push_back(worldExtents.y); mExtentZ.push_back(worldExtents.z);
+	mRadius.push_back(radius * scale);
+
+	return mCount++;
+}
+
+void FrustumCuller::extractPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6])
+{
+	glm::vec4 w(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+	for (int i = 0; i < 3; i++)
+	{
+		glm::vec4 row(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+		planes[i * 2] = w + row;
+		planes[i * 2 + 1] = w - row;
+	}
+
+	for (int i = 0; i < 6; i++)
+	{
+		float length = glm::length(glm::vec3(planes[i]));
+		if (length > 0.0f)
+			planes[i] /= length;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// An instance is outside when its center lies further behind one plane than
+// the smaller of its two bounds reaches: the sphere radius, or the box's
+// projection onto the plane normal.
+//-----------------------------------------------------------------------------
+FrustumCullStats FrustumCuller::cull(const glm::mat4& viewProjection, std::vector<unsigned char>& visible) const
+{
+	visible.resize(mCount);
+
+	glm::vec4 planes[6];
+	extractPlanes(viewProjection, planes);
+
+	size_t i = 0;
+#ifdef FRUSTUM_CULLER_SSE2
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+
+	__m128 px[6], py[6], pz[6], pw[6], ax[6], ay[6], az[6];
+	for (int p = 0; p < 6; p++)
+	{
+		px[p] = _mm_set1_ps(planes[p].x);
+		py[p] = _mm_set1_ps(planes[p].y);
+		pz[p] = _mm_set1_ps(planes[p].z);
+		pw[p] = _mm_set1_ps(planes[p].w);
+		ax[p] = _mm_andnot_ps(signMask, px[p]);
+		ay[p] = _mm_andnot_ps(signMask, py[p]);
+		az[p] = _mm_andnot_ps(signMask, pz[p]);
+	}
+
+	for (; i + 4 <= mCount; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&mCenterX[i]);
+		__m128 cy = _mm_loadu_ps(&mCenterY[i]);
+		__m128 cz = _mm_loadu_ps(&mCenterZ[i]);
+		__m128 ex = _mm_loadu_ps(&mExtentX[i]);
+		__m128 ey = _mm_loadu_ps(&mExtentY[i]);
+		__m128 ez = _mm_loadu_ps(&mExtentZ[i]);
+		__m128 radius = _mm_loadu_ps(&mRadius[i]);
+
+		__m128 outside = _mm_setzero_ps();
+		for (int p = 0; p < 6; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], cx), _mm_mul_ps(py[p], cy)),
+				_mm_add_ps(_mm_mul_ps(pz[p], cz), pw[p]));
+			__m128 boxReach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)), _mm_mul_ps(az[p], ez));
+			__m128 reach = _mm_min_ps(radius, boxReach);
+
+			// distance < -reach  <=>  distance + reach < 0
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+		}
+
+		int mask = _mm_movemask_ps(outside);
+		visible[i] = !(mask & 1);
+		visible[i + 1] = !(mask & 2);
+		visible[i + 2] = !(mask & 4);
+		visible[i + 3] = !(mask & 8);
+	}
+#endif
+
+	cullScalar(planes, i, mCount, visible.data());
+
+	FrustumCullStats stats = { 0, 0 };
+	for (size_t k = 0; k < mCount; k++)
+		stats.visible += visible[k];
+	stats.culled = mCount - stats.visible;
+	return stats;
+}
+
+void FrustumCuller::cullScalar(const glm::vec4 planes[6], size_t begin, size_t end, unsigned char* visible) const
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; p++)
+		{
+			const glm::vec4& plane = planes[p];
+			float distance = plane.x * mCenterX[i] + plane.y * mCenterY[i] + plane.z * mCenterZ[i] + plane.w;
+			float boxReach = std::abs(plane.x) * mExtentX[i] + std::abs(plane.y) * mExtentY[i] + std::abs(plane.z) * mExtentZ[i];
+			outside = distance + glm::min(mRadius[i], boxReach) < 0.0f;
+		}
+		visible[i] = !outside;
+	}
+}
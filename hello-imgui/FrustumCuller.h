@@ -0,0 +1,54 @@
+//-----------------------------------------------------------------------------
+// FrustumCuller.h
+//
+// Whole-object visibility against a view frustum.  Instance bounds are kept
+// as world space boxes with a bounding sphere in structure-of-arrays form and
+// tested four at a time with SSE2 where available.
+//-----------------------------------------------------------------------------
+#ifndef FRUSTUM_CULLER_H
+#define FRUSTUM_CULLER_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Results of one cull() call
+struct FrustumCullStats
+{
+	size_t visible;
+	size_t culled;
+};
+
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+
+	void clear();
+	void reserve(size_t instanceCount);
+
+	// Adds an instance of a mesh whose model space bounds are the box
+	// 'center' +- 'extents' and the sphere 'radius' around the same center,
+	// placed with 'model'.  Returns the index of the instance.
+	size_t addInstance(const glm::vec3& center, const glm::vec3& extents, float radius, const glm::mat4& model);
+	size_t getInstanceCount() const { return mCount; }
+
+	// Sets visible[i] to 1 for every instance that intersects the frustum of
+	// 'viewProjection' and to 0 for the others
+	FrustumCullStats cull(const glm::mat4& viewProjection, std::vector<unsigned char>& visible) const;
+
+	// Left, right, bottom, top, near and far planes of 'viewProjection'
+	// (Gribb & Hartmann), normalized and facing inwards
+	static void extractPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6]);
+
+private:
+	void cullScalar(const glm::vec4 planes[6], size_t begin, size_t end, unsigned char* visible) const;
+
+	// World space bounds, one array per component
+	std::vector<float> mCenterX, mCenterY, mCenterZ;
+	std::vector<float> mExtentX, mExtentY, mExtentZ;
+	std::vector<float> mRadius;
+	size_t mCount;
+};
+#endif // FRUSTUM_CULLER_H
@@ -0,0 +1,553 @@
+//-----------------------------------------------------------------------------
+// GeometryArena.cpp
+//
+// Vertex and index storage shared by all meshes of one vertex layout: one
+// VBO, one IBO and one VAO, with every mesh a sub-allocated range of each.
+// Meshes draw with a base vertex and an index buffer offset.  An optional
+// position only VBO parallel to the vertex buffer feeds depth passes.
+//-----------------------------------------------------------------------------
+#include "GeometryArena.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+
+#include <fmt/core.h>
+
+#include "InstanceBuffer.h"
+
+namespace
+{
+	// 32-bit indices need 4 byte aligned offsets, 16-bit ones share the buffer
+	const size_t INDEX_ALIGNMENT = 4;
+
+	// First buffer sizes, enough for the sample scene without growing
+	const size_t INITIAL_VERTEX_CAPACITY = 64 * 1024;
+	const size_t INITIAL_INDEX_CAPACITY = 1024 * 1024;
+
+	std::unique_ptr<GeometryArena> gArenas[VERTEX_LAYOUT_COUNT];
+}
+
+//-----------------------------------------------------------------------------
+// Constructor.  The buffers are created by the first allocation.
+//-----------------------------------------------------------------------------
+GeometryArena::GeometryArena(VertexLayout layout)
+	: mLayout(layout),
+	  mVertexSize(VertexFormat::getVertexSize(layout)),
+	  mPositionSize(VertexFormat::getPositionSize(layout)),
+	  mVAO(0),
+	  mVBO(0),
+	  mIBO(0),
+	  mInstancedVAO(0),
+	  mInstanceBuffer(0),
+	  mDepthStream(false),
+	  mDepthVAO(0),
+	  mDepthVBO(0),
+	  mDepthInstancedVAO(0),
+	  mDepthInstanceBuffer(0),
+	  mDefragmentations(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+GeometryArena::~GeometryArena()
+{
+	// Don't do this, the GL context may already be gone
+	//destroy();
+}
+
+void GeometryArena::destroy()
+{
+	glDeleteVertexArrays(1, &mVAO);
+	glDeleteVertexArrays(1, &mInstancedVAO);
+	glDeleteVertexArrays(1, &mDepthVAO);
+	glDeleteVertexArrays(1, &mDepthInstancedVAO);
+	glDeleteBuffers(1, &mVBO);
+	glDeleteBuffers(1, &mIBO);
+	glDeleteBuffers(1, &mDepthVBO);
+	mVAO = mInstancedVAO = mVBO = mIBO = 0;
+	mDepthVAO = mDepthInstancedVAO = mDepthVBO = 0;
+	mInstanceBuffer = mDepthInstanceBuffer = 0;
+
+	mVertexRanges.reset(0);
+	mIndexRanges.reset(0);
+	mAllocations.clear();
+	mFreeHandles.clear();
+}
+
+//-----------------------------------------------------------------------------
+// Best fit in both buffers.  When either has no range large enough and the
+// free space would not suffice either, the buffers grow to twice the size
+// with every allocation left where it is.  They are compacted only when the
+// free space is enough but too split up.
+//-----------------------------------------------------------------------------
+GeometryArena::Handle GeometryArena::allocate(const void* vertexData, size_t vertexCount, const void* indexData, size_t indexBytes)
+{
+	// Whole aligned units, so freed ranges leave no slivers behind
+	size_t indexSpace = (indexBytes + INDEX_ALIGNMENT - 1) & ~(INDEX_ALIGNMENT - 1);
+
+	size_t vertexOffset, indexOffset;
+	if (!allocateRanges(vertexCount, indexSpace, vertexOffset, indexOffset))
+	{
+		size_t vertexNeeded = mVertexRanges.getUsed() + vertexCount;
+		size_t indexNeeded = mIndexRanges.getUsed() + indexSpace;
+
+		size_t vertexCapacity = std::max(mVertexRanges.getCapacity(), INITIAL_VERTEX_CAPACITY);
+		size_t indexCapacity = std::max(mIndexRanges.getCapacity(), INITIAL_INDEX_CAPACITY);
+		while (vertexCapacity < vertexNeeded)
+			vertexCapacity *= 2;
+		while (indexCapacity < indexNeeded)
+			indexCapacity *= 2;
+
+		// The new space is at the end, so after growing the ranges may still
+		// not fit between the old allocations
+		bool grown = false;
+		if (mVBO != 0 && (vertexCapacity > mVertexRanges.getCapacity() || indexCapacity > mIndexRanges.getCapacity()))
+		{
+			grow(vertexCapacity, indexCapacity);
+			grown = allocateRanges(vertexCount, indexSpace, vertexOffset, indexOffset);
+		}
+
+		if (!grown)
+		{
+			rebuild(vertexCapacity, indexCapacity);
+			allocateRanges(vertexCount, indexSpace, vertexOffset, indexOffset);
+		}
+	}
+
+	// GL_COPY_WRITE_BUFFER leaves the VAO's element array binding alone
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mVBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, vertexOffset * mVertexSize, vertexCount * mVertexSize, vertexData);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mIBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset, indexBytes, indexData);
+	if (mDepthVBO != 0)
+	{
+		std::vector<unsigned char> positions(vertexCount * mPositionSize);
+		VertexFormat::extractPositions(mLayout, vertexData, vertexCount, positions.data());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mDepthVBO);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, vertexOffset * mPositionSize, positions.size(), positions.data());
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	Handle handle;
+	if (!mFreeHandles.empty())
+	{
+		handle = mFreeHandles.back();
+		mFreeHandles.pop_back();
+	}
+	else
+	{
+		handle = (Handle)mAllocations.size();
+		mAllocations.push_back({});
+	}
+	mAllocations[handle] = { vertexOffset, vertexCount, indexOffset, indexSpace, true };
+
+	return handle;
+}
+
+void GeometryArena::free(Handle handle)
+{
+	if (handle >= mAllocations.size() || !mAllocations[handle].live)
+		return;
+
+	Allocation& allocation = mAllocations[handle];
+	mVertexRanges.free(allocation.vertexOffset, allocation.vertexCount);
+	mIndexRanges.free(allocation.indexOffset, allocation.indexBytes);
+	allocation.live = false;
+	mFreeHandles.push_back(handle);
+}
+
+void GeometryArena::bind() const
+{
+	glBindVertexArray(mVAO);
+}
+
+void GeometryArena::bindInstanced(GLuint instanceBuffer)
+{
+	bindInstancedArray(mInstancedVAO, mInstanceBuffer, false, instanceBuffer);
+}
+
+void GeometryArena::bindDepth() const
+{
+	glBindVertexArray(mDepthVAO != 0 ? mDepthVAO : mVAO);
+}
+
+void GeometryArena::bindDepthInstanced(GLuint instanceBuffer)
+{
+	if (mDepthVBO != 0)
+		bindInstancedArray(mDepthInstancedVAO, mDepthInstanceBuffer, true, instanceBuffer);
+	else
+		bindInstanced(instanceBuffer);
+}
+
+//-----------------------------------------------------------------------------
+// The instanced VAOs are created on first use and only re-pointed when the
+// instance buffer changes
+//-----------------------------------------------------------------------------
+void GeometryArena::bindInstancedArray(GLuint& vao, GLuint& boundInstanceBuffer, bool depth, GLuint instanceBuffer)
+{
+	if (vao == 0)
+	{
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		if (depth)
+			setDepthAttributes();
+		else
+			setVertexAttributes();
+		boundInstanceBuffer = 0;
+	}
+	else
+	{
+		glBindVertexArray(vao);
+	}
+
+	if (instanceBuffer != boundInstanceBuffer)
+	{
+		InstanceBuffer::setAttributes(instanceBuffer);
+		boundInstanceBuffer = instanceBuffer;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// The depth stream of allocations made before it was turned on is built from
+// the vertex buffer, which is read back once
+//-----------------------------------------------------------------------------
+void GeometryArena::setDepthStream(bool enable)
+{
+	if (enable == mDepthStream)
+		return;
+	mDepthStream = enable;
+
+	if (!enable)
+	{
+		glDeleteVertexArrays(1, &mDepthVAO);
+		glDeleteVertexArrays(1, &mDepthInstancedVAO);
+		glDeleteBuffers(1, &mDepthVBO);
+		mDepthVAO = mDepthInstancedVAO = mDepthVBO = 0;
+		mDepthInstanceBuffer = 0;
+		return;
+	}
+
+	// Created by the first allocation otherwise
+	if (mVBO == 0)
+		return;
+
+	size_t vertexCapacity = mVertexRanges.getCapacity();
+	std::vector<unsigned char> vertices(vertexCapacity * mVertexSize);
+	std::vector<unsigned char> positions(vertexCapacity * mPositionSize);
+	glBindBuffer(GL_COPY_READ_BUFFER, mVBO);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, vertices.size(), vertices.data());
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	VertexFormat::extractPositions(mLayout, vertices.data(), vertexCapacity, positions.data());
+
+	glGenBuffers(1, &mDepthVBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mDepthVBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, positions.size(), positions.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	initVertexArrays();
+}
+
+//-----------------------------------------------------------------------------
+// Takes ranges from both buffers, or from neither
+//-----------------------------------------------------------------------------
+bool GeometryArena::allocateRanges(size_t vertexCount, size_t indexSpace, size_t& vertexOffset, size_t& indexOffset)
+{
+	vertexOffset = mVertexRanges.allocate(vertexCount);
+	indexOffset = mIndexRanges.allocate(indexSpace, INDEX_ALIGNMENT);
+	if (vertexOffset != RangeAllocator::INVALID_OFFSET && indexOffset != RangeAllocator::INVALID_OFFSET)
+		return true;
+
+	if (vertexOffset != RangeAllocator::INVALID_OFFSET)
+		mVertexRanges.free(vertexOffset, vertexCount);
+	if (indexOffset != RangeAllocator::INVALID_OFFSET)
+		mIndexRanges.free(indexOffset, indexSpace);
+	return false;
+}
+
+void GeometryArena::defragment()
+{
+	if (mVBO != 0)
+		rebuild(mVertexRanges.getCapacity(), mIndexRanges.getCapacity());
+}
+
+void GeometryArena::shrink()
+{
+	if (mVBO == 0)
+		return;
+
+	size_t vertexCapacity = mVertexRanges.getCapacity();
+	size_t indexCapacity = mIndexRanges.getCapacity();
+	while (vertexCapacity > INITIAL_VERTEX_CAPACITY && mVertexRanges.getUsed() <= vertexCapacity / 4)
+		vertexCapacity /= 2;
+	while (indexCapacity > INITIAL_INDEX_CAPACITY && mIndexRanges.getUsed() <= indexCapacity / 4)
+		indexCapacity /= 2;
+
+	if (vertexCapacity != mVertexRanges.getCapacity() || indexCapacity != mIndexRanges.getCapacity())
+		rebuild(vertexCapacity, indexCapacity);
+}
+
+//-----------------------------------------------------------------------------
+// Moves each buffer that is smaller than its new capacity to a larger one
+// with a single copy of the whole buffer.  Offsets do not change, the added
+// space is free at the end.
+//-----------------------------------------------------------------------------
+void GeometryArena::grow(size_t vertexCapacity, size_t indexCapacity)
+{
+	if (vertexCapacity > mVertexRanges.getCapacity())
+	{
+		growBuffer(mVBO, mVertexRanges.getCapacity() * mVertexSize, vertexCapacity * mVertexSize);
+		if (mDepthVBO != 0)
+			growBuffer(mDepthVBO, mVertexRanges.getCapacity() * mPositionSize, vertexCapacity * mPositionSize);
+		mVertexRanges.grow(vertexCapacity);
+	}
+	if (indexCapacity > mIndexRanges.getCapacity())
+	{
+		growBuffer(mIBO, mIndexRanges.getCapacity(), indexCapacity);
+		mIndexRanges.grow(indexCapacity);
+	}
+	initVertexArrays();
+
+	mDefragmentations++;
+}
+
+void GeometryArena::growBuffer(GLuint& buffer, size_t bytes, size_t newBytes)
+{
+	GLuint grown;
+	glGenBuffers(1, &grown);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+	glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, bytes);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glDeleteBuffers(1, &buffer);
+	buffer = grown;
+}
+
+//-----------------------------------------------------------------------------
+// Copies the live allocations, in buffer order, to the front of new buffers
+// of the given capacity.  glCopyBufferSubData cannot move overlapping ranges
+// within one buffer, so this always goes through a second pair of buffers.
+//-----------------------------------------------------------------------------
+void GeometryArena::rebuild(size_t vertexCapacity, size_t indexCapacity)
+{
+	GLuint vbo, ibo, depthVBO = 0;
+	glGenBuffers(1, &vbo);
+	glGenBuffers(1, &ibo);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+	glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * mVertexSize, nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, ibo);
+	glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity, nullptr, GL_STATIC_DRAW);
+	if (mDepthStream)
+	{
+		glGenBuffers(1, &depthVBO);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, depthVBO);
+		glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * mPositionSize, nullptr, GL_STATIC_DRAW);
+	}
+
+	std::vector<Handle> order;
+	for (Handle handle = 0; handle < (Handle)mAllocations.size(); handle++)
+	{
+		if (mAllocations[handle].live)
+			order.push_back(handle);
+	}
+	std::sort(order.begin(), order.end(), [this](Handle a, Handle b) {
+		return mAllocations[a].vertexOffset < mAllocations[b].vertexOffset;
+	});
+
+	// An empty allocator hands out ranges front to back
+	mVertexRanges.reset(vertexCapacity);
+	mIndexRanges.reset(indexCapacity);
+	for (Handle handle : order)
+	{
+		Allocation& allocation = mAllocations[handle];
+		size_t vertexOffset = mVertexRanges.allocate(allocation.vertexCount);
+		size_t indexOffset = mIndexRanges.allocate(allocation.indexBytes, INDEX_ALIGNMENT);
+
+		glBindBuffer(GL_COPY_READ_BUFFER, mVBO);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.vertexOffset * mVertexSize,
+			vertexOffset * mVertexSize, allocation.vertexCount * mVertexSize);
+		glBindBuffer(GL_COPY_READ_BUFFER, mIBO);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ibo);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.indexOffset, indexOffset, allocation.indexBytes);
+		if (mDepthVBO != 0)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, mDepthVBO);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, depthVBO);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.vertexOffset * mPositionSize,
+				vertexOffset * mPositionSize, allocation.vertexCount * mPositionSize);
+		}
+
+		allocation.vertexOffset = vertexOffset;
+		allocation.indexOffset = indexOffset;
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glDeleteBuffers(1, &mVBO);
+	glDeleteBuffers(1, &mIBO);
+	glDeleteBuffers(1, &mDepthVBO);
+	mVBO = vbo;
+	mIBO = ibo;
+	mDepthVBO = depthVBO;
+	initVertexArrays();
+
+	if (!order.empty())
+		mDefragmentations++;
+
+	fmt::println("GeometryArena {}: {} meshes in {} vertices ({} KB) and {} KB of indices",
+		VertexFormat::getName(mLayout), order.size(), vertexCapacity, vertexCapacity * mVertexSize / 1024, indexCapacity / 1024);
+}
+
+//-----------------------------------------------------------------------------
+// Points the VAOs at the current buffers
+//-----------------------------------------------------------------------------
+void GeometryArena::initVertexArrays()
+{
+	if (mVAO == 0)
+		glGenVertexArrays(1, &mVAO);
+
+	glBindVertexArray(mVAO);
+	setVertexAttributes();
+
+	// The instance attributes keep pointing at their own buffer
+	if (mInstancedVAO != 0)
+	{
+		glBindVertexArray(mInstancedVAO);
+		setVertexAttributes();
+	}
+
+	if (mDepthVBO != 0)
+	{
+		if (mDepthVAO == 0)
+			glGenVertexArrays(1, &mDepthVAO);
+		glBindVertexArray(mDepthVAO);
+		setDepthAttributes();
+
+		if (mDepthInstancedVAO != 0)
+		{
+			glBindVertexArray(mDepthInstancedVAO);
+			setDepthAttributes();
+		}
+	}
+
+	// unbind to make sure other code does not change it somewhere else
+	glBindVertexArray(0);
+}
+
+//-----------------------------------------------------------------------------
+// Vertex format and buffers of the bound VAO
+//-----------------------------------------------------------------------------
+void GeometryArena::setVertexAttributes()
+{
+	glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+
+	// The element array binding is part of the VAO state
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIBO);
+
+	if (mLayout == VERTEX_LAYOUT_FLOAT)
+	{
+		// Vertex Positions
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, position));
+
+		// Normals attribute
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, normal));
+
+		// Vertex Texture Coords
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, texCoords));
+	}
+	else
+	{
+		// Vertex Positions, 0..1 within the bounds
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, position));
+
+		// Normals attribute, octahedral xy or xyz
+		if (mLayout == VERTEX_LAYOUT_PACKED_OCT16)
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, normal));
+		else
+			glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, normal));
+
+		// Vertex Texture Coords
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, texCoords));
+	}
+
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+}
+
+//-----------------------------------------------------------------------------
+// Positions only, the depth stream with the shared index buffer.  The packed
+// layouts keep their quantization, so the same dequantization applies.
+//-----------------------------------------------------------------------------
+void GeometryArena::setDepthAttributes()
+{
+	glBindBuffer(GL_ARRAY_BUFFER, mDepthVBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIBO);
+
+	if (mLayout == VERTEX_LAYOUT_FLOAT)
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (GLsizei)mPositionSize, (GLvoid*)0);
+	else
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, (GLsizei)mPositionSize, (GLvoid*)0);
+
+	glEnableVertexAttribArray(0);
+}
+
+GeometryArenaStats GeometryArena::getStats() const
+{
+	GeometryArenaStats stats;
+	stats.allocations = mAllocations.size() - mFreeHandles.size();
+	stats.vertexBytes = mVertexRanges.getCapacity() * mVertexSize;
+	stats.indexBytes = mIndexRanges.getCapacity();
+	stats.vertexBytesUsed = mVertexRanges.getUsed() * mVertexSize;
+	stats.indexBytesUsed = mIndexRanges.getUsed();
+	stats.freeRanges = mVertexRanges.getFreeRangeCount() + mIndexRanges.getFreeRangeCount();
+	stats.fragmentation = std::max(mVertexRanges.getFragmentation(), mIndexRanges.getFragmentation());
+	stats.defragmentations = mDefragmentations;
+	stats.depthBytes = (mDepthVBO != 0) ? mVertexRanges.getCapacity() * mPositionSize : 0;
+	return stats;
+}
+
+GeometryArena& GeometryArena::get(VertexLayout layout)
+{
+	std::unique_ptr<GeometryArena>& arena = gArenas[layout];
+	if (!arena)
+		arena.reset(new GeometryArena(layout));
+	return *arena;
+}
+
+GeometryArenaStats GeometryArena::getTotalStats()
+{
+	GeometryArenaStats total = {};
+	for (const std::unique_ptr<GeometryArena>& arena : gArenas)
+	{
+		if (!arena)
+			continue;
+
+		GeometryArenaStats stats = arena->getStats();
+		total.allocations += stats.allocations;
+		total.vertexBytes += stats.vertexBytes;
+		total.indexBytes += stats.indexBytes;
+		total.vertexBytesUsed += stats.vertexBytesUsed;
+		total.indexBytesUsed += stats.indexBytesUsed;
+		total.freeRanges += stats.freeRanges;
+		total.fragmentation = std::max(total.fragmentation, stats.fragmentation);
+		total.defragmentations += stats.defragmentations;
+		total.depthBytes += stats.depthBytes;
+	}
+	return total;
+}
+
+void GeometryArena::destroyAll()
+{
+	for (std::unique_ptr<GeometryArena>& arena : gArenas)
+	{
+		if (arena)
+			arena->destroy();
+		arena.reset();
+	}
+}
@@ -0,0 +1,128 @@
+//-----------------------------------------------------------------------------
+// GeometryArena.h
+//
+// Vertex and index storage shared by all meshes of one vertex layout: one
+// VBO, one IBO and one VAO, with every mesh a sub-allocated range of each.
+// Meshes draw with a base vertex and an index buffer offset.  An optional
+// position only VBO parallel to the vertex buffer feeds depth passes.
+//-----------------------------------------------------------------------------
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "RangeAllocator.h"
+#include "VertexFormat.h"
+
+// Occupancy of one arena, or of all of them summed
+struct GeometryArenaStats
+{
+	size_t allocations;
+	size_t vertexBytes;			// buffer sizes
+	size_t indexBytes;
+	size_t vertexBytesUsed;
+	size_t indexBytesUsed;
+	size_t freeRanges;			// vertex and index buffer
+	float fragmentation;		// 1 - largest free range / free space, the worse buffer
+	size_t defragmentations;	// buffer rebuilds, to compact or to grow
+	size_t depthBytes;			// position only stream, 0 when off
+};
+
+class GeometryArena
+{
+public:
+	typedef uint32_t Handle;
+	static const Handle INVALID_HANDLE = ~(Handle)0;
+
+	explicit GeometryArena(VertexLayout layout);
+	~GeometryArena();
+
+	// Copies 'vertexCount' vertices of the arena's layout and 'indexBytes'
+	// bytes of 16 or 32-bit indices into the buffers, growing them when the
+	// free space is too small and compacting them when it is too split up
+	Handle allocate(const void* vertexData, size_t vertexCount, const void* indexData, size_t indexBytes);
+	void free(Handle handle);
+
+	// Where an allocation lives.  Both change when the arena is compacted,
+	// so look them up when drawing rather than keeping them.
+	GLint getBaseVertex(Handle handle) const    { return (GLint)mAllocations[handle].vertexOffset; }
+	size_t getIndexOffset(Handle handle) const  { return mAllocations[handle].indexOffset; }		// in bytes
+
+	// Binds the VAO, which holds the vertex format and both buffers
+	void bind() const;
+
+	// Binds a second VAO that also reads per-instance attributes from
+	// 'instanceBuffer' (see InstanceBuffer)
+	void bindInstanced(GLuint instanceBuffer);
+
+	// Depth passes: VAOs that read only positions, from a tightly packed copy
+	// of the vertex buffer at the same vertex offsets, and the same indices.
+	// Fall back to the full vertex format while the depth stream is off.
+	void bindDepth() const;
+	void bindDepthInstanced(GLuint instanceBuffer);
+
+	// Keeps the position only stream of every allocation.  Turning it on
+	// with meshes already loaded reads their positions back from the GPU.
+	void setDepthStream(bool enable);
+	bool hasDepthStream() const { return mDepthStream; }
+
+	// Moves every allocation to the front of the buffers so the free space
+	// is one range at the end
+	void defragment();
+
+	// Halves the buffers while no more than a quarter of them is used, down
+	// to their first size, so space freed by evicted meshes is given back
+	void shrink();
+	void destroy();
+
+	VertexLayout getLayout() const { return mLayout; }
+	GeometryArenaStats getStats() const;
+
+	// The arena of each vertex layout, created on first use
+	static GeometryArena& get(VertexLayout layout);
+	static GeometryArenaStats getTotalStats();
+	static void destroyAll();
+
+private:
+	struct Allocation
+	{
+		size_t vertexOffset;	// in vertices
+		size_t vertexCount;
+		size_t indexOffset;		// in bytes
+		size_t indexBytes;		// rounded up to the index alignment
+		bool live;
+	};
+
+	GeometryArena(const GeometryArena& rhs);
+	GeometryArena& operator= (const GeometryArena& rhs) { return *this; }
+
+	bool allocateRanges(size_t vertexCount, size_t indexSpace, size_t& vertexOffset, size_t& indexOffset);
+	void grow(size_t vertexCapacity, size_t indexCapacity);
+	void growBuffer(GLuint& buffer, size_t bytes, size_t newBytes);
+	void rebuild(size_t vertexCapacity, size_t indexCapacity);
+	void initVertexArrays();
+	void setVertexAttributes();
+	void setDepthAttributes();
+	void bindInstancedArray(GLuint& vao, GLuint& boundInstanceBuffer, bool depth, GLuint instanceBuffer);
+
+	VertexLayout mLayout;
+	size_t mVertexSize;
+	size_t mPositionSize;				// of the depth stream
+	GLuint mVAO, mVBO, mIBO;
+	GLuint mInstancedVAO;
+	GLuint mInstanceBuffer;				// the instanced VAO reads from
+	bool mDepthStream;
+	GLuint mDepthVAO, mDepthVBO;
+	GLuint mDepthInstancedVAO;
+	GLuint mDepthInstanceBuffer;
+	RangeAllocator mVertexRanges;		// in vertices
+	RangeAllocator mIndexRanges;		// in bytes
+	std::vector<Allocation> mAllocations;
+	std::vector<Handle> mFreeHandles;
+	size_t mDefragmentations;
+};
+#endif // GEOMETRY_ARENA_H
@@ -0,0 +1,78 @@
+//-----------------------------------------------------------------------------
+// InstanceBuffer.cpp
+//
+// Per-instance vertex attributes for hardware instancing: a model matrix, a
+// color and a diffuse map layer for every copy drawn by Mesh::drawInstanced.
+//-----------------------------------------------------------------------------
+#include "InstanceBuffer.h"
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+InstanceBuffer::InstanceBuffer()
+	: mBuffer(0),
+	  mCount(0),
+	  mCapacity(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+InstanceBuffer::~InstanceBuffer()
+{
+	// Don't do this
+	//destroy();
+}
+
+void InstanceBuffer::destroy()
+{
+	glDeleteBuffers(1, &mBuffer);
+	mBuffer = 0;
+	mCount = mCapacity = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Grows to the next power of two so a changing count rarely reallocates
+//-----------------------------------------------------------------------------
+void InstanceBuffer::upload(const InstanceData* instances, size_t count)
+{
+	if (mBuffer == 0)
+		glGenBuffers(1, &mBuffer);
+
+	while (mCapacity < count)
+		mCapacity = (mCapacity == 0) ? 256 : mCapacity * 2;
+
+	glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+	glBufferData(GL_ARRAY_BUFFER, mCapacity * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+	if (count > 0)
+		glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceData), instances);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	mCount = count;
+}
+
+//-----------------------------------------------------------------------------
+// A mat4 attribute takes four locations, one per column
+//-----------------------------------------------------------------------------
+void InstanceBuffer::setAttributes(GLuint buffer)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+	for (GLuint column = 0; column < 4; column++)
+	{
+		GLuint location = INSTANCE_MODEL_ATTRIB + column;
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+			(GLvoid*)(offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(location, 1);
+		glEnableVertexAttribArray(location);
+	}
+
+	glVertexAttribPointer(INSTANCE_COLOR_ATTRIB, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (GLvoid*)offsetof(InstanceData, color));
+	glVertexAttribDivisor(INSTANCE_COLOR_ATTRIB, 1);
+	glEnableVertexAttribArray(INSTANCE_COLOR_ATTRIB);
+
+	glVertexAttribPointer(INSTANCE_LAYER_ATTRIB, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (GLvoid*)offsetof(InstanceData, layer));
+	glVertexAttribDivisor(INSTANCE_LAYER_ATTRIB, 1);
+	glEnableVertexAttribArray(INSTANCE_LAYER_ATTRIB);
+}
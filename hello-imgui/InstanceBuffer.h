@@ -0,0 +1,52 @@
+//-----------------------------------------------------------------------------
+// InstanceBuffer.h
+//
+// Per-instance vertex attributes for hardware instancing: a model matrix, a
+// color and a diffuse map layer for every copy drawn by Mesh::drawInstanced.
+//-----------------------------------------------------------------------------
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <cstddef>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// One instance, read by the *_instanced.vert shaders with divisor 1
+struct InstanceData
+{
+	glm::mat4 model;
+	glm::vec4 color;		// multiplies the lit color
+	float layer = -1.0f;	// of the texture array bound as diffuseArray, negative for the material's diffuse map
+};
+
+const GLuint INSTANCE_MODEL_ATTRIB = 5;		// 5..8, one matrix column each
+const GLuint INSTANCE_COLOR_ATTRIB = 9;
+const GLuint INSTANCE_LAYER_ATTRIB = 10;
+
+class InstanceBuffer
+{
+public:
+	InstanceBuffer();
+	~InstanceBuffer();
+
+	// Replaces the instances.  The old storage is orphaned, so refilling the
+	// buffer every frame does not wait for draws still reading it.
+	void upload(const InstanceData* instances, size_t count);
+	void destroy();
+
+	GLuint getBuffer() const { return mBuffer; }
+	size_t getCount() const  { return mCount; }
+
+	// Points the instance attributes of the bound vertex array at 'buffer'
+	static void setAttributes(GLuint buffer);
+
+private:
+	InstanceBuffer(const InstanceBuffer& rhs);
+	InstanceBuffer& operator= (const InstanceBuffer& rhs) { return *this; }
+
+	GLuint mBuffer;
+	size_t mCount;
+	size_t mCapacity;
+};
+#endif // INSTANCE_BUFFER_H
@@ -0,0 +1,130 @@
+//-----------------------------------------------------------------------------
+// MappedFile.cpp
+//
+// Read-only memory mapped file (Windows / POSIX)
+//-----------------------------------------------------------------------------
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+MappedFile::MappedFile()
+	: mData(nullptr),
+	  mSize(0),
+#ifdef _WIN32
+	  mFileHandle(INVALID_HANDLE_VALUE),
+	  mMappingHandle(NULL)
+#else
+	  mFileDescriptor(-1)
+#endif
+{
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+//-----------------------------------------------------------------------------
+// Maps the whole file read-only.  Returns false if the file is missing,
+// empty or can not be mapped.
+//-----------------------------------------------------------------------------
+bool MappedFile::open(const std::string& filename)
+{
+	close();
+
+#ifdef _WIN32
+	mFileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (mFileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(mFileHandle, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	mMappingHandle = CreateFileMappingA(mFileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mMappingHandle == NULL)
+	{
+		close();
+		return false;
+	}
+
+	mData = static_cast<const unsigned char*>(MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0));
+	mSize = (size_t)fileSize.QuadPart;
+#else
+	mFileDescriptor = ::open(filename.c_str(), O_RDONLY);
+	if (mFileDescriptor < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(mFileDescriptor, &st) != 0 || st.st_size == 0)
+	{
+		close();
+		return false;
+	}
+
+	void* mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, mFileDescriptor, 0);
+	if (mapping == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+
+	mData = static_cast<const unsigned char*>(mapping);
+	mSize = (size_t)st.st_size;
+#endif
+
+	if (mData == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Unmaps the file
+//-----------------------------------------------------------------------------
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (mData != nullptr)
+		UnmapViewOfFile(mData);
+	if (mMappingHandle != NULL)
+		CloseHandle(mMappingHandle);
+	if (mFileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(mFileHandle);
+
+	mMappingHandle = NULL;
+	mFileHandle = INVALID_HANDLE_VALUE;
+#else
+	if (mData != nullptr)
+		munmap(const_cast<unsigned char*>(mData), mSize);
+	if (mFileDescriptor >= 0)
+		::close(mFileDescriptor);
+
+	mFileDescriptor = -1;
+#endif
+
+	mData = nullptr;
+	mSize = 0;
+}
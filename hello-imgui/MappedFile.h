@@ -0,0 +1,39 @@
+//-----------------------------------------------------------------------------
+// MappedFile.h
+//
+// Read-only memory mapped file (Windows / POSIX)
+//-----------------------------------------------------------------------------
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const std::string& filename);
+	void close();
+
+	bool isOpen() const                 { return mData != nullptr; }
+	const unsigned char* data() const   { return mData; }
+	size_t size() const                 { return mSize; }
+
+private:
+	MappedFile(const MappedFile& rhs);
+	MappedFile& operator= (const MappedFile& rhs) { return *this; }
+
+	const unsigned char* mData;
+	size_t mSize;
+
+#ifdef _WIN32
+	void* mFileHandle;
+	void* mMappingHandle;
+#else
+	int mFileDescriptor;
+#endif
+};
+#endif // MAPPED_FILE_H
@@ -0,0 +1,108 @@
+//-----------------------------------------------------------------------------
+// Material.cpp
+//
+// Materials of OBJ models: .mtl loading, texture file lookup, and the
+// per-material index ranges a Mesh draws them with.
+//-----------------------------------------------------------------------------
+#include "Material.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+#include <fmt/core.h>
+#include <tiny_obj_loader.h>
+
+#include "TextureLibrary.h"
+
+//-----------------------------------------------------------------------------
+// The .mtl syntax is parsed by tinyobjloader, the same parser the small
+// models go through, so both paths agree on names and texture options.
+//-----------------------------------------------------------------------------
+bool Materials::loadLibrary(const std::string& filename, std::vector<Material>& materials)
+{
+	std::ifstream file(filename);
+	if (!file)
+	{
+		fmt::println("Unable to open material library '{}'", filename);
+		return false;
+	}
+
+	std::map<std::string, int> materialMap;
+	std::vector<tinyobj::material_t> parsed;
+	std::string warning, error;
+	tinyobj::LoadMtl(&materialMap, &parsed, &file, &warning, &error);
+
+	if (!warning.empty())
+		fmt::println("Material library '{}': {}", filename, warning);
+	if (!error.empty())
+	{
+		fmt::println("Material library '{}': {}", filename, error);
+		return false;
+	}
+
+	std::string directory = std::filesystem::path(filename).parent_path().string();
+	for (const tinyobj::material_t& material : parsed)
+		materials.push_back(create(material.name, material.diffuse_texname, material.specular_texname, directory));
+
+	return true;
+}
+
+Material Materials::create(const std::string& name, const std::string& diffuseMap, const std::string& specularMap,
+	const std::string& mtlDirectory)
+{
+	Material material;
+	material.name = name;
+	material.diffuseMapFile = diffuseMap.empty() ? std::string() : resolveTexturePath(mtlDirectory, diffuseMap);
+	material.specularMapFile = specularMap.empty() ? std::string() : resolveTexturePath(mtlDirectory, specularMap);
+	material.diffuseMap = nullptr;
+	material.specularMap = nullptr;
+	return material;
+}
+
+//-----------------------------------------------------------------------------
+// Exporters write absolute paths of the artist's machine and Windows
+// separators, so only the file name is trusted for the fallback lookup
+//-----------------------------------------------------------------------------
+std::string Materials::resolveTexturePath(const std::string& mtlDirectory, const std::string& mapName)
+{
+	std::string name = mapName;
+	std::replace(name.begin(), name.end(), '\\', '/');
+
+	std::filesystem::path directory(mtlDirectory);
+	std::filesystem::path candidates[] = {
+		directory / name,
+		directory / ".." / "textures" / std::filesystem::path(name).filename()
+	};
+
+	std::error_code ec;
+	for (const std::filesystem::path& candidate : candidates)
+	{
+		if (std::filesystem::is_regular_file(candidate, ec))
+			return candidate.lexically_normal().generic_string();
+	}
+
+	fmt::println("Texture '{}' of material library in '{}' not found", mapName, mtlDirectory);
+	return std::string();
+}
+
+void Materials::loadTextures(Material& material)
+{
+	material.diffuseMap = material.diffuseMapFile.empty() ? nullptr : TextureLibrary::load(material.diffuseMapFile);
+	material.specularMap = material.specularMapFile.empty() ? nullptr : TextureLibrary::load(material.specularMapFile, TEXTURE_USAGE_MASK);
+}
+
+void Materials::resolveLayers(Material& material)
+{
+	TextureLayer layer = TextureLibrary::getLayer(material.diffuseMap);
+	material.diffuseArray = layer.array;
+	material.diffuseLayer = layer.layer;
+}
+
+bool Materials::drawOrderLess(const Material& a, const Material& b)
+{
+	if (a.diffuseMapFile != b.diffuseMapFile)
+		return a.diffuseMapFile < b.diffuseMapFile;
+	return a.specularMapFile < b.specularMapFile;
+}
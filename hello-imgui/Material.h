@@ -0,0 +1,66 @@
+//-----------------------------------------------------------------------------
+// Material.h
+//
+// Materials of OBJ models: .mtl loading, texture file lookup, and the
+// per-material index ranges a Mesh draws them with.
+//-----------------------------------------------------------------------------
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Texture2D.h"
+
+class TextureArray;
+
+// The triangles of one material within one LOD
+struct MeshSubset
+{
+	uint32_t material;			// index into the mesh's materials
+	uint32_t indexOffset;		// in indices
+	uint32_t indexCount;
+	uint32_t meshletOffset;		// meshlets covering the range, see Meshlet.h
+	uint32_t meshletCount;
+};
+
+// Texture maps of a material.  The textures come from TextureLibrary and
+// are shared with every other material using the same file.
+struct Material
+{
+	std::string name;
+	std::string diffuseMapFile;		// empty if the material has none
+	std::string specularMapFile;
+	Texture2D* diffuseMap;			// null until loadTextures, or if not loadable
+	Texture2D* specularMap;
+	TextureArray* diffuseArray = nullptr;	// the diffuse map packed into an array, see resolveLayers
+	int diffuseLayer = -1;
+};
+
+class Materials
+{
+public:
+	// Appends the materials of the .mtl file 'filename' to 'materials'
+	static bool loadLibrary(const std::string& filename, std::vector<Material>& materials);
+
+	// A material whose map names are resolved against 'mtlDirectory'
+	static Material create(const std::string& name, const std::string& diffuseMap, const std::string& specularMap,
+		const std::string& mtlDirectory);
+
+	// Finds the file of a map name: relative to the .mtl, or by file name in
+	// the textures folder next to the models folder.  Returns an empty
+	// string if neither exists.
+	static std::string resolveTexturePath(const std::string& mtlDirectory, const std::string& mapName);
+
+	// Diffuse maps as sRGB color, specular maps as one linear channel
+	static void loadTextures(Material& material);
+
+	// Looks up the array layer TextureLibrary::buildArrays packed the
+	// diffuse map into, or clears it if the map was not packed
+	static void resolveLayers(Material& material);
+
+	// Orders materials so those sharing textures are drawn back to back
+	static bool drawOrderLess(const Material& a, const Material& b);
+};
+#endif // MATERIAL_H
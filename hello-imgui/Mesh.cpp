@@ -9,17 +9,256 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <unordered_map>
 
 #include <fmt/core.h>
 
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "ObjParser.h"
+#include "ResidencyManager.h"
+
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
+namespace
+{
+	// Models at least this large go through the multithreaded ObjParser,
+	// smaller ones are not worth the thread start-up and use tinyobjloader.
+	const std::uintmax_t STREAMING_PARSER_MIN_BYTES = 256 * 1024;
+
+	//-------------------------------------------------------------------------
+	// Hash of the position/normal/texcoord index triple of an OBJ face corner
+	//-------------------------------------------------------------------------
+	struct ObjIndexHash
+	{
+		size_t operator()(const ObjIndex& idx) const
+		{
+			size_t h = std::hash<int>()(idx.vertex);
+			h ^= std::hash<int>()(idx.normal) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			h ^= std::hash<int>()(idx.texcoord) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			return h;
+		}
+	};
+
+	struct ObjIndexEqual
+	{
+		bool operator()(const ObjIndex& a, const ObjIndex& b) const
+		{
+			return a.vertex == b.vertex &&
+				a.normal == b.normal &&
+				a.texcoord == b.texcoord;
+		}
+	};
+
+	//-------------------------------------------------------------------------
+	// FNV-1a hash of the vertex attributes.  Catches corners that reference
+	// different OBJ indices but end up with bit-identical attributes.
+	//-------------------------------------------------------------------------
+	struct VertexHash
+	{
+		size_t operator()(const Vertex& v) const
+		{
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&v);
+			uint64_t h = 14695981039346656037ull;
+			for (size_t i = 0; i < sizeof(Vertex); i++)
+			{
+				h ^= bytes[i];
+				h *= 1099511628211ull;
+			}
+			return (size_t)h;
+		}
+	};
+
+	struct VertexEqual
+	{
+		bool operator()(const Vertex& a, const Vertex& b) const
+		{
+			return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+		}
+	};
+
+	//-------------------------------------------------------------------------
+	// Loads a model with tinyobjloader into the same layout ObjParser produces.
+	// The reader also loads the material libraries, which go to 'materials'
+	// in the order of data.materialNames.  It does not report their files,
+	// so the mtllib lines are read again for data.materialLibraries.
+	//-------------------------------------------------------------------------
+	bool loadTinyObj(const std::string& filename, ObjData& data, std::vector<Material>& materials)
+	{
+		tinyobj::ObjReader reader;
+
+		std::string directory = std::filesystem::path(filename).parent_path().string();
+		tinyobj::ObjReaderConfig reader_config;
+		reader_config.mtl_search_path = directory; // Path to material files
+
+		if (!reader.ParseFromFile(filename, reader_config)) {
+			if (!reader.Error().empty()) {
+				fmt::println("TinyObjReader: {}", reader.Error());
+			}
+			return false;
+		}
+
+		if (!reader.Warning().empty()) {
+			fmt::println("TinyObjReader: {}", reader.Warning());
+		}
+
+		auto& attrib = reader.GetAttrib();
+		auto& shapes = reader.GetShapes();
+
+		data.positions.assign(attrib.vertices.begin(), attrib.vertices.end());
+		data.normals.assign(attrib.normals.begin(), attrib.normals.end());
+		data.texcoords.assign(attrib.texcoords.begin(), attrib.texcoords.end());
+		data.corners.clear();
+		data.triangleMaterials.clear();
+		data.materialLibraries.clear();
+		data.materialNames.clear();
+
+		std::ifstream file(filename);
+		std::string line;
+		while (std::getline(file, line)) {
+			size_t start = line.find_first_not_of(" \t");
+			if (start == std::string::npos || line.compare(start, 6, "mtllib") != 0 || line.size() <= start + 6 ||
+				(line[start + 6] != ' ' && line[start + 6] != '\t'))
+				continue;
+
+			size_t nameStart = line.find_first_not_of(" \t", start + 6);
+			size_t nameEnd = line.find_last_not_of(" \t\r");
+			if (nameStart != std::string::npos && nameEnd >= nameStart)
+				data.materialLibraries.push_back(line.substr(nameStart, nameEnd - nameStart + 1));
+		}
+
+		for (const tinyobj::material_t& material : reader.GetMaterials()) {
+			data.materialNames.push_back(material.name);
+			materials.push_back(Materials::create(material.name, material.diffuse_texname, material.specular_texname, directory));
+		}
+
+		// Loop over shapes
+		for (size_t s = 0; s < shapes.size(); s++) {
+			// Faces are already triangulated by the reader
+			for (const tinyobj::index_t& idx : shapes[s].mesh.indices) {
+				data.corners.push_back({ idx.vertex_index, idx.normal_index, idx.texcoord_index });
+			}
+			data.triangleMaterials.insert(data.triangleMaterials.end(),
+				shapes[s].mesh.material_ids.begin(), shapes[s].mesh.material_ids.end());
+		}
+		data.triangleMaterials.resize(data.corners.size() / 3, -1);
+
+		return true;
+	}
+
+	//-------------------------------------------------------------------------
+	// Copies 'source' into a fixed size, zero terminated field.  Strings that
+	// do not fit are stored empty.
+	//-------------------------------------------------------------------------
+	bool copyString(char* destination, size_t size, const std::string& source)
+	{
+		std::memset(destination, 0, size);
+		if (source.size() >= size)
+			return false;
+		std::memcpy(destination, source.data(), source.size());
+		return true;
+	}
+
+	//-------------------------------------------------------------------------
+	// Builds the Vertex of a face corner
+	//-------------------------------------------------------------------------
+	Vertex makeVertex(const ObjData& data, const ObjIndex& idx)
+	{
+		Vertex meshVertex{};
+
+		// access to vertex
+		meshVertex.position = glm::vec3(
+			data.positions[3 * size_t(idx.vertex) + 0],
+			data.positions[3 * size_t(idx.vertex) + 1],
+			data.positions[3 * size_t(idx.vertex) + 2]);
+
+		// Check if `normal` is zero or positive. negative = no normal data
+		if (idx.normal >= 0) {
+			meshVertex.normal = glm::vec3(
+				data.normals[3 * size_t(idx.normal) + 0],
+				data.normals[3 * size_t(idx.normal) + 1],
+				data.normals[3 * size_t(idx.normal) + 2]);
+		}
+
+		// Check if `texcoord` is zero or positive. negative = no texcoord data
+		if (idx.texcoord >= 0) {
+			meshVertex.texCoords = glm::vec2(
+				data.texcoords[2 * size_t(idx.texcoord) + 0],
+				data.texcoords[2 * size_t(idx.texcoord) + 1]);
+		}
+
+		return meshVertex;
+	}
+
+#ifdef VERIFY_OBJ_PARSER
+	//-------------------------------------------------------------------------
+	// Compares the Vertex stream of ObjParser against tinyobjloader
+	//-------------------------------------------------------------------------
+	void verifyObjParser(const std::string& filename)
+	{
+		ObjData fast, reference;
+		std::vector<Material> referenceMaterials;
+		if (!ObjParser::parse(filename, fast) || !loadTinyObj(filename, reference, referenceMaterials)) {
+			fmt::println("VerifyObjParser '{}': parse failed", filename);
+			return;
+		}
+
+		if (fast.corners.size() != reference.corners.size()) {
+			fmt::println("VerifyObjParser '{}': MISMATCH {} vs {} corners", filename, fast.corners.size(), reference.corners.size());
+			return;
+		}
+
+		size_t mismatches = 0;
+		float maxError = 0.0f;
+		for (size_t i = 0; i < fast.corners.size(); i++) {
+			Vertex a = makeVertex(fast, fast.corners[i]);
+			Vertex b = makeVertex(reference, reference.corners[i]);
+			if (std::memcmp(&a, &b, sizeof(Vertex)) != 0) {
+				mismatches++;
+				const float* fa = &a.position.x;
+				const float* fb = &b.position.x;
+				for (size_t k = 0; k < sizeof(Vertex) / sizeof(float); k++)
+					maxError = std::max(maxError, std::abs(fa[k] - fb[k]));
+			}
+		}
+
+		fmt::println("VerifyObjParser '{}': {} corners, {} differ (max error {})",
+			filename, fast.corners.size(), mismatches, maxError);
+
+		// Fanned polygons triangulate differently from tinyobjloader's ear
+		// clipping, so their corners are expected to differ
+		if (fast.fannedPolygons > 0)
+			fmt::println("VerifyObjParser '{}': {} polygons of more than 4 corners are fan triangulated, tinyobjloader ear clips them",
+				filename, fast.fannedPolygons);
+	}
+#endif
+}
+
+MeshDrawStats Mesh::sDrawStats = {};
+
 //-----------------------------------------------------------------------------
 // Constructor
 //-----------------------------------------------------------------------------
 Mesh::Mesh()
-	:mLoaded(false)
+	:mLoaded(false),
+	 mVertexCount(0),
+	 mIndexCount(0),
+	 mIndexType(GL_UNSIGNED_INT),
+	 mLayout(VERTEX_LAYOUT_FLOAT),
+	 mBoundsMin(0.0f),
+	 mBoundsMax(0.0f),
+	 mBoundsRadius(0.0f),
+	 mArena(nullptr),
+	 mGeometry(GeometryArena::INVALID_HANDLE),
+	 mLastUsedFrame(0)
 {
 }
 
@@ -29,136 +268,844 @@ Mesh::Mesh()
 Mesh::~Mesh()
 {
 	// Don't do this
-	//glDeleteVertexArrays(1, &mVAO);
-	//glDeleteBuffers(1, &mVBO);
+	//destroy();
 }
 
+//-----------------------------------------------------------------------------
+// Returns the vertex and index ranges to the geometry arena
+//-----------------------------------------------------------------------------
 void Mesh::destroy()
 {
-	glDeleteVertexArrays(1, &mVAO);
-	glDeleteBuffers(1, &mVBO);
+	ResidencyManager::removeMesh(this);
+	if (mArena != nullptr)
+		mArena->free(mGeometry);
+	mArena = nullptr;
+	mGeometry = GeometryArena::INVALID_HANDLE;
+	mLoaded = false;
+}
+
+//-----------------------------------------------------------------------------
+// Move constructor
+//-----------------------------------------------------------------------------
+Mesh::Mesh(Mesh&& rhs)
+	: Mesh()
+{
+	*this = std::move(rhs);
+}
+
+//-----------------------------------------------------------------------------
+// Move assignment.  Like the destructor it does not free geometry this mesh
+// may already own.
+//-----------------------------------------------------------------------------
+Mesh& Mesh::operator=(Mesh&& rhs)
+{
+	if (this == &rhs)
+		return *this;
+
+	mLoaded = rhs.mLoaded;
+	mVertices = std::move(rhs.mVertices);
+	mIndices = std::move(rhs.mIndices);
+	mLods = std::move(rhs.mLods);
+	mMaterials = std::move(rhs.mMaterials);
+	mSubsets = std::move(rhs.mSubsets);
+	mMeshlets = std::move(rhs.mMeshlets);
+	mVertexCount = rhs.mVertexCount;
+	mIndexCount = rhs.mIndexCount;
+	mIndexType = rhs.mIndexType;
+	mLayout = rhs.mLayout;
+	mBoundsMin = rhs.mBoundsMin;
+	mBoundsMax = rhs.mBoundsMax;
+	mBoundsRadius = rhs.mBoundsRadius;
+	mArena = rhs.mArena;
+	mGeometry = rhs.mGeometry;
+	mPending = std::move(rhs.mPending);
+	mFilename = std::move(rhs.mFilename);
+	mLastUsedFrame = rhs.mLastUsedFrame;
+
+	if (ResidencyManager::removeMesh(&rhs))
+		ResidencyManager::addMesh(this);
+
+	rhs.mLoaded = false;
+	rhs.mArena = nullptr;
+	rhs.mGeometry = GeometryArena::INVALID_HANDLE;
+	return *this;
 }
 
+// CPU side results of prepareOBJ, uploaded by upload()
+struct Mesh::PendingUpload
+{
+	MeshCache cache;						// warm path: blobs straight from the mapping
+	std::vector<unsigned char> vertices;	// cold path: packed vertices
+	std::vector<GLushort> shortIndices;		// cold path: narrowed indices, if 16-bit
+};
+
 //-----------------------------------------------------------------------------
 // Loads a Wavefront OBJ model
 //-----------------------------------------------------------------------------
-bool Mesh::loadOBJ(const std::string& filename)
+bool Mesh::loadOBJ(const std::string& filename, VertexLayout layout)
+{
+	if (!prepareOBJ(filename, layout))
+		return false;
+
+	upload();
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Reads the mesh cache or parses the OBJ file, without any GL calls
+//-----------------------------------------------------------------------------
+bool Mesh::prepareOBJ(const std::string& filename, VertexLayout layout)
 {
-	std::vector<unsigned int> vertexIndices, uvIndices;
-	std::vector<glm::vec3> tempVertices;
-	std::vector<glm::vec2> tempUVs;
-	std::vector<glm::vec3> tempNormals;
+	auto startTime = std::chrono::steady_clock::now();
 
-	tinyobj::ObjReader reader;
+	mLayout = layout;
+	mFilename = filename;
+	mPending.reset(new PendingUpload());
 
-	tinyobj::ObjReaderConfig reader_config;
-	reader_config.mtl_search_path = "./models"; // Path to material files
+	// Warm path: the vertex and index blobs stay mapped until upload()
+	MeshCache& cache = mPending->cache;
+	if (cache.open(filename, layout))
+	{
+		const MeshCacheHeader& header = cache.getHeader();
+		mVertexCount = header.vertexCount;
+		mIndexCount = header.indexCount;
+		mIndexType = header.indexType;
+		mBoundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+		mBoundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+		mBoundsRadius = header.boundsRadius;
+		mLods.assign(cache.getLods(), cache.getLods() + header.lodCount);
+		mMeshlets.assign(cache.getMeshlets(), cache.getMeshlets() + header.meshletCount);
+		mSubsets.assign(cache.getSubsets(), cache.getSubsets() + header.subsetCount);
 
-	if (!reader.ParseFromFile(filename, reader_config)) {
-		if (!reader.Error().empty()) {
-			fmt::println("TinyObjReader: {}", reader.Error());
+		mMaterials.clear();
+		for (uint32_t i = 0; i < header.materialCount; i++)
+		{
+			const MeshCacheMaterial& record = cache.getMaterials()[i];
+			mMaterials.push_back({ record.name, record.diffuseMapFile, record.specularMapFile, nullptr, nullptr });
 		}
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+		fmt::println("Mesh '{}': {} vertices ({}), {} indices in {} LODs loaded from cache in {:.2f} ms",
+			filename, mVertexCount, VertexFormat::getName(mLayout), mIndexCount, mLods.size(), ms);
+
+		return true;
+	}
+
+	// Cold path: parse the OBJ text
+	std::vector<std::string> materialLibraries;
+	if (!parseOBJ(filename, materialLibraries))
+	{
+		mPending.reset();
 		return false;
 	}
 
-	if (!reader.Warning().empty()) {
-		fmt::println("TinyObjReader: {}", reader.Warning());
+	// Narrow the indices once, the same blob is uploaded and cached
+	const void* indexData = &mIndices[0];
+	if (mIndexType == GL_UNSIGNED_SHORT)
+	{
+		mPending->shortIndices.assign(mIndices.begin(), mIndices.end());
+		indexData = &mPending->shortIndices[0];
+	}
+
+	// Pack the vertices into the GPU layout and report what it costs
+	std::vector<unsigned char>& packedVertices = mPending->vertices;
+	VertexFormat::pack(mLayout, mVertices, mBoundsMin, mBoundsMax, packedVertices);
+
+	if (mLayout != VERTEX_LAYOUT_FLOAT)
+	{
+		VertexPackError error = VertexFormat::measureError(mLayout, mVertices, mBoundsMin, mBoundsMax, packedVertices);
+		float extent = glm::length(mBoundsMax - mBoundsMin);
+
+		fmt::println("Mesh '{}': {} layout, {} -> {} bytes/vertex, max error position {:.3g} ({:.4f}% of extent), normal {:.3f} deg, uv {:.3g}",
+			filename, VertexFormat::getName(mLayout), sizeof(Vertex), VertexFormat::getVertexSize(mLayout),
+			error.position, (extent > 0.0f) ? 100.0f * error.position / extent : 0.0f, error.normal, error.texCoord);
+	}
+
+	// A material the cache cannot hold whole would load without its name or
+	// textures on every warm start, so such a mesh is not cached at all
+	bool cacheable = true;
+	std::vector<MeshCacheMaterial> materialRecords(mMaterials.size());
+	for (size_t i = 0; i < mMaterials.size(); i++)
+	{
+		MeshCacheMaterial& record = materialRecords[i];
+		if (!copyString(record.name, sizeof(record.name), mMaterials[i].name) ||
+			!copyString(record.diffuseMapFile, sizeof(record.diffuseMapFile), mMaterials[i].diffuseMapFile) ||
+			!copyString(record.specularMapFile, sizeof(record.specularMapFile), mMaterials[i].specularMapFile))
+		{
+			fmt::println("Mesh '{}': material '{}' has names too long for the cache, not caching", filename, mMaterials[i].name);
+			cacheable = false;
+		}
 	}
 
-	auto& attrib = reader.GetAttrib();
-	auto& shapes = reader.GetShapes();
-	auto& materials = reader.GetMaterials();
+	MeshCacheData cacheData;
+	cacheData.vertices = &packedVertices[0];
+	cacheData.vertexLayout = mLayout;
+	cacheData.vertexStride = (uint32_t)VertexFormat::getVertexSize(mLayout);
+	cacheData.vertexCount = (uint32_t)mVertexCount;
+	cacheData.indices = indexData;
+	cacheData.indexType = mIndexType;
+	cacheData.indexCount = (uint32_t)mIndexCount;
+	cacheData.lods = &mLods[0];
+	cacheData.lodCount = (uint32_t)mLods.size();
+	cacheData.meshlets = &mMeshlets[0];
+	cacheData.meshletCount = (uint32_t)mMeshlets.size();
+	cacheData.materials = materialRecords.data();
+	cacheData.materialCount = (uint32_t)materialRecords.size();
+	cacheData.subsets = mSubsets.data();
+	cacheData.subsetCount = (uint32_t)mSubsets.size();
+	cacheData.libraries = materialLibraries.data();
+	cacheData.libraryCount = (uint32_t)materialLibraries.size();
+	cacheData.boundsMin = mBoundsMin;
+	cacheData.boundsMax = mBoundsMax;
+	cacheData.boundsRadius = mBoundsRadius;
+	if (cacheable)
+		MeshCache::write(filename, cacheData);
 
-	// Loop over shapes
-	for (size_t s = 0; s < shapes.size(); s++) {
-		// Loop over faces(polygon)
-		size_t index_offset = 0;
-		for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-			size_t fv = size_t(shapes[s].mesh.num_face_vertices[f]);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	fmt::println("Mesh '{}': parsed in {:.2f} ms", filename, ms);
 
-			// Loop over vertices in the face.
-			for (size_t v = 0; v < fv; v++) {
-				Vertex meshVertex;
+	return true;
+}
 
-				// access to vertex
-				tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-				tinyobj::real_t vx = attrib.vertices[3 * size_t(idx.vertex_index) + 0];
-				tinyobj::real_t vy = attrib.vertices[3 * size_t(idx.vertex_index) + 1];
-				tinyobj::real_t vz = attrib.vertices[3 * size_t(idx.vertex_index) + 2];
+//-----------------------------------------------------------------------------
+// Creates the GL buffers from the data prepareOBJ kept and loads the
+// material textures
+//-----------------------------------------------------------------------------
+void Mesh::upload()
+{
+	if (!mPending)
+		return;
 
-				glm::vec3 vertex(vx, vy, vz);
-				meshVertex.position = vertex;
+	if (mPending->cache.isOpen())
+	{
+		initBuffers(mPending->cache.getVertexData(), mPending->cache.getIndexData());
+	}
+	else
+	{
+		const void* indexData = mPending->shortIndices.empty() ? (const void*)&mIndices[0] : (const void*)&mPending->shortIndices[0];
+		initBuffers(&mPending->vertices[0], indexData);
+	}
+	mPending.reset();
 
-				// Check if `normal_index` is zero or positive. negative = no normal data
-				if (idx.normal_index >= 0) {
-					tinyobj::real_t nx = attrib.normals[3 * size_t(idx.normal_index) + 0];
-					tinyobj::real_t ny = attrib.normals[3 * size_t(idx.normal_index) + 1];
-					tinyobj::real_t nz = attrib.normals[3 * size_t(idx.normal_index) + 2];
+	for (Material& material : mMaterials)
+		Materials::loadTextures(material);
 
-					glm::vec3 normal(nx, ny, nz);
-					meshVertex.normal = normal;
-				}
+	mLoaded = true;
+	mLastUsedFrame = ResidencyManager::getFrame();
+	ResidencyManager::addMesh(this);
+}
+
+//-----------------------------------------------------------------------------
+// Parses a Wavefront OBJ model into welded, indexed vertices.  The .mtl files
+// its materials were read from go to 'materialLibraries'.
+//-----------------------------------------------------------------------------
+bool Mesh::parseOBJ(const std::string& filename, std::vector<std::string>& materialLibraries)
+{
+	std::error_code ec;
+	std::uintmax_t fileSize = std::filesystem::file_size(filename, ec);
+	if (ec) {
+		fmt::println("Unable to open mesh '{}'", filename);
+		return false;
+	}
 
-				// Check if `texcoord_index` is zero or positive. negative = no texcoord data
-				if (idx.texcoord_index >= 0) {
-					tinyobj::real_t tx = attrib.texcoords[2 * size_t(idx.texcoord_index) + 0];
-					tinyobj::real_t ty = attrib.texcoords[2 * size_t(idx.texcoord_index) + 1];
+#ifdef VERIFY_OBJ_PARSER
+	verifyObjParser(filename);
+#endif
 
-					glm::vec2 uv(tx, ty);
-					meshVertex.texCoords = uv;
-				}
+	ObjData obj;
+	std::vector<Material> libraryMaterials;
+	std::filesystem::path directory = std::filesystem::path(filename).parent_path();
+	bool parsed = false;
+	if (fileSize >= STREAMING_PARSER_MIN_BYTES) {
+		parsed = ObjParser::parse(filename, obj);
 
-				mVertices.push_back(meshVertex);
-			}
-			index_offset += fv;
+		for (size_t i = 0; parsed && i < obj.materialLibraries.size(); i++)
+			Materials::loadLibrary((directory / obj.materialLibraries[i]).string(), libraryMaterials);
+	}
+	else {
+		parsed = loadTinyObj(filename, obj, libraryMaterials);
+	}
+	if (!parsed)
+		return false;
+
+	materialLibraries.clear();
+	for (const std::string& library : obj.materialLibraries)
+		materialLibraries.push_back((directory / library).string());
+
+	// Materials by usemtl index, the last one for faces before any usemtl
+	std::vector<Material> objMaterials;
+	for (const std::string& name : obj.materialNames) {
+		auto found = std::find_if(libraryMaterials.begin(), libraryMaterials.end(),
+			[&name](const Material& material) { return material.name == name; });
+		if (found == libraryMaterials.end())
+			fmt::println("Mesh '{}': material '{}' not found", filename, name);
+		objMaterials.push_back(found != libraryMaterials.end() ? *found : Materials::create(name, "", "", ""));
+	}
+	objMaterials.push_back(Materials::create("", "", "", ""));
+
+	size_t numTriangles = obj.corners.size() / 3;
+	auto triangleMaterial = [&obj, &objMaterials](size_t triangle) {
+		int material = obj.triangleMaterials[triangle];
+		return (material >= 0) ? (size_t)material : objMaterials.size() - 1;
+	};
+
+	// Keep the materials in use, ordered so those sharing textures are adjacent
+	std::vector<bool> materialUsed(objMaterials.size(), false);
+	for (size_t t = 0; t < numTriangles; t++)
+		materialUsed[triangleMaterial(t)] = true;
+
+	std::vector<size_t> drawOrder;
+	for (size_t m = 0; m < objMaterials.size(); m++)
+		if (materialUsed[m])
+			drawOrder.push_back(m);
+	std::stable_sort(drawOrder.begin(), drawOrder.end(),
+		[&objMaterials](size_t a, size_t b) { return Materials::drawOrderLess(objMaterials[a], objMaterials[b]); });
+
+	std::vector<uint32_t> materialRemap(objMaterials.size(), 0);
+	mMaterials.clear();
+	for (size_t i = 0; i < drawOrder.size(); i++) {
+		materialRemap[drawOrder[i]] = (uint32_t)i;
+		mMaterials.push_back(objMaterials[drawOrder[i]]);
+	}
+
+	// Weld face corners into unique vertices.  Corners are first matched on
+	// their OBJ index triple, then on the resulting attributes.
+	std::unordered_map<ObjIndex, GLuint, ObjIndexHash, ObjIndexEqual> cornerToIndex;
+	std::unordered_map<Vertex, GLuint, VertexHash, VertexEqual> vertexToIndex;
+	size_t numCorners = obj.corners.size();
+
+	mVertices.clear();
+	mIndices.clear();
+	mIndices.reserve(numCorners);
+
+	for (const ObjIndex& idx : obj.corners) {
+		auto corner = cornerToIndex.find(idx);
+		if (corner != cornerToIndex.end()) {
+			mIndices.push_back(corner->second);
+			continue;
+		}
+
+		Vertex meshVertex = makeVertex(obj, idx);
+
+		auto existing = vertexToIndex.find(meshVertex);
+		GLuint index;
+		if (existing != vertexToIndex.end()) {
+			index = existing->second;
+		}
+		else {
+			index = (GLuint)mVertices.size();
+			mVertices.push_back(meshVertex);
+			vertexToIndex.emplace(meshVertex, index);
+		}
+
+		cornerToIndex.emplace(idx, index);
+		mIndices.push_back(index);
+	}
+
+	if (mIndices.empty()) {
+		fmt::println("Mesh '{}' has no faces", filename);
+		return false;
+	}
+
+	// Use 16-bit indices whenever every vertex is addressable with them
+	mIndexType = (mVertices.size() <= 0xFFFF) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+	size_t indexSize = getIndexSize();
+	long long flatBytes = (long long)(numCorners * sizeof(Vertex));
+	long long indexedBytes = (long long)(mVertices.size() * sizeof(Vertex) + mIndices.size() * indexSize);
 
+	fmt::println("Mesh '{}': {} corners -> {} vertices, {} indices ({}-bit), {} bytes saved ({} -> {})",
+		filename, numCorners, mVertices.size(), mIndices.size(), indexSize * 8,
+		flatBytes - indexedBytes, flatBytes, indexedBytes);
+
+	VertexCacheStats before = MeshOptimizer::analyzeVertexCache(mIndices, mVertices.size());
+
+	// Every material is optimized and simplified on its own, which also keeps
+	// the borders between materials in place in the LODs
+	std::vector<std::vector<GLuint>> subsetIndices(mMaterials.size());
+	for (size_t t = 0; t < numTriangles; t++) {
+		std::vector<GLuint>& indices = subsetIndices[materialRemap[triangleMaterial(t)]];
+		indices.insert(indices.end(), mIndices.begin() + t * 3, mIndices.begin() + t * 3 + 3);
+	}
+
+	std::vector<std::vector<MeshLod>> subsetLods(mMaterials.size());
+	size_t lodCount = 1;
+	for (size_t m = 0; m < mMaterials.size(); m++) {
+		std::vector<GLuint>& indices = subsetIndices[m];
+
+		// Reorder triangles for the post-transform cache and overdraw
+		MeshOptimizer::optimizeVertexCache(indices, mVertices.size());
+		MeshOptimizer::optimizeOverdraw(indices, &mVertices[0].position.x, sizeof(Vertex), mVertices.size());
+
+		// Simplified LODs reuse the vertices of LOD 0 and are appended to its indices
+		std::vector<MeshLod>& lods = subsetLods[m];
+		MeshSimplifier::generateLods(indices, indices.size(), mVertices, lods);
+		for (size_t i = 1; i < lods.size(); i++)
+		{
+			std::vector<GLuint> lodIndices(indices.begin() + lods[i].indexOffset,
+				indices.begin() + lods[i].indexOffset + lods[i].indexCount);
+			MeshOptimizer::optimizeVertexCache(lodIndices, mVertices.size());
+			std::copy(lodIndices.begin(), lodIndices.end(), indices.begin() + lods[i].indexOffset);
 		}
+		lodCount = std::max(lodCount, lods.size());
 	}
 
-	// Create and initialize the buffers
-	initBuffers();
+	// Lay the LODs out one after the other, each as its materials' ranges in
+	// draw order.  Materials with a shorter chain repeat their coarsest level.
+	mIndices.clear();
+	mLods.clear();
+	mSubsets.clear();
+	for (size_t lod = 0; lod < lodCount; lod++)
+	{
+		MeshLod range = { (uint32_t)mIndices.size(), 0, 0.0f, 0, 0 };
+		for (size_t m = 0; m < mMaterials.size(); m++)
+		{
+			const MeshLod& level = subsetLods[m][std::min(lod, subsetLods[m].size() - 1)];
+			const std::vector<GLuint>& indices = subsetIndices[m];
 
-	return (mLoaded = true);
+			mSubsets.push_back({ (uint32_t)m, (uint32_t)mIndices.size(), level.indexCount, 0, 0 });
+			mIndices.insert(mIndices.end(), indices.begin() + level.indexOffset, indices.begin() + level.indexOffset + level.indexCount);
+			range.error = std::max(range.error, level.error);
+		}
+		range.indexCount = (uint32_t)mIndices.size() - range.indexOffset;
+		mLods.push_back(range);
+	}
+
+	// Split every material of every LOD into meshlets for culling
+	mMeshlets.clear();
+	for (size_t lod = 0; lod < mLods.size(); lod++)
+	{
+		mLods[lod].meshletOffset = (uint32_t)mMeshlets.size();
+		for (size_t m = 0; m < mMaterials.size(); m++)
+		{
+			MeshSubset& subset = mSubsets[lod * mMaterials.size() + m];
+			subset.meshletOffset = (uint32_t)mMeshlets.size();
+			Meshlets::build(mIndices, subset.indexOffset, subset.indexCount, mVertices, mMeshlets);
+			subset.meshletCount = (uint32_t)mMeshlets.size() - subset.meshletOffset;
+		}
+		mLods[lod].meshletCount = (uint32_t)mMeshlets.size() - mLods[lod].meshletOffset;
+	}
+
+	// Triangle order inside a meshlet does not matter for culling, so give it
+	// back to the vertex cache, on meshlet-local indices to keep this cheap
+	std::vector<GLuint> localIndices, localToGlobal;
+	std::vector<GLuint> globalToLocal(mVertices.size(), ~0u);
+	for (const Meshlet& meshlet : mMeshlets)
+	{
+		GLuint* meshletIndices = &mIndices[meshlet.indexOffset];
+		localIndices.clear();
+		localToGlobal.clear();
+		for (uint32_t i = 0; i < meshlet.indexCount; i++)
+		{
+			GLuint& local = globalToLocal[meshletIndices[i]];
+			if (local == ~0u)
+			{
+				local = (GLuint)localToGlobal.size();
+				localToGlobal.push_back(meshletIndices[i]);
+			}
+			localIndices.push_back(local);
+		}
+
+		MeshOptimizer::optimizeVertexCache(localIndices, localToGlobal.size());
+		for (uint32_t i = 0; i < meshlet.indexCount; i++)
+			meshletIndices[i] = localToGlobal[localIndices[i]];
+		for (GLuint global : localToGlobal)
+			globalToLocal[global] = ~0u;
+	}
+
+	// Reorder vertices for fetch locality, in order of first use by LOD 0
+	MeshOptimizer::optimizeVertexFetch(&mVertices[0], mVertices.size(), sizeof(Vertex), mIndices);
+
+	std::vector<GLuint> lod0Indices(mIndices.begin(), mIndices.begin() + mLods[0].indexCount);
+	VertexCacheStats after = MeshOptimizer::analyzeVertexCache(lod0Indices, mVertices.size());
+
+	fmt::println("Mesh '{}': ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+		filename, before.acmr, after.acmr, before.atvr, after.atvr);
+
+	std::string lodReport;
+	for (const MeshLod& lod : mLods)
+		lodReport += fmt::format(" {} ({:.4f}, {})", lod.indexCount / 3, lod.error, lod.meshletCount);
+	fmt::println("Mesh '{}': {} LODs, triangles (error, meshlets):{}", filename, mLods.size(), lodReport);
+
+	std::string materialReport;
+	for (const Material& material : mMaterials)
+		materialReport += fmt::format(" '{}' ({})", material.name, material.diffuseMapFile.empty() ? "untextured" : material.diffuseMapFile);
+	fmt::println("Mesh '{}': {} materials:{}", filename, mMaterials.size(), materialReport);
+
+	mVertexCount = mVertices.size();
+	mIndexCount = mIndices.size();
+
+	mBoundsMin = mBoundsMax = mVertices[0].position;
+	for (const Vertex& vertex : mVertices)
+	{
+		mBoundsMin = glm::min(mBoundsMin, vertex.position);
+		mBoundsMax = glm::max(mBoundsMax, vertex.position);
+	}
+
+	// Tighter than half the diagonal for anything but a box
+	mBoundsRadius = 0.0f;
+	for (const Vertex& vertex : mVertices)
+		mBoundsRadius = glm::max(mBoundsRadius, glm::distance(getBoundsCenter(), vertex.position));
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Copies mVertexCount vertices and mIndexCount indices of type mIndexType
+// into the geometry arena of the vertex layout
+//-----------------------------------------------------------------------------
+void Mesh::initBuffers(const void* vertexData, const void* indexData)
+{
+	mArena = &GeometryArena::get(mLayout);
+	mGeometry = mArena->allocate(vertexData, mVertexCount, indexData, mIndexCount * getIndexSize());
+}
+
+void Mesh::resolveTextureLayers()
+{
+	for (Material& material : mMaterials)
+		Materials::resolveLayers(material);
+}
+
+//-----------------------------------------------------------------------------
+// Maps the mesh cache, if it still holds exactly the geometry uploaded
+//-----------------------------------------------------------------------------
+bool Mesh::openCache(MeshCache& cache) const
+{
+	if (!cache.open(mFilename, mLayout))
+		return false;
+
+	const MeshCacheHeader& header = cache.getHeader();
+	return header.vertexCount == mVertexCount && header.indexCount == mIndexCount && header.indexType == mIndexType;
+}
+
+bool Mesh::evict()
+{
+	MeshCache cache;
+	if (!mLoaded || !isResident() || !openCache(cache))
+		return false;
+
+	mArena->free(mGeometry);
+	mGeometry = GeometryArena::INVALID_HANDLE;
+	return true;
+}
+
+size_t Mesh::getMemorySize() const
+{
+	return isResident() ? mVertexCount * VertexFormat::getVertexSize(mLayout) + mIndexCount * getIndexSize() : 0;
 }
 
 //-----------------------------------------------------------------------------
-// Create and initialize the vertex buffer and vertex array object
-// Must have valid, non-empty std::vector of Vertex objects.
+// Called by every draw: marks the mesh used and, if it was evicted, copies
+// the geometry back from the mesh cache before the draw goes on.  A mesh
+// whose cache has gone since stops drawing.
 //-----------------------------------------------------------------------------
-void Mesh::initBuffers()
+bool Mesh::makeResident()
 {
-	glGenVertexArrays(1, &mVAO);
-	glGenBuffers(1, &mVBO);
+	mLastUsedFrame = ResidencyManager::getFrame();
+	if (isResident())
+		return true;
+
+	auto startTime = std::chrono::steady_clock::now();
+	MeshCache cache;
+	if (!openCache(cache))
+	{
+		fmt::println("Mesh '{}': evicted and its cache is gone, cannot reload", mFilename);
+		mLoaded = false;
+		return false;
+	}
+	initBuffers(cache.getVertexData(), cache.getIndexData());
+
+	ResidencyManager::addStall(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Sets the dequantization constants for the vertex shader (see
+// VertexFormat.h) and binds the arena's vertex array, the instanced one if
+// an instance buffer is given
+//-----------------------------------------------------------------------------
+void Mesh::bindForDraw(GLuint instanceBuffer, bool depthOnly)
+{
+	if (mLayout == VERTEX_LAYOUT_FLOAT)
+	{
+		glVertexAttrib4f(DEQUANTIZE_OFFSET_ATTRIB, 0.0f, 0.0f, 0.0f, 0.0f);
+		glVertexAttrib3f(DEQUANTIZE_SCALE_ATTRIB, 1.0f, 1.0f, 1.0f);
+	}
+	else
+	{
+		glm::vec3 scale = mBoundsMax - mBoundsMin;
+		float octahedral = (mLayout == VERTEX_LAYOUT_PACKED_OCT16) ? 1.0f : 0.0f;
+		glVertexAttrib4f(DEQUANTIZE_OFFSET_ATTRIB, mBoundsMin.x, mBoundsMin.y, mBoundsMin.z, octahedral);
+		glVertexAttrib3f(DEQUANTIZE_SCALE_ATTRIB, scale.x, scale.y, scale.z);
+	}
 
-	glBindVertexArray(mVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, mVBO);
-	glBufferData(GL_ARRAY_BUFFER, mVertices.size() * sizeof(Vertex), &mVertices[0], GL_STATIC_DRAW);
+	if (depthOnly)
+	{
+		if (instanceBuffer != 0)
+			mArena->bindDepthInstanced(instanceBuffer);
+		else
+			mArena->bindDepth();
+	}
+	else if (instanceBuffer != 0)
+		mArena->bindInstanced(instanceBuffer);
+	else
+		mArena->bind();
+}
 
-	// Vertex Positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+//-----------------------------------------------------------------------------
+// Binds the diffuse map of 'material' to texture unit 0, unless 'previous'
+// (the material drawn just before) already left it there
+//-----------------------------------------------------------------------------
+void Mesh::bindMaterial(const Material& material, const Material* previous)
+{
+	if (previous != nullptr && previous->diffuseMap == material.diffuseMap)
+		return;
 
-	// Normals attribute
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(3 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(1);
+	if (material.diffuseMap != nullptr)
+	{
+		material.diffuseMap->bind(0);
+	}
+	else
+	{
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	sDrawStats.textureBinds++;
+}
 
-	// Vertex Texture Coords
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(6 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(2);
+//-----------------------------------------------------------------------------
+// Render one LOD of the mesh
+//-----------------------------------------------------------------------------
+void Mesh::draw(int lod, bool bindMaterials)
+{
+	drawLod(lod, bindMaterials, false);
+}
 
-	// unbind to make sure other code does not change it somewhere else
+//-----------------------------------------------------------------------------
+// Depth only: positions alone, one draw per LOD and no material state
+//-----------------------------------------------------------------------------
+void Mesh::drawDepth(int lod)
+{
+	drawLod(lod, false, true);
+}
+
+void Mesh::drawDepthCulled(int lod, const glm::mat4& model, const glm::mat4& viewProjection)
+{
+	drawLodCulled(lod, model, viewProjection, glm::vec3(0.0f), false, false, true);
+}
+
+void Mesh::drawDepthInstanced(int lod, const InstanceBuffer& instances)
+{
+	drawLodInstanced(lod, instances, false, true);
+}
+
+void Mesh::drawLod(int lod, bool bindMaterials, bool depthOnly)
+{
+	if (!mLoaded || !makeResident()) return;
+
+	lod = clampLod(lod);
+	const MeshLod& range = mLods[lod];
+	size_t indexSize = getIndexSize();
+	size_t indexStart = mArena->getIndexOffset(mGeometry);
+	GLint baseVertex = mArena->getBaseVertex(mGeometry);
+
+	bindForDraw(0, depthOnly);
+	if (bindMaterials)
+	{
+		const MeshSubset* subsets = getSubsets(lod);
+		const Material* previous = nullptr;
+		for (size_t m = 0; m < mMaterials.size(); m++)
+		{
+			const Material& material = mMaterials[subsets[m].material];
+			bindMaterial(material, previous);
+			previous = &material;
+
+			glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)subsets[m].indexCount, mIndexType,
+				(GLvoid*)(indexStart + subsets[m].indexOffset * indexSize), baseVertex);
+			sDrawStats.drawCalls++;
+		}
+	}
+	else
+	{
+		// The materials of a LOD are back to back
+		glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)range.indexCount, mIndexType,
+			(GLvoid*)(indexStart + range.indexOffset * indexSize), baseVertex);
+		sDrawStats.drawCalls++;
+	}
 	glBindVertexArray(0);
+
+	sDrawStats.triangles += range.indexCount / 3;
+	sDrawStats.fullDetailTriangles += mLods[0].indexCount / 3;
+	sDrawStats.instances++;
 }
 
 //-----------------------------------------------------------------------------
-// Render the mesh
+// Render one LOD of the mesh for every instance of the buffer
 //-----------------------------------------------------------------------------
-void Mesh::draw()
+void Mesh::drawInstanced(int lod, const InstanceBuffer& instances, bool bindMaterials)
+{
+	drawLodInstanced(lod, instances, bindMaterials, false);
+}
+
+void Mesh::drawLodInstanced(int lod, const InstanceBuffer& instances, bool bindMaterials, bool depthOnly)
 {
-	if (!mLoaded) return;
+	if (!mLoaded || instances.getCount() == 0 || !makeResident()) return;
+
+	lod = clampLod(lod);
+	const MeshLod& range = mLods[lod];
+	size_t indexSize = getIndexSize();
+	size_t indexStart = mArena->getIndexOffset(mGeometry);
+	GLint baseVertex = mArena->getBaseVertex(mGeometry);
+	GLsizei instanceCount = (GLsizei)instances.getCount();
+
+	bindForDraw(instances.getBuffer(), depthOnly);
+	if (bindMaterials)
+	{
+		const MeshSubset* subsets = getSubsets(lod);
+		const Material* previous = nullptr;
+		for (size_t m = 0; m < mMaterials.size(); m++)
+		{
+			const Material& material = mMaterials[subsets[m].material];
+			bindMaterial(material, previous);
+			previous = &material;
 
-	glBindVertexArray(mVAO);
-	glDrawArrays(GL_TRIANGLES, 0, mVertices.size());
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)subsets[m].indexCount, mIndexType,
+				(GLvoid*)(indexStart + subsets[m].indexOffset * indexSize), instanceCount, baseVertex);
+			sDrawStats.drawCalls++;
+		}
+	}
+	else
+	{
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)range.indexCount, mIndexType,
+			(GLvoid*)(indexStart + range.indexOffset * indexSize), instanceCount, baseVertex);
+		sDrawStats.drawCalls++;
+	}
 	glBindVertexArray(0);
+
+	sDrawStats.triangles += range.indexCount / 3 * instances.getCount();
+	sDrawStats.fullDetailTriangles += mLods[0].indexCount / 3 * instances.getCount();
+	sDrawStats.instances += instances.getCount();
 }
 
+//-----------------------------------------------------------------------------
+// Render the visible meshlets of one LOD with a multi-draw per material, or
+// a single one without materials
+//-----------------------------------------------------------------------------
+void Mesh::drawCulled(int lod, const glm::mat4& model, const glm::mat4& viewProjection, const glm::vec3& eye, bool backfaceCull,
+	bool bindMaterials)
+{
+	drawLodCulled(lod, model, viewProjection, eye, backfaceCull, bindMaterials, false);
+}
+
+void Mesh::drawLodCulled(int lod, const glm::mat4& model, const glm::mat4& viewProjection, const glm::vec3& eye, bool backfaceCull,
+	bool bindMaterials, bool depthOnly)
+{
+	if (!mLoaded || !makeResident()) return;
+
+	lod = clampLod(lod);
+	const MeshLod& range = mLods[lod];
+	size_t indexSize = getIndexSize();
+	size_t indexStart = mArena->getIndexOffset(mGeometry);
+
+	glm::vec3 modelEye = glm::vec3(glm::inverse(model) * glm::vec4(eye, 1.0f));
+	glm::mat4 modelViewProjection = viewProjection * model;
+
+	const MeshSubset* subsets = getSubsets(lod);
+	const Material* previous = nullptr;
+	size_t batchCount = bindMaterials ? mMaterials.size() : 1;
+	size_t indexCount = 0;
+	bool bound = false;
+
+	for (size_t batch = 0; batch < batchCount; batch++)
+	{
+		uint32_t meshletOffset = bindMaterials ? subsets[batch].meshletOffset : range.meshletOffset;
+		uint32_t meshletCount = bindMaterials ? subsets[batch].meshletCount : range.meshletCount;
+
+		Meshlets::cull(&mMeshlets[meshletOffset], meshletCount, modelViewProjection, modelEye, backfaceCull,
+			indexSize, indexStart, mDrawCounts, mDrawOffsets, sDrawStats.meshlets);
+		if (mDrawCounts.empty())
+			continue;
+
+		for (GLsizei count : mDrawCounts)
+			indexCount += (size_t)count;
+
+		if (!bound)
+		{
+			bindForDraw(0, depthOnly);
+			bound = true;
+		}
+
+		if (bindMaterials)
+		{
+			const Material& material = mMaterials[subsets[batch].material];
+			bindMaterial(material, previous);
+			previous = &material;
+		}
+
+		mDrawBaseVertices.assign(mDrawCounts.size(), mArena->getBaseVertex(mGeometry));
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, mDrawCounts.data(), mIndexType, mDrawOffsets.data(),
+			(GLsizei)mDrawCounts.size(), mDrawBaseVertices.data());
+		sDrawStats.drawCalls++;
+	}
+
+	if (bound)
+		glBindVertexArray(0);
+
+	sDrawStats.triangles += indexCount / 3;
+	sDrawStats.fullDetailTriangles += mLods[0].indexCount / 3;
+	sDrawStats.instances++;
+}
+
+//-----------------------------------------------------------------------------
+// LOD selection.  The bounding sphere's projected radius in pixels scales
+// the world space error of each LOD to its size on screen.
+//-----------------------------------------------------------------------------
+int Mesh::selectLod(const glm::mat4& model, const Camera& camera, float viewportHeight, float maxPixelError) const
+{
+	if (mLods.size() <= 1)
+		return 0;
+
+	glm::vec3 center = glm::vec3(model * glm::vec4(getBoundsCenter(), 1.0f));
+	float scale = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+	float radius = mBoundsRadius * scale;
+
+	// Inside the sphere everything is close enough to need full detail
+	float distance = glm::length(center - camera.getPosition());
+	if (distance <= radius)
+		return 0;
+
+	float pixelsPerUnit = viewportHeight / (2.0f * distance * std::tan(glm::radians(camera.getFOV()) * 0.5f));
+
+	int lod = 0;
+	for (size_t i = 1; i < mLods.size(); i++)
+	{
+		if (mLods[i].error * scale * pixelsPerUnit <= maxPixelError)
+			lod = (int)i;
+	}
+	return lod;
+}
+
+//-----------------------------------------------------------------------------
+// selectLod solved for the distance.  Kept non-decreasing so the LOD of an
+// instance is the number of distances it is beyond, minus one.
+//-----------------------------------------------------------------------------
+void Mesh::getLodDistances(float scale, const Camera& camera, float viewportHeight, float maxPixelError,
+	std::vector<float>& distances) const
+{
+	distances.assign(glm::max(mLods.size(), (size_t)1), 0.0f);
+
+	float unitsPerPixel = 2.0f * std::tan(glm::radians(camera.getFOV()) * 0.5f) / viewportHeight;
+	for (size_t i = 1; i < mLods.size(); i++)
+	{
+		float distance = mLods[i].error * scale / (maxPixelError * unitsPerPixel);
+		distances[i] = glm::max(glm::max(distance, distances[i - 1]), mBoundsRadius * scale);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Clears the draw counters, e.g. once per frame
+//-----------------------------------------------------------------------------
+void Mesh::resetDrawStats()
+{
+	sDrawStats = {};
+}
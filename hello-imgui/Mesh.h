@@ -7,6 +7,7 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <memory>
 #include <vector>
 #include <string>
 #define GLEW_STATIC
@@ -14,11 +15,25 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
-struct Vertex
+#include "Camera.h"
+#include "GeometryArena.h"
+#include "InstanceBuffer.h"
+#include "Material.h"
+#include "Meshlet.h"
+#include "MeshSimplifier.h"
+#include "VertexFormat.h"
+
+class MeshCache;
+
+// Draw counters, accumulated over all meshes until reset
+struct MeshDrawStats
 {
-	glm::vec3 position;
-	glm::vec3 normal;
-	glm::vec2 texCoords;
+	size_t drawCalls;
+	size_t triangles;				// triangles submitted
+	size_t fullDetailTriangles;		// triangles LOD 0 would have submitted
+	size_t textureBinds;
+	size_t instances;				// objects drawn, an instanced draw counts each copy
+	MeshletCullStats meshlets;		// drawCulled only
 };
 
 class Mesh
@@ -28,16 +43,133 @@ public:
 	 Mesh();
 	~Mesh();
 
-	bool loadOBJ(const std::string& filename);
-	void draw();
+	// Moving hands over the GL objects, the source is left unloaded
+	Mesh(Mesh&& rhs);
+	Mesh& operator=(Mesh&& rhs);
+
+	// Loads from the binary mesh cache when it is up to date, otherwise
+	// parses the OBJ file and writes the cache for the next launch.
+	// The GPU copy of the vertices is stored in 'layout'.
+	// Same as prepareOBJ() followed by upload().
+	bool loadOBJ(const std::string& filename, VertexLayout layout = VERTEX_LAYOUT_PACKED_OCT16);
+
+	// The CPU half of loadOBJ: reads the cache or parses the file and keeps
+	// the GPU-ready data for upload().  Makes no GL calls, so it can run on
+	// a worker thread.
+	bool prepareOBJ(const std::string& filename, VertexLayout layout = VERTEX_LAYOUT_PACKED_OCT16);
+
+	// The GL half of loadOBJ: creates the buffers from what prepareOBJ kept
+	// and loads the material textures.  The mesh draws from then on.
+	void upload();
+	bool isLoaded() const { return mLoaded; }
+
+	// Draws one LOD material by material, binding each diffuse map to
+	// texture unit 0.  Without 'bindMaterials' (e.g. for depth only passes)
+	// the whole LOD is a single draw.
+	void draw(int lod = 0, bool bindMaterials = true);
 	void destroy();
 
+	// Draws the meshlets of 'lod' that are inside the frustum of
+	// viewProjection * model and, if 'backfaceCull' is set, not facing away
+	// from the world space 'eye'
+	void drawCulled(int lod, const glm::mat4& model, const glm::mat4& viewProjection, const glm::vec3& eye, bool backfaceCull,
+		bool bindMaterials = true);
+
+	// Draws every instance of 'instances' with one LOD, one instanced draw
+	// per material.  Needs a *_instanced.vert shader, which takes the model
+	// matrix and color from the instance attributes.
+	void drawInstanced(int lod, const InstanceBuffer& instances, bool bindMaterials = true);
+
+	// Depth only passes (shadow maps, depth pre-pass): the whole LOD from the
+	// arena's position only stream when it has one (see
+	// GeometryArena::setDepthStream), binding no textures.  The shaders must
+	// read nothing but the position.
+	void drawDepth(int lod = 0);
+	void drawDepthCulled(int lod, const glm::mat4& model, const glm::mat4& viewProjection);
+	void drawDepthInstanced(int lod, const InstanceBuffer& instances);
+
+	// Picks the coarsest LOD whose simplification error stays below
+	// 'maxPixelError' pixels, projecting the bounding sphere with the
+	// camera's field of view onto a viewport 'viewportHeight' pixels high.
+	int selectLod(const glm::mat4& model, const Camera& camera, float viewportHeight, float maxPixelError = 1.0f) const;
+
+	// The same choice for many instances of scale 'scale': LOD i is used from
+	// distances[i] away from the camera on (distances[0] is 0)
+	void getLodDistances(float scale, const Camera& camera, float viewportHeight, float maxPixelError,
+		std::vector<float>& distances) const;
+
+	size_t getLodCount() const { return mLods.size(); }
+	const MeshLod& getLod(size_t lod) const { return mLods[lod]; }
+
+	size_t getMaterialCount() const { return mMaterials.size(); }
+	const Material& getMaterial(size_t material) const { return mMaterials[material]; }
+
+	// Residency (see ResidencyManager): evict returns the geometry to the
+	// arena, if the mesh cache can give it back.  The next draw reloads it
+	// from there, waiting for it.
+	bool evict();
+	bool isResident() const { return mGeometry != GeometryArena::INVALID_HANDLE; }
+	size_t getMemorySize() const;		// geometry in the arena, 0 while evicted
+	uint64_t getLastUsedFrame() const { return mLastUsedFrame; }		// last drawn, in ResidencyManager frames
+
+	// Picks up the array layers of the materials' diffuse maps once
+	// TextureLibrary::buildArrays has (re)built the arrays
+	void resolveTextureLayers();
+
+	static const MeshDrawStats& getDrawStats() { return sDrawStats; }
+	static void resetDrawStats();
+
+	size_t getVertexCount() const { return mVertexCount; }
+	size_t getIndexCount() const  { return mIndexCount; }		// all LODs
+	VertexLayout getVertexLayout() const { return mLayout; }
+
+	const glm::vec3& getBoundsMin() const { return mBoundsMin; }
+	const glm::vec3& getBoundsMax() const { return mBoundsMax; }
+	glm::vec3 getBoundsCenter() const     { return (mBoundsMin + mBoundsMax) * 0.5f; }
+	float getBoundsRadius() const         { return mBoundsRadius; }		// around getBoundsCenter()
+
+	// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, as the arena holds the indices
+	GLenum getIndexType() const    { return mIndexType; }
+
 private:
 
-	void initBuffers();
+	struct PendingUpload;
+
+	bool parseOBJ(const std::string& filename, std::vector<std::string>& materialLibraries);
+	void initBuffers(const void* vertexData, const void* indexData);
+	bool openCache(MeshCache& cache) const;
+	bool makeResident();
+	void bindForDraw(GLuint instanceBuffer = 0, bool depthOnly = false);
+	void drawLod(int lod, bool bindMaterials, bool depthOnly);
+	void drawLodCulled(int lod, const glm::mat4& model, const glm::mat4& viewProjection, const glm::vec3& eye, bool backfaceCull,
+		bool bindMaterials, bool depthOnly);
+	void drawLodInstanced(int lod, const InstanceBuffer& instances, bool bindMaterials, bool depthOnly);
+	int clampLod(int lod) const { return glm::clamp(lod, 0, (int)mLods.size() - 1); }
+	size_t getIndexSize() const { return (mIndexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint); }
+	const MeshSubset* getSubsets(int lod) const { return &mSubsets[(size_t)lod * mMaterials.size()]; }
+	void bindMaterial(const Material& material, const Material* previous);
 
 	bool mLoaded;
 	std::vector<Vertex> mVertices;
-	GLuint mVBO, mVAO;
+	std::vector<GLuint> mIndices;		// every LOD, back to back
+	std::vector<MeshLod> mLods;
+	std::vector<Material> mMaterials;	// in draw order
+	std::vector<MeshSubset> mSubsets;	// one per material for every LOD, LOD by LOD
+	std::vector<Meshlet> mMeshlets;		// of all LODs
+	std::vector<GLsizei> mDrawCounts;	// visible ranges, rebuilt by drawCulled
+	std::vector<const GLvoid*> mDrawOffsets;
+	std::vector<GLint> mDrawBaseVertices;
+	size_t mVertexCount, mIndexCount;
+	GLenum mIndexType;		// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, whichever is narrowest
+	VertexLayout mLayout;
+	glm::vec3 mBoundsMin, mBoundsMax;
+	float mBoundsRadius;
+	GeometryArena* mArena;
+	GeometryArena::Handle mGeometry;
+	std::unique_ptr<PendingUpload> mPending;	// between prepareOBJ and upload
+	std::string mFilename;
+	uint64_t mLastUsedFrame;
+
+	static MeshDrawStats sDrawStats;
 };
 #endif //MESH_H
@@ -0,0 +1,362 @@
+//-----------------------------------------------------------------------------
+// MeshCache.cpp
+//
+// Versioned binary mesh cache.  Holds the final GPU-ready vertex and index
+// blobs of a model so the OBJ text does not have to be parsed again.
+//-----------------------------------------------------------------------------
+#include "MeshCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace
+{
+	const char MESH_CACHE_MAGIC[4] = { 'M', 'S', 'H', 'C' };
+
+	uint64_t alignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	// Whether [offset, offset + bytes) lies in a file of 'size' bytes,
+	// without overflowing on garbage offsets
+	bool fits(uint64_t offset, uint64_t bytes, uint64_t size)
+	{
+		return bytes <= size && offset <= size - bytes;
+	}
+
+	bool rangeFits(uint32_t offset, uint32_t count, uint32_t total)
+	{
+		return count <= total && offset <= total - count;
+	}
+
+	//-------------------------------------------------------------------------
+	// The index and meshlet ranges of the LODs, subsets and meshlets stay
+	// inside the cached blobs, so a corrupt cache cannot draw out of range
+	//-------------------------------------------------------------------------
+	bool rangesValid(const MeshCacheHeader& header, const unsigned char* data)
+	{
+		const MeshLod* lods = reinterpret_cast<const MeshLod*>(data + header.lodOffset);
+		for (uint32_t i = 0; i < header.lodCount; i++)
+		{
+			if (!rangeFits(lods[i].indexOffset, lods[i].indexCount, header.indexCount) ||
+				!rangeFits(lods[i].meshletOffset, lods[i].meshletCount, header.meshletCount))
+				return false;
+		}
+
+		const MeshSubset* subsets = reinterpret_cast<const MeshSubset*>(data + header.subsetOffset);
+		for (uint32_t i = 0; i < header.subsetCount; i++)
+		{
+			if (subsets[i].material >= header.materialCount ||
+				!rangeFits(subsets[i].indexOffset, subsets[i].indexCount, header.indexCount) ||
+				!rangeFits(subsets[i].meshletOffset, subsets[i].meshletCount, header.meshletCount))
+				return false;
+		}
+
+		const Meshlet* meshlets = reinterpret_cast<const Meshlet*>(data + header.meshletOffset);
+		for (uint32_t i = 0; i < header.meshletCount; i++)
+		{
+			if (!rangeFits(meshlets[i].indexOffset, meshlets[i].indexCount, header.indexCount))
+				return false;
+		}
+		return true;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+MeshCache::MeshCache()
+	: mHeader(nullptr)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+MeshCache::~MeshCache()
+{
+	close();
+}
+
+//-----------------------------------------------------------------------------
+// Cache files live next to their source, e.g. models/robot.obj.meshbin
+//-----------------------------------------------------------------------------
+std::string MeshCache::cacheFilename(const std::string& sourceFile)
+{
+	return sourceFile + ".meshbin";
+}
+
+//-----------------------------------------------------------------------------
+// Maps the cache of 'sourceFile'.  The cache is only accepted if its version
+// and vertex layout match, every blob and range in it is consistent, and it
+// was built from the current source and material libraries: same size and
+// write time, or failing that, same content hash.
+//-----------------------------------------------------------------------------
+bool MeshCache::open(const std::string& sourceFile, VertexLayout vertexLayout)
+{
+	close();
+
+	SourceKey key;
+	if (!getSourceKey(sourceFile, key))
+		return false;
+
+	if (!mFile.open(cacheFilename(sourceFile)))
+		return false;
+
+	if (mFile.size() < sizeof(MeshCacheHeader))
+	{
+		close();
+		return false;
+	}
+
+	const MeshCacheHeader* header = reinterpret_cast<const MeshCacheHeader*>(mFile.data());
+	uint64_t size = mFile.size();
+	uint64_t indexSize = (header->indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+
+	bool valid = std::memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) == 0 &&
+		header->version == MESH_CACHE_VERSION &&
+		header->vertexLayout == (uint32_t)vertexLayout &&
+		header->vertexStride == VertexFormat::getVertexSize(vertexLayout) &&
+		header->vertexCount > 0 &&
+		header->vertexBytes == (uint64_t)header->vertexCount * header->vertexStride &&
+		fits(header->vertexOffset, header->vertexBytes, size) &&
+		(header->indexType == GL_UNSIGNED_SHORT || header->indexType == GL_UNSIGNED_INT) &&
+		header->indexCount > 0 &&
+		header->indexBytes == (uint64_t)header->indexCount * indexSize &&
+		fits(header->indexOffset, header->indexBytes, size) &&
+		header->lodBytes == (uint64_t)header->lodCount * sizeof(MeshLod) &&
+		header->lodCount > 0 &&
+		fits(header->lodOffset, header->lodBytes, size) &&
+		header->meshletBytes == (uint64_t)header->meshletCount * sizeof(Meshlet) &&
+		fits(header->meshletOffset, header->meshletBytes, size) &&
+		header->materialBytes == (uint64_t)header->materialCount * sizeof(MeshCacheMaterial) &&
+		fits(header->materialOffset, header->materialBytes, size) &&
+		header->subsetBytes == (uint64_t)header->subsetCount * sizeof(MeshSubset) &&
+		header->subsetCount == (uint64_t)header->materialCount * header->lodCount &&
+		fits(header->subsetOffset, header->subsetBytes, size) &&
+		header->libraryBytes == (uint64_t)header->libraryCount * sizeof(MeshCacheLibrary) &&
+		fits(header->libraryOffset, header->libraryBytes, size) &&
+		header->sourceSize == key.size &&
+		rangesValid(*header, mFile.data());
+
+	// A matching size but different time stamp happens after a checkout or
+	// copy, so fall back to comparing the content hash.
+	if (valid && header->sourceTime != key.time)
+	{
+		uint64_t hash = 0;
+		valid = hashFile(sourceFile, hash) && hash == header->sourceHash;
+	}
+
+	// The cached materials hold what the .mtl files said when it was written
+	const MeshCacheLibrary* libraries = reinterpret_cast<const MeshCacheLibrary*>(mFile.data() + (valid ? header->libraryOffset : 0));
+	for (uint32_t i = 0; valid && i < header->libraryCount; i++)
+	{
+		const MeshCacheLibrary& library = libraries[i];
+		valid = library.file[MESH_CACHE_PATH_MAX - 1] == '\0' && isCurrent(library.file, library.size, library.time, library.hash);
+	}
+
+	if (!valid)
+	{
+		close();
+		return false;
+	}
+
+	mHeader = header;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Unmaps the cache file
+//-----------------------------------------------------------------------------
+void MeshCache::close()
+{
+	mHeader = nullptr;
+	mFile.close();
+}
+
+//-----------------------------------------------------------------------------
+// Writes the cache for 'sourceFile'.  The file is written under a temporary
+// name and renamed so a partially written cache is never picked up.
+//-----------------------------------------------------------------------------
+bool MeshCache::write(const std::string& sourceFile, const MeshCacheData& data)
+{
+	SourceKey key;
+	uint64_t hash = 0;
+	if (!getSourceKey(sourceFile, key) || !hashFile(sourceFile, hash))
+		return false;
+
+	std::vector<MeshCacheLibrary> libraries(data.libraryCount);
+	for (uint32_t i = 0; i < data.libraryCount; i++)
+	{
+		const std::string& libraryFile = data.libraries[i];
+		MeshCacheLibrary& library = libraries[i];
+		std::memset(&library, 0, sizeof(library));
+		if (libraryFile.size() >= sizeof(library.file))
+		{
+			fmt::println("Mesh cache: material library path '{}' is too long, '{}' is not cached", libraryFile, sourceFile);
+			return false;
+		}
+		std::memcpy(library.file, libraryFile.data(), libraryFile.size());
+
+		// An empty file has nothing to hash, its size alone identifies it
+		SourceKey libraryKey;
+		if (getSourceKey(libraryFile, libraryKey))
+		{
+			library.size = libraryKey.size;
+			library.time = libraryKey.time;
+			if (libraryKey.size > 0 && !hashFile(libraryFile, library.hash))
+				return false;
+		}
+		else
+		{
+			library.size = ~0ull;
+		}
+	}
+
+	size_t indexSize = (data.indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+
+	MeshCacheHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+	header.version = MESH_CACHE_VERSION;
+	header.sourceSize = key.size;
+	header.sourceTime = key.time;
+	header.sourceHash = hash;
+	header.vertexLayout = data.vertexLayout;
+	header.vertexStride = data.vertexStride;
+	header.vertexCount = data.vertexCount;
+	header.indexType = data.indexType;
+	header.indexCount = data.indexCount;
+	for (int i = 0; i < 3; i++)
+	{
+		header.boundsMin[i] = data.boundsMin[i];
+		header.boundsMax[i] = data.boundsMax[i];
+	}
+	header.boundsRadius = data.boundsRadius;
+	header.vertexBytes = (uint64_t)data.vertexStride * data.vertexCount;
+	header.vertexOffset = alignUp(sizeof(MeshCacheHeader), 16);
+	header.indexBytes = (uint64_t)indexSize * data.indexCount;
+	header.indexOffset = alignUp(header.vertexOffset + header.vertexBytes, 16);
+	header.lodCount = data.lodCount;
+	header.lodBytes = (uint64_t)sizeof(MeshLod) * data.lodCount;
+	header.lodOffset = alignUp(header.indexOffset + header.indexBytes, 16);
+	header.meshletCount = data.meshletCount;
+	header.meshletBytes = (uint64_t)sizeof(Meshlet) * data.meshletCount;
+	header.meshletOffset = alignUp(header.lodOffset + header.lodBytes, 16);
+	header.materialCount = data.materialCount;
+	header.materialBytes = (uint64_t)sizeof(MeshCacheMaterial) * data.materialCount;
+	header.materialOffset = alignUp(header.meshletOffset + header.meshletBytes, 16);
+	header.subsetCount = data.subsetCount;
+	header.subsetBytes = (uint64_t)sizeof(MeshSubset) * data.subsetCount;
+	header.subsetOffset = alignUp(header.materialOffset + header.materialBytes, 16);
+	header.libraryCount = data.libraryCount;
+	header.libraryBytes = (uint64_t)sizeof(MeshCacheLibrary) * data.libraryCount;
+	header.libraryOffset = alignUp(header.subsetOffset + header.subsetBytes, 16);
+
+	std::string filename = cacheFilename(sourceFile);
+	std::string tempFilename = filename + ".tmp";
+
+	std::ofstream file(tempFilename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		fmt::println("Unable to write mesh cache '{}'", filename);
+		return false;
+	}
+
+	const char padding[16] = {};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(padding, (std::streamsize)(header.vertexOffset - sizeof(header)));
+	file.write(static_cast<const char*>(data.vertices), (std::streamsize)header.vertexBytes);
+	file.write(padding, (std::streamsize)(header.indexOffset - header.vertexOffset - header.vertexBytes));
+	file.write(static_cast<const char*>(data.indices), (std::streamsize)header.indexBytes);
+	file.write(padding, (std::streamsize)(header.lodOffset - header.indexOffset - header.indexBytes));
+	file.write(reinterpret_cast<const char*>(data.lods), (std::streamsize)header.lodBytes);
+	file.write(padding, (std::streamsize)(header.meshletOffset - header.lodOffset - header.lodBytes));
+	file.write(reinterpret_cast<const char*>(data.meshlets), (std::streamsize)header.meshletBytes);
+	file.write(padding, (std::streamsize)(header.materialOffset - header.meshletOffset - header.meshletBytes));
+	file.write(reinterpret_cast<const char*>(data.materials), (std::streamsize)header.materialBytes);
+	file.write(padding, (std::streamsize)(header.subsetOffset - header.materialOffset - header.materialBytes));
+	file.write(reinterpret_cast<const char*>(data.subsets), (std::streamsize)header.subsetBytes);
+	file.write(padding, (std::streamsize)(header.libraryOffset - header.subsetOffset - header.subsetBytes));
+	file.write(reinterpret_cast<const char*>(libraries.data()), (std::streamsize)header.libraryBytes);
+	file.close();
+
+	std::error_code ec;
+	if (file.fail())
+	{
+		std::filesystem::remove(tempFilename, ec);
+		fmt::println("Unable to write mesh cache '{}'", filename);
+		return false;
+	}
+
+	std::filesystem::rename(tempFilename, filename, ec);
+	if (ec)
+	{
+		std::filesystem::remove(tempFilename, ec);
+		return false;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Whether 'file' still has the key it was cached with, as open checks the
+// source.  A file that was missing must still be missing.
+//-----------------------------------------------------------------------------
+bool MeshCache::isCurrent(const std::string& file, uint64_t size, int64_t time, uint64_t hash)
+{
+	SourceKey key;
+	if (!getSourceKey(file, key))
+		return size == ~0ull;
+
+	if (key.size != size)
+		return false;
+
+	uint64_t current = 0;
+	return key.time == time || key.size == 0 || (hashFile(file, current) && current == hash);
+}
+
+//-----------------------------------------------------------------------------
+// Size and last write time of the source file
+//-----------------------------------------------------------------------------
+bool MeshCache::getSourceKey(const std::string& sourceFile, SourceKey& key)
+{
+	std::error_code ec;
+	std::uintmax_t size = std::filesystem::file_size(sourceFile, ec);
+	if (ec)
+		return false;
+
+	std::filesystem::file_time_type time = std::filesystem::last_write_time(sourceFile, ec);
+	if (ec)
+		return false;
+
+	key.size = (uint64_t)size;
+	key.time = (int64_t)time.time_since_epoch().count();
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// 64-bit FNV-1a hash of the file contents
+//-----------------------------------------------------------------------------
+bool MeshCache::hashFile(const std::string& filename, uint64_t& hash)
+{
+	MappedFile file;
+	if (!file.open(filename))
+		return false;
+
+	const unsigned char* bytes = file.data();
+	uint64_t h = 14695981039346656037ull;
+	for (size_t i = 0; i < file.size(); i++)
+	{
+		h ^= bytes[i];
+		h *= 1099511628211ull;
+	}
+
+	hash = h;
+	return true;
+}
@@ -0,0 +1,160 @@
+//-----------------------------------------------------------------------------
+// MeshCache.h
+//
+// Versioned binary mesh cache.  Holds the final GPU-ready vertex and index
+// blobs of a model so the OBJ text does not have to be parsed again.
+//-----------------------------------------------------------------------------
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "MappedFile.h"
+#include "Material.h"
+#include "Meshlet.h"
+#include "MeshSimplifier.h"
+#include "VertexFormat.h"
+
+// Bump whenever the layout of the cache or of the Vertex struct changes
+const uint32_t MESH_CACHE_VERSION = 8;
+
+// Longest texture path a cached material can hold, including the terminator
+const size_t MESH_CACHE_PATH_MAX = 260;
+
+// A material as stored in the cache, texture paths already resolved
+struct MeshCacheMaterial
+{
+	char name[64];
+	char diffuseMapFile[MESH_CACHE_PATH_MAX];
+	char specularMapFile[MESH_CACHE_PATH_MAX];
+};
+
+// A .mtl file the materials came from, keyed like the source so editing it
+// invalidates the cache too.  A library that did not exist has size ~0.
+struct MeshCacheLibrary
+{
+	char     file[MESH_CACHE_PATH_MAX];	// as the OBJ directory and mtllib name resolve it
+	uint32_t reserved;
+	uint64_t size;
+	int64_t  time;
+	uint64_t hash;
+};
+
+struct MeshCacheHeader
+{
+	char     magic[4];			// "MSHC"
+	uint32_t version;
+
+	// Source file key
+	uint64_t sourceSize;
+	int64_t  sourceTime;		// last write time
+	uint64_t sourceHash;		// FNV-1a of the source bytes
+
+	// Geometry
+	uint32_t vertexLayout;		// VertexLayout, packed positions are relative to the bounds
+	uint32_t vertexStride;
+	uint32_t vertexCount;
+	uint32_t indexType;			// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	uint32_t indexCount;		// all LODs
+	uint32_t lodCount;
+	uint32_t meshletCount;
+	uint32_t materialCount;
+	uint32_t subsetCount;		// materialCount per LOD
+	uint32_t libraryCount;
+	float    boundsMin[3];
+	float    boundsMax[3];
+	float    boundsRadius;		// sphere around the center of the bounds
+
+	// Blob locations relative to the start of the file
+	uint64_t vertexOffset;
+	uint64_t vertexBytes;
+	uint64_t indexOffset;
+	uint64_t indexBytes;
+	uint64_t lodOffset;			// MeshLod[lodCount]
+	uint64_t lodBytes;
+	uint64_t meshletOffset;		// Meshlet[meshletCount]
+	uint64_t meshletBytes;
+	uint64_t materialOffset;	// MeshCacheMaterial[materialCount]
+	uint64_t materialBytes;
+	uint64_t subsetOffset;		// MeshSubset[subsetCount]
+	uint64_t subsetBytes;
+	uint64_t libraryOffset;		// MeshCacheLibrary[libraryCount]
+	uint64_t libraryBytes;
+};
+
+// Everything needed to write a cache file
+struct MeshCacheData
+{
+	const void* vertices;
+	VertexLayout vertexLayout;
+	uint32_t vertexStride;
+	uint32_t vertexCount;
+
+	const void* indices;
+	GLenum indexType;
+	uint32_t indexCount;
+
+	const MeshLod* lods;
+	uint32_t lodCount;
+
+	const Meshlet* meshlets;
+	uint32_t meshletCount;
+
+	const MeshCacheMaterial* materials;
+	uint32_t materialCount;
+
+	const MeshSubset* subsets;
+	uint32_t subsetCount;
+
+	const std::string* libraries;	// .mtl files read for the materials
+	uint32_t libraryCount;
+
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	float boundsRadius;
+};
+
+class MeshCache
+{
+public:
+	MeshCache();
+	~MeshCache();
+
+	// Maps the cache file of 'sourceFile' if one exists and is up to date
+	bool open(const std::string& sourceFile, VertexLayout vertexLayout);
+	void close();
+	bool isOpen() const { return mHeader != nullptr; }
+
+	static bool write(const std::string& sourceFile, const MeshCacheData& data);
+	static std::string cacheFilename(const std::string& sourceFile);
+
+	const MeshCacheHeader& getHeader() const { return *mHeader; }
+	const void* getVertexData() const        { return mFile.data() + mHeader->vertexOffset; }
+	const void* getIndexData() const         { return mFile.data() + mHeader->indexOffset; }
+	const MeshLod* getLods() const           { return reinterpret_cast<const MeshLod*>(mFile.data() + mHeader->lodOffset); }
+	const Meshlet* getMeshlets() const       { return reinterpret_cast<const Meshlet*>(mFile.data() + mHeader->meshletOffset); }
+	const MeshCacheMaterial* getMaterials() const { return reinterpret_cast<const MeshCacheMaterial*>(mFile.data() + mHeader->materialOffset); }
+	const MeshSubset* getSubsets() const     { return reinterpret_cast<const MeshSubset*>(mFile.data() + mHeader->subsetOffset); }
+	const MeshCacheLibrary* getLibraries() const { return reinterpret_cast<const MeshCacheLibrary*>(mFile.data() + mHeader->libraryOffset); }
+
+	// Source file identity, also used by TextureCache
+	struct SourceKey
+	{
+		uint64_t size;
+		int64_t time;
+	};
+
+	static bool getSourceKey(const std::string& sourceFile, SourceKey& key);
+	static bool hashFile(const std::string& filename, uint64_t& hash);
+
+private:
+	static bool isCurrent(const std::string& file, uint64_t size, int64_t time, uint64_t hash);
+
+	MappedFile mFile;
+	const MeshCacheHeader* mHeader;
+};
+#endif // MESH_CACHE_H
@@ -0,0 +1,456 @@
+//-----------------------------------------------------------------------------
+// MeshSimplifier.cpp
+//
+// Quadric error edge-collapse simplification (Garland & Heckbert) for
+// indexed triangle lists, and generation of a chain of levels of detail
+// that share one vertex buffer.
+//-----------------------------------------------------------------------------
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+	// Cost of changing a normal or texture coordinate by 1 when a vertex is
+	// collapsed, as a distance relative to the mesh radius
+	const double ATTRIBUTE_WEIGHT = 0.01;
+
+	// Weight of the planes that keep open borders in place
+	const double BORDER_WEIGHT = 10.0;
+
+	// LOD chain: each level aims for half the triangles of the previous one
+	const size_t MIN_LOD_TRIANGLES = 32;
+	const float MIN_LOD_REDUCTION = 0.85f;		// keep a level only if it has at most 85% of the previous triangles
+	const float MAX_LOD_ERROR = 0.1f;			// relative to the bounding radius
+
+	const GLuint AMBIGUOUS_WEDGE = 0xFFFFFFFFu;
+
+	//-------------------------------------------------------------------------
+	// Sum of squared distances to a set of weighted planes
+	//-------------------------------------------------------------------------
+	struct Quadric
+	{
+		double a2, b2, c2, ab, ac, bc, ad, bd, cd, d2;
+		double weight;
+	};
+
+	void addPlane(Quadric& q, double a, double b, double c, double d, double weight)
+	{
+		q.a2 += a * a * weight;
+		q.b2 += b * b * weight;
+		q.c2 += c * c * weight;
+		q.ab += a * b * weight;
+		q.ac += a * c * weight;
+		q.bc += b * c * weight;
+		q.ad += a * d * weight;
+		q.bd += b * d * weight;
+		q.cd += c * d * weight;
+		q.d2 += d * d * weight;
+		q.weight += weight;
+	}
+
+	void addPlane(Quadric& q, const glm::vec3& normal, const glm::vec3& point, double weight)
+	{
+		double d = -((double)normal.x * point.x + (double)normal.y * point.y + (double)normal.z * point.z);
+		addPlane(q, normal.x, normal.y, normal.z, d, weight);
+	}
+
+	void addQuadric(Quadric& q, const Quadric& other)
+	{
+		q.a2 += other.a2; q.b2 += other.b2; q.c2 += other.c2;
+		q.ab += other.ab; q.ac += other.ac; q.bc += other.bc;
+		q.ad += other.ad; q.bd += other.bd; q.cd += other.cd;
+		q.d2 += other.d2;
+		q.weight += other.weight;
+	}
+
+	// Weighted mean squared distance of 'p' to the planes
+	double evaluate(const Quadric& q, const glm::vec3& p)
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double error = q.a2 * x * x + q.b2 * y * y + q.c2 * z * z
+			+ 2.0 * (q.ab * x * y + q.ac * x * z + q.bc * y * z)
+			+ 2.0 * (q.ad * x + q.bd * y + q.cd * z)
+			+ q.d2;
+		return (q.weight > 0.0) ? std::abs(error) / q.weight : 0.0;
+	}
+
+	struct PositionHash
+	{
+		size_t operator()(const glm::vec3& p) const
+		{
+			uint32_t bits[3];
+			std::memcpy(bits, &p.x, sizeof(bits));
+			uint64_t h = 14695981039346656037ull;
+			for (uint32_t b : bits)
+			{
+				h ^= b;
+				h *= 1099511628211ull;
+			}
+			return (size_t)h;
+		}
+	};
+
+	struct PositionEqual
+	{
+		bool operator()(const glm::vec3& a, const glm::vec3& b) const
+		{
+			return std::memcmp(&a.x, &b.x, sizeof(float) * 3) == 0;
+		}
+	};
+
+	uint64_t edgeKey(GLuint a, GLuint b)
+	{
+		return ((uint64_t)a << 32) | b;
+	}
+
+	enum VertexKind
+	{
+		KIND_MANIFOLD,		// interior vertex, can collapse onto any neighbour
+		KIND_BORDER,		// on an open border, can only collapse along it
+		KIND_LOCKED			// non-manifold or a border junction, never moves
+	};
+
+	struct Collapse
+	{
+		GLuint from;		// position ids
+		GLuint to;
+		double cost;
+	};
+}
+
+//-----------------------------------------------------------------------------
+// Vertex-to-vertex edge collapses, so the simplified mesh only references
+// existing vertices and every LOD can share one vertex buffer.
+//
+// Vertices that share a position but differ in normal or UV ("wedges" along
+// a seam or crease) collapse together, each onto the wedge it shares an edge
+// with, which keeps the discontinuity intact.  Collapses are done in passes:
+// all candidate edges are sorted by cost and the cheapest independent ones
+// are applied, then adjacency is rebuilt.
+//-----------------------------------------------------------------------------
+float MeshSimplifier::simplify(std::vector<GLuint>& indices, const std::vector<Vertex>& vertices,
+	size_t targetIndexCount, float maxError)
+{
+	size_t vertexCount = vertices.size();
+	if (indices.size() <= targetIndexCount || vertexCount == 0)
+		return 0.0f;
+
+	// Group vertices by position: positionId is the first vertex at that
+	// position and nextWedge links all vertices at it into a ring
+	std::vector<GLuint> positionId(vertexCount), nextWedge(vertexCount);
+	{
+		std::unordered_map<glm::vec3, GLuint, PositionHash, PositionEqual> firstAt;
+		std::vector<GLuint> lastAt(vertexCount);
+		for (GLuint v = 0; v < (GLuint)vertexCount; v++)
+		{
+			auto inserted = firstAt.emplace(vertices[v].position, v);
+			GLuint first = inserted.first->second;
+			positionId[v] = first;
+			nextWedge[v] = first;
+
+			if (!inserted.second)
+				nextWedge[lastAt[first]] = v;
+			lastAt[first] = v;
+		}
+	}
+
+	auto position = [&](GLuint v) -> const glm::vec3& { return vertices[v].position; };
+
+	glm::vec3 boundsMin = vertices[0].position, boundsMax = vertices[0].position;
+	for (const Vertex& v : vertices)
+	{
+		boundsMin = glm::min(boundsMin, v.position);
+		boundsMax = glm::max(boundsMax, v.position);
+	}
+	double attributeScale = ATTRIBUTE_WEIGHT * 0.5 * glm::length(boundsMax - boundsMin);
+	attributeScale *= attributeScale;
+
+	std::vector<Quadric> quadrics(vertexCount);
+	std::vector<VertexKind> kind(vertexCount);
+	std::vector<unsigned int> borderEdges(vertexCount);
+	std::unordered_map<uint64_t, unsigned int> edgeCount;
+	std::unordered_map<uint64_t, GLuint> wedgeTo;
+	std::vector<unsigned int> triangleOffset(vertexCount + 1);
+	std::vector<unsigned int> triangleList;
+	std::vector<GLuint> remap(vertexCount);
+	std::vector<bool> locked(vertexCount);
+	std::vector<Collapse> collapses;
+
+	auto countEdge = [&](GLuint a, GLuint b) -> unsigned int {
+		auto found = edgeCount.find(edgeKey(a, b));
+		return (found != edgeCount.end()) ? found->second : 0;
+	};
+
+	double worstCost = 0.0;
+	double maxCost = (double)maxError * maxError;
+	bool firstPass = true;
+
+	while (indices.size() > targetIndexCount)
+	{
+		size_t triangleCount = indices.size() / 3;
+
+		// Directed edges between positions, for borders and manifoldness
+		edgeCount.clear();
+		for (size_t t = 0; t < triangleCount; t++)
+			for (int k = 0; k < 3; k++)
+				edgeCount[edgeKey(positionId[indices[t * 3 + k]], positionId[indices[t * 3 + (k + 1) % 3]])]++;
+
+		std::fill(kind.begin(), kind.end(), KIND_MANIFOLD);
+		std::fill(borderEdges.begin(), borderEdges.end(), 0);
+		for (const auto& edge : edgeCount)
+		{
+			GLuint a = (GLuint)(edge.first >> 32), b = (GLuint)(edge.first & 0xFFFFFFFFu);
+			if (edge.second > 1)
+				kind[a] = kind[b] = KIND_LOCKED;
+			if (countEdge(b, a) == 0)
+			{
+				borderEdges[a]++;
+				borderEdges[b]++;
+			}
+		}
+		for (size_t p = 0; p < vertexCount; p++)
+		{
+			if (kind[p] != KIND_LOCKED && borderEdges[p] > 0)
+				kind[p] = (borderEdges[p] == 2) ? KIND_BORDER : KIND_LOCKED;
+		}
+
+		// The quadrics are built once from the input surface and accumulate
+		// as vertices collapse, so they measure the error against the input
+		if (firstPass)
+		{
+			for (size_t t = 0; t < triangleCount; t++)
+			{
+				const GLuint* tri = &indices[t * 3];
+				glm::vec3 p0 = position(tri[0]), p1 = position(tri[1]), p2 = position(tri[2]);
+				glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+				float area = glm::length(n);
+				if (area <= 0.0f)
+					continue;
+				n /= area;
+
+				for (int k = 0; k < 3; k++)
+				{
+					addPlane(quadrics[positionId[tri[k]]], n, p0, area * 0.5);
+
+					// Planes through border edges, perpendicular to the face
+					GLuint a = positionId[tri[k]], b = positionId[tri[(k + 1) % 3]];
+					if (countEdge(b, a) == 0)
+					{
+						glm::vec3 edge = position(b) - position(a);
+						glm::vec3 borderNormal = glm::cross(edge, n);
+						float length = glm::length(borderNormal);
+						if (length > 0.0f)
+						{
+							double weight = BORDER_WEIGHT * glm::dot(edge, edge);
+							addPlane(quadrics[a], borderNormal / length, position(a), weight);
+							addPlane(quadrics[b], borderNormal / length, position(a), weight);
+						}
+					}
+				}
+			}
+			firstPass = false;
+		}
+
+		// Wedge of each vertex across every edge it is part of
+		wedgeTo.clear();
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint a = indices[t * 3 + k], b = indices[t * 3 + (k + 1) % 3];
+				GLuint pairs[2][2] = { { a, b }, { b, a } };
+				for (auto& pair : pairs)
+				{
+					auto inserted = wedgeTo.emplace(edgeKey(pair[0], positionId[pair[1]]), pair[1]);
+					if (!inserted.second && inserted.first->second != pair[1])
+						inserted.first->second = AMBIGUOUS_WEDGE;
+				}
+			}
+		}
+
+		// Triangles around each position
+		std::fill(triangleOffset.begin(), triangleOffset.end(), 0);
+		for (GLuint index : indices)
+			triangleOffset[positionId[index] + 1]++;
+		for (size_t p = 0; p < vertexCount; p++)
+			triangleOffset[p + 1] += triangleOffset[p];
+		triangleList.resize(indices.size());
+		{
+			std::vector<unsigned int> fill(triangleOffset.begin(), triangleOffset.end() - 1);
+			for (size_t t = 0; t < triangleCount; t++)
+				for (int k = 0; k < 3; k++)
+					triangleList[fill[positionId[indices[t * 3 + k]]]++] = (unsigned int)t;
+		}
+
+		// Cost of collapsing position 'from' onto 'to', negative if not allowed
+		auto collapseCost = [&](GLuint from, GLuint to) -> double {
+			if (kind[from] == KIND_LOCKED)
+				return -1.0;
+			if (kind[from] == KIND_BORDER && countEdge(from, to) != 0 && countEdge(to, from) != 0)
+				return -1.0;
+
+			double cost = evaluate(quadrics[from], position(to));
+
+			// Every wedge needs a partner wedge at the target
+			GLuint w = from;
+			do
+			{
+				auto found = wedgeTo.find(edgeKey(w, to));
+				if (found == wedgeTo.end() || found->second == AMBIGUOUS_WEDGE)
+					return -1.0;
+
+				const Vertex& a = vertices[w];
+				const Vertex& b = vertices[found->second];
+				glm::vec3 dn = a.normal - b.normal;
+				glm::vec2 duv = a.texCoords - b.texCoords;
+				cost += (glm::dot(dn, dn) + glm::dot(duv, duv)) * attributeScale;
+
+				w = nextWedge[w];
+			} while (w != from);
+
+			return cost;
+		};
+
+		// Cheapest allowed direction of every edge
+		collapses.clear();
+		std::unordered_set<uint64_t> visited;
+		for (const auto& edge : edgeCount)
+		{
+			GLuint a = (GLuint)(edge.first >> 32), b = (GLuint)(edge.first & 0xFFFFFFFFu);
+			if (a == b || !visited.insert(edgeKey(std::min(a, b), std::max(a, b))).second)
+				continue;
+
+			double costAB = collapseCost(a, b);
+			double costBA = collapseCost(b, a);
+			if (costAB >= 0.0 && (costBA < 0.0 || costAB <= costBA))
+				collapses.push_back({ a, b, costAB });
+			else if (costBA >= 0.0)
+				collapses.push_back({ b, a, costBA });
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+		size_t goal = triangleCount - targetIndexCount / 3;
+		size_t removed = 0;
+
+		for (size_t v = 0; v < vertexCount; v++)
+			remap[v] = (GLuint)v;
+		std::fill(locked.begin(), locked.end(), false);
+
+		for (const Collapse& collapse : collapses)
+		{
+			if (removed >= goal || collapse.cost > maxCost)
+				break;
+
+			GLuint from = collapse.from, to = collapse.to;
+			if (locked[from] || locked[to])
+				continue;
+
+			// Reject collapses that flip a triangle around 'from'
+			size_t collapsed = 0;
+			bool flipped = false;
+			for (unsigned int i = triangleOffset[from]; i < triangleOffset[from + 1] && !flipped; i++)
+			{
+				const GLuint* tri = &indices[triangleList[i] * 3];
+				GLuint p[3] = { positionId[tri[0]], positionId[tri[1]], positionId[tri[2]] };
+				if (p[0] == to || p[1] == to || p[2] == to)
+				{
+					collapsed++;
+					continue;
+				}
+
+				glm::vec3 before = glm::cross(position(p[1]) - position(p[0]), position(p[2]) - position(p[0]));
+				for (int k = 0; k < 3; k++)
+					if (p[k] == from)
+						p[k] = to;
+				glm::vec3 after = glm::cross(position(p[1]) - position(p[0]), position(p[2]) - position(p[0]));
+
+				flipped = glm::dot(before, after) <= 0.0f;
+			}
+			if (flipped)
+				continue;
+
+			GLuint w = from;
+			do
+			{
+				remap[w] = wedgeTo[edgeKey(w, to)];
+				w = nextWedge[w];
+			} while (w != from);
+
+			addQuadric(quadrics[to], quadrics[from]);
+
+			// Keep collapses in one pass independent: nothing around 'from'
+			// may move again until adjacency is rebuilt
+			for (unsigned int i = triangleOffset[from]; i < triangleOffset[from + 1]; i++)
+				for (int k = 0; k < 3; k++)
+					locked[positionId[indices[triangleList[i] * 3 + k]]] = true;
+
+			removed += collapsed;
+			worstCost = std::max(worstCost, collapse.cost);
+		}
+
+		if (removed == 0)
+			break;
+
+		// Apply the collapses and drop the triangles that became degenerate
+		size_t write = 0;
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			GLuint a = remap[indices[t * 3]], b = remap[indices[t * 3 + 1]], c = remap[indices[t * 3 + 2]];
+			if (positionId[a] == positionId[b] || positionId[b] == positionId[c] || positionId[a] == positionId[c])
+				continue;
+
+			indices[write++] = a;
+			indices[write++] = b;
+			indices[write++] = c;
+		}
+		indices.resize(write);
+	}
+
+	return (float)std::sqrt(worstCost);
+}
+
+//-----------------------------------------------------------------------------
+// Builds LOD 1, 2, ... by simplifying the previous level, so the errors of
+// the levels add up.  Stops when a level no longer pays for itself.
+//-----------------------------------------------------------------------------
+void MeshSimplifier::generateLods(std::vector<GLuint>& indices, size_t lod0Count, const std::vector<Vertex>& vertices,
+	std::vector<MeshLod>& lods)
+{
+	lods.clear();
+	lods.push_back({ 0, (uint32_t)lod0Count, 0.0f, 0, 0 });
+	if (vertices.empty())
+		return;
+
+	glm::vec3 boundsMin = vertices[0].position, boundsMax = vertices[0].position;
+	for (const Vertex& v : vertices)
+	{
+		boundsMin = glm::min(boundsMin, v.position);
+		boundsMax = glm::max(boundsMax, v.position);
+	}
+	float errorBudget = MAX_LOD_ERROR * 0.5f * glm::length(boundsMax - boundsMin);
+
+	std::vector<GLuint> lod(indices.begin(), indices.begin() + lod0Count);
+	float error = 0.0f;
+
+	while (lods.size() < MAX_MESH_LODS && error < errorBudget)
+	{
+		size_t previousCount = lod.size();
+		size_t targetCount = (previousCount / 6) * 3;
+		if (targetCount / 3 < MIN_LOD_TRIANGLES)
+			break;
+
+		float lodError = simplify(lod, vertices, targetCount, errorBudget - error);
+		if (lod.size() > previousCount * MIN_LOD_REDUCTION)
+			break;
+
+		error += lodError;
+		lods.push_back({ (uint32_t)indices.size(), (uint32_t)lod.size(), error, 0, 0 });
+		indices.insert(indices.end(), lod.begin(), lod.end());
+	}
+}
@@ -0,0 +1,47 @@
+//-----------------------------------------------------------------------------
+// MeshSimplifier.h
+//
+// Quadric error edge-collapse simplification (Garland & Heckbert) for
+// indexed triangle lists, and generation of a chain of levels of detail
+// that share one vertex buffer.
+//-----------------------------------------------------------------------------
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "VertexFormat.h"
+
+// Longest LOD chain generateLods builds, LOD 0 included
+const size_t MAX_MESH_LODS = 4;
+
+// One level of detail: a range of the shared index buffer
+struct MeshLod
+{
+	uint32_t indexOffset;		// in indices
+	uint32_t indexCount;
+	float    error;				// simplification error relative to LOD 0, in model units
+
+	uint32_t meshletOffset;		// meshlets covering the range, see Meshlet.h
+	uint32_t meshletCount;
+};
+
+class MeshSimplifier
+{
+public:
+	// Collapses edges of 'indices' onto existing vertices until at most
+	// 'targetIndexCount' indices remain or the next collapse would move the
+	// surface by more than 'maxError' model units.  Borders, UV seams and
+	// normal creases are preserved.  Returns the error of the result.
+	static float simplify(std::vector<GLuint>& indices, const std::vector<Vertex>& vertices,
+		size_t targetIndexCount, float maxError);
+
+	// Appends successively halved LODs of the triangles in indices[0, lod0Count)
+	// to 'indices' and describes every level, LOD 0 included, in 'lods'
+	static void generateLods(std::vector<GLuint>& indices, size_t lod0Count, const std::vector<Vertex>& vertices,
+		std::vector<MeshLod>& lods);
+};
+#endif // MESH_SIMPLIFIER_H
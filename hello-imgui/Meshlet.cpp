@@ -0,0 +1,307 @@
+//-----------------------------------------------------------------------------
+// Meshlet.cpp
+//
+// Meshlets: small clusters of triangles with a bounding sphere and a normal
+// cone, so whole clusters outside the frustum or facing away from the
+// viewer can be skipped before drawing.
+//-----------------------------------------------------------------------------
+#include "Meshlet.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "FrustumCuller.h"
+
+namespace
+{
+	// Cones wider than this (cosine of the half angle) are never culled
+	const float MIN_CONE_COS = 0.1f;
+
+	// Unconnected triangles considered when a meshlet runs out of neighbours,
+	// and how closely they must follow the meshlet's average normal
+	const size_t FALLBACK_WINDOW = 32;
+	const float FALLBACK_MIN_COS = 0.9f;
+
+	//-------------------------------------------------------------------------
+	// Bounds of triangles [begin, end) of the index buffer
+	//-------------------------------------------------------------------------
+	void computeBounds(Meshlet& meshlet, const std::vector<GLuint>& indices, size_t begin, size_t end,
+		const std::vector<Vertex>& vertices)
+	{
+		// Sphere around the center of the bounding box
+		glm::vec3 boundsMin = vertices[indices[begin]].position, boundsMax = boundsMin;
+		for (size_t i = begin; i < end; i++)
+		{
+			boundsMin = glm::min(boundsMin, vertices[indices[i]].position);
+			boundsMax = glm::max(boundsMax, vertices[indices[i]].position);
+		}
+
+		glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+		float radius = 0.0f;
+		for (size_t i = begin; i < end; i++)
+			radius = glm::max(radius, glm::distance(center, vertices[indices[i]].position));
+
+		// Cone around the average face normal, as wide as the farthest normal
+		glm::vec3 axis(0.0f);
+		std::vector<glm::vec3> normals;
+		normals.reserve((end - begin) / 3);
+		for (size_t i = begin; i < end; i += 3)
+		{
+			glm::vec3 p0 = vertices[indices[i]].position;
+			glm::vec3 p1 = vertices[indices[i + 1]].position;
+			glm::vec3 p2 = vertices[indices[i + 2]].position;
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float area = glm::length(n);
+			if (area > 0.0f)
+			{
+				normals.push_back(n / area);
+				axis += n / area;
+			}
+		}
+
+		float axisLength = glm::length(axis);
+		float minCos = -1.0f;
+		if (axisLength > 0.0f)
+		{
+			axis /= axisLength;
+			minCos = 1.0f;
+			for (const glm::vec3& n : normals)
+				minCos = glm::min(minCos, glm::dot(axis, n));
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			meshlet.center[k] = center[k];
+			meshlet.coneAxis[k] = axis[k];
+		}
+		meshlet.radius = radius;
+		meshlet.coneCutoff = (minCos >= MIN_CONE_COS) ? std::sqrt(1.0f - minCos * minCos) : 2.0f;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Greedy growth: a meshlet starts at the first unused triangle in the current
+// (vertex cache) order and keeps adding the adjacent triangle that brings in
+// the fewest new vertices and bends the normal cone the least.  The range is
+// rewritten so every meshlet is a run of consecutive triangles.
+//-----------------------------------------------------------------------------
+void Meshlets::build(std::vector<GLuint>& indices, size_t indexOffset, size_t indexCount,
+	const std::vector<Vertex>& vertices, std::vector<Meshlet>& meshlets)
+{
+	size_t triangleCount = indexCount / 3;
+	size_t vertexCount = vertices.size();
+	if (triangleCount == 0)
+		return;
+
+	const GLuint* tris = &indices[indexOffset];
+
+	std::vector<glm::vec3> faceNormal(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		glm::vec3 p0 = vertices[tris[t * 3]].position;
+		glm::vec3 p1 = vertices[tris[t * 3 + 1]].position;
+		glm::vec3 p2 = vertices[tris[t * 3 + 2]].position;
+		glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+		float area = glm::length(n);
+		faceNormal[t] = (area > 0.0f) ? n / area : glm::vec3(0.0f);
+	}
+
+	// Vertex -> triangle adjacency in compressed rows
+	std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		adjacencyOffset[tris[i] + 1]++;
+	for (size_t v = 0; v < vertexCount; v++)
+		adjacencyOffset[v + 1] += adjacencyOffset[v];
+
+	std::vector<unsigned int> adjacency(triangleCount * 3);
+	{
+		std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+			adjacency[fill[tris[i]]++] = (unsigned int)(i / 3);
+	}
+
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<size_t> stamp(vertexCount, 0);
+	size_t meshletId = 0;
+
+	std::vector<GLuint> result;
+	result.reserve(indexCount);
+
+	std::vector<unsigned int> candidates;
+	size_t seed = 0;
+
+	while (true)
+	{
+		while (seed < triangleCount && emitted[seed])
+			seed++;
+		if (seed == triangleCount)
+			break;
+
+		meshletId++;
+		size_t meshletStart = result.size();
+		size_t meshletVertices = 0;
+		glm::vec3 axis(0.0f);
+		candidates.clear();
+
+		size_t next = seed;
+		while (true)
+		{
+			// Add the triangle and make its neighbours candidates
+			emitted[next] = true;
+			axis += faceNormal[next];
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint v = tris[next * 3 + k];
+				result.push_back(v);
+				if (stamp[v] != meshletId)
+				{
+					stamp[v] = meshletId;
+					meshletVertices++;
+					for (unsigned int a = adjacencyOffset[v]; a < adjacencyOffset[v + 1]; a++)
+						if (!emitted[adjacency[a]])
+							candidates.push_back(adjacency[a]);
+				}
+			}
+
+			if ((result.size() - meshletStart) / 3 >= MAX_MESHLET_TRIANGLES)
+				break;
+
+			float axisLength = glm::length(axis);
+			glm::vec3 direction = (axisLength > 0.0f) ? axis / axisLength : glm::vec3(0.0f);
+
+			// Best candidate: fewest new vertices, then closest to the cone axis
+			float bestScore = 0.0f;
+			size_t best = triangleCount;
+			size_t write = 0;
+			for (unsigned int t : candidates)
+			{
+				if (emitted[t])
+					continue;
+				candidates[write++] = t;
+
+				int newVertices = 0;
+				for (int k = 0; k < 3; k++)
+					if (stamp[tris[t * 3 + k]] != meshletId)
+						newVertices++;
+				if (meshletVertices + newVertices > MAX_MESHLET_VERTICES)
+					continue;
+
+				float score = newVertices + (1.0f - glm::dot(direction, faceNormal[t]));
+				if (best == triangleCount || score < bestScore)
+				{
+					bestScore = score;
+					best = t;
+				}
+			}
+			candidates.resize(write);
+
+			// Nothing connected left (a UV seam or a separate part): continue
+			// with nearby triangles of the input order that keep the cone tight
+			if (best == triangleCount)
+			{
+				size_t scanned = 0;
+				for (size_t t = seed; t < triangleCount && scanned < FALLBACK_WINDOW; t++)
+				{
+					if (emitted[t])
+						continue;
+					scanned++;
+
+					int newVertices = 0;
+					for (int k = 0; k < 3; k++)
+						if (stamp[tris[t * 3 + k]] != meshletId)
+							newVertices++;
+					float alignment = glm::dot(direction, faceNormal[t]);
+					if (meshletVertices + newVertices > MAX_MESHLET_VERTICES || alignment < FALLBACK_MIN_COS)
+						continue;
+
+					float score = newVertices + (1.0f - alignment);
+					if (best == triangleCount || score < bestScore)
+					{
+						bestScore = score;
+						best = t;
+					}
+				}
+			}
+
+			if (best == triangleCount)
+				break;
+			next = best;
+		}
+
+		Meshlet meshlet;
+		meshlet.indexOffset = (uint32_t)(indexOffset + meshletStart);
+		meshlet.indexCount = (uint32_t)(result.size() - meshletStart);
+		meshlets.push_back(meshlet);
+	}
+
+	std::copy(result.begin(), result.end(), indices.begin() + indexOffset);
+
+	for (size_t m = meshlets.size() - (size_t)meshletId; m < meshlets.size(); m++)
+		computeBounds(meshlets[m], indices, meshlets[m].indexOffset, meshlets[m].indexOffset + meshlets[m].indexCount, vertices);
+}
+
+//-----------------------------------------------------------------------------
+// Culling happens in model space: the frustum planes are extracted from the
+// model-view-projection matrix (Gribb & Hartmann), and back-facing is
+// invariant under the model transform as long as the eye is in model space.
+//-----------------------------------------------------------------------------
+void Meshlets::cull(const Meshlet* meshlets, size_t meshletCount, const glm::mat4& modelViewProjection,
+	const glm::vec3& eye, bool backfaceCull, size_t indexSize, size_t indexStart,
+	std::vector<GLsizei>& counts, std::vector<const GLvoid*>& offsets, MeshletCullStats& stats)
+{
+	counts.clear();
+	offsets.clear();
+
+	glm::vec4 planes[6];
+	FrustumCuller::extractPlanes(modelViewProjection, planes);
+
+	size_t rangeEnd = 0;
+	for (size_t m = 0; m < meshletCount; m++)
+	{
+		const Meshlet& meshlet = meshlets[m];
+		glm::vec3 center(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+
+		bool outside = false;
+		for (const glm::vec4& plane : planes)
+		{
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -meshlet.radius)
+			{
+				outside = true;
+				break;
+			}
+		}
+		if (outside)
+		{
+			stats.frustumCulled++;
+			continue;
+		}
+
+		// Every triangle faces away if the eye sees the whole sphere from
+		// within the cone's complement: dot(v, axis) >= sin(angle) * |v| for
+		// every v from the eye into the sphere
+		if (backfaceCull && meshlet.coneCutoff <= 1.0f)
+		{
+			glm::vec3 axis(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]);
+			glm::vec3 toCenter = center - eye;
+			if (glm::dot(toCenter, axis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius * (1.0f + meshlet.coneCutoff))
+			{
+				stats.backfaceCulled++;
+				continue;
+			}
+		}
+
+		stats.visible++;
+
+		// Extend the previous range when the meshlets are adjacent
+		if (!counts.empty() && rangeEnd == meshlet.indexOffset)
+		{
+			counts.back() += (GLsizei)meshlet.indexCount;
+		}
+		else
+		{
+			counts.push_back((GLsizei)meshlet.indexCount);
+			offsets.push_back((const GLvoid*)(indexStart + meshlet.indexOffset * indexSize));
+		}
+		rangeEnd = meshlet.indexOffset + meshlet.indexCount;
+	}
+}
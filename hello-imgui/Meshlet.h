@@ -0,0 +1,62 @@
+//-----------------------------------------------------------------------------
+// Meshlet.h
+//
+// Meshlets: small clusters of triangles with a bounding sphere and a normal
+// cone, so whole clusters outside the frustum or facing away from the
+// viewer can be skipped before drawing.
+//-----------------------------------------------------------------------------
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "VertexFormat.h"
+
+const size_t MAX_MESHLET_VERTICES = 64;
+const size_t MAX_MESHLET_TRIANGLES = 124;
+
+// A run of consecutive triangles of the index buffer, with its bounds
+struct Meshlet
+{
+	uint32_t indexOffset;		// in indices
+	uint32_t indexCount;
+
+	float center[3];			// bounding sphere, model space
+	float radius;
+
+	float coneAxis[3];			// average face normal
+	float coneCutoff;			// sine of the cone's half angle, > 1 if the cone cannot be culled
+};
+
+// Meshlet culling results
+struct MeshletCullStats
+{
+	size_t visible;
+	size_t frustumCulled;
+	size_t backfaceCulled;
+};
+
+class Meshlets
+{
+public:
+	// Groups the triangles of indices[indexOffset, indexOffset + indexCount)
+	// into meshlets of at most MAX_MESHLET_VERTICES unique vertices and
+	// MAX_MESHLET_TRIANGLES triangles, reordering them so each meshlet is a
+	// contiguous run, and appends the meshlets to 'meshlets'
+	static void build(std::vector<GLuint>& indices, size_t indexOffset, size_t indexCount,
+		const std::vector<Vertex>& vertices, std::vector<Meshlet>& meshlets);
+
+	// Culls 'meshlets' against the frustum of 'modelViewProjection' and, if
+	// 'backfaceCull' is set, against the model space eye position.  Surviving
+	// runs of triangles are merged and written as glMultiDrawElements ranges,
+	// offset by 'indexStart' bytes.
+	static void cull(const Meshlet* meshlets, size_t meshletCount, const glm::mat4& modelViewProjection,
+		const glm::vec3& eye, bool backfaceCull, size_t indexSize, size_t indexStart,
+		std::vector<GLsizei>& counts, std::vector<const GLvoid*>& offsets, MeshletCullStats& stats);
+};
+#endif // MESHLET_H
@@ -0,0 +1,117 @@
+//-----------------------------------------------------------------------------
+// MipBenchmark.cpp
+//
+// Times MipGenerator's filters against the driver's glGenerateMipmap on a
+// synthetic image, and the GL thread's share of either way of making a
+// mipmapped texture.  Run on the GL thread, it blocks while it measures.
+//-----------------------------------------------------------------------------
+#include "MipBenchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include <fmt/core.h>
+
+#include "MipGenerator.h"
+#include "Texture2D.h"
+
+namespace
+{
+	double elapsedMs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Smooth gradients with fine detail, so no filter gets an easy ride
+	TextureImage makeImage(int size)
+	{
+		TextureImage image;
+		image.width = size;
+		image.height = size;
+		image.components = 4;
+		image.srgb = true;
+		image.pixels.resize((size_t)size * size * 4);
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				unsigned char* texel = &image.pixels[((size_t)y * size + x) * 4];
+				texel[0] = (unsigned char)(x * 255 / size);
+				texel[1] = (unsigned char)(y * 255 / size);
+				texel[2] = (unsigned char)(128.0 + 127.0 * std::sin(x * 0.37) * std::cos(y * 0.23));
+				texel[3] = (unsigned char)(((x ^ y) & 8) ? 255 : 64);
+			}
+		}
+		return image;
+	}
+
+	double timeGenerate(const TextureImage& source, const MipOptions& options, int repeats, TextureImage* chain = nullptr)
+	{
+		double best = 1e30;
+		for (int i = 0; i < repeats; i++)
+		{
+			TextureImage image = source;
+			auto start = std::chrono::steady_clock::now();
+			MipGenerator::generateMips(image, options);
+			best = std::min(best, elapsedMs(start));
+
+			if (chain != nullptr && i == 0)
+				*chain = image;
+		}
+		return best;
+	}
+
+	double timeUpload(const TextureImage& image, int repeats)
+	{
+		double best = 1e30;
+		for (int i = 0; i < repeats; i++)
+		{
+			Texture2D texture;
+			glFinish();
+			auto start = std::chrono::steady_clock::now();
+			texture.upload(image);
+			glFinish();
+			best = std::min(best, elapsedMs(start));
+			texture.destroy();
+		}
+		return best;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// The driver path does all its work on the GL thread, the CPU path only the
+// upload, the chain itself having been built on a loader thread
+//-----------------------------------------------------------------------------
+MipBenchmarkResult MipBenchmark::run(int size, int repeats)
+{
+	MipBenchmarkResult result;
+	result.size = size;
+
+	TextureImage source = makeImage(size);
+	TextureImage chain;
+
+	MipOptions options;
+	options.srgb = false;
+	options.simd = false;
+	result.scalarMs = timeGenerate(source, options, repeats);
+	options.simd = true;
+	result.simdMs = timeGenerate(source, options, repeats, &chain);
+	options.srgb = true;
+	result.srgbMs = timeGenerate(source, options, repeats);
+	options.filter = MIP_FILTER_KAISER;
+	result.kaiserMs = timeGenerate(source, options, repeats);
+
+	result.driverMs = timeUpload(source, repeats);
+	result.uploadMs = timeUpload(chain, repeats);
+
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	fmt::println("Mipmaps of {}x{} on {}, MPixel/s of level 0:", size, size, renderer ? renderer : "?");
+	fmt::println("  CPU box scalar      {:8.2f} ms {:8.1f}", result.scalarMs, result.getRate(result.scalarMs));
+	fmt::println("  CPU box {:<11} {:8.2f} ms {:8.1f}", MipGenerator::getSimdName(), result.simdMs, result.getRate(result.simdMs));
+	fmt::println("  CPU box sRGB        {:8.2f} ms {:8.1f}", result.srgbMs, result.getRate(result.srgbMs));
+	fmt::println("  CPU Kaiser sRGB     {:8.2f} ms {:8.1f}", result.kaiserMs, result.getRate(result.kaiserMs));
+	fmt::println("  GL thread, glGenerateMipmap   {:8.2f} ms", result.driverMs);
+	fmt::println("  GL thread, upload CPU levels  {:8.2f} ms", result.uploadMs);
+	return result;
+}
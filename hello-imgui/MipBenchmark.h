@@ -0,0 +1,34 @@
+//-----------------------------------------------------------------------------
+// MipBenchmark.h
+//
+// Times MipGenerator's filters against the driver's glGenerateMipmap on a
+// synthetic image, and the GL thread's share of either way of making a
+// mipmapped texture.  Run on the GL thread, it blocks while it measures.
+//-----------------------------------------------------------------------------
+#ifndef MIP_BENCHMARK_H
+#define MIP_BENCHMARK_H
+
+struct MipBenchmarkResult
+{
+	int size = 0;				// of the square level 0
+
+	// Whole chain on the CPU, best of the repeats
+	double scalarMs = 0.0;		// linear box, scalar
+	double simdMs = 0.0;		// linear box, SSE2 or NEON
+	double srgbMs = 0.0;		// box in linear light
+	double kaiserMs = 0.0;		// Kaiser in linear light
+
+	// GL thread, until glFinish returns
+	double driverMs = 0.0;		// glTexImage2D of level 0 and glGenerateMipmap
+	double uploadMs = 0.0;		// every level from the CPU chain
+
+	// Level 0 megapixels per second
+	double getRate(double ms) const { return (ms > 0.0) ? (double)size * size / (ms * 1000.0) : 0.0; }
+};
+
+class MipBenchmark
+{
+public:
+	static MipBenchmarkResult run(int size = 2048, int repeats = 5);
+};
+#endif // MIP_BENCHMARK_H
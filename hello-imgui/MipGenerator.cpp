@@ -0,0 +1,443 @@
+//-----------------------------------------------------------------------------
+// MipGenerator.cpp
+//
+// Mip chains of RGBA8 images built on the CPU, for the texture cache and the
+// texture cooker, so the GL thread only uploads levels.  Each level is
+// filtered from the one above: a 2x2 box, the result glGenerateMipmap
+// gives, with SSE2 or NEON where available, or a windowed Kaiser filter.
+// Color may be filtered in linear space and alpha tested coverage kept.
+//-----------------------------------------------------------------------------
+#include "MipGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_GENERATOR_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define MIP_GENERATOR_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+	MipOptions sOptions;
+
+	// 8-bit sRGB to linear, and linear in 1/4095 steps back to 8-bit sRGB
+	struct SrgbTables
+	{
+		float toLinear[256];
+		unsigned char toSrgb[4096];
+
+		SrgbTables()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.0f;
+				toLinear[i] = (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int i = 0; i < 4096; i++)
+			{
+				float c = i / 4095.0f;
+				float s = (c <= 0.0031308f) ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+				toSrgb[i] = (unsigned char)(s * 255.0f + 0.5f);
+			}
+		}
+	};
+
+	const SrgbTables& getSrgbTables()
+	{
+		static SrgbTables tables;
+		return tables;
+	}
+
+	unsigned char toSrgb(const SrgbTables& tables, float linear)
+	{
+		return tables.toSrgb[(int)(std::clamp(linear, 0.0f, 1.0f) * 4095.0f + 0.5f)];
+	}
+
+	unsigned char toUnorm(float value)
+	{
+		return (unsigned char)(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+
+	// Channels holding color, the last one of two and four is alpha
+	int getColorCount(int components)
+	{
+		return (components == 2 || components == 4) ? components - 1 : components;
+	}
+
+	// Halving takes 6 source texels per axis, centred between the middle two
+	const int KAISER_TAPS = 6;
+
+	// Kaiser windowed sinc at half the source rate, window radius 3 texels
+	struct KaiserKernel
+	{
+		float weights[KAISER_TAPS];
+
+		KaiserKernel()
+		{
+			const float beta = 4.0f;
+			const float radius = 3.0f;
+			const float pi = 3.14159265f;
+
+			float sum = 0.0f;
+			for (int i = 0; i < KAISER_TAPS; i++)
+			{
+				float d = (float)i - 2.5f;	// distance from the centre in source texels
+				float x = 0.5f * d;
+				float sinc = std::sin(pi * x) / (pi * x);
+				float t = d / radius;
+				float window = besselI0(beta * std::sqrt(std::max(0.0f, 1.0f - t * t))) / besselI0(beta);
+				weights[i] = sinc * window;
+				sum += weights[i];
+			}
+			for (int i = 0; i < KAISER_TAPS; i++)
+				weights[i] /= sum;
+		}
+
+		static float besselI0(float x)
+		{
+			float sum = 1.0f, term = 1.0f;
+			for (int k = 1; k < 20; k++)
+			{
+				term *= (x / (2.0f * k)) * (x / (2.0f * k));
+				sum += term;
+			}
+			return sum;
+		}
+	};
+
+	const KaiserKernel& getKaiserKernel()
+	{
+		static KaiserKernel kernel;
+		return kernel;
+	}
+}
+
+int MipGenerator::getMipCount(int width, int height)
+{
+	int count = 1;
+	while (width > 1 || height > 1)
+	{
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+		count++;
+	}
+	return count;
+}
+
+size_t MipGenerator::getChainSize(int width, int height, int mipCount, int components)
+{
+	size_t size = 0;
+	for (int level = 0; level < mipCount; level++)
+	{
+		size += (size_t)width * height * components;
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+	return size;
+}
+
+void MipGenerator::downsample(const unsigned char* source, int width, int height, unsigned char* target)
+{
+	downsampleBox(source, width, height, 4, target, true);
+}
+
+void MipGenerator::downsample(const unsigned char* source, int width, int height, unsigned char* target, const MipOptions& options)
+{
+	downsample(source, width, height, 4, target, options, options.srgb);
+}
+
+void MipGenerator::downsample(const unsigned char* source, int width, int height, int components, unsigned char* target,
+	const MipOptions& options, bool srgb)
+{
+	if (options.filter == MIP_FILTER_KAISER)
+		downsampleKaiser(source, width, height, components, target, srgb);
+	else if (srgb)
+		downsampleBoxSrgb(source, width, height, components, target);
+	else
+		downsampleBox(source, width, height, components, target, options.simd);
+}
+
+//-----------------------------------------------------------------------------
+// Each level is filtered from the previous one, already in place.  Alpha is
+// scaled once the chain is complete, so every level filters the original
+// alpha of the one above.
+//-----------------------------------------------------------------------------
+void MipGenerator::generateMips(TextureImage& image)
+{
+	generateMips(image, sOptions);
+}
+
+void MipGenerator::generateMips(TextureImage& image, const MipOptions& options)
+{
+	int components = image.components;
+	if (image.format != 0 || components < 1 || components > 4 || image.mipCount != 1)
+		return;
+
+	bool srgb = options.srgb && image.srgb;
+	int mipCount = getMipCount(image.width, image.height);
+	image.pixels.resize(getChainSize(image.width, image.height, mipCount, components));
+
+	size_t offset = 0;
+	int width = image.width;
+	int height = image.height;
+	for (int level = 1; level < mipCount; level++)
+	{
+		size_t levelSize = (size_t)width * height * components;
+		downsample(&image.pixels[offset], width, height, components, &image.pixels[offset + levelSize], options, srgb);
+
+		offset += levelSize;
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+	image.mipCount = mipCount;
+
+	// Only images with alpha
+	if (options.alphaCutoff > 0.0f && (components == 2 || components == 4))
+	{
+		float coverage = getCoverage(image.pixels.data(), image.width, image.height, components, options.alphaCutoff, 1.0f);
+
+		offset = (size_t)image.width * image.height * components;
+		width = std::max(1, image.width / 2);
+		height = std::max(1, image.height / 2);
+		for (int level = 1; level < mipCount; level++)
+		{
+			preserveCoverage(&image.pixels[offset], width, height, components, options.alphaCutoff, coverage);
+
+			offset += (size_t)width * height * components;
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+	}
+}
+
+void MipGenerator::setOptions(const MipOptions& options)
+{
+	sOptions = options;
+}
+
+const MipOptions& MipGenerator::getOptions()
+{
+	return sOptions;
+}
+
+uint32_t MipGenerator::getOptionsKey(const MipOptions& options)
+{
+	uint32_t cutoff = (uint32_t)(std::clamp(options.alphaCutoff, 0.0f, 1.0f) * 255.0f + 0.5f);
+	return (uint32_t)options.filter | (options.srgb ? 0x10u : 0u) | (cutoff << 8);
+}
+
+const char* MipGenerator::getSimdName()
+{
+#if defined(MIP_GENERATOR_SSE2)
+	return "SSE2";
+#elif defined(MIP_GENERATOR_NEON)
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// (a + b + c + d + 2) / 4 per channel.  For RGBA the vector loops average 4
+// (SSE2) or 2 (NEON) target texels at a time, rounding the same way, and
+// the scalar loop does the rest of the row.
+//-----------------------------------------------------------------------------
+void MipGenerator::downsampleBox(const unsigned char* source, int width, int height, int components, unsigned char* target, bool simd)
+{
+	int targetWidth = std::max(1, width / 2);
+	int targetHeight = std::max(1, height / 2);
+	size_t rowBytes = (size_t)width * components;
+
+	for (int y = 0; y < targetHeight; y++)
+	{
+		const unsigned char* row0 = source + (size_t)std::min(2 * y, height - 1) * rowBytes;
+		const unsigned char* row1 = source + (size_t)std::min(2 * y + 1, height - 1) * rowBytes;
+		unsigned char* out = target + (size_t)y * targetWidth * components;
+
+		int x = 0;
+		if (simd && components == 4 && width >= 2)
+		{
+#if defined(MIP_GENERATOR_SSE2)
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i two = _mm_set1_epi16(2);
+			for (; x + 4 <= targetWidth; x += 4)
+			{
+				__m128i result[2];
+				for (int half = 0; half < 2; half++)
+				{
+					__m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 8 + half * 16));
+					__m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 8 + half * 16));
+
+					// Texels 0, 1 and 2, 3 of the two rows, summed vertically as 16 bits
+					__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+					__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+					// Then horizontally: 0 + 1, 2 + 3
+					__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+					result[half] = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+				}
+				_mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(result[0], result[1]));
+			}
+#elif defined(MIP_GENERATOR_NEON)
+			for (; x + 2 <= targetWidth; x += 2)
+			{
+				uint8x16_t a = vld1q_u8(row0 + x * 8);
+				uint8x16_t b = vld1q_u8(row1 + x * 8);
+
+				uint16x8_t lo = vaddl_u8(vget_low_u8(a), vget_low_u8(b));
+				uint16x8_t hi = vaddl_u8(vget_high_u8(a), vget_high_u8(b));
+				uint16x8_t sum = vaddq_u16(vcombine_u16(vget_low_u16(lo), vget_low_u16(hi)),
+					vcombine_u16(vget_high_u16(lo), vget_high_u16(hi)));
+				vst1_u8(out + x * 4, vrshrn_n_u16(sum, 2));
+			}
+#endif
+		}
+
+		for (; x < targetWidth; x++)
+		{
+			size_t x0 = (size_t)std::min(2 * x, width - 1) * components;
+			size_t x1 = (size_t)std::min(2 * x + 1, width - 1) * components;
+			for (int c = 0; c < components; c++)
+				out[x * components + c] = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// The box average of linear light, so dark and bright texels blend to the
+// brightness the eye sees rather than a darker one
+//-----------------------------------------------------------------------------
+void MipGenerator::downsampleBoxSrgb(const unsigned char* source, int width, int height, int components, unsigned char* target)
+{
+	const SrgbTables& tables = getSrgbTables();
+	int targetWidth = std::max(1, width / 2);
+	int targetHeight = std::max(1, height / 2);
+	int colors = getColorCount(components);
+	size_t rowBytes = (size_t)width * components;
+
+	for (int y = 0; y < targetHeight; y++)
+	{
+		const unsigned char* row0 = source + (size_t)std::min(2 * y, height - 1) * rowBytes;
+		const unsigned char* row1 = source + (size_t)std::min(2 * y + 1, height - 1) * rowBytes;
+		unsigned char* out = target + (size_t)y * targetWidth * components;
+
+		for (int x = 0; x < targetWidth; x++)
+		{
+			size_t x0 = (size_t)std::min(2 * x, width - 1) * components;
+			size_t x1 = (size_t)std::min(2 * x + 1, width - 1) * components;
+			for (int c = 0; c < colors; c++)
+			{
+				float linear = tables.toLinear[row0[x0 + c]] + tables.toLinear[row0[x1 + c]] +
+					tables.toLinear[row1[x0 + c]] + tables.toLinear[row1[x1 + c]];
+				out[x * components + c] = toSrgb(tables, 0.25f * linear);
+			}
+			for (int c = colors; c < components; c++)
+				out[x * components + c] = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Separable: rows into a float buffer, then columns, clamping at the edges.
+// The negative lobes can overshoot, so results are clamped to [0, 1].
+//-----------------------------------------------------------------------------
+void MipGenerator::downsampleKaiser(const unsigned char* source, int width, int height, int components, unsigned char* target, bool srgb)
+{
+	const SrgbTables& tables = getSrgbTables();
+	const KaiserKernel& kernel = getKaiserKernel();
+	int targetWidth = std::max(1, width / 2);
+	int targetHeight = std::max(1, height / 2);
+	int colors = srgb ? getColorCount(components) : 0;
+
+	std::vector<float> texels((size_t)width * height * components);
+	for (size_t i = 0; i < texels.size(); i++)
+		texels[i] = ((int)(i % components) < colors) ? tables.toLinear[source[i]] : source[i] / 255.0f;
+
+	// Rows, unless they are one texel wide
+	std::vector<float> rows((size_t)targetWidth * height * components);
+	for (int y = 0; y < height; y++)
+	{
+		const float* in = &texels[(size_t)y * width * components];
+		float* out = &rows[(size_t)y * targetWidth * components];
+		for (int x = 0; x < targetWidth; x++)
+		{
+			float sum[4] = {};
+			for (int tap = 0; tap < KAISER_TAPS; tap++)
+			{
+				int sx = (width == 1) ? 0 : std::clamp(2 * x - 2 + tap, 0, width - 1);
+				float weight = (width == 1) ? 1.0f / KAISER_TAPS : kernel.weights[tap];
+				for (int c = 0; c < components; c++)
+					sum[c] += weight * in[sx * components + c];
+			}
+			for (int c = 0; c < components; c++)
+				out[x * components + c] = sum[c];
+		}
+	}
+
+	// Then columns
+	for (int y = 0; y < targetHeight; y++)
+	{
+		unsigned char* out = target + (size_t)y * targetWidth * components;
+		for (int x = 0; x < targetWidth; x++)
+		{
+			float sum[4] = {};
+			for (int tap = 0; tap < KAISER_TAPS; tap++)
+			{
+				int sy = (height == 1) ? 0 : std::clamp(2 * y - 2 + tap, 0, height - 1);
+				float weight = (height == 1) ? 1.0f / KAISER_TAPS : kernel.weights[tap];
+				const float* in = &rows[((size_t)sy * targetWidth + x) * components];
+				for (int c = 0; c < components; c++)
+					sum[c] += weight * in[c];
+			}
+			for (int c = 0; c < components; c++)
+				out[x * components + c] = (c < colors) ? toSrgb(tables, sum[c]) : toUnorm(sum[c]);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Averaged alpha fades below an alpha test cutoff, so alpha tested foliage
+// and fences thin out with distance.  Binary search for the alpha scale at
+// which this level passes the test as often as level 0, then apply it.
+//-----------------------------------------------------------------------------
+void MipGenerator::preserveCoverage(unsigned char* level, int width, int height, int components, float cutoff, float coverage)
+{
+	float low = 0.0f, high = 4.0f;
+	for (int i = 0; i < 12; i++)
+	{
+		float scale = 0.5f * (low + high);
+		if (getCoverage(level, width, height, components, cutoff, scale) < coverage)
+			low = scale;
+		else
+			high = scale;
+	}
+
+	// Alpha steps in 1/255, so coverage jumps: take whichever bound is closer
+	float lowError = std::abs(getCoverage(level, width, height, components, cutoff, low) - coverage);
+	float highError = std::abs(getCoverage(level, width, height, components, cutoff, high) - coverage);
+	float scale = (lowError < highError) ? low : high;
+
+	size_t count = (size_t)width * height;
+	unsigned char* alpha = level + components - 1;
+	for (size_t i = 0; i < count; i++)
+		alpha[i * components] = (unsigned char)std::min(255.0f, alpha[i * components] * scale + 0.5f);
+}
+
+// Share of texels whose alpha, times 'scale', passes the test
+float MipGenerator::getCoverage(const unsigned char* level, int width, int height, int components, float cutoff, float scale)
+{
+	size_t count = (size_t)width * height;
+	const unsigned char* alpha = level + components - 1;
+	size_t passed = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (alpha[i * components] * scale >= cutoff * 255.0f)
+			passed++;
+	}
+	return (float)passed / (float)count;
+}
@@ -0,0 +1,71 @@
+//-----------------------------------------------------------------------------
+// MipGenerator.h
+//
+// Mip chains of 8-bit images built on the CPU, for the texture cache and the
+// texture cooker, so the GL thread only uploads levels.  Each level is
+// filtered from the one above: a 2x2 box, the result glGenerateMipmap
+// gives, with SSE2 or NEON where available, or a windowed Kaiser filter.
+// Color may be filtered in linear space and alpha tested coverage kept.
+//-----------------------------------------------------------------------------
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Texture2D.h"
+
+enum MipFilter
+{
+	MIP_FILTER_BOX = 0,			// 2x2 average
+	MIP_FILTER_KAISER = 1		// 6x6 Kaiser windowed sinc, sharper minified detail
+};
+
+struct MipOptions
+{
+	MipFilter filter = MIP_FILTER_BOX;
+	bool srgb = true;			// filter the color of sRGB images as linear light, alpha stays linear
+	float alphaCutoff = 0.0f;	// above 0, scale the alpha of each level so as many texels pass an alpha test at this cutoff as on level 0
+	bool simd = true;			// the vector box filter when there is one, same result as the scalar one
+};
+
+class MipGenerator
+{
+public:
+	// Levels down to 1x1
+	static int getMipCount(int width, int height);
+
+	// Bytes of 'mipCount' levels
+	static size_t getChainSize(int width, int height, int mipCount, int components = 4);
+
+	// Writes the next smaller level of the RGBA8 'source' to 'target'.  An
+	// odd last row or column is dropped, a side of 1 is kept.  Without
+	// options, a linear box filter; with them, the source is taken as sRGB.
+	static void downsample(const unsigned char* source, int width, int height, unsigned char* target);
+	static void downsample(const unsigned char* source, int width, int height, unsigned char* target, const MipOptions& options);
+
+	// Appends every smaller level to the single level of 'image', of one to
+	// four channels.  Without options, those set with setOptions.
+	static void generateMips(TextureImage& image);
+	static void generateMips(TextureImage& image, const MipOptions& options);
+
+	// Used by generateMips for every texture, set before any is loaded
+	static void setOptions(const MipOptions& options);
+	static const MipOptions& getOptions();
+
+	// Identifies the options that change the pixels, for the texture cache
+	static uint32_t getOptionsKey(const MipOptions& options);
+
+	// "SSE2", "NEON" or "scalar"
+	static const char* getSimdName();
+
+private:
+	static void downsample(const unsigned char* source, int width, int height, int components, unsigned char* target,
+		const MipOptions& options, bool srgb);
+	static void downsampleBox(const unsigned char* source, int width, int height, int components, unsigned char* target, bool simd);
+	static void downsampleBoxSrgb(const unsigned char* source, int width, int height, int components, unsigned char* target);
+	static void downsampleKaiser(const unsigned char* source, int width, int height, int components, unsigned char* target, bool srgb);
+	static void preserveCoverage(unsigned char* level, int width, int height, int components, float cutoff, float coverage);
+	static float getCoverage(const unsigned char* level, int width, int height, int components, float cutoff, float scale);
+};
+#endif // MIP_GENERATOR_H
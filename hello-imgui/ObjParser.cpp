@@ -0,0 +1,640 @@
+//-----------------------------------------------------------------------------
+// ObjParser.cpp
+//
+// Multithreaded streaming Wavefront OBJ parser.  The file is memory mapped,
+// split on line boundaries and the chunks are parsed in parallel.
+//-----------------------------------------------------------------------------
+#include "ObjParser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <utility>
+
+#include <fmt/core.h>
+
+#include "MappedFile.h"
+
+namespace
+{
+	// Chunks smaller than this are not worth a thread of their own
+	const size_t MIN_CHUNK_BYTES = 256 * 1024;
+
+	// Flags marking which indices of a corner were relative (negative) in the file
+	const uint8_t RELATIVE_VERTEX = 1;
+	const uint8_t RELATIVE_NORMAL = 2;
+	const uint8_t RELATIVE_TEXCOORD = 4;
+
+	// Powers of ten that are exactly representable as a double
+	const double POW10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	//-------------------------------------------------------------------------
+	// Result of parsing one chunk.  Relative indices are resolved against the
+	// chunk's own attribute counts and fixed up once every chunk is done.
+	//-------------------------------------------------------------------------
+	struct ObjChunk
+	{
+		const char* begin;
+		const char* end;
+
+		std::vector<float> positions;
+		std::vector<float> normals;
+		std::vector<float> texcoords;
+
+		std::vector<ObjIndex> corners;			// polygon corners, not yet triangulated
+		std::vector<uint8_t> relative;			// RELATIVE_* flags per corner
+		std::vector<uint32_t> faceSizes;		// corners per polygon
+		size_t numTriangles = 0;
+		size_t fannedPolygons = 0;
+		size_t numLines = 0;
+
+		// usemtl lines as (first polygon, name), resolved to material
+		// indices once every chunk is parsed
+		std::vector<std::pair<size_t, std::string>> materialSwitches;
+		std::vector<std::string> materialLibraries;
+		int firstMaterial = -1;			// in effect at the start of the chunk
+		std::vector<int> switchMaterials;
+
+		// Global attribute offsets, first output triangle and first file line
+		// (zero-based) of this chunk
+		size_t positionBase = 0, normalBase = 0, texcoordBase = 0;
+		size_t triangleBase = 0;
+		size_t lineBase = 0;
+
+		std::string error;
+		size_t errorLine = 0;	// one-based, within the chunk
+	};
+
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t';
+	}
+
+	inline const char* skipSpace(const char* p, const char* end)
+	{
+		while (p < end && isSpace(*p))
+			p++;
+		return p;
+	}
+
+	//-------------------------------------------------------------------------
+	// Parses a signed decimal integer, returns nullptr if there is none
+	//-------------------------------------------------------------------------
+	const char* parseInt(const char* p, const char* end, int& value)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = (*p == '-');
+			p++;
+		}
+
+		if (p >= end || *p < '0' || *p > '9')
+			return nullptr;
+
+		int result = 0;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			result = result * 10 + (*p - '0');
+			p++;
+		}
+
+		value = negative ? -result : result;
+		return p;
+	}
+
+	//-------------------------------------------------------------------------
+	// Parses up to 'count' floats of a v/vn/vt line into 'out'.  Missing
+	// components are written as zero, extra components are ignored.
+	//-------------------------------------------------------------------------
+	void parseFloats(const char* p, const char* end, int count, std::vector<float>& out)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			float value = 0.0f;
+			const char* next = ObjParser::parseFloat(p, end, value);
+			if (next != nullptr)
+				p = next;
+			out.push_back(value);
+		}
+	}
+
+	//-------------------------------------------------------------------------
+	// Converts a one-based or negative OBJ index into a zero-based index,
+	// relative to 'count' attributes seen so far in this chunk if negative.
+	//-------------------------------------------------------------------------
+	inline bool toZeroBased(int value, size_t count, int& index, bool& relative)
+	{
+		if (value > 0)
+		{
+			index = value - 1;
+			relative = false;
+			return true;
+		}
+		if (value < 0)
+		{
+			index = (int)count + value;
+			relative = true;
+			return true;
+		}
+		return false;
+	}
+
+	//-------------------------------------------------------------------------
+	// Parses the corners of an 'f' line: v, v/vt, v//vn or v/vt/vn
+	//-------------------------------------------------------------------------
+	bool parseFace(const char* p, const char* end, ObjChunk& chunk)
+	{
+		size_t numPositions = chunk.positions.size() / 3;
+		size_t numNormals = chunk.normals.size() / 3;
+		size_t numTexcoords = chunk.texcoords.size() / 2;
+
+		uint32_t faceSize = 0;
+		for (;;)
+		{
+			p = skipSpace(p, end);
+			if (p >= end || *p == '\r' || *p == '#')
+				break;
+
+			ObjIndex corner = { -1, -1, -1 };
+			uint8_t flags = 0;
+			bool relative = false;
+			int value = 0;
+
+			p = parseInt(p, end, value);
+			if (p == nullptr || !toZeroBased(value, numPositions, corner.vertex, relative))
+				return false;
+			if (relative)
+				flags |= RELATIVE_VERTEX;
+
+			if (p < end && *p == '/')
+			{
+				p++;
+				if (p < end && *p != '/')
+				{
+					p = parseInt(p, end, value);
+					if (p == nullptr || !toZeroBased(value, numTexcoords, corner.texcoord, relative))
+						return false;
+					if (relative)
+						flags |= RELATIVE_TEXCOORD;
+				}
+
+				if (p < end && *p == '/')
+				{
+					p++;
+					p = parseInt(p, end, value);
+					if (p == nullptr || !toZeroBased(value, numNormals, corner.normal, relative))
+						return false;
+					if (relative)
+						flags |= RELATIVE_NORMAL;
+				}
+			}
+
+			chunk.corners.push_back(corner);
+			chunk.relative.push_back(flags);
+			faceSize++;
+		}
+
+		if (faceSize < 3)
+		{
+			// Points and lines are not rendered
+			chunk.corners.resize(chunk.corners.size() - faceSize);
+			chunk.relative.resize(chunk.relative.size() - faceSize);
+			return true;
+		}
+
+		chunk.faceSizes.push_back(faceSize);
+		chunk.numTriangles += faceSize - 2;
+		if (faceSize > 4)
+			chunk.fannedPolygons++;
+		return true;
+	}
+
+	//-------------------------------------------------------------------------
+	// The rest of a usemtl or mtllib line, without surrounding blanks
+	//-------------------------------------------------------------------------
+	std::string parseName(const char* p, const char* end)
+	{
+		p = skipSpace(p, end);
+		while (end > p && (isSpace(end[-1]) || end[-1] == '\r'))
+			end--;
+		return std::string(p, end);
+	}
+
+	inline bool startsWithKeyword(const char* s, const char* lineEnd, const char* keyword, size_t length)
+	{
+		return (size_t)(lineEnd - s) > length && std::memcmp(s, keyword, length) == 0 && isSpace(s[length]);
+	}
+
+	//-------------------------------------------------------------------------
+	// Pass 1: parse every line of the chunk
+	//-------------------------------------------------------------------------
+	void parseChunk(ObjChunk& chunk)
+	{
+		const char* p = chunk.begin;
+		size_t lineNumber = 0;
+
+		while (p < chunk.end)
+		{
+			const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', chunk.end - p));
+			if (lineEnd == nullptr)
+				lineEnd = chunk.end;
+			lineNumber++;
+
+			const char* s = skipSpace(p, lineEnd);
+			if (lineEnd - s >= 2 && s[0] == 'v')
+			{
+				if (isSpace(s[1]))
+					parseFloats(s + 2, lineEnd, 3, chunk.positions);
+				else if (s[1] == 'n' && lineEnd - s >= 3 && isSpace(s[2]))
+					parseFloats(s + 3, lineEnd, 3, chunk.normals);
+				else if (s[1] == 't' && lineEnd - s >= 3 && isSpace(s[2]))
+					parseFloats(s + 3, lineEnd, 2, chunk.texcoords);
+			}
+			else if (lineEnd - s >= 2 && s[0] == 'f' && isSpace(s[1]))
+			{
+				if (!parseFace(s + 2, lineEnd, chunk))
+				{
+					chunk.error = fmt::format("invalid face '{}'", parseName(s, lineEnd));
+					chunk.errorLine = lineNumber;
+					return;
+				}
+			}
+			else if (startsWithKeyword(s, lineEnd, "usemtl", 6))
+			{
+				chunk.materialSwitches.emplace_back(chunk.faceSizes.size(), parseName(s + 7, lineEnd));
+			}
+			else if (startsWithKeyword(s, lineEnd, "mtllib", 6))
+			{
+				chunk.materialLibraries.push_back(parseName(s + 7, lineEnd));
+			}
+
+			p = lineEnd + 1;
+		}
+
+		chunk.numLines = lineNumber;
+	}
+
+	//-------------------------------------------------------------------------
+	// One-based line of the chunk's 'polygon'-th face.  Only used to report
+	// errors, so the faces are parsed again rather than recording every line.
+	//-------------------------------------------------------------------------
+	size_t findFaceLine(const ObjChunk& chunk, size_t polygon)
+	{
+		ObjChunk scratch;
+		const char* p = chunk.begin;
+		size_t lineNumber = 0;
+
+		while (p < chunk.end)
+		{
+			const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', chunk.end - p));
+			if (lineEnd == nullptr)
+				lineEnd = chunk.end;
+			lineNumber++;
+
+			const char* s = skipSpace(p, lineEnd);
+			if (lineEnd - s >= 2 && s[0] == 'f' && isSpace(s[1]))
+			{
+				parseFace(s + 2, lineEnd, scratch);
+				if (scratch.faceSizes.size() > polygon)
+					return lineNumber;
+			}
+
+			p = lineEnd + 1;
+		}
+		return 0;
+	}
+
+	//-------------------------------------------------------------------------
+	// Resolves a chunk-relative index to a global one and range checks it
+	//-------------------------------------------------------------------------
+	inline bool resolve(int& index, bool relative, size_t base, size_t count)
+	{
+		if (index == -1 && !relative)
+			return true;	// attribute not present
+
+		long long global = relative ? (long long)base + index : (long long)index;
+		if (global < 0 || global >= (long long)count)
+			return false;
+
+		index = (int)global;
+		return true;
+	}
+
+	//-------------------------------------------------------------------------
+	// Pass 2: resolve indices and triangulate the chunk's polygons into the
+	// output, starting at the chunk's first triangle.
+	//-------------------------------------------------------------------------
+	void resolveChunk(ObjChunk& chunk, ObjData& data)
+	{
+		size_t numPositions = data.positions.size() / 3;
+		size_t numNormals = data.normals.size() / 3;
+		size_t numTexcoords = data.texcoords.size() / 2;
+
+		size_t i = 0;
+		for (size_t polygon = 0; polygon < chunk.faceSizes.size(); polygon++)
+		{
+			for (size_t last = i + chunk.faceSizes[polygon]; i < last; i++)
+			{
+				ObjIndex& c = chunk.corners[i];
+				uint8_t flags = chunk.relative[i];
+
+				if (!resolve(c.vertex, (flags & RELATIVE_VERTEX) != 0, chunk.positionBase, numPositions) ||
+					!resolve(c.normal, (flags & RELATIVE_NORMAL) != 0, chunk.normalBase, numNormals) ||
+					!resolve(c.texcoord, (flags & RELATIVE_TEXCOORD) != 0, chunk.texcoordBase, numTexcoords))
+				{
+					chunk.error = "face index out of range";
+					chunk.errorLine = findFaceLine(chunk, polygon);
+					return;
+				}
+			}
+		}
+
+		ObjIndex* out = &data.corners[chunk.triangleBase * 3];
+		const ObjIndex* face = chunk.corners.data();
+		const float* positions = data.positions.data();
+
+		int* triangleMaterial = &data.triangleMaterials[chunk.triangleBase];
+		int material = chunk.firstMaterial;
+		size_t nextSwitch = 0;
+
+		for (size_t polygon = 0; polygon < chunk.faceSizes.size(); polygon++)
+		{
+			while (nextSwitch < chunk.materialSwitches.size() && chunk.materialSwitches[nextSwitch].first == polygon)
+				material = chunk.switchMaterials[nextSwitch++];
+
+			uint32_t faceSize = chunk.faceSizes[polygon];
+			for (uint32_t k = 2; k < faceSize; k++)
+				*triangleMaterial++ = material;
+
+			if (faceSize == 4)
+			{
+				// Split the quad along its shorter diagonal, same as tinyobjloader
+				const float* v0 = &positions[3 * face[0].vertex];
+				const float* v1 = &positions[3 * face[1].vertex];
+				const float* v2 = &positions[3 * face[2].vertex];
+				const float* v3 = &positions[3 * face[3].vertex];
+
+				float e02x = v2[0] - v0[0], e02y = v2[1] - v0[1], e02z = v2[2] - v0[2];
+				float e13x = v3[0] - v1[0], e13y = v3[1] - v1[1], e13z = v3[2] - v1[2];
+				float sqr02 = e02x * e02x + e02y * e02y + e02z * e02z;
+				float sqr13 = e13x * e13x + e13y * e13y + e13z * e13z;
+
+				if (sqr02 < sqr13)
+				{
+					*out++ = face[0]; *out++ = face[1]; *out++ = face[2];
+					*out++ = face[0]; *out++ = face[2]; *out++ = face[3];
+				}
+				else
+				{
+					*out++ = face[0]; *out++ = face[1]; *out++ = face[3];
+					*out++ = face[1]; *out++ = face[2]; *out++ = face[3];
+				}
+			}
+			else
+			{
+				// Triangles, and a fan for larger polygons.  Assumes they are
+				// convex; see ObjData::fannedPolygons.
+				for (uint32_t k = 1; k + 1 < faceSize; k++)
+				{
+					*out++ = face[0];
+					*out++ = face[k];
+					*out++ = face[k + 1];
+				}
+			}
+
+			face += faceSize;
+		}
+	}
+
+	//-------------------------------------------------------------------------
+	// Runs 'job' on every chunk, the first one on the calling thread
+	//-------------------------------------------------------------------------
+	template <typename Job>
+	void runChunks(std::vector<ObjChunk>& chunks, Job job)
+	{
+		std::vector<std::thread> threads;
+		threads.reserve(chunks.size());
+
+		for (size_t i = 1; i < chunks.size(); i++)
+			threads.emplace_back(job, std::ref(chunks[i]));
+
+		job(chunks[0]);
+
+		for (std::thread& thread : threads)
+			thread.join();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Parses a float without touching the C locale: [+-]digits[.digits][e[+-]digits]
+// Returns a pointer past the number, or nullptr if there is no number.
+//-----------------------------------------------------------------------------
+const char* ObjParser::parseFloat(const char* p, const char* end, float& value)
+{
+	p = skipSpace(p, end);
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = (*p == '-');
+		p++;
+	}
+
+	uint64_t mantissa = 0;
+	int significantDigits = 0;
+	int exponent = 0;
+	bool anyDigits = false;
+
+	// Integer part.  Digits beyond what fits in the mantissa only scale it.
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		anyDigits = true;
+		if (significantDigits < 19)
+		{
+			mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+			if (mantissa != 0)
+				significantDigits++;
+		}
+		else
+		{
+			exponent++;
+		}
+		p++;
+	}
+
+	// Fractional part
+	if (p < end && *p == '.')
+	{
+		p++;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			anyDigits = true;
+			if (significantDigits < 19)
+			{
+				mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+				if (mantissa != 0)
+					significantDigits++;
+				exponent--;
+			}
+			p++;
+		}
+	}
+
+	if (!anyDigits)
+		return nullptr;
+
+	// Exponent
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		int e = 0;
+		const char* next = parseInt(p + 1, end, e);
+		if (next != nullptr)
+		{
+			exponent += e;
+			p = next;
+		}
+	}
+
+	// With a mantissa below 2^53 and |exponent| <= 22 a single multiply or
+	// divide by an exact power of ten is correctly rounded.
+	double result = (double)mantissa;
+	if (exponent < 0)
+		result = (exponent >= -22) ? result / POW10[-exponent] : result * std::pow(10.0, exponent);
+	else if (exponent > 0)
+		result = (exponent <= 22) ? result * POW10[exponent] : result * std::pow(10.0, exponent);
+
+	value = (float)(negative ? -result : result);
+	return p;
+}
+
+//-----------------------------------------------------------------------------
+// Parses a Wavefront OBJ file into triangulated attribute/index streams.
+// Geometry (v, vn, vt, f) and material references (mtllib, usemtl) are
+// read, everything else is skipped.
+//-----------------------------------------------------------------------------
+bool ObjParser::parse(const std::string& filename, ObjData& data, unsigned int maxThreads)
+{
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		fmt::println("ObjParser: unable to open '{}'", filename);
+		return false;
+	}
+
+	const char* text = reinterpret_cast<const char*>(file.data());
+	size_t size = file.size();
+
+	if (maxThreads == 0)
+		maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	size_t numChunks = std::min<size_t>(maxThreads, std::max<size_t>(1, size / MIN_CHUNK_BYTES));
+
+	// Split on line boundaries
+	std::vector<ObjChunk> chunks(numChunks);
+	const char* begin = text;
+	for (size_t i = 0; i < numChunks; i++)
+	{
+		const char* end = text + size;
+		if (i + 1 < numChunks)
+		{
+			end = text + size * (i + 1) / numChunks;
+			if (end < begin)
+				end = begin;
+			const char* newline = static_cast<const char*>(std::memchr(end, '\n', text + size - end));
+			end = (newline != nullptr) ? newline + 1 : text + size;
+		}
+
+		chunks[i].begin = begin;
+		chunks[i].end = end;
+		begin = end;
+	}
+
+	runChunks(chunks, parseChunk);
+
+	// Global offsets of every chunk.  Every chunk before the first failed one
+	// was parsed to its end, so its line count is complete.
+	size_t numPositions = 0, numNormals = 0, numTexcoords = 0, numTriangles = 0, numLines = 0;
+	data.fannedPolygons = 0;
+	for (ObjChunk& chunk : chunks)
+	{
+		chunk.lineBase = numLines;
+		if (!chunk.error.empty())
+		{
+			fmt::println("ObjParser: '{}': {} on line {}", filename, chunk.error, chunk.lineBase + chunk.errorLine);
+			return false;
+		}
+
+		chunk.positionBase = numPositions;
+		chunk.normalBase = numNormals;
+		chunk.texcoordBase = numTexcoords;
+		chunk.triangleBase = numTriangles;
+
+		numPositions += chunk.positions.size() / 3;
+		numNormals += chunk.normals.size() / 3;
+		numTexcoords += chunk.texcoords.size() / 2;
+		numTriangles += chunk.numTriangles;
+		numLines += chunk.numLines;
+		data.fannedPolygons += chunk.fannedPolygons;
+	}
+
+	// Number the materials in order of first use; a chunk starts with the
+	// material the previous chunks left in effect
+	data.materialLibraries.clear();
+	data.materialNames.clear();
+	int currentMaterial = -1;
+	for (ObjChunk& chunk : chunks)
+	{
+		data.materialLibraries.insert(data.materialLibraries.end(), chunk.materialLibraries.begin(), chunk.materialLibraries.end());
+
+		chunk.firstMaterial = currentMaterial;
+		for (const auto& materialSwitch : chunk.materialSwitches)
+		{
+			auto name = std::find(data.materialNames.begin(), data.materialNames.end(), materialSwitch.second);
+			currentMaterial = (int)(name - data.materialNames.begin());
+			if (name == data.materialNames.end())
+				data.materialNames.push_back(materialSwitch.second);
+			chunk.switchMaterials.push_back(currentMaterial);
+		}
+	}
+
+	// Merge the attributes
+	data.positions.clear();
+	data.normals.clear();
+	data.texcoords.clear();
+	data.positions.reserve(numPositions * 3);
+	data.normals.reserve(numNormals * 3);
+	data.texcoords.reserve(numTexcoords * 2);
+
+	for (ObjChunk& chunk : chunks)
+	{
+		data.positions.insert(data.positions.end(), chunk.positions.begin(), chunk.positions.end());
+		data.normals.insert(data.normals.end(), chunk.normals.begin(), chunk.normals.end());
+		data.texcoords.insert(data.texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+
+		std::vector<float>().swap(chunk.positions);
+		std::vector<float>().swap(chunk.normals);
+		std::vector<float>().swap(chunk.texcoords);
+	}
+
+	// Resolve and triangulate in parallel, each chunk owns its output range
+	data.corners.resize(numTriangles * 3);
+	data.triangleMaterials.resize(numTriangles);
+	runChunks(chunks, [&data](ObjChunk& chunk) { resolveChunk(chunk, data); });
+
+	for (const ObjChunk& chunk : chunks)
+	{
+		if (!chunk.error.empty())
+		{
+			fmt::println("ObjParser: '{}': {} on line {}", filename, chunk.error, chunk.lineBase + chunk.errorLine);
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,48 @@
+//-----------------------------------------------------------------------------
+// ObjParser.h
+//
+// Multithreaded streaming Wavefront OBJ parser.  The file is memory mapped,
+// split on line boundaries and the chunks are parsed in parallel.
+//-----------------------------------------------------------------------------
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include <string>
+#include <vector>
+
+// Zero-based attribute indices of a face corner, -1 = not present
+struct ObjIndex
+{
+	int vertex;
+	int normal;
+	int texcoord;
+};
+
+// Triangulated OBJ geometry, laid out like tinyobj::attrib_t
+struct ObjData
+{
+	std::vector<float> positions;	// xyz
+	std::vector<float> normals;		// xyz
+	std::vector<float> texcoords;	// uv
+	std::vector<ObjIndex> corners;	// 3 per triangle
+
+	std::vector<std::string> materialLibraries;	// mtllib files, relative to the OBJ
+	std::vector<std::string> materialNames;		// usemtl names, in order of first use
+	std::vector<int> triangleMaterials;			// index into materialNames per triangle, -1 = none
+
+	// Polygons of more than 4 corners are split as a fan from their first
+	// corner, which is only correct for convex polygons.  tinyobjloader
+	// ear clips them instead, so their triangles differ from its output.
+	size_t fannedPolygons = 0;
+};
+
+class ObjParser
+{
+public:
+	// Parses 'filename' using up to 'maxThreads' threads (0 = one per core)
+	static bool parse(const std::string& filename, ObjData& data, unsigned int maxThreads = 0);
+
+	// Locale-free float parsing, exposed for verification
+	static const char* parseFloat(const char* p, const char* end, float& value);
+};
+#endif // OBJ_PARSER_H
@@ -0,0 +1,227 @@
+//-----------------------------------------------------------------------------
+// ProgramCache.cpp
+//
+// Versioned binary shader program cache.  Holds the driver's linked program
+// binary (glGetProgramBinary) so a warm start loads it with glProgramBinary
+// instead of compiling and linking the GLSL again.
+//-----------------------------------------------------------------------------
+#include "ProgramCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace
+{
+	const char PROGRAM_CACHE_MAGIC[4] = { 'P', 'R', 'G', 'C' };
+
+	// Set by ProgramCache::init, 0 while binaries are unsupported
+	GLint gBinaryFormats = 0;
+
+	// The binary starts 16 byte aligned, right after the header
+	const uint64_t BINARY_OFFSET = (sizeof(ProgramCacheHeader) + 15) & ~(uint64_t)15;
+
+	// 64-bit FNV-1a, continued from 'hash', over the bytes and a terminator
+	// so "ab" + "c" and "a" + "bc" differ
+	uint64_t hashString(uint64_t hash, const char* text, size_t length)
+	{
+		for (size_t i = 0; i < length; i++)
+		{
+			hash ^= (unsigned char)text[i];
+			hash *= 1099511628211ull;
+		}
+		hash ^= 0xff;
+		hash *= 1099511628211ull;
+		return hash;
+	}
+
+	uint64_t hashGLString(uint64_t hash, GLenum name)
+	{
+		const char* text = (const char*)glGetString(name);
+		return hashString(hash, text != nullptr ? text : "", text != nullptr ? std::strlen(text) : 0);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+ProgramCache::ProgramCache()
+	: mHeader(nullptr)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+ProgramCache::~ProgramCache()
+{
+	close();
+}
+
+//-----------------------------------------------------------------------------
+// GL_ARB_get_program_binary names its functions like GL 4.1 core does, so
+// on an older context they are loaded into glad's core function pointers.
+//-----------------------------------------------------------------------------
+void ProgramCache::init(GLADloadproc loader)
+{
+	bool functions = GLAD_GL_VERSION_4_1 != 0;
+	if (!functions)
+	{
+		GLint extensionCount = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+		for (GLint i = 0; i < extensionCount && !functions; i++)
+		{
+			const char* name = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+			functions = name != nullptr && std::strcmp(name, "GL_ARB_get_program_binary") == 0;
+		}
+
+		if (functions)
+		{
+			glad_glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)loader("glGetProgramBinary");
+			glad_glProgramBinary = (PFNGLPROGRAMBINARYPROC)loader("glProgramBinary");
+			glad_glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)loader("glProgramParameteri");
+			functions = glad_glGetProgramBinary != nullptr && glad_glProgramBinary != nullptr && glad_glProgramParameteri != nullptr;
+		}
+	}
+
+	gBinaryFormats = 0;
+	if (functions)
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &gBinaryFormats);
+
+	fmt::println("Program cache: {}", (gBinaryFormats > 0) ? "binaries kept between runs" :
+		functions ? "driver has no binary formats" : "no GL 4.1 or GL_ARB_get_program_binary");
+}
+
+bool ProgramCache::isSupported()
+{
+	return gBinaryFormats > 0;
+}
+
+uint64_t ProgramCache::makeKey(const std::string& vsSource, const std::string& fsSource)
+{
+	uint64_t hash = 14695981039346656037ull;
+	hash = hashString(hash, vsSource.data(), vsSource.size());
+	hash = hashString(hash, fsSource.data(), fsSource.size());
+	hash = hashGLString(hash, GL_VENDOR);
+	hash = hashGLString(hash, GL_RENDERER);
+	hash = hashGLString(hash, GL_VERSION);
+	return hash;
+}
+
+//-----------------------------------------------------------------------------
+// Cache files live next to the vertex shader and name both shaders, e.g.
+// shaders/lighting_spot_instanced.vert+lighting_spot.frag.progbin
+//-----------------------------------------------------------------------------
+std::string ProgramCache::cacheFilename(const std::string& vsFilename, const std::string& fsFilename)
+{
+	return vsFilename + "+" + std::filesystem::path(fsFilename).filename().string() + ".progbin";
+}
+
+//-----------------------------------------------------------------------------
+// Maps the cache file.  It is only accepted if its version and key match;
+// whether the driver still takes the binary is up to glProgramBinary.
+//-----------------------------------------------------------------------------
+bool ProgramCache::open(const std::string& filename, uint64_t key)
+{
+	close();
+
+	if (!mFile.open(filename))
+		return false;
+
+	if (mFile.size() < sizeof(ProgramCacheHeader))
+	{
+		close();
+		return false;
+	}
+
+	const ProgramCacheHeader* header = reinterpret_cast<const ProgramCacheHeader*>(mFile.data());
+
+	bool valid = std::memcmp(header->magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC)) == 0 &&
+		header->version == PROGRAM_CACHE_VERSION &&
+		header->key == key &&
+		header->binaryBytes > 0 &&
+		header->binaryOffset >= sizeof(ProgramCacheHeader) &&
+		header->binaryOffset + header->binaryBytes <= mFile.size();
+
+	if (!valid)
+	{
+		close();
+		return false;
+	}
+
+	mHeader = header;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Unmaps the cache file
+//-----------------------------------------------------------------------------
+void ProgramCache::close()
+{
+	mHeader = nullptr;
+	mFile.close();
+}
+
+//-----------------------------------------------------------------------------
+// Writes the binary of 'program' under a temporary name that is renamed once
+// complete
+//-----------------------------------------------------------------------------
+bool ProgramCache::write(const std::string& filename, uint64_t key, GLuint program, double compileMs)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+
+	std::vector<unsigned char> binary((size_t)length);
+	GLenum binaryFormat = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(program, length, &written, &binaryFormat, binary.data());
+	if (written <= 0)
+		return false;
+
+	ProgramCacheHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+	header.version = PROGRAM_CACHE_VERSION;
+	header.key = key;
+	header.binaryFormat = (uint32_t)binaryFormat;
+	header.binaryOffset = BINARY_OFFSET;
+	header.binaryBytes = (uint64_t)written;
+	header.compileMs = compileMs;
+
+	std::string tempFilename = filename + ".tmp";
+
+	std::ofstream file(tempFilename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		fmt::println("Unable to write program cache '{}'", filename);
+		return false;
+	}
+
+	const char padding[16] = {};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(padding, (std::streamsize)(header.binaryOffset - sizeof(header)));
+	file.write(reinterpret_cast<const char*>(binary.data()), (std::streamsize)header.binaryBytes);
+	file.close();
+
+	std::error_code ec;
+	if (file.fail())
+	{
+		std::filesystem::remove(tempFilename, ec);
+		fmt::println("Unable to write program cache '{}'", filename);
+		return false;
+	}
+
+	std::filesystem::rename(tempFilename, filename, ec);
+	if (ec)
+	{
+		std::filesystem::remove(tempFilename, ec);
+		return false;
+	}
+
+	return true;
+}
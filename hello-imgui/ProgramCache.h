@@ -0,0 +1,75 @@
+//-----------------------------------------------------------------------------
+// ProgramCache.h
+//
+// Versioned binary shader program cache.  Holds the driver's linked program
+// binary (glGetProgramBinary) so a warm start loads it with glProgramBinary
+// instead of compiling and linking the GLSL again.
+//-----------------------------------------------------------------------------
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <glad/glad.h>
+
+#include "MappedFile.h"
+
+// Bump whenever the layout of the cache changes
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+struct ProgramCacheHeader
+{
+	char     magic[4];			// "PRGC"
+	uint32_t version;
+
+	uint64_t key;				// see makeKey
+	uint32_t binaryFormat;		// as glGetProgramBinary returned it
+	uint32_t reserved;
+	uint64_t binaryOffset;
+	uint64_t binaryBytes;
+
+	double   compileMs;			// compile and link time of the source it was made from
+};
+
+class ProgramCache
+{
+public:
+	ProgramCache();
+	~ProgramCache();
+
+	// Program binaries need GL 4.1 or GL_ARB_get_program_binary, whose
+	// functions glad only loads for a 4.1 context.  Call once the GL is
+	// loaded, with the loader for the extension's functions.
+	static void init(GLADloadproc loader);
+
+	// init found the functions and the driver has at least one format
+	static bool isSupported();
+
+	// FNV-1a of the shaders' source, after includes, and of the GL vendor,
+	// renderer and version strings, so a driver update misses the cache.
+	// The shaders have no defines of their own; any would be in the source.
+	static uint64_t makeKey(const std::string& vsSource, const std::string& fsSource);
+
+	// Maps the cache file if it exists and was made for 'key'
+	bool open(const std::string& filename, uint64_t key);
+	void close();
+	bool isOpen() const { return mHeader != nullptr; }
+
+	// Stores the binary of the linked 'program', which must have been linked
+	// with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+	static bool write(const std::string& filename, uint64_t key, GLuint program, double compileMs);
+	static std::string cacheFilename(const std::string& vsFilename, const std::string& fsFilename);
+
+	const ProgramCacheHeader& getHeader() const { return *mHeader; }
+	const unsigned char* getBinary() const      { return mFile.data() + mHeader->binaryOffset; }
+
+private:
+	ProgramCache(const ProgramCache& rhs);
+	ProgramCache& operator= (const ProgramCache& rhs) { return *this; }
+
+	MappedFile mFile;
+	const ProgramCacheHeader* mHeader;
+};
+#endif // PROGRAM_CACHE_H
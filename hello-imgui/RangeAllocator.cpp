@@ -0,0 +1,133 @@
+//-----------------------------------------------------------------------------
+// RangeAllocator.cpp
+//
+// Best-fit allocator of ranges within a linear address space, e.g. a GL
+// buffer.  Only the bookkeeping lives here; the memory belongs to the user.
+//-----------------------------------------------------------------------------
+#include "RangeAllocator.h"
+
+#include <cassert>
+#include <iterator>
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+RangeAllocator::RangeAllocator(size_t capacity)
+	: mCapacity(0),
+	  mUsed(0)
+{
+	reset(capacity);
+}
+
+void RangeAllocator::reset(size_t capacity)
+{
+	mFreeByOffset.clear();
+	mFreeBySize.clear();
+	mCapacity = capacity;
+	mUsed = 0;
+	if (capacity > 0)
+		insertFree(0, capacity);
+}
+
+void RangeAllocator::grow(size_t capacity)
+{
+	if (capacity <= mCapacity)
+		return;
+
+	size_t oldCapacity = mCapacity;
+	mCapacity = capacity;
+
+	// Free the new tail as if it had been allocated, so it merges with a
+	// free range at the old end
+	mUsed += capacity - oldCapacity;
+	free(oldCapacity, capacity - oldCapacity);
+}
+
+//-----------------------------------------------------------------------------
+// Best fit: the smallest free range that holds 'size' units once aligned.
+// Alignment padding at the front of the range stays free.
+//-----------------------------------------------------------------------------
+size_t RangeAllocator::allocate(size_t size, size_t alignment)
+{
+	assert(size > 0 && (alignment & (alignment - 1)) == 0);
+
+	for (auto candidate = mFreeBySize.lower_bound(size); candidate != mFreeBySize.end(); ++candidate)
+	{
+		size_t rangeOffset = candidate->second;
+		size_t rangeSize = candidate->first;
+		size_t offset = (rangeOffset + alignment - 1) & ~(alignment - 1);
+		if (offset + size > rangeOffset + rangeSize)
+			continue;
+
+		eraseFree(mFreeByOffset.find(rangeOffset));
+		if (offset > rangeOffset)
+			insertFree(rangeOffset, offset - rangeOffset);
+		if (offset + size < rangeOffset + rangeSize)
+			insertFree(offset + size, rangeOffset + rangeSize - offset - size);
+
+		mUsed += size;
+		return offset;
+	}
+
+	return INVALID_OFFSET;
+}
+
+void RangeAllocator::free(size_t offset, size_t size)
+{
+	assert(offset + size <= mCapacity && size <= mUsed);
+	mUsed -= size;
+
+	// Merge with the free range that ends where this one starts
+	auto next = mFreeByOffset.lower_bound(offset);
+	if (next != mFreeByOffset.begin())
+	{
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset)
+		{
+			offset = previous->first;
+			size += previous->second;
+			eraseFree(previous);
+		}
+	}
+
+	// ... and with the one that starts where it ends
+	next = mFreeByOffset.lower_bound(offset);
+	if (next != mFreeByOffset.end() && next->first == offset + size)
+	{
+		size += next->second;
+		eraseFree(next);
+	}
+
+	insertFree(offset, size);
+}
+
+size_t RangeAllocator::getLargestFreeRange() const
+{
+	return mFreeBySize.empty() ? 0 : mFreeBySize.rbegin()->first;
+}
+
+float RangeAllocator::getFragmentation() const
+{
+	size_t freeSize = mCapacity - mUsed;
+	return (freeSize > 0) ? 1.0f - (float)getLargestFreeRange() / (float)freeSize : 0.0f;
+}
+
+void RangeAllocator::insertFree(size_t offset, size_t size)
+{
+	mFreeByOffset.emplace(offset, size);
+	mFreeBySize.emplace(size, offset);
+}
+
+void RangeAllocator::eraseFree(std::map<size_t, size_t>::iterator range)
+{
+	auto bySize = mFreeBySize.equal_range(range->second);
+	for (auto it = bySize.first; it != bySize.second; ++it)
+	{
+		if (it->second == range->first)
+		{
+			mFreeBySize.erase(it);
+			break;
+		}
+	}
+	mFreeByOffset.erase(range);
+}
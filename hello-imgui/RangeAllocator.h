@@ -0,0 +1,51 @@
+//-----------------------------------------------------------------------------
+// RangeAllocator.h
+//
+// Best-fit allocator of ranges within a linear address space, e.g. a GL
+// buffer.  Only the bookkeeping lives here; the memory belongs to the user.
+//-----------------------------------------------------------------------------
+#ifndef RANGE_ALLOCATOR_H
+#define RANGE_ALLOCATOR_H
+
+#include <cstddef>
+#include <map>
+
+class RangeAllocator
+{
+public:
+	static const size_t INVALID_OFFSET = ~(size_t)0;
+
+	explicit RangeAllocator(size_t capacity = 0);
+
+	// Forgets every allocation and starts over with 'capacity' units
+	void reset(size_t capacity);
+
+	// Extends the space to 'capacity' units, keeping the allocations
+	void grow(size_t capacity);
+
+	// Returns the offset of 'size' units aligned to 'alignment' (a power of
+	// two), taken from the smallest free range they fit in, or
+	// INVALID_OFFSET if none is large enough
+	size_t allocate(size_t size, size_t alignment = 1);
+
+	// Returns a range to the free list, merging it with its neighbours
+	void free(size_t offset, size_t size);
+
+	size_t getCapacity() const         { return mCapacity; }
+	size_t getUsed() const             { return mUsed; }
+	size_t getFreeRangeCount() const   { return mFreeByOffset.size(); }
+	size_t getLargestFreeRange() const;
+
+	// 0 when the free space is one range, towards 1 the more it is split
+	float getFragmentation() const;
+
+private:
+	void insertFree(size_t offset, size_t size);
+	void eraseFree(std::map<size_t, size_t>::iterator range);
+
+	std::map<size_t, size_t> mFreeByOffset;		// offset -> size
+	std::multimap<size_t, size_t> mFreeBySize;	// size -> offset, for best fit
+	size_t mCapacity;
+	size_t mUsed;
+};
+#endif // RANGE_ALLOCATOR_H
@@ -0,0 +1,239 @@
+//-----------------------------------------------------------------------------
+// ResidencyManager.cpp
+//
+// Keeps the video memory of the library's textures and of meshes under a
+// budget.  Once a frame is drawn, whatever was used longest ago goes first:
+// textures drop to a small mip, meshes leave their geometry arena.  Both
+// come back on demand, a texture once it is bound again and fits, a mesh
+// when it is next drawn, which stalls that draw while it reloads.
+//-----------------------------------------------------------------------------
+#include "ResidencyManager.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "GeometryArena.h"
+#include "Mesh.h"
+#include "TextureLibrary.h"
+
+namespace
+{
+	// Whatever was used this recently stays, so what is on screen does not
+	// go back and forth
+	const uint64_t MIN_IDLE_FRAMES = 2;
+
+	// Demoted textures restored per frame, to spread the uploads
+	const size_t MAX_RESTORES_PER_FRAME = 4;
+
+	size_t gBudget = 0;
+	int gLowMipSize = 64;
+	std::vector<Mesh*> gMeshes;
+
+	size_t gEvictions = 0;
+	size_t gReloads = 0;
+	size_t gStalls = 0;
+	double gStallMs = 0.0;
+
+	// A texture to demote or a mesh to evict
+	struct Candidate
+	{
+		uint64_t lastUsedFrame;
+		size_t bytes;
+		const TextureLibraryEntry* texture;
+		Mesh* mesh;
+	};
+
+	bool isIdle(uint64_t lastUsedFrame, uint64_t frame)
+	{
+		return lastUsedFrame + MIN_IDLE_FRAMES <= frame;
+	}
+}
+
+void ResidencyManager::setBudget(size_t bytes)
+{
+	gBudget = bytes;
+}
+
+size_t ResidencyManager::getBudget()
+{
+	return gBudget;
+}
+
+void ResidencyManager::setLowMipSize(int size)
+{
+	gLowMipSize = std::max(1, size);
+}
+
+int ResidencyManager::getLowMipSize()
+{
+	return gLowMipSize;
+}
+
+void ResidencyManager::beginFrame()
+{
+	sFrame++;
+}
+
+void ResidencyManager::addMesh(Mesh* mesh)
+{
+	if (std::find(gMeshes.begin(), gMeshes.end(), mesh) == gMeshes.end())
+		gMeshes.push_back(mesh);
+}
+
+bool ResidencyManager::removeMesh(Mesh* mesh)
+{
+	auto found = std::find(gMeshes.begin(), gMeshes.end(), mesh);
+	if (found == gMeshes.end())
+		return false;
+
+	gMeshes.erase(found);
+	return true;
+}
+
+void ResidencyManager::addStall(double ms)
+{
+	gReloads++;
+	gStalls++;
+	gStallMs += ms;
+}
+
+//-----------------------------------------------------------------------------
+// Demoted textures bound this frame come back first, as long as they fit.
+// Then, over budget, the textures and meshes used longest ago (the largest
+// first among those last used in the same frame) go until it holds.  What
+// was used in the last MIN_IDLE_FRAMES frames is kept even over budget.
+// Texture arrays count against the budget but stay whole, the textures they
+// copy make room instead.
+//-----------------------------------------------------------------------------
+void ResidencyManager::update()
+{
+	std::vector<TextureLibraryEntry> textures;
+	TextureLibrary::getTextures(textures);
+
+	size_t resident = TextureLibrary::getArrayStats().bytes;
+	for (const TextureLibraryEntry& entry : textures)
+		resident += entry.texture->getMemorySize();
+	for (Mesh* mesh : gMeshes)
+		resident += mesh->getMemorySize();
+
+	size_t restores = 0;
+	for (const TextureLibraryEntry& entry : textures)
+	{
+		Texture2D& texture = *entry.texture;
+		if (restores == MAX_RESTORES_PER_FRAME)
+			break;
+		if (!texture.isDemoted() || texture.getLastUsedFrame() != sFrame)
+			continue;
+
+		size_t lowBytes = texture.getMemorySize();
+		if (gBudget != 0 && resident + texture.getFullMemorySize() - lowBytes > gBudget)
+			continue;
+
+		if (texture.restore(entry.filename, entry.usage))
+		{
+			resident += texture.getMemorySize() - lowBytes;
+			gReloads++;
+			restores++;
+		}
+	}
+
+	if (gBudget == 0 || resident <= gBudget)
+		return;
+
+	std::vector<Candidate> candidates;
+	for (const TextureLibraryEntry& entry : textures)
+	{
+		const Texture2D& texture = *entry.texture;
+		if (!texture.isDemoted() && std::max(texture.getWidth(), texture.getHeight()) > gLowMipSize &&
+			isIdle(texture.getLastUsedFrame(), sFrame))
+		{
+			candidates.push_back({ texture.getLastUsedFrame(), texture.getMemorySize(), &entry, nullptr });
+		}
+	}
+	for (Mesh* mesh : gMeshes)
+	{
+		if (mesh->isResident() && isIdle(mesh->getLastUsedFrame(), sFrame))
+			candidates.push_back({ mesh->getLastUsedFrame(), mesh->getMemorySize(), nullptr, mesh });
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+		return (a.lastUsedFrame != b.lastUsedFrame) ? a.lastUsedFrame < b.lastUsedFrame : a.bytes > b.bytes;
+	});
+
+	size_t overBudget = resident - gBudget;
+	size_t demoted = 0, evicted = 0;
+	for (const Candidate& candidate : candidates)
+	{
+		if (resident <= gBudget)
+			break;
+
+		if (candidate.texture != nullptr)
+		{
+			Texture2D& texture = *candidate.texture->texture;
+			if (texture.demote(candidate.texture->filename, candidate.texture->usage, gLowMipSize))
+			{
+				resident -= candidate.bytes - texture.getMemorySize();
+				demoted++;
+			}
+		}
+		else if (candidate.mesh->evict())
+		{
+			resident -= candidate.bytes;
+			evicted++;
+		}
+	}
+
+	if (evicted > 0)
+	{
+		for (int layout = 0; layout < VERTEX_LAYOUT_COUNT; layout++)
+			GeometryArena::get((VertexLayout)layout).shrink();
+	}
+
+	gEvictions += demoted + evicted;
+	if (demoted + evicted > 0)
+	{
+		fmt::println("Residency: {:.0f} KB over the {:.0f} KB budget, {} textures to low mip, {} meshes evicted, {:.0f} KB resident",
+			overBudget / 1024.0, gBudget / 1024.0, demoted, evicted, resident / 1024.0);
+	}
+}
+
+ResidencyStats ResidencyManager::getStats()
+{
+	ResidencyStats stats = {};
+	stats.budgetBytes = gBudget;
+
+	std::vector<TextureLibraryEntry> textures;
+	TextureLibrary::getTextures(textures);
+	for (const TextureLibraryEntry& entry : textures)
+	{
+		stats.textureBytes += entry.texture->getMemorySize();
+		stats.demotedTextures += entry.texture->isDemoted();
+	}
+	for (Mesh* mesh : gMeshes)
+	{
+		stats.meshBytes += mesh->getMemorySize();
+		stats.evictedMeshes += !mesh->isResident();
+	}
+
+	stats.arrayBytes = TextureLibrary::getArrayStats().bytes;
+	stats.residentBytes = stats.textureBytes + stats.arrayBytes + stats.meshBytes;
+	stats.evictions = gEvictions;
+	stats.reloads = gReloads;
+	stats.stalls = gStalls;
+	stats.stallMs = gStallMs;
+	return stats;
+}
+
+void ResidencyManager::printReport()
+{
+	ResidencyStats stats = getStats();
+	if (stats.budgetBytes != 0)
+		fmt::println("Residency: {:.0f} KB of a {:.0f} KB budget resident", stats.residentBytes / 1024.0, stats.budgetBytes / 1024.0);
+	else
+		fmt::println("Residency: {:.0f} KB resident, no budget", stats.residentBytes / 1024.0);
+	fmt::println("  textures {:.0f} KB, {} at low mip; texture arrays {:.0f} KB; meshes {:.0f} KB, {} evicted", stats.textureBytes / 1024.0,
+		stats.demotedTextures, stats.arrayBytes / 1024.0, stats.meshBytes / 1024.0, stats.evictedMeshes);
+	fmt::println("  {} evictions, {} reloads, {} reload stalls ({:.1f} ms)", stats.evictions, stats.reloads, stats.stalls, stats.stallMs);
+}
@@ -0,0 +1,70 @@
+//-----------------------------------------------------------------------------
+// ResidencyManager.h
+//
+// Keeps the video memory of the library's textures and of meshes under a
+// budget.  Once a frame is drawn, whatever was used longest ago goes first:
+// textures drop to a small mip, meshes leave their geometry arena.  Both
+// come back on demand, a texture once it is bound again and fits, a mesh
+// when it is next drawn, which stalls that draw while it reloads.
+//-----------------------------------------------------------------------------
+#ifndef RESIDENCY_MANAGER_H
+#define RESIDENCY_MANAGER_H
+
+#include <cstddef>
+#include <cstdint>
+
+class Mesh;
+
+struct ResidencyStats
+{
+	size_t budgetBytes;			// 0 for no budget
+	size_t residentBytes;		// textures, texture arrays and mesh geometry
+	size_t textureBytes;
+	size_t arrayBytes;			// TextureLibrary's arrays, which are never demoted
+	size_t meshBytes;
+	size_t demotedTextures;		// at their low mip now
+	size_t evictedMeshes;		// out of the arena now
+	size_t evictions;			// textures demoted and meshes evicted, all along
+	size_t reloads;				// textures and meshes brought back
+	size_t stalls;				// of those, draws that waited for their mesh
+	double stallMs;
+};
+
+class ResidencyManager
+{
+public:
+	// Bytes textures and meshes may take, 0 for no limit
+	static void setBudget(size_t bytes);
+	static size_t getBudget();
+
+	// Demoted textures keep their levels no larger than 'size'
+	static void setLowMipSize(int size);
+	static int getLowMipSize();
+
+	// Counts frames for the last used frame of textures and meshes, call
+	// before drawing
+	static void beginFrame();
+	static uint64_t getFrame() { return sFrame; }
+
+	// Restores demoted textures bound this frame while they fit, then
+	// demotes and evicts what was used longest ago until under budget.
+	// Call once the frame is drawn.
+	static void update();
+
+	// Meshes join when uploaded and leave when destroyed; textures are
+	// those of TextureLibrary
+	static void addMesh(Mesh* mesh);
+	static bool removeMesh(Mesh* mesh);
+
+	// A draw waited 'ms' for its mesh to reload
+	static void addStall(double ms);
+
+	static ResidencyStats getStats();
+	static void printReport();
+
+private:
+	// Inline, so Texture2D, which texture-cooker builds too, reads it
+	// without linking the manager
+	static inline uint64_t sFrame = 1;
+};
+#endif // RESIDENCY_MANAGER_H
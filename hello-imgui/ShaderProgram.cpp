@@ -1,5 +1,8 @@
 #include "ShaderProgram.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -7,6 +10,20 @@
 #include <fmt/core.h>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "ProgramCache.h"
+
+namespace
+{
+	// Uniform block name and binding point, see setBlockBinding
+	std::vector<std::pair<string, GLuint>> gBlockBindings;
+}
+
+GLuint ShaderProgram::sCurrentProgram = 0;
+bool ShaderProgram::sSkipRedundant = true;
+UniformStats ShaderProgram::sUniformStats = {};
+ProgramLoadStats ShaderProgram::sLoadStats = {};
+bool ShaderProgram::sParallelCompile = false;
+
 ShaderProgram::ShaderProgram()
 	: mHandle(0)
 {
@@ -24,15 +41,59 @@ void ShaderProgram::destroy()
 	if (mHandle != 0) {
 		glDeleteProgram(mHandle);
 	}
+	if (sCurrentProgram == mHandle)
+		sCurrentProgram = 0;
 }
 
 //-----------------------------------------------------------------------------
-// Loads vertex and fragment shaders
+// Loads vertex and fragment shaders, from the program cache when this driver
+// linked the same source before.  Waits for the compile.
 //-----------------------------------------------------------------------------
 bool ShaderProgram::loadShaders(const char* vsFilename, const char* fsFilename)
 {
-	string vsString = fileToString(vsFilename);
-	string fsString = fileToString(fsFilename);
+	if (!submitShaders(vsFilename, fsFilename))
+		return false;
+
+	finish();
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Starts compiling and linking without asking for any status, which would
+// wait for the driver.  Submitted together, programs compile side by side on
+// drivers with compiler threads.  A program cache hit is ready at once.
+//-----------------------------------------------------------------------------
+bool ShaderProgram::submitShaders(const char* vsFilename, const char* fsFilename)
+{
+	string vsString = expandIncludes(fileToString(vsFilename), vsFilename);
+	string fsString = expandIncludes(fileToString(fsFilename), fsFilename);
+
+	auto start = std::chrono::steady_clock::now();
+	sLoadStats.programs++;
+
+	bool cacheSupported = ProgramCache::isSupported();
+	uint64_t cacheKey = 0;
+	string cacheFilename;
+	if (cacheSupported)
+	{
+		cacheKey = ProgramCache::makeKey(vsString, fsString);
+		cacheFilename = ProgramCache::cacheFilename(vsFilename, fsFilename);
+
+		double cachedCompileMs = 0.0;
+		if (loadBinary(cacheFilename, cacheKey, cachedCompileMs))
+		{
+			double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			sLoadStats.cacheHits++;
+			sLoadStats.cacheLoadMs += loadMs;
+			sLoadStats.cachedCompileMs += cachedCompileMs;
+			fmt::println("Shader program {} + {}: {:.2f} ms from the program cache, {:.2f} ms to compile and link", vsFilename,
+				fsFilename, loadMs, cachedCompileMs);
+
+			readUniforms();
+			bindUniformBlocks();
+			return true;
+		}
+	}
 
 	const GLchar* vsSourcePtr = vsString.c_str();
 	const GLchar* fsSourcePtr = fsString.c_str();
@@ -44,14 +105,13 @@ bool ShaderProgram::loadShaders(const char* vsFilename, const char* fsFilename)
 	glShaderSource(fs, 1, &fsSourcePtr, NULL);
 
 	glCompileShader(vs);
-	checkCompileErrors(vs, VERTEX);
-
 	glCompileShader(fs);
-	checkCompileErrors(fs, FRAGMENT);
 
 	mHandle = glCreateProgram();
 	if (mHandle == 0)
 	{
+		glDeleteShader(vs);
+		glDeleteShader(fs);
 		fmt::println("Unable to create shader program!");
 		return false;
 	}
@@ -59,21 +119,114 @@ bool ShaderProgram::loadShaders(const char* vsFilename, const char* fsFilename)
 	glAttachShader(mHandle, vs);
 	glAttachShader(mHandle, fs);
 
+	if (cacheSupported)
+		glProgramParameteri(mHandle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
 	glLinkProgram(mHandle);
-	checkCompileErrors(mHandle, PROGRAM);
 
-	glDeleteShader(vs);
-	glDeleteShader(fs);
+	mPending.pending = true;
+	mPending.vs = vs;
+	mPending.fs = fs;
+	mPending.vsFilename = vsFilename;
+	mPending.fsFilename = fsFilename;
+	mPending.cacheFilename = cacheFilename;
+	mPending.cacheKey = cacheKey;
+	mPending.start = start;
+	return true;
+}
 
-	mUniformLocations.clear();
+//-----------------------------------------------------------------------------
+// With parallel compile the driver says whether linking is done without
+// waiting for it.  Without, there is no asking, so the program is finished.
+//-----------------------------------------------------------------------------
+bool ShaderProgram::poll()
+{
+	if (!mPending.pending)
+		return true;
 
+	if (sParallelCompile)
+	{
+		GLint complete = GL_FALSE;
+		glGetProgramiv(mHandle, GL_COMPLETION_STATUS_KHR, &complete);
+		if (complete == GL_FALSE)
+			return false;
+	}
+
+	finish();
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// Waits for the submitted program, reports compile errors, stores it in the
+// program cache and lists its uniforms
+//-----------------------------------------------------------------------------
+void ShaderProgram::finish()
+{
+	if (!mPending.pending)
+		return;
+
+	checkCompileErrors(mPending.vs, VERTEX);
+	checkCompileErrors(mPending.fs, FRAGMENT);
+	checkCompileErrors(mHandle, PROGRAM);
+
+	glDeleteShader(mPending.vs);
+	glDeleteShader(mPending.fs);
+
+	// Until the link was seen done: with other programs submitted alongside,
+	// or polled once a frame, this is more than the compile itself took
+	double compileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mPending.start).count();
+	sLoadStats.compileMs += compileMs;
+	fmt::println("Shader program {} + {}: {:.2f} ms to compile and link", mPending.vsFilename, mPending.fsFilename, compileMs);
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(mHandle, GL_LINK_STATUS, &linked);
+	if (!mPending.cacheFilename.empty() && linked == GL_TRUE)
+		ProgramCache::write(mPending.cacheFilename, mPending.cacheKey, mHandle, compileMs);
+
+	mPending = PendingLink();
+
+	readUniforms();
+	bindUniformBlocks();
+}
+
+//-----------------------------------------------------------------------------
+// Lets the driver compile on as many threads as it likes, where it supports
+// GL_KHR_parallel_shader_compile (or the ARB original).  Call once the GL
+// is loaded, with the loader for the extension's function.
+//-----------------------------------------------------------------------------
+void ShaderProgram::initParallelCompile(GLADloadproc loader)
+{
+	typedef void (APIENTRY* MaxShaderCompilerThreadsProc)(GLuint count);
+
+	const char* function = nullptr;
+	GLint extensionCount = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+	for (GLint i = 0; i < extensionCount && function == nullptr; i++)
+	{
+		const char* name = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		if (name == nullptr)
+			continue;
+		if (std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0)
+			function = "glMaxShaderCompilerThreadsKHR";
+		else if (std::strcmp(name, "GL_ARB_parallel_shader_compile") == 0)
+			function = "glMaxShaderCompilerThreadsARB";
+	}
+
+	MaxShaderCompilerThreadsProc maxThreads = (function != nullptr) ? (MaxShaderCompilerThreadsProc)loader(function) : nullptr;
+	sParallelCompile = maxThreads != nullptr;
+	if (sParallelCompile)
+		maxThreads(0xFFFFFFFFu);
+
+	fmt::println("Shader compile: {}", sParallelCompile ? "parallel, polled without waiting" : "no parallel compile extension, waits per program");
+}
+
 void ShaderProgram::use()
 {
 	if (mHandle > 0)
+	{
 		glUseProgram(mHandle);
+		sCurrentProgram = mHandle;
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -105,6 +258,84 @@ string ShaderProgram::fileToString(const string& filename)
 	return ss.str();
 }
 
+//-----------------------------------------------------------------------------
+// Creates the program from its cached binary.  The driver may refuse a
+// binary the key did not catch (a different build with the same version
+// string), then the caller compiles the source and replaces the cache.
+//-----------------------------------------------------------------------------
+bool ShaderProgram::loadBinary(const string& cacheFilename, uint64_t cacheKey, double& compileMs)
+{
+	ProgramCache cache;
+	if (!cache.open(cacheFilename, cacheKey))
+		return false;
+
+	GLuint program = glCreateProgram();
+	if (program == 0)
+		return false;
+
+	const ProgramCacheHeader& header = cache.getHeader();
+	glProgramBinary(program, (GLenum)header.binaryFormat, cache.getBinary(), (GLsizei)header.binaryBytes);
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked == GL_FALSE)
+	{
+		glDeleteProgram(program);
+		fmt::println("Program cache '{}' was rejected by the driver, compiling the source", cacheFilename);
+		return false;
+	}
+
+	mHandle = program;
+	compileMs = header.compileMs;
+	return true;
+}
+
+void ShaderProgram::resetLoadStats()
+{
+	sLoadStats = {};
+}
+
+void ShaderProgram::printLoadReport()
+{
+	const ProgramLoadStats& stats = sLoadStats;
+	size_t compiled = stats.programs - stats.cacheHits;
+	fmt::println("Shader programs: {} loaded, {} from the program cache in {:.2f} ms ({:.2f} ms when compiled), {} compiled in {:.2f} ms summed",
+		stats.programs, stats.cacheHits, stats.cacheLoadMs, stats.cachedCompileMs, compiled, stats.compileMs);
+}
+
+//-----------------------------------------------------------------------------
+// Replaces the '#include "file"' lines of a shader with the files, looked
+// for next to 'filename'.  One level only, included files are not expanded.
+//-----------------------------------------------------------------------------
+string ShaderProgram::expandIncludes(const string& source, const string& filename)
+{
+	const string directive = "#include";
+	size_t slash = filename.find_last_of("/\\");
+	string directory = (slash != string::npos) ? filename.substr(0, slash + 1) : string();
+
+	std::stringstream in(source);
+	std::stringstream out;
+	string line;
+	while (std::getline(in, line))
+	{
+		size_t first = line.find_first_not_of(" \t");
+		size_t open = line.find('"');
+		size_t close = line.rfind('"');
+		if (first == string::npos || line.compare(first, directive.size(), directive) != 0 || open == string::npos || close <= open)
+		{
+			out << line << '\n';
+			continue;
+		}
+
+		string include = directory + line.substr(open + 1, close - open - 1);
+		string text = fileToString(include);
+		if (text.empty())
+			fmt::println("Shader include '{}' is missing or empty", include);
+		out << text << '\n';
+	}
+	return out.str();
+}
+
 //-----------------------------------------------------------------------------
 // Returns the active shader program
 //-----------------------------------------------------------------------------
@@ -153,91 +384,286 @@ void  ShaderProgram::checkCompileErrors(GLuint shader, ShaderType type)
 
 }
 
+//-----------------------------------------------------------------------------
+// Lists the active uniforms once, after linking, so setting one by name is a
+// binary search over their hashes with no allocation or string compares.
+// Arrays are listed element by element.  Uniform block members have no
+// location and are left out.  Names of one location (an array and its first
+// element) share the slot of its last sent value.
+//-----------------------------------------------------------------------------
+void ShaderProgram::readUniforms()
+{
+	mUniforms.clear();
+	mValues.clear();
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(mHandle, GL_LINK_STATUS, &linked);
+	if (linked == GL_FALSE)
+		return;
+
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(mHandle, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(mHandle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	std::vector<string> names;
+	std::vector<GLchar> buffer((size_t)maxLength + 1);
+	auto add = [this, &names](const string& name, GLenum type) {
+		GLint location = glGetUniformLocation(mHandle, name.c_str());
+		if (location < 0)
+			return;
+		mUniforms.push_back({ UniformName::hashName(name.c_str()), location, type, -1 });
+		names.push_back(name);
+	};
+
+	for (GLint i = 0; i < count; i++)
+	{
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(mHandle, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+		string name(buffer.data(), (size_t)length);
+
+		// Arrays are reported as "name[0]"
+		size_t bracket = name.rfind("[0]");
+		if (bracket != string::npos && bracket + 3 == name.size())
+		{
+			string base = name.substr(0, bracket);
+			add(base, type);
+			for (GLint element = 0; element < size; element++)
+				add(base + "[" + std::to_string(element) + "]", type);
+		}
+		else
+		{
+			add(name, type);
+		}
+	}
+
+	std::vector<size_t> order(mUniforms.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [this](size_t a, size_t b) { return mUniforms[a].hash < mUniforms[b].hash; });
+
+	std::vector<Uniform> sorted;
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		// Two names of one program on the same hash would shadow each other
+		if (i > 0 && mUniforms[order[i]].hash == mUniforms[order[i - 1]].hash)
+			fmt::println("Shader uniforms '{}' and '{}' have the same hash, '{}' cannot be set", names[order[i - 1]], names[order[i]], names[order[i]]);
+		sorted.push_back(mUniforms[order[i]]);
+	}
+	mUniforms.swap(sorted);
+
+	std::vector<GLint> locations;
+	for (const Uniform& uniform : mUniforms)
+		locations.push_back(uniform.location);
+	std::sort(locations.begin(), locations.end());
+	locations.erase(std::unique(locations.begin(), locations.end()), locations.end());
+
+	for (Uniform& uniform : mUniforms)
+		uniform.slot = (int)(std::lower_bound(locations.begin(), locations.end(), uniform.location) - locations.begin());
+	mValues.resize(locations.size());
+}
+
+void ShaderProgram::invalidateUniforms()
+{
+	for (UniformValue& value : mValues)
+		value.size = 0;
+}
+
+void ShaderProgram::resetUniformStats()
+{
+	sUniformStats = {};
+}
+
+//-----------------------------------------------------------------------------
+// Whether setting 'uniform' to 'value' needs a GL call.  Inactive uniforms
+// never do.  The value is recorded only while this program is in use, as
+// the GL call would go to whichever one is.
+//-----------------------------------------------------------------------------
+bool ShaderProgram::isChanged(UniformHandle uniform, const void* value, size_t size)
+{
+	if (uniform.location < 0)
+		return false;
+
+	if (mHandle == sCurrentProgram && uniform.slot >= 0 && (size_t)uniform.slot < mValues.size())
+	{
+		UniformValue& last = mValues[uniform.slot];
+		if (sSkipRedundant && last.size == size && std::memcmp(last.data, value, size) == 0)
+		{
+			sUniformStats.skipped++;
+			return false;
+		}
+		last.size = size;
+		std::memcpy(last.data, value, size);
+	}
+
+	sUniformStats.issued++;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Points the program's uniform blocks at the binding points given to
+// setBlockBinding.  Blocks without one are left at binding 0.
+//-----------------------------------------------------------------------------
+void ShaderProgram::bindUniformBlocks()
+{
+	GLint linked = GL_FALSE;
+	glGetProgramiv(mHandle, GL_LINK_STATUS, &linked);
+	if (linked == GL_FALSE)
+		return;
+
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(mHandle, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+	glGetProgramiv(mHandle, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+
+	std::vector<GLchar> buffer((size_t)maxLength + 1);
+	for (GLint i = 0; i < count; i++)
+	{
+		GLsizei length = 0;
+		glGetActiveUniformBlockName(mHandle, (GLuint)i, (GLsizei)buffer.size(), &length, buffer.data());
+		string name(buffer.data(), (size_t)length);
+
+		auto found = std::find_if(gBlockBindings.begin(), gBlockBindings.end(),
+			[&name](const std::pair<string, GLuint>& binding) { return binding.first == name; });
+		if (found != gBlockBindings.end())
+			glUniformBlockBinding(mHandle, (GLuint)i, found->second);
+		else
+			fmt::println("Shader uniform block '{}' has no binding point", name);
+	}
+}
+
+void ShaderProgram::setBlockBinding(const char* blockName, GLuint binding)
+{
+	for (std::pair<string, GLuint>& entry : gBlockBindings)
+	{
+		if (entry.first == blockName)
+		{
+			entry.second = binding;
+			return;
+		}
+	}
+	gBlockBindings.push_back({ blockName, binding });
+}
+
+//-----------------------------------------------------------------------------
+// Returns the uniform identifier given its name, -1 if the program has no
+// such active uniform.
+// NOTE: Shader must be currently active first to set it.
+//-----------------------------------------------------------------------------
+GLint ShaderProgram::getUniformLocation(UniformName name) const
+{
+	return getUniform(name).location;
+}
+
+UniformHandle ShaderProgram::getUniform(UniformName name) const
+{
+	auto found = std::lower_bound(mUniforms.begin(), mUniforms.end(), name.hash,
+		[](const Uniform& uniform, uint32_t hash) { return uniform.hash < hash; });
+
+	UniformHandle handle;
+	if (found != mUniforms.end() && found->hash == name.hash)
+	{
+		handle.location = found->location;
+		handle.type = found->type;
+		handle.slot = found->slot;
+	}
+	return handle;
+}
+
 //-----------------------------------------------------------------------------
 // Sets a glm::vec2 shader uniform
 //-----------------------------------------------------------------------------
-void ShaderProgram::setUniform(const GLchar* name, const glm::vec2& v)
+void ShaderProgram::setUniform(UniformName name, const glm::vec2& v)
+{
+	setUniform(getUniform(name), v);
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::vec2& v)
 {
-	GLint loc = getUniformLocation(name);
-	glUniform2f(loc, v.x, v.y);
+	if (isChanged(uniform, &v, sizeof(v)))
+		glUniform2f(uniform.location, v.x, v.y);
 }
 
 //-----------------------------------------------------------------------------
 // Sets a glm::vec3 shader uniform
 //-----------------------------------------------------------------------------
-void ShaderProgram::setUniform(const GLchar* name, const glm::vec3& v)
+void ShaderProgram::setUniform(UniformName name, const glm::vec3& v)
 {
-	GLint loc = getUniformLocation(name);
-	glUniform3f(loc, v.x, v.y, v.z);
+	setUniform(getUniform(name), v);
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::vec3& v)
+{
+	if (isChanged(uniform, &v, sizeof(v)))
+		glUniform3f(uniform.location, v.x, v.y, v.z);
 }
 
 //-----------------------------------------------------------------------------
 // Sets a glm::vec4 shader uniform
 //-----------------------------------------------------------------------------
-void ShaderProgram::setUniform(const GLchar* name, const glm::vec4& v)
+void ShaderProgram::setUniform(UniformName name, const glm::vec4& v)
+{
+	setUniform(getUniform(name), v);
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::vec4& v)
 {
-	GLint loc = getUniformLocation(name);
-	glUniform4f(loc, v.x, v.y, v.z, v.w);
+	if (isChanged(uniform, &v, sizeof(v)))
+		glUniform4f(uniform.location, v.x, v.y, v.z, v.w);
 }
 
 //-----------------------------------------------------------------------------
 // Sets a glm::mat4 shader uniform
 //-----------------------------------------------------------------------------
-void ShaderProgram::setUniform(const GLchar* name, const glm::mat4& m)
+void ShaderProgram::setUniform(UniformName name, const glm::mat4& m)
 {
-	GLint loc = getUniformLocation(name);
+	setUniform(getUniform(name), m);
+}
 
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::mat4& m)
+{
 	// loc = location of uniform in shader
 	// count = how many matrices (1 if not an array of mats)
 	// transpose = False for opengl because column major
 	// value = the matrix to set for the uniform
-	glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(m));
+	if (isChanged(uniform, glm::value_ptr(m), sizeof(GLfloat) * 16))
+		glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(m));
 }
 
 //-----------------------------------------------------------------------------
 // Sets a GLfloat shader uniform
 //-----------------------------------------------------------------------------
-void ShaderProgram::setUniform(const GLchar* name, const GLfloat f)
+void ShaderProgram::setUniform(UniformName name, const GLfloat f)
 {
-	GLint loc = getUniformLocation(name);
-	glUniform1f(loc, f);
+	setUniform(getUniform(name), f);
 }
 
-//-----------------------------------------------------------------------------
-// Sets a GLint shader uniform
-//-----------------------------------------------------------------------------
-void ShaderProgram::setUniform(const GLchar* name, const GLint v)
+void ShaderProgram::setUniform(UniformHandle uniform, const GLfloat f)
 {
-	GLint loc = getUniformLocation(name);
-	glUniform1i(loc, v);
+	if (isChanged(uniform, &f, sizeof(f)))
+		glUniform1f(uniform.location, f);
 }
 
 //-----------------------------------------------------------------------------
-// Sets a GLint shader uniform that is specific to a texture unit
+// Sets a GLint shader uniform
 //-----------------------------------------------------------------------------
-void ShaderProgram::setUniformSampler(const GLchar* name, const GLint& slot)
+void ShaderProgram::setUniform(UniformName name, const GLint v)
 {
-	glActiveTexture(GL_TEXTURE0 + slot);
+	setUniform(getUniform(name), v);
+}
 
-	GLint loc = getUniformLocation(name);
-	glUniform1i(loc, slot);
+void ShaderProgram::setUniform(UniformHandle uniform, const GLint v)
+{
+	if (isChanged(uniform, &v, sizeof(v)))
+		glUniform1i(uniform.location, v);
 }
 
 //-----------------------------------------------------------------------------
-// Returns the uniform identifier given it's string name.
-// NOTE: Shader must be currently active first.
+// Sets a GLint shader uniform that is specific to a texture unit
 //-----------------------------------------------------------------------------
-GLint ShaderProgram::getUniformLocation(const GLchar* name)
+void ShaderProgram::setUniformSampler(UniformName name, const GLint& slot)
 {
-	std::map<string, GLint>::iterator it = mUniformLocations.find(name);
-
-	// Only need to query the shader program IF it doesn't already exist.
-	if (it == mUniformLocations.end())
-	{
-		// Find it and add it to the map
-		mUniformLocations[name] = glGetUniformLocation(mHandle, name);
-	}
+	glActiveTexture(GL_TEXTURE0 + slot);
 
-	// Return it
-	return mUniformLocations[name];
+	setUniform(getUniform(name), slot);
 }
@@ -1,13 +1,65 @@
 #ifndef SHADER_H
 #define SHADER_H
 
+#include <chrono>
+#include <cstdint>
 #include <string>
-#include <map>
+#include <vector>
 #define GLEW_STATIC
 #include <glad/glad.h>
 #include "glm/glm.hpp"
 using std::string;
 
+// GL_KHR_parallel_shader_compile, the same value in the ARB version
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// A uniform name reduced to its 32-bit FNV-1a hash, which is all ShaderProgram
+// looks uniforms up by.  For a string literal the hash is folded at compile
+// time by optimizing compilers; a constexpr UniformName guarantees it.
+struct UniformName
+{
+	constexpr UniformName(const GLchar* name) : hash(hashName(name)) {}
+
+	static constexpr uint32_t hashName(const GLchar* name)
+	{
+		uint32_t hash = 2166136261u;
+		for (; *name != '\0'; name++)
+			hash = (hash ^ (uint32_t)(unsigned char)*name) * 16777619u;
+		return hash;
+	}
+
+	uint32_t hash;
+};
+
+// A uniform resolved once with ShaderProgram::getUniform, set without any
+// lookup.  A location of -1 (an inactive or unknown uniform) is ignored by
+// the GL, as with names.
+struct UniformHandle
+{
+	GLint location = -1;
+	GLenum type = 0;		// GL_FLOAT_MAT4, GL_SAMPLER_2D, ...
+	int slot = -1;			// of the value the program last sent, per location
+};
+
+// Program loads, accumulated over all programs until reset
+struct ProgramLoadStats
+{
+	size_t programs;
+	size_t cacheHits;			// loaded from the program cache
+	double compileMs;			// compiling and linking the others
+	double cacheLoadMs;			// loading the cache hits
+	double cachedCompileMs;		// what the cache hits took to compile when cached
+};
+
+// Uniform updates, accumulated over all programs until reset
+struct UniformStats
+{
+	size_t issued;		// glUniform calls made
+	size_t skipped;		// sets dropped, the uniform already had the value
+};
+
 class ShaderProgram
 {
 public:
@@ -21,29 +73,118 @@ public:
 		PROGRAM
 	};
 
-	// Only supports vertex and fragment (this series will only have those two)
+	// Only supports vertex and fragment (this series will only have those two).
+	// A line '#include "file"' is replaced by that file, from the same folder.
+	// The linked program is kept in a ProgramCache file for the next start.
 	bool loadShaders(const char* vsFilename, const char* fsFilename);
+
+	// loadShaders in two halves, to compile many programs at once: submit
+	// them all, then poll each until it returns true (it never waits with
+	// parallel compile) or finish it, which waits.  Until then the program
+	// has no uniforms and must not be used; draw with a ready one meanwhile.
+	bool submitShaders(const char* vsFilename, const char* fsFilename);
+	bool poll();
+	void finish();
+	bool isReady() const { return !mPending.pending; }
+
+	static void initParallelCompile(GLADloadproc loader);
+	static bool hasParallelCompile() { return sParallelCompile; }
+
 	void use();
 	void destroy();
 
 	const GLuint getProgram();
 
-	void setUniform(const GLchar* name, const glm::vec2& v);
-	void setUniform(const GLchar* name, const glm::vec3& v);
-	void setUniform(const GLchar* name, const glm::vec4& v);
-	void setUniform(const GLchar* name, const glm::mat4& m);
-	void setUniform(const GLchar* name, const GLfloat f);
-	void setUniform(const GLchar* name, const GLint v);
-	void setUniformSampler(const GLchar* name, const GLint& slot);
+	void setUniform(UniformName name, const glm::vec2& v);
+	void setUniform(UniformName name, const glm::vec3& v);
+	void setUniform(UniformName name, const glm::vec4& v);
+	void setUniform(UniformName name, const glm::mat4& m);
+	void setUniform(UniformName name, const GLfloat f);
+	void setUniform(UniformName name, const GLint v);
+	void setUniformSampler(UniformName name, const GLint& slot);
+
+	// The same through handles, for uniforms set per object
+	void setUniform(UniformHandle uniform, const glm::vec2& v);
+	void setUniform(UniformHandle uniform, const glm::vec3& v);
+	void setUniform(UniformHandle uniform, const glm::vec4& v);
+	void setUniform(UniformHandle uniform, const glm::mat4& m);
+	void setUniform(UniformHandle uniform, const GLfloat f);
+	void setUniform(UniformHandle uniform, const GLint v);
+
+	// Resolves a uniform of the linked program, e.g. "light.position" or
+	// "lights[2]" (an array's first element also answers to its bare name)
+	UniformHandle getUniform(UniformName name) const;
+	GLint getUniformLocation(UniformName name) const;
+	size_t getUniformCount() const { return mUniforms.size(); }
+
+	// Each program keeps the last value it sent to each uniform and drops
+	// sets that would not change it.  The copy holds while uniforms are set
+	// through ShaderProgram only, on the program in use; anything else that
+	// sets them must call invalidateUniforms.
+	void invalidateUniforms();
+	static void setSkipRedundant(bool skip) { sSkipRedundant = skip; }
+	static bool getSkipRedundant() { return sSkipRedundant; }
+
+	static const UniformStats& getUniformStats() { return sUniformStats; }
+	static void resetUniformStats();
+
+	static const ProgramLoadStats& getLoadStats() { return sLoadStats; }
+	static void resetLoadStats();
+	static void printLoadReport();
+
+	// Uniform blocks named 'blockName' are bound to 'binding' by every
+	// program linked afterwards, so all of them read the same buffer
+	static void setBlockBinding(const char* blockName, GLuint binding);
+
 private:
 
+	// An active uniform, see readUniforms
+	struct Uniform
+	{
+		uint32_t hash;
+		GLint location;
+		GLenum type;
+		int slot;
+	};
+
+	// A program submitted and not yet seen linked
+	struct PendingLink
+	{
+		bool pending = false;
+		GLuint vs = 0;
+		GLuint fs = 0;
+		string vsFilename;
+		string fsFilename;
+		string cacheFilename;		// empty without program binaries
+		uint64_t cacheKey = 0;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	// The last value sent to a location, as its bytes
+	struct UniformValue
+	{
+		size_t size = 0;		// 0 until the first set
+		float data[16];
+	};
+
 	string fileToString(const string& filename);
+	string expandIncludes(const string& source, const string& filename);
+	bool loadBinary(const string& cacheFilename, uint64_t cacheKey, double& compileMs);
 	void  checkCompileErrors(GLuint shader, ShaderType type);
-	// We are going to speed up looking for uniforms by keeping their locations in a map
-	GLint getUniformLocation(const GLchar* name);
+	void readUniforms();
+	void bindUniformBlocks();
+	bool isChanged(UniformHandle uniform, const void* value, size_t size);
 
 
 	GLuint mHandle;
-	std::map<string, GLint> mUniformLocations;
+	std::vector<Uniform> mUniforms;		// sorted by name hash
+	std::vector<UniformValue> mValues;	// by Uniform::slot
+	PendingLink mPending;
+
+	static GLuint sCurrentProgram;		// last use()
+	static bool sSkipRedundant;
+	static UniformStats sUniformStats;
+	static ProgramLoadStats sLoadStats;
+	static bool sParallelCompile;
 };
 #endif // SHADER_H
@@ -1,12 +1,21 @@
 #include "Skybox.h"
 
-#include <stb_image.h>
 #include <fmt/core.h>
 
 Skybox::Skybox(const std::vector<std::string>& faces)
 {
 	mCubemapTexture = loadCubemap(faces);
+	initGeometry();
+}
+
+Skybox::Skybox()
+	: mCubemapTexture(0)
+{
+	initGeometry();
+}
 
+void Skybox::initGeometry()
+{
 	float mSkyboxVertices[] = {
 		// positions          
 		-1.0f,  1.0f, -1.0f,
@@ -81,26 +90,55 @@ void Skybox::destroy()
 }
 
 GLuint Skybox::loadCubemap(const std::vector<std::string>& faces) 
+{
+	std::vector<TextureImage> images(faces.size());
+	for (size_t i = 0; i < faces.size(); i++)
+	{
+		if (!Texture2D::decodeImage(faces[i], false, TEXTURE_USAGE_COLOR, images[i]))
+			fmt::println("Cubemap texture failed to load at path: {}", faces[i]);
+	}
+
+	return createCubemap(images);
+}
+
+GLuint Skybox::createCubemap(const std::vector<TextureImage>& faces)
 {
 	GLuint textureID;
 	glGenTextures(1, &textureID);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-	int width, height, nrChannels;
-	for (unsigned int i = 0; i < faces.size(); i++)
+	// The format of the first face that loaded; the others are converted to it
+	const TextureImage* first = nullptr;
+	for (const TextureImage& face : faces)
 	{
-		stbi_set_flip_vertically_on_load(false);
-		unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-		if (data)
+		if (!face.pixels.empty())
 		{
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			stbi_image_free(data);
+			first = &face;
+			break;
 		}
-		else
+	}
+
+	if (first != nullptr)
+	{
+		GLenum internalFormat = TextureFormat::getInternalFormat(first->components, first->srgb);
+		bool immutable = Texture2D::hasTexStorage();
+		if (immutable)
+			glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, internalFormat, first->width, first->height);
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (unsigned int i = 0; i < faces.size(); i++)
 		{
-			fmt::println("Cubemap texture failed to load at path: {}", faces[i]);
-			stbi_image_free(data);
+			const TextureImage& face = faces[i];
+			if (face.pixels.empty() || face.width != first->width || face.height != first->height)
+				continue;
+
+			GLenum pixelFormat = TextureFormat::getPixelFormat(face.components);
+			if (immutable)
+				glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 0, 0, face.width, face.height, pixelFormat, GL_UNSIGNED_BYTE, face.pixels.data());
+			else
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, internalFormat, face.width, face.height, 0, pixelFormat, GL_UNSIGNED_BYTE, face.pixels.data());
 		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 	}
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -113,13 +151,21 @@ GLuint Skybox::loadCubemap(const std::vector<std::string>& faces)
 	return textureID;
 }
 
-void Skybox::render(ShaderProgram skyboxShader, const glm::mat4& view, const glm::mat4& projection)
+void Skybox::setCubemap(const std::vector<TextureImage>& faces)
 {
+	glDeleteTextures(1, &mCubemapTexture);
+	mCubemapTexture = createCubemap(faces);
+}
+
+void Skybox::render(ShaderProgram& skyboxShader)
+{
+	// still loading
+	if (mCubemapTexture == 0)
+		return;
+
 	// skybox cube
 	glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
 	skyboxShader.use();
-	skyboxShader.setUniform("view", glm::mat4(glm::mat3(view)));
-	skyboxShader.setUniform("projection", projection);
 
 	glBindVertexArray(mVAO);
 
@@ -8,19 +8,29 @@
 #include <glad/glad.h>
 
 #include "ShaderProgram.h"
+#include "Texture2D.h"
 
 class Skybox
 {
 public:
 	Skybox(const std::vector<std::string>& faces);
+	Skybox();		// without a cubemap, nothing renders until setCubemap()
 	~Skybox();
 
 	GLuint loadCubemap(const std::vector<std::string>& faces);
-	void render(ShaderProgram skyboxShader, const glm::mat4& view, const glm::mat4& projection);
+
+	// Creates the cubemap from six decoded RGB faces (+X, -X, +Y, -Y, +Z, -Z)
+	static GLuint createCubemap(const std::vector<TextureImage>& faces);
+	void setCubemap(const std::vector<TextureImage>& faces);
+
+	// The view and projection come from the frame uniforms (FrameUniforms.h)
+	void render(ShaderProgram& skyboxShader);
 
 	void destroy();
 
 private:
+	void initGeometry();
+
 	GLuint mSkyboxVertices;
 	GLuint mVAO, mVBO;
 	GLuint mCubemapTexture;
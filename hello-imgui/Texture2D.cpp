@@ -5,19 +5,39 @@
 // Simple 2D texture class
 //-----------------------------------------------------------------------------
 #include <iostream>
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cstring>
 
 #include <fmt/core.h>
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
 #include "Texture2D.h"
+#include "DdsFile.h"
+#include "MipGenerator.h"
+#include "ResidencyManager.h"
+#include "TextureCache.h"
+#include "TextureCompressor.h"
+
+const unsigned char* TextureImage::data() const
+{
+	return cache ? cache->getPixels() : pixels.data();
+}
 
 //-----------------------------------------------------------------------------
 // Constructor
 //-----------------------------------------------------------------------------
 Texture2D::Texture2D()
-	: mTexture(0)
+	: mTexture(0),
+	  mWidth(0),
+	  mHeight(0),
+	  mLevels(0),
+	  mInternalFormat(0),
+	  mFirstLevel(0),
+	  mFullMemorySize(0),
+	  mLastUsedFrame(0)
 {
 }
 
@@ -40,13 +60,68 @@ void Texture2D::destroy()
 // http://nothings.org/stb_image.h
 // Creates mip maps if generateMipMaps is true.
 //-----------------------------------------------------------------------------
-bool Texture2D::loadTexture(const string& fileName, bool generateMipMaps)
+bool Texture2D::loadTexture(const string& fileName, bool generateMipMaps, TextureUsage usage)
+{
+	TextureImage image;
+	if (!readImage(fileName, usage, image))
+		return false;
+
+	if (upload(image, generateMipMaps))
+		return true;
+
+	// A cooked format this GL cannot sample
+	return image.format != 0 && decodeImage(fileName, true, usage, image) && upload(image, generateMipMaps);
+}
+
+bool Texture2D::readImage(const string& fileName, TextureUsage usage, TextureImage& image)
 {
-	int width, height, components;
+	if (DdsFile::isUpToDate(fileName) && DdsFile::read(DdsFile::cookedFilename(fileName), image))
+	{
+		image.srgb = TextureFormat::isSrgb(usage);
+		return true;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	uint32_t mipOptions = MipGenerator::getOptionsKey(MipGenerator::getOptions());
+	std::shared_ptr<TextureCache> cache = std::make_shared<TextureCache>();
+	if (cache->open(fileName, usage, mipOptions))
+	{
+		const TextureCacheHeader& header = cache->getHeader();
+		image.width = (int)header.width;
+		image.height = (int)header.height;
+		image.components = (int)header.components;
+		image.format = 0;
+		image.srgb = TextureFormat::isSrgb(usage);
+		image.mipCount = (int)header.mipCount;
+		image.pixels.clear();
+		image.cache = cache;
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		fmt::println("Texture '{}': {}x{}, {} mips mapped from cache in {:.2f} ms", fileName, image.width, image.height, image.mipCount, ms);
+		return true;
+	}
 
-	// Use stbi image library to load our image
-	stbi_set_flip_vertically_on_load(true);
-	unsigned char* imageData = stbi_load(fileName.c_str(), &width, &height, &components, STBI_rgb_alpha);
+	if (!decodeImage(fileName, true, usage, image))
+		return false;
+	double decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	MipGenerator::generateMips(image);
+	TextureCache::write(fileName, image, usage, mipOptions);
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	fmt::println("Texture '{}': {}x{} decoded in {:.2f} ms, {} mips built and cached in {:.2f} ms", fileName,
+		image.width, image.height, decodeMs, image.mipCount, ms - decodeMs);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Decodes with stb image.  stbi_set_flip_vertically_on_load is a global
+// setting, so the rows are flipped here while copying out of stb's buffer.
+//-----------------------------------------------------------------------------
+bool Texture2D::decodeImage(const string& fileName, bool flipVertically, int components, TextureImage& image)
+{
+	int width, height, fileComponents;
+	unsigned char* imageData = stbi_load(fileName.c_str(), &width, &height, &fileComponents, components);
 
 	if (imageData == NULL)
 	{
@@ -54,6 +129,55 @@ bool Texture2D::loadTexture(const string& fileName, bool generateMipMaps)
 		return false;
 	}
 
+	image.width = width;
+	image.height = height;
+	image.components = (components != 0) ? components : fileComponents;
+	image.format = 0;
+	image.srgb = false;
+	image.mipCount = 1;
+	image.cache.reset();
+
+	size_t rowBytes = (size_t)width * image.components;
+	image.pixels.resize(rowBytes * height);
+	for (int y = 0; y < height; y++)
+	{
+		int source = flipVertically ? height - 1 - y : y;
+		std::memcpy(&image.pixels[rowBytes * y], imageData + rowBytes * source, rowBytes);
+	}
+
+	stbi_image_free(imageData);
+	return true;
+}
+
+bool Texture2D::decodeImage(const string& fileName, bool flipVertically, TextureUsage usage, TextureImage& image)
+{
+	int width, height, fileComponents;
+	if (!stbi_info(fileName.c_str(), &width, &height, &fileComponents))
+	{
+		fmt::println("Error loading texture '{}'", fileName);
+		return false;
+	}
+
+	if (!decodeImage(fileName, flipVertically, TextureFormat::getComponents(fileComponents, usage), image))
+		return false;
+
+	image.srgb = TextureFormat::isSrgb(usage);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Creates the GL texture from decoded 8-bit pixels
+//-----------------------------------------------------------------------------
+bool Texture2D::upload(const TextureImage& image, bool generateMipMaps)
+{
+	if (image.format != 0)
+		return uploadCompressed(image);
+
+	if (image.data() == nullptr || image.components < 1 || image.components > 4)
+		return false;
+
+	int levels = generateMipMaps ? MipGenerator::getMipCount(image.width, image.height) : 1;
+
 	glGenTextures(1, &mTexture);
 	glBindTexture(GL_TEXTURE_2D, mTexture); // all upcoming GL_TEXTURE_2D operations will affect our texture object (mTexture)
 
@@ -66,20 +190,269 @@ bool Texture2D::loadTexture(const string& fileName, bool generateMipMaps)
 	// GL_NEAREST
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	// Trilinear where there is a chain to sample, GL_LINEAR alone never leaves level 0
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (levels > 1) ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, imageData);
+	uploadLevels(image, levels);
+
+	glBindTexture(GL_TEXTURE_2D, 0); // unbind texture when done so we don't accidentally mess up our mTexture
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Allocates 'levels' levels and fills them from the chain of 'image',
+// generating those it does not have.  One and two channel textures read as
+// gray, so shaders can sample every texture as RGBA.
+//-----------------------------------------------------------------------------
+void Texture2D::uploadLevels(const TextureImage& image, int levels)
+{
+	GLenum internalFormat = TextureFormat::getInternalFormat(image.components, image.srgb);
+	GLenum pixelFormat = TextureFormat::getPixelFormat(image.components);
+	int provided = std::min(image.mipCount, levels);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+	if (image.components <= 2)
+	{
+		GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, (image.components == 2) ? GL_GREEN : GL_ONE };
+		glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	}
+
+	// Rows of one and three channel levels are not multiples of 4 bytes
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	bool immutable = hasTexStorage();
+	if (immutable)
+		glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, image.width, image.height);
 
-	if (generateMipMaps)
+	const unsigned char* level = image.data();
+	int width = image.width;
+	int height = image.height;
+	for (int mip = 0; mip < provided; mip++)
+	{
+		if (immutable)
+			glTexSubImage2D(GL_TEXTURE_2D, mip, 0, 0, width, height, pixelFormat, GL_UNSIGNED_BYTE, level);
+		else
+			glTexImage2D(GL_TEXTURE_2D, mip, internalFormat, width, height, 0, pixelFormat, GL_UNSIGNED_BYTE, level);
+
+		level += (size_t)width * height * image.components;
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+
+	if (provided < levels)
 		glGenerateMipmap(GL_TEXTURE_2D);
 
-	stbi_image_free(imageData);
-	glBindTexture(GL_TEXTURE_2D, 0); // unbind texture when done so we don't accidentally mess up our mTexture
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	mWidth = image.width;
+	mHeight = image.height;
+	mLevels = levels;
+	mInternalFormat = internalFormat;
+}
 
+//-----------------------------------------------------------------------------
+// Uploads every level of the cooked mip chain as is
+//-----------------------------------------------------------------------------
+bool Texture2D::uploadCompressed(const TextureImage& image)
+{
+	GLenum format = image.srgb ? TextureFormat::getSrgbFormat(image.format) : image.format;
+	if (!isFormatSupported(format))
+		return false;
+
+	glGenTextures(1, &mTexture);
+	glBindTexture(GL_TEXTURE_2D, mTexture);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (image.mipCount > 1) ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// The chain may stop short of 1x1
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.mipCount - 1);
+
+	bool immutable = hasTexStorage();
+	if (immutable)
+		glTexStorage2D(GL_TEXTURE_2D, image.mipCount, format, image.width, image.height);
+
+	const unsigned char* level = image.data();
+	int width = image.width;
+	int height = image.height;
+	for (int mip = 0; mip < image.mipCount; mip++)
+	{
+		size_t size = TextureCompressor::getImageSize(format, width, height);
+		if (immutable)
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, mip, 0, 0, width, height, format, (GLsizei)size, level);
+		else
+			glCompressedTexImage2D(GL_TEXTURE_2D, mip, format, width, height, 0, (GLsizei)size, level);
+
+		level += size;
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	mWidth = image.width;
+	mHeight = image.height;
+	mLevels = image.mipCount;
+	mInternalFormat = format;
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// glTexStorage2D is core in GL 4.2; before, every level is specified on its
+// own
+//-----------------------------------------------------------------------------
+bool Texture2D::hasTexStorage()
+{
+	return GLAD_GL_VERSION_4_2 != 0;
+}
+
+size_t Texture2D::getMemorySize() const
+{
+	return (mTexture != 0) ? TextureFormat::getMemorySize(mInternalFormat, mWidth, mHeight, mLevels) : 0;
+}
+
+size_t Texture2D::getRgba8Size() const
+{
+	if (mTexture == 0 || TextureCompressor::getBlockBytes(mInternalFormat) != 0)
+		return getMemorySize();
+	return TextureFormat::getMemorySize(GL_RGBA8, mWidth, mHeight, mLevels);
+}
+
+size_t Texture2D::getFullMemorySize() const
+{
+	return isDemoted() ? mFullMemorySize : getMemorySize();
+}
+
+//-----------------------------------------------------------------------------
+// Uploads the tail of the image's chain from the first level that fits in
+// 'maxSize' as a texture of its own, then deletes the full one.  Sampling
+// with the same coordinates reads the same image, only blurrier.
+//-----------------------------------------------------------------------------
+bool Texture2D::demote(const string& fileName, TextureUsage usage, int maxSize)
+{
+	if (mTexture == 0 || isDemoted() || std::max(mWidth, mHeight) <= maxSize)
+		return false;
+
+	TextureImage image;
+	if (!readImage(fileName, usage, image))
+		return false;
+
+	auto levelSize = [&image](int width, int height) {
+		return (image.format != 0) ? TextureCompressor::getImageSize(image.format, width, height) : (size_t)width * height * image.components;
+	};
+
+	int firstLevel = 0;
+	int width = image.width;
+	int height = image.height;
+	size_t offset = 0;
+	while (firstLevel + 1 < image.mipCount && std::max(width, height) > maxSize)
+	{
+		offset += levelSize(width, height);
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+		firstLevel++;
+	}
+	if (firstLevel == 0)
+		return false;
+
+	TextureImage low;
+	low.width = width;
+	low.height = height;
+	low.components = image.components;
+	low.format = image.format;
+	low.srgb = image.srgb;
+	low.mipCount = image.mipCount - firstLevel;
+
+	size_t size = 0;
+	for (int mip = 0; mip < low.mipCount; mip++)
+	{
+		size += levelSize(width, height);
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+	low.pixels.assign(image.data() + offset, image.data() + offset + size);
+
+	size_t fullMemorySize = getMemorySize();
+	GLuint full = mTexture;
+	if (!upload(low, true))
+	{
+		mTexture = full;
+		return false;
+	}
+	glDeleteTextures(1, &full);
+
+	mFirstLevel = firstLevel;
+	mFullMemorySize = fullMemorySize;
+	return true;
+}
+
+bool Texture2D::restore(const string& fileName, TextureUsage usage)
+{
+	if (!isDemoted())
+		return false;
+
+	TextureImage image;
+	if (!readImage(fileName, usage, image))
+		return false;
+
+	GLuint low = mTexture;
+	if (!upload(image, true))
+	{
+		mTexture = low;
+		return false;
+	}
+	glDeleteTextures(1, &low);
+
+	mFirstLevel = 0;
+	mFullMemorySize = 0;
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// RGTC is core in GL 3.0; S3TC and BPTC depend on extensions, which are
+// looked up once, as is sRGB S3TC
+//-----------------------------------------------------------------------------
+bool Texture2D::isFormatSupported(GLenum format)
+{
+	static int s3tc = -1, s3tcSrgb = -1, bptc = -1;
+	if (s3tc < 0)
+	{
+		s3tc = s3tcSrgb = bptc = 0;
+		GLint extensionCount = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+		for (GLint i = 0; i < extensionCount; i++)
+		{
+			const char* name = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+			if (name == nullptr)
+				continue;
+			if (std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+				s3tc = 1;
+			else if (std::strcmp(name, "GL_ARB_texture_compression_bptc") == 0)
+				bptc = 1;
+			else if (std::strcmp(name, "GL_EXT_texture_sRGB") == 0 || std::strcmp(name, "GL_EXT_texture_compression_s3tc_srgb") == 0)
+				s3tcSrgb = 1;
+		}
+	}
+
+	switch (format)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:			return s3tc == 1;
+	case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:	return s3tc == 1 && s3tcSrgb == 1;
+	case GL_COMPRESSED_RG_RGTC2:					return true;
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:
+	case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:		return bptc == 1;
+	default:										return false;
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Bind the texture unit passed in as the active texture in the shader
 //-----------------------------------------------------------------------------
@@ -89,6 +462,7 @@ void Texture2D::bind(GLuint texUnit)
 
 	glActiveTexture(GL_TEXTURE0 + texUnit);
 	glBindTexture(GL_TEXTURE_2D, mTexture);
+	mLastUsedFrame = ResidencyManager::getFrame();
 }
 
 //-----------------------------------------------------------------------------
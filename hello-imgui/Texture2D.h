@@ -8,24 +8,103 @@
 #define TEXTURE2D_H
 
 #include <glad/glad.h>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
 using std::string;
 
+#include "TextureFormat.h"
+
+class TextureCache;
+
+// Pixels decoded on the CPU, waiting to be uploaded
+struct TextureImage
+{
+	int width = 0;
+	int height = 0;
+	int components = 0;
+	GLenum format = 0;		// block compressed internal format, 0 for 8-bit pixels
+	bool srgb = false;		// sRGB encoded color, sampled as linear
+	int mipCount = 1;		// levels in 'pixels', largest first
+	std::vector<unsigned char> pixels;
+	std::shared_ptr<TextureCache> cache;	// when set, the levels are read from its mapping instead
+
+	const unsigned char* data() const;
+};
+
 class Texture2D
 {
 public:
 	Texture2D();
 	virtual ~Texture2D();
 
-	bool loadTexture(const string& fileName, bool generateMipMaps = true);
+	bool loadTexture(const string& fileName, bool generateMipMaps = true, TextureUsage usage = TEXTURE_USAGE_COLOR);
+
+	// Decodes an image file into 'image' with 'components' channels (0 keeps
+	// the file's).  Makes no GL calls and touches no global decoder state,
+	// so it can run on any thread.
+	static bool decodeImage(const string& fileName, bool flipVertically, int components, TextureImage& image);
+
+	// Decodes with the channels and color space TextureFormat picks for 'usage'
+	static bool decodeImage(const string& fileName, bool flipVertically, TextureUsage usage, TextureImage& image);
+
+	// The image loadTexture uploads: the cooked, block compressed file (see
+	// DdsFile) when it is up to date, otherwise the mipmapped RGBA pixels
+	// from the texture cache, decoding the image and writing the cache when
+	// that is missing or stale.  Like decodeImage, safe on any thread.
+	static bool readImage(const string& fileName, TextureUsage usage, TextureImage& image);
+
+	// Creates the texture from 8-bit pixels, e.g. from decodeImage, or from a
+	// compressed mip chain, in the format TextureFormat picks and with
+	// immutable storage where the GL has it.  A mip chain, e.g. from the
+	// texture cache, is uploaded level by level instead of generating the
+	// mipmaps.  Fails for compressed formats the GL does not support, in
+	// which case the caller decodes the source instead.
+	bool upload(const TextureImage& image, bool generateMipMaps = true);
+
+	// Whether the GL can sample 'format', GL thread only
+	static bool isFormatSupported(GLenum format);
+
+	// Whether textures are allocated immutable, with glTexStorage2D
+	static bool hasTexStorage();
+	bool isLoaded() const { return mTexture != 0; }
+
+	int getWidth() const { return mWidth; }
+	int getHeight() const { return mHeight; }
+	int getLevels() const { return mLevels; }
+	GLenum getInternalFormat() const { return mInternalFormat; }
+
+	// Video memory of the texture, and what it took as RGBA8 before the
+	// format was picked by usage (compressed textures are unchanged)
+	size_t getMemorySize() const;
+	size_t getRgba8Size() const;
+
+	// Residency (see ResidencyManager): demote re-creates the texture from
+	// its levels no larger than 'maxSize', restore from the whole chain
+	// again.  Both re-read the image 'fileName' was loaded from for 'usage'.
+	bool demote(const string& fileName, TextureUsage usage, int maxSize);
+	bool restore(const string& fileName, TextureUsage usage);
+	bool isDemoted() const { return mFirstLevel > 0; }
+	size_t getFullMemorySize() const;		// with every level resident
+	uint64_t getLastUsedFrame() const { return mLastUsedFrame; }		// last bound, in ResidencyManager frames
+
 	void bind(GLuint texUnit = 0);
 	void unbind(GLuint texUnit);
 	void destroy();
 
 private:
+	bool uploadCompressed(const TextureImage& image);
+	void uploadLevels(const TextureImage& image, int levels);
+
 	Texture2D(const Texture2D& rhs);
 	Texture2D& operator= (const Texture2D& rhs) {return *this;}
 
 	GLuint mTexture;
+	int mWidth, mHeight, mLevels;
+	GLenum mInternalFormat;
+	int mFirstLevel;				// of the full chain, while demoted
+	size_t mFullMemorySize;			// while demoted
+	uint64_t mLastUsedFrame;
 };
 #endif //TEXTURE2D_H
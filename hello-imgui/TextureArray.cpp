@@ -0,0 +1,169 @@
+//-----------------------------------------------------------------------------
+// TextureArray.cpp
+//
+// Images of one size and format as the layers of a GL_TEXTURE_2D_ARRAY.
+// Objects whose diffuse maps share an array draw without switching
+// textures, the shader picks each one's layer (see InstanceData::layer).
+//-----------------------------------------------------------------------------
+#include "TextureArray.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "TextureCompressor.h"
+#include "TextureFormat.h"
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+TextureArray::TextureArray()
+	: mTexture(0),
+	  mWidth(0),
+	  mHeight(0),
+	  mLevels(0),
+	  mLayers(0),
+	  mInternalFormat(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+TextureArray::~TextureArray()
+{
+	// Don't do this
+	// glDeleteTextures(1, &mTexture);
+}
+
+void TextureArray::destroy()
+{
+	glDeleteTextures(1, &mTexture);
+	mTexture = 0;
+	mLayers = 0;
+}
+
+bool TextureArray::isCompatible(const TextureImage& first, const TextureImage& image)
+{
+	return image.width == first.width && image.height == first.height && image.format == first.format &&
+		image.components == first.components && image.srgb == first.srgb && image.mipCount == first.mipCount;
+}
+
+//-----------------------------------------------------------------------------
+// Allocates every level of every layer, with immutable storage where the GL
+// has it, then fills them layer by layer
+//-----------------------------------------------------------------------------
+bool TextureArray::create(const std::vector<TextureImage>& layers)
+{
+	if (layers.empty() || (int)layers.size() > getMaxLayers())
+		return false;
+
+	const TextureImage& first = layers[0];
+	for (const TextureImage& image : layers)
+	{
+		if (!isCompatible(first, image) || image.data() == nullptr)
+			return false;
+	}
+
+	bool compressed = first.format != 0;
+	GLenum internalFormat = compressed ? (first.srgb ? TextureFormat::getSrgbFormat(first.format) : first.format) :
+		TextureFormat::getInternalFormat(first.components, first.srgb);
+	GLenum pixelFormat = TextureFormat::getPixelFormat(first.components);
+	if (compressed && !Texture2D::isFormatSupported(internalFormat))
+		return false;
+
+	glGenTextures(1, &mTexture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture);
+
+	// As Texture2D::upload sets them
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, (first.mipCount > 1) ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, first.mipCount - 1);
+
+	if (!compressed && first.components <= 2)
+	{
+		GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, (first.components == 2) ? GL_GREEN : GL_ONE };
+		glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	GLsizei layerCount = (GLsizei)layers.size();
+	bool immutable = Texture2D::hasTexStorage();
+	if (immutable)
+	{
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, first.mipCount, internalFormat, first.width, first.height, layerCount);
+	}
+	else
+	{
+		int width = first.width;
+		int height = first.height;
+		for (int mip = 0; mip < first.mipCount; mip++)
+		{
+			if (compressed)
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, mip, internalFormat, width, height, layerCount, 0,
+					(GLsizei)(TextureCompressor::getImageSize(internalFormat, width, height) * layerCount), nullptr);
+			else
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, mip, internalFormat, width, height, layerCount, 0, pixelFormat, GL_UNSIGNED_BYTE, nullptr);
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+	}
+
+	for (GLsizei layer = 0; layer < layerCount; layer++)
+	{
+		const unsigned char* level = layers[layer].data();
+		int width = first.width;
+		int height = first.height;
+		for (int mip = 0; mip < first.mipCount; mip++)
+		{
+			size_t size = compressed ? TextureCompressor::getImageSize(internalFormat, width, height) : (size_t)width * height * first.components;
+			if (compressed)
+				glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, mip, 0, 0, layer, width, height, 1, internalFormat, (GLsizei)size, level);
+			else
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, mip, 0, 0, layer, width, height, 1, pixelFormat, GL_UNSIGNED_BYTE, level);
+
+			level += size;
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	mWidth = first.width;
+	mHeight = first.height;
+	mLevels = first.mipCount;
+	mLayers = (int)layerCount;
+	mInternalFormat = internalFormat;
+	return true;
+}
+
+size_t TextureArray::getMemorySize() const
+{
+	return (mTexture != 0) ? TextureFormat::getMemorySize(mInternalFormat, mWidth, mHeight, mLevels) * mLayers : 0;
+}
+
+int TextureArray::getMaxLayers()
+{
+	static GLint maxLayers = 0;
+	if (maxLayers == 0)
+		glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	return (int)maxLayers;
+}
+
+void TextureArray::bind(GLuint texUnit)
+{
+	assert(texUnit >= 0 && texUnit < 32);
+
+	glActiveTexture(GL_TEXTURE0 + texUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture);
+}
+
+void TextureArray::unbind(GLuint texUnit)
+{
+	glActiveTexture(GL_TEXTURE0 + texUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
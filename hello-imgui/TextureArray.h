@@ -0,0 +1,56 @@
+//-----------------------------------------------------------------------------
+// TextureArray.h
+//
+// Images of one size and format as the layers of a GL_TEXTURE_2D_ARRAY.
+// Objects whose diffuse maps share an array draw without switching
+// textures, the shader picks each one's layer (see InstanceData::layer).
+//-----------------------------------------------------------------------------
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "Texture2D.h"
+
+class TextureArray
+{
+public:
+	TextureArray();
+	virtual ~TextureArray();
+
+	// Whether 'image' can be a layer of an array holding 'first': the same
+	// size, channels or compressed format, color space and mip count
+	static bool isCompatible(const TextureImage& first, const TextureImage& image);
+
+	// Creates the array with one layer per image, in order, each with its
+	// mip chain, in the format Texture2D::upload would pick.  The images must
+	// be compatible and are uploaded as they are, no mipmaps are generated.
+	bool create(const std::vector<TextureImage>& layers);
+
+	bool isLoaded() const { return mTexture != 0; }
+	int getLayerCount() const { return mLayers; }
+	int getWidth() const { return mWidth; }
+	int getHeight() const { return mHeight; }
+	int getLevels() const { return mLevels; }
+	GLenum getInternalFormat() const { return mInternalFormat; }
+	size_t getMemorySize() const;
+
+	// Most layers an array may have, GL_MAX_ARRAY_TEXTURE_LAYERS, GL thread only
+	static int getMaxLayers();
+
+	void bind(GLuint texUnit = 0);
+	void unbind(GLuint texUnit);
+	void destroy();
+
+private:
+	TextureArray(const TextureArray& rhs);
+	TextureArray& operator= (const TextureArray& rhs) {return *this;}
+
+	GLuint mTexture;
+	int mWidth, mHeight, mLevels, mLayers;
+	GLenum mInternalFormat;
+};
+#endif // TEXTURE_ARRAY_H
@@ -0,0 +1,174 @@
+//-----------------------------------------------------------------------------
+// TextureCache.cpp
+//
+// Versioned binary texture cache.  Holds the decoded, flipped 8-bit pixels of
+// an image with its whole mip chain, so a warm start neither decodes the
+// image nor builds mipmaps, and uploads every level straight from the
+// mapped file.
+//-----------------------------------------------------------------------------
+#include "TextureCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <fmt/core.h>
+
+#include "MeshCache.h"
+#include "MipGenerator.h"
+
+namespace
+{
+	const char TEXTURE_CACHE_MAGIC[4] = { 'T', 'E', 'X', 'C' };
+
+	// Level 0 starts 16 byte aligned, right after the header
+	const uint64_t PIXEL_OFFSET = (sizeof(TextureCacheHeader) + 15) & ~(uint64_t)15;
+}
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+TextureCache::TextureCache()
+	: mHeader(nullptr)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+TextureCache::~TextureCache()
+{
+	close();
+}
+
+//-----------------------------------------------------------------------------
+// Cache files live next to their source, e.g. textures/crate.jpg.texbin, or
+// textures/crate.jpg.mask.texbin for its single channel mask
+//-----------------------------------------------------------------------------
+std::string TextureCache::cacheFilename(const std::string& sourceFile, TextureUsage usage)
+{
+	return sourceFile + ((usage == TEXTURE_USAGE_MASK) ? ".mask.texbin" : ".texbin");
+}
+
+//-----------------------------------------------------------------------------
+// Maps the cache of 'sourceFile', validated like MeshCache: version, sizes,
+// then the source size and write time, or failing that its content hash
+//-----------------------------------------------------------------------------
+bool TextureCache::open(const std::string& sourceFile, TextureUsage usage, uint32_t mipOptions)
+{
+	close();
+
+	MeshCache::SourceKey key;
+	if (!MeshCache::getSourceKey(sourceFile, key))
+		return false;
+
+	if (!mFile.open(cacheFilename(sourceFile, usage)))
+		return false;
+
+	if (mFile.size() < sizeof(TextureCacheHeader))
+	{
+		close();
+		return false;
+	}
+
+	const TextureCacheHeader* header = reinterpret_cast<const TextureCacheHeader*>(mFile.data());
+
+	bool valid = std::memcmp(header->magic, TEXTURE_CACHE_MAGIC, sizeof(TEXTURE_CACHE_MAGIC)) == 0 &&
+		header->version == TEXTURE_CACHE_VERSION &&
+		header->mipOptions == mipOptions &&
+		header->usage == (uint32_t)usage &&
+		header->components >= 1 && header->components <= 4 &&
+		header->width > 0 && header->height > 0 &&
+		header->mipCount == (uint32_t)MipGenerator::getMipCount((int)header->width, (int)header->height) &&
+		header->pixelBytes == MipGenerator::getChainSize((int)header->width, (int)header->height, (int)header->mipCount, (int)header->components) &&
+		header->pixelOffset + header->pixelBytes <= mFile.size() &&
+		header->sourceSize == key.size;
+
+	if (valid && header->sourceTime != key.time)
+	{
+		uint64_t hash = 0;
+		valid = MeshCache::hashFile(sourceFile, hash) && hash == header->sourceHash;
+	}
+
+	if (!valid)
+	{
+		close();
+		return false;
+	}
+
+	mHeader = header;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Unmaps the cache file
+//-----------------------------------------------------------------------------
+void TextureCache::close()
+{
+	mHeader = nullptr;
+	mFile.close();
+}
+
+//-----------------------------------------------------------------------------
+// Writes the cache for 'sourceFile' from its full mip chain, under a
+// temporary name that is renamed once complete
+//-----------------------------------------------------------------------------
+bool TextureCache::write(const std::string& sourceFile, const TextureImage& image, TextureUsage usage, uint32_t mipOptions)
+{
+	if (image.format != 0 || image.mipCount != MipGenerator::getMipCount(image.width, image.height))
+		return false;
+
+	MeshCache::SourceKey key;
+	uint64_t hash = 0;
+	if (!MeshCache::getSourceKey(sourceFile, key) || !MeshCache::hashFile(sourceFile, hash))
+		return false;
+
+	TextureCacheHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, TEXTURE_CACHE_MAGIC, sizeof(TEXTURE_CACHE_MAGIC));
+	header.version = TEXTURE_CACHE_VERSION;
+	header.sourceSize = key.size;
+	header.sourceTime = key.time;
+	header.sourceHash = hash;
+	header.width = (uint32_t)image.width;
+	header.height = (uint32_t)image.height;
+	header.mipCount = (uint32_t)image.mipCount;
+	header.mipOptions = mipOptions;
+	header.components = (uint32_t)image.components;
+	header.usage = (uint32_t)usage;
+	header.pixelOffset = PIXEL_OFFSET;
+	header.pixelBytes = MipGenerator::getChainSize(image.width, image.height, image.mipCount, image.components);
+
+	std::string filename = cacheFilename(sourceFile, usage);
+	std::string tempFilename = filename + ".tmp";
+
+	std::ofstream file(tempFilename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		fmt::println("Unable to write texture cache '{}'", filename);
+		return false;
+	}
+
+	const char padding[16] = {};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(padding, (std::streamsize)(header.pixelOffset - sizeof(header)));
+	file.write(reinterpret_cast<const char*>(image.data()), (std::streamsize)header.pixelBytes);
+	file.close();
+
+	std::error_code ec;
+	if (file.fail())
+	{
+		std::filesystem::remove(tempFilename, ec);
+		fmt::println("Unable to write texture cache '{}'", filename);
+		return false;
+	}
+
+	std::filesystem::rename(tempFilename, filename, ec);
+	if (ec)
+	{
+		std::filesystem::remove(tempFilename, ec);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,70 @@
+//-----------------------------------------------------------------------------
+// TextureCache.h
+//
+// Versioned binary texture cache.  Holds the decoded, flipped 8-bit pixels of
+// an image with its whole mip chain, so a warm start neither decodes the
+// image nor builds mipmaps, and uploads every level straight from the
+// mapped file.
+//-----------------------------------------------------------------------------
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "MappedFile.h"
+#include "Texture2D.h"
+
+// Bump whenever the layout of the cache or of the pixel data changes
+const uint32_t TEXTURE_CACHE_VERSION = 3;
+
+struct TextureCacheHeader
+{
+	char     magic[4];			// "TEXC"
+	uint32_t version;
+
+	// Source file key, see MeshCache
+	uint64_t sourceSize;
+	int64_t  sourceTime;
+	uint64_t sourceHash;
+
+	// 'components' bytes per texel, rows bottom up, mip levels largest first
+	// and back to back
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipCount;
+	uint32_t mipOptions;		// MipGenerator::getOptionsKey of the filter that built the levels
+	uint32_t components;
+	uint32_t usage;				// TextureUsage the channels were picked for
+	uint64_t pixelOffset;
+	uint64_t pixelBytes;
+};
+
+class TextureCache
+{
+public:
+	TextureCache();
+	~TextureCache();
+
+	// Maps the cache file of 'sourceFile' if one exists, is up to date and
+	// was made for 'usage' with the same 'mipOptions'
+	bool open(const std::string& sourceFile, TextureUsage usage, uint32_t mipOptions);
+	void close();
+	bool isOpen() const { return mHeader != nullptr; }
+
+	// 'image' holds the full mip chain, see MipGenerator::generateMips
+	static bool write(const std::string& sourceFile, const TextureImage& image, TextureUsage usage, uint32_t mipOptions);
+	static std::string cacheFilename(const std::string& sourceFile, TextureUsage usage);
+
+	const TextureCacheHeader& getHeader() const { return *mHeader; }
+	const unsigned char* getPixels() const      { return mFile.data() + mHeader->pixelOffset; }
+
+private:
+	TextureCache(const TextureCache& rhs);
+	TextureCache& operator= (const TextureCache& rhs) { return *this; }
+
+	MappedFile mFile;
+	const TextureCacheHeader* mHeader;
+};
+#endif // TEXTURE_CACHE_H
@@ -0,0 +1,443 @@
+//-----------------------------------------------------------------------------
+// TextureCompressor.cpp
+//
+// Block compression of RGBA8 images into the BCn formats GL can sample
+// directly: BC1 (DXT1) for opaque color, BC3 (DXT5) for color with alpha and
+// BC5 (RGTC2) for two channel data such as normal maps.
+//-----------------------------------------------------------------------------
+#include "TextureCompressor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+namespace
+{
+	//-------------------------------------------------------------------------
+	// RGB565 endpoints, expanded to 8 bits by replicating the high bits
+	//-------------------------------------------------------------------------
+	uint16_t packRgb565(const glm::vec3& color)
+	{
+		int r = (int)std::lround(glm::clamp(color.r, 0.0f, 255.0f) * 31.0f / 255.0f);
+		int g = (int)std::lround(glm::clamp(color.g, 0.0f, 255.0f) * 63.0f / 255.0f);
+		int b = (int)std::lround(glm::clamp(color.b, 0.0f, 255.0f) * 31.0f / 255.0f);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	glm::ivec3 unpackRgb565(uint16_t color)
+	{
+		int r = (color >> 11) & 31;
+		int g = (color >> 5) & 63;
+		int b = color & 31;
+		return glm::ivec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+	}
+
+	// The four colors of a BC1 block in four color mode (color0 > color1)
+	void colorPalette(uint16_t color0, uint16_t color1, glm::ivec3 palette[4])
+	{
+		palette[0] = unpackRgb565(color0);
+		palette[1] = unpackRgb565(color1);
+		palette[2] = (2 * palette[0] + palette[1]) / 3;
+		palette[3] = (palette[0] + 2 * palette[1]) / 3;
+	}
+
+	int distanceSquared(const glm::ivec3& a, const glm::ivec3& b)
+	{
+		glm::ivec3 d = a - b;
+		return d.x * d.x + d.y * d.y + d.z * d.z;
+	}
+
+	// Picks the closest palette entry per pixel, returns the summed error
+	int assignColorIndices(const glm::ivec3 pixels[16], const glm::ivec3 palette[4], int indices[16])
+	{
+		int error = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			int bestError = distanceSquared(pixels[i], palette[0]);
+			for (int p = 1; p < 4; p++)
+			{
+				int e = distanceSquared(pixels[i], palette[p]);
+				if (e < bestError)
+				{
+					best = p;
+					bestError = e;
+				}
+			}
+			indices[i] = best;
+			error += bestError;
+		}
+		return error;
+	}
+
+	//-------------------------------------------------------------------------
+	// Endpoints that best fit the given index assignment in the least
+	// squares sense; false if every pixel uses the same weight
+	//-------------------------------------------------------------------------
+	bool fitEndpoints(const glm::ivec3 pixels[16], const int indices[16], glm::vec3& end0, glm::vec3& end1)
+	{
+		static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		glm::vec3 ax(0.0f), bx(0.0f);
+		for (int i = 0; i < 16; i++)
+		{
+			float a = weights[indices[i]];
+			float b = 1.0f - a;
+			glm::vec3 x(pixels[i]);
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			ax += a * x;
+			bx += b * x;
+		}
+
+		float determinant = aa * bb - ab * ab;
+		if (std::abs(determinant) < 1e-6f)
+			return false;
+
+		end0 = (ax * bb - bx * ab) / determinant;
+		end1 = (bx * aa - ax * ab) / determinant;
+		return true;
+	}
+
+	//-------------------------------------------------------------------------
+	// BC1 color block: endpoints from the extremes along the principal axis
+	// of the colors, then refined by least squares while that lowers the error
+	//-------------------------------------------------------------------------
+	void compressColorBlock(const glm::ivec3 pixels[16], unsigned char* block)
+	{
+		glm::vec3 mean(0.0f);
+		for (int i = 0; i < 16; i++)
+			mean += glm::vec3(pixels[i]);
+		mean /= 16.0f;
+
+		float covariance[6] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			glm::vec3 d = glm::vec3(pixels[i]) - mean;
+			covariance[0] += d.r * d.r;
+			covariance[1] += d.r * d.g;
+			covariance[2] += d.r * d.b;
+			covariance[3] += d.g * d.g;
+			covariance[4] += d.g * d.b;
+			covariance[5] += d.b * d.b;
+		}
+
+		// Power iteration for the dominant eigenvector
+		glm::vec3 axis(1.0f, 1.0f, 1.0f);
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			glm::vec3 next(covariance[0] * axis.r + covariance[1] * axis.g + covariance[2] * axis.b,
+				covariance[1] * axis.r + covariance[3] * axis.g + covariance[4] * axis.b,
+				covariance[2] * axis.r + covariance[4] * axis.g + covariance[5] * axis.b);
+			float length = glm::length(next);
+			if (length < 1e-6f)
+				break;
+			axis = next / length;
+		}
+
+		float minProjection = 0.0f, maxProjection = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			float projection = glm::dot(glm::vec3(pixels[i]) - mean, axis);
+			minProjection = std::min(minProjection, projection);
+			maxProjection = std::max(maxProjection, projection);
+		}
+
+		uint16_t color0 = packRgb565(mean + axis * maxProjection);
+		uint16_t color1 = packRgb565(mean + axis * minProjection);
+
+		glm::ivec3 palette[4];
+		int indices[16];
+		colorPalette(color0, color1, palette);
+		int error = assignColorIndices(pixels, palette, indices);
+
+		for (int iteration = 0; iteration < 2 && error > 0; iteration++)
+		{
+			glm::vec3 end0, end1;
+			if (!fitEndpoints(pixels, indices, end0, end1))
+				break;
+
+			uint16_t fitted0 = packRgb565(end0);
+			uint16_t fitted1 = packRgb565(end1);
+			int fittedIndices[16];
+			colorPalette(fitted0, fitted1, palette);
+			int fittedError = assignColorIndices(pixels, palette, fittedIndices);
+			if (fittedError >= error)
+				break;
+
+			color0 = fitted0;
+			color1 = fitted1;
+			error = fittedError;
+			std::memcpy(indices, fittedIndices, sizeof(indices));
+		}
+
+		// color0 > color1 selects four color mode; swapping the endpoints
+		// swaps index 0 with 1 and 2 with 3
+		if (color0 < color1)
+		{
+			std::swap(color0, color1);
+			for (int i = 0; i < 16; i++)
+				indices[i] ^= 1;
+		}
+		else if (color0 == color1)
+		{
+			for (int i = 0; i < 16; i++)
+				indices[i] = 0;
+		}
+
+		uint32_t bits = 0;
+		for (int i = 0; i < 16; i++)
+			bits |= (uint32_t)indices[i] << (2 * i);
+
+		block[0] = (unsigned char)(color0 & 0xFF);
+		block[1] = (unsigned char)(color0 >> 8);
+		block[2] = (unsigned char)(color1 & 0xFF);
+		block[3] = (unsigned char)(color1 >> 8);
+		for (int b = 0; b < 4; b++)
+			block[4 + b] = (unsigned char)(bits >> (8 * b));
+	}
+
+	void decompressColorBlock(const unsigned char* block, glm::ivec3 pixels[16])
+	{
+		uint16_t color0 = (uint16_t)(block[0] | (block[1] << 8));
+		uint16_t color1 = (uint16_t)(block[2] | (block[3] << 8));
+		uint32_t bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+
+		glm::ivec3 palette[4];
+		colorPalette(color0, color1, palette);
+
+		// Three colors and black, only written by other encoders
+		if (color0 <= color1)
+		{
+			palette[2] = (palette[0] + palette[1]) / 2;
+			palette[3] = glm::ivec3(0);
+		}
+
+		for (int i = 0; i < 16; i++)
+			pixels[i] = palette[(bits >> (2 * i)) & 3];
+	}
+
+	//-------------------------------------------------------------------------
+	// BC4 block of one channel (BC3 alpha, the two halves of BC5): the range
+	// of the block in eight steps
+	//-------------------------------------------------------------------------
+	void channelPalette(int value0, int value1, int palette[8])
+	{
+		palette[0] = value0;
+		palette[1] = value1;
+		if (value0 > value1)
+		{
+			for (int i = 1; i < 7; i++)
+				palette[1 + i] = ((7 - i) * value0 + i * value1) / 7;
+		}
+		else
+		{
+			for (int i = 1; i < 5; i++)
+				palette[1 + i] = ((5 - i) * value0 + i * value1) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	void compressChannelBlock(const int values[16], unsigned char* block)
+	{
+		int minValue = 255, maxValue = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			minValue = std::min(minValue, values[i]);
+			maxValue = std::max(maxValue, values[i]);
+		}
+
+		int palette[8];
+		channelPalette(maxValue, minValue, palette);
+
+		uint64_t bits = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			for (int p = 1; p < 8; p++)
+			{
+				if (std::abs(values[i] - palette[p]) < std::abs(values[i] - palette[best]))
+					best = p;
+			}
+			bits |= (uint64_t)best << (3 * i);
+		}
+
+		block[0] = (unsigned char)maxValue;
+		block[1] = (unsigned char)minValue;
+		for (int b = 0; b < 6; b++)
+			block[2 + b] = (unsigned char)(bits >> (8 * b));
+	}
+
+	void decompressChannelBlock(const unsigned char* block, int values[16])
+	{
+		int palette[8];
+		channelPalette(block[0], block[1], palette);
+
+		uint64_t bits = 0;
+		for (int b = 0; b < 6; b++)
+			bits |= (uint64_t)block[2 + b] << (8 * b);
+
+		for (int i = 0; i < 16; i++)
+			values[i] = palette[(bits >> (3 * i)) & 7];
+	}
+}
+
+size_t TextureCompressor::getBlockBytes(GLenum format)
+{
+	switch (format)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:			return 8;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+	case GL_COMPRESSED_RG_RGTC2:
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:
+	case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:		return 16;
+	default:										return 0;
+	}
+}
+
+size_t TextureCompressor::getImageSize(GLenum format, int width, int height)
+{
+	size_t blocksX = (size_t)std::max(1, (width + 3) / 4);
+	size_t blocksY = (size_t)std::max(1, (height + 3) / 4);
+	return blocksX * blocksY * getBlockBytes(format);
+}
+
+const char* TextureCompressor::getName(GLenum format)
+{
+	switch (format)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:			return "BC1";
+	case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:			return "BC1 sRGB";
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:			return "BC3";
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:	return "BC3 sRGB";
+	case GL_COMPRESSED_RG_RGTC2:					return "BC5";
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:				return "BC7";
+	case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:		return "BC7 sRGB";
+	default:										return "RGBA8";
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Block by block, edge blocks repeat the last row and column
+//-----------------------------------------------------------------------------
+bool TextureCompressor::compress(GLenum format, const unsigned char* rgba, int width, int height, std::vector<unsigned char>& blocks)
+{
+	size_t blockBytes = getBlockBytes(format);
+	if (blockBytes == 0 || format == GL_COMPRESSED_RGBA_BPTC_UNORM || width <= 0 || height <= 0)
+		return false;
+
+	blocks.resize(getImageSize(format, width, height));
+	unsigned char* out = blocks.data();
+
+	for (int blockY = 0; blockY < height; blockY += 4)
+	{
+		for (int blockX = 0; blockX < width; blockX += 4)
+		{
+			glm::ivec3 colors[16];
+			int alphas[16], reds[16], greens[16];
+			for (int i = 0; i < 16; i++)
+			{
+				int x = std::min(blockX + (i & 3), width - 1);
+				int y = std::min(blockY + (i >> 2), height - 1);
+				const unsigned char* pixel = rgba + ((size_t)y * width + x) * 4;
+				colors[i] = glm::ivec3(pixel[0], pixel[1], pixel[2]);
+				reds[i] = pixel[0];
+				greens[i] = pixel[1];
+				alphas[i] = pixel[3];
+			}
+
+			if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+			{
+				compressColorBlock(colors, out);
+			}
+			else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+			{
+				compressChannelBlock(alphas, out);
+				compressColorBlock(colors, out + 8);
+			}
+			else
+			{
+				compressChannelBlock(reds, out);
+				compressChannelBlock(greens, out + 8);
+			}
+			out += blockBytes;
+		}
+	}
+
+	return true;
+}
+
+bool TextureCompressor::decompress(GLenum format, const unsigned char* blocks, int width, int height, std::vector<unsigned char>& rgba)
+{
+	size_t blockBytes = getBlockBytes(format);
+	if (blockBytes == 0 || format == GL_COMPRESSED_RGBA_BPTC_UNORM || width <= 0 || height <= 0)
+		return false;
+
+	rgba.resize((size_t)width * height * 4);
+	const unsigned char* in = blocks;
+
+	for (int blockY = 0; blockY < height; blockY += 4)
+	{
+		for (int blockX = 0; blockX < width; blockX += 4)
+		{
+			glm::ivec3 colors[16];
+			int first[16], second[16];
+			for (int i = 0; i < 16; i++)
+			{
+				colors[i] = glm::ivec3(0);
+				first[i] = 255;
+				second[i] = 0;
+			}
+
+			if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+			{
+				decompressColorBlock(in, colors);
+			}
+			else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+			{
+				decompressChannelBlock(in, first);
+				decompressColorBlock(in + 8, colors);
+			}
+			else
+			{
+				decompressChannelBlock(in, first);
+				decompressChannelBlock(in + 8, second);
+			}
+			in += blockBytes;
+
+			for (int i = 0; i < 16; i++)
+			{
+				int x = blockX + (i & 3);
+				int y = blockY + (i >> 2);
+				if (x >= width || y >= height)
+					continue;
+
+				unsigned char* pixel = &rgba[((size_t)y * width + x) * 4];
+				if (format == GL_COMPRESSED_RG_RGTC2)
+				{
+					pixel[0] = (unsigned char)first[i];
+					pixel[1] = (unsigned char)second[i];
+					pixel[2] = 0;
+					pixel[3] = 255;
+				}
+				else
+				{
+					pixel[0] = (unsigned char)colors[i].r;
+					pixel[1] = (unsigned char)colors[i].g;
+					pixel[2] = (unsigned char)colors[i].b;
+					pixel[3] = (unsigned char)first[i];
+				}
+			}
+		}
+	}
+
+	return true;
+}
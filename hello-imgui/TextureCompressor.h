@@ -0,0 +1,60 @@
+//-----------------------------------------------------------------------------
+// TextureCompressor.h
+//
+// Block compression of RGBA8 images into the BCn formats GL can sample
+// directly: BC1 (DXT1) for opaque color, BC3 (DXT5) for color with alpha and
+// BC5 (RGTC2) for two channel data such as normal maps.
+//-----------------------------------------------------------------------------
+#ifndef TEXTURE_COMPRESSOR_H
+#define TEXTURE_COMPRESSOR_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+
+// S3TC is an extension in GL 3.3, RGTC is core and BPTC (BC7) is GL 4.2
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RG_RGTC2
+#define GL_COMPRESSED_RG_RGTC2 0x8DBD
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+// Their sRGB variants, for color (EXT_texture_sRGB, BPTC)
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
+
+class TextureCompressor
+{
+public:
+	// Bytes of one 4x4 block, 0 for formats this class does not know
+	static size_t getBlockBytes(GLenum format);
+
+	// Bytes of a 'width' x 'height' image, partial blocks count as whole ones
+	static size_t getImageSize(GLenum format, int width, int height);
+
+	static const char* getName(GLenum format);
+
+	// Compresses 'width' x 'height' RGBA8 pixels.  BC7 is only read, not
+	// written (see DdsFile).
+	static bool compress(GLenum format, const unsigned char* rgba, int width, int height, std::vector<unsigned char>& blocks);
+
+	// Decodes the blocks back to RGBA8 the way the GPU does, e.g. to measure
+	// the error.  BC5 leaves blue at 0 and alpha at 255.
+	static bool decompress(GLenum format, const unsigned char* blocks, int width, int height, std::vector<unsigned char>& rgba);
+};
+#endif // TEXTURE_COMPRESSOR_H
@@ -0,0 +1,216 @@
+//-----------------------------------------------------------------------------
+// TextureCooker.cpp
+//
+// texture-cooker: compresses the images of a directory to BCn with a full
+// mip chain, each next to its source as <image>.dds (see DdsFile), which
+// Texture2D then loads instead of decoding the image.
+//
+//   texture-cooker [--force] [--format bc1|bc3|bc5] [--filter box|kaiser] [directory]
+//
+// The format is picked per image unless given: BC3 if any pixel is not
+// fully opaque, BC1 otherwise.  Mips are filtered in linear light, except
+// for BC5, which holds normals.  Images already cooked are skipped.
+//-----------------------------------------------------------------------------
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "DdsFile.h"
+#include "MipGenerator.h"
+#include "Texture2D.h"
+#include "TextureCompressor.h"
+
+namespace
+{
+	bool isImageFile(const std::filesystem::path& path)
+	{
+		std::string extension = path.extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+		return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".tga" || extension == ".bmp";
+	}
+
+	bool hasAlpha(const TextureImage& image)
+	{
+		for (size_t i = 3; i < image.pixels.size(); i += 4)
+		{
+			if (image.pixels[i] != 255)
+				return true;
+		}
+		return false;
+	}
+
+	// Peak signal to noise ratio over the channels the format keeps
+	double psnr(GLenum format, const std::vector<unsigned char>& original, const std::vector<unsigned char>& decoded)
+	{
+		int channels = (format == GL_COMPRESSED_RG_RGTC2) ? 2 : (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ? 3 : 4;
+
+		double squaredError = 0.0;
+		size_t count = 0;
+		for (size_t i = 0; i < original.size(); i += 4)
+		{
+			for (int c = 0; c < channels; c++)
+			{
+				double d = (double)original[i + c] - (double)decoded[i + c];
+				squaredError += d * d;
+				count++;
+			}
+		}
+
+		if (squaredError == 0.0)
+			return INFINITY;
+		return 10.0 * std::log10(255.0 * 255.0 * (double)count / squaredError);
+	}
+
+	//-------------------------------------------------------------------------
+	// Decodes 'sourceFile' the way Texture2D does and writes the cooked file
+	//-------------------------------------------------------------------------
+	bool cook(const std::string& sourceFile, GLenum forcedFormat)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		TextureImage source;
+		if (!Texture2D::decodeImage(sourceFile, true, 4, source))
+			return false;
+
+		GLenum format = (forcedFormat != 0) ? forcedFormat :
+			hasAlpha(source) ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+
+		// Normal maps are not colors
+		MipOptions mipOptions = MipGenerator::getOptions();
+		if (format == GL_COMPRESSED_RG_RGTC2)
+			mipOptions.srgb = false;
+
+		TextureImage cooked;
+		cooked.width = source.width;
+		cooked.height = source.height;
+		cooked.components = source.components;
+		cooked.format = format;
+		cooked.mipCount = 0;
+
+		std::vector<unsigned char> level = source.pixels;
+		std::vector<unsigned char> next, blocks, decoded;
+		int width = source.width;
+		int height = source.height;
+		double levelZeroPsnr = 0.0;
+		while (true)
+		{
+			TextureCompressor::compress(format, level.data(), width, height, blocks);
+			cooked.pixels.insert(cooked.pixels.end(), blocks.begin(), blocks.end());
+
+			if (cooked.mipCount == 0)
+			{
+				TextureCompressor::decompress(format, blocks.data(), width, height, decoded);
+				levelZeroPsnr = psnr(format, level, decoded);
+			}
+			cooked.mipCount++;
+
+			if (width == 1 && height == 1)
+				break;
+
+			next.resize((size_t)std::max(1, width / 2) * std::max(1, height / 2) * 4);
+			MipGenerator::downsample(level.data(), width, height, next.data(), mipOptions);
+			level.swap(next);
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+
+		std::string cookedFile = DdsFile::cookedFilename(sourceFile);
+		if (!DdsFile::write(cookedFile, cooked))
+			return false;
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		size_t rawBytes = (size_t)source.width * source.height * 4 * 4 / 3;
+		fmt::println("{}: {}x{} {}, {} mips, {} KB -> {} KB as RGBA8 with mips ({:.1f}x), {:.1f} dB, {:.0f} ms", sourceFile,
+			source.width, source.height, TextureCompressor::getName(format), cooked.mipCount, rawBytes / 1024,
+			cooked.pixels.size() / 1024, (double)rawBytes / cooked.pixels.size(), levelZeroPsnr, ms);
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string directory = "textures";
+	GLenum forcedFormat = 0;
+	bool force = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--force") == 0)
+		{
+			force = true;
+		}
+		else if (std::strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+			if (name == "bc1")
+				forcedFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+			else if (name == "bc3")
+				forcedFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+			else if (name == "bc5")
+				forcedFormat = GL_COMPRESSED_RG_RGTC2;
+			else
+			{
+				fmt::println("Unknown format '{}', expected bc1, bc3 or bc5", name);
+				return 1;
+			}
+		}
+		else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+			MipOptions mipOptions = MipGenerator::getOptions();
+			if (name == "box")
+				mipOptions.filter = MIP_FILTER_BOX;
+			else if (name == "kaiser")
+				mipOptions.filter = MIP_FILTER_KAISER;
+			else
+			{
+				fmt::println("Unknown filter '{}', expected box or kaiser", name);
+				return 1;
+			}
+			MipGenerator::setOptions(mipOptions);
+		}
+		else
+		{
+			directory = argv[i];
+		}
+	}
+
+	std::error_code error;
+	std::vector<std::string> sources;
+	for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+	{
+		if (entry.is_regular_file() && isImageFile(entry.path()))
+			sources.push_back(entry.path().generic_string());
+	}
+	if (error)
+	{
+		fmt::println("Cannot read directory '{}'", directory);
+		return 1;
+	}
+	std::sort(sources.begin(), sources.end());
+
+	int cooked = 0, skipped = 0, failed = 0;
+	for (const std::string& source : sources)
+	{
+		if (!force && DdsFile::isUpToDate(source))
+		{
+			skipped++;
+			continue;
+		}
+
+		if (cook(source, forcedFormat))
+			cooked++;
+		else
+			failed++;
+	}
+
+	fmt::println("{} textures cooked, {} up to date, {} failed", cooked, skipped, failed);
+	return (failed > 0) ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+//-----------------------------------------------------------------------------
+// TextureFormat.cpp
+//
+// Which GL format a texture gets, from the channels of its source and what
+// it is used for: color keeps RGB8 or RGBA8 and is stored as sRGB, masks
+// such as specular maps become a single linear R8 channel.
+//-----------------------------------------------------------------------------
+#include "TextureFormat.h"
+
+#include <algorithm>
+
+#include "TextureCompressor.h"
+
+int TextureFormat::getComponents(int sourceComponents, TextureUsage usage)
+{
+	if (usage == TEXTURE_USAGE_MASK)
+		return 1;
+
+	// Gray and gray alpha to RGB and RGBA
+	return (sourceComponents == 2 || sourceComponents == 4) ? 4 : 3;
+}
+
+GLenum TextureFormat::getInternalFormat(int components, bool srgb)
+{
+	switch (components)
+	{
+	case 1:		return GL_R8;
+	case 2:		return GL_RG8;
+	case 3:		return srgb ? GL_SRGB8 : GL_RGB8;
+	default:	return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+	}
+}
+
+GLenum TextureFormat::getPixelFormat(int components)
+{
+	switch (components)
+	{
+	case 1:		return GL_RED;
+	case 2:		return GL_RG;
+	case 3:		return GL_RGB;
+	default:	return GL_RGBA;
+	}
+}
+
+GLenum TextureFormat::getSrgbFormat(GLenum compressedFormat)
+{
+	switch (compressedFormat)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:	return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:	return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:		return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+	default:								return compressedFormat;
+	}
+}
+
+size_t TextureFormat::getMemorySize(GLenum internalFormat, int width, int height, int levels)
+{
+	size_t texelBytes = 0;
+	switch (internalFormat)
+	{
+	case GL_R8:				texelBytes = 1; break;
+	case GL_RG8:			texelBytes = 2; break;
+	case GL_RGB8:
+	case GL_SRGB8:			texelBytes = 3; break;
+	case GL_RGBA8:
+	case GL_SRGB8_ALPHA8:	texelBytes = 4; break;
+	}
+
+	size_t size = 0;
+	for (int level = 0; level < levels; level++)
+	{
+		size += (texelBytes != 0) ? (size_t)width * height * texelBytes : TextureCompressor::getImageSize(internalFormat, width, height);
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+	return size;
+}
+
+const char* TextureFormat::getName(GLenum internalFormat)
+{
+	switch (internalFormat)
+	{
+	case GL_R8:				return "R8";
+	case GL_RG8:			return "RG8";
+	case GL_RGB8:			return "RGB8";
+	case GL_SRGB8:			return "SRGB8";
+	case GL_RGBA8:			return "RGBA8";
+	case GL_SRGB8_ALPHA8:	return "SRGB8_ALPHA8";
+	default:				return TextureCompressor::getName(internalFormat);
+	}
+}
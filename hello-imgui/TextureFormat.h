@@ -0,0 +1,45 @@
+//-----------------------------------------------------------------------------
+// TextureFormat.h
+//
+// Which GL format a texture gets, from the channels of its source and what
+// it is used for: color keeps RGB8 or RGBA8 and is stored as sRGB, masks
+// such as specular maps become a single linear R8 channel.
+//-----------------------------------------------------------------------------
+#ifndef TEXTURE_FORMAT_H
+#define TEXTURE_FORMAT_H
+
+#include <cstddef>
+
+#include <glad/glad.h>
+
+enum TextureUsage
+{
+	TEXTURE_USAGE_COLOR = 0,	// sRGB color, e.g. diffuse maps and the skybox
+	TEXTURE_USAGE_MASK = 1		// one linear channel, e.g. specular maps
+};
+
+class TextureFormat
+{
+public:
+	// Channels kept of a source with 'sourceComponents'.  Core GL has no one
+	// or two channel sRGB formats, so gray color is widened to RGB.
+	static int getComponents(int sourceComponents, TextureUsage usage);
+
+	static bool isSrgb(TextureUsage usage) { return usage == TEXTURE_USAGE_COLOR; }
+
+	// GL_R8 .. GL_RGBA8, or GL_SRGB8 / GL_SRGB8_ALPHA8
+	static GLenum getInternalFormat(int components, bool srgb);
+
+	// GL_RED .. GL_RGBA, for glTexSubImage2D
+	static GLenum getPixelFormat(int components);
+
+	// The sRGB variant of a block compressed format, itself if it has none
+	static GLenum getSrgbFormat(GLenum compressedFormat);
+
+	// Video memory of 'levels' levels, as the format's size; drivers may pad
+	// three channel formats to four
+	static size_t getMemorySize(GLenum internalFormat, int width, int height, int levels);
+
+	static const char* getName(GLenum internalFormat);
+};
+#endif // TEXTURE_FORMAT_H
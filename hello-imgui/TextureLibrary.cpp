@@ -0,0 +1,206 @@
+//-----------------------------------------------------------------------------
+// TextureLibrary.cpp
+//
+// Textures shared by file name, so materials of different meshes that use
+// the same image load and bind one GL texture.
+//-----------------------------------------------------------------------------
+#include "TextureLibrary.h"
+
+#include "AssetLoader.h"
+#include "TextureArray.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace
+{
+	// By file name and usage, failed loads stay in the map as null
+	std::unordered_map<std::string, std::unique_ptr<Texture2D>> gTextures;
+
+	AssetLoader* gAssetLoader = nullptr;
+
+	// Built by buildArrays, with the layer of every texture packed
+	std::vector<std::unique_ptr<TextureArray>> gArrays;
+	std::unordered_map<const Texture2D*, TextureLayer> gLayers;
+}
+
+Texture2D* TextureLibrary::load(const std::string& filename, TextureUsage usage)
+{
+	std::string key = filename + '#' + std::to_string((int)usage);
+	auto existing = gTextures.find(key);
+	if (existing != gTextures.end())
+		return existing->second.get();
+
+	std::unique_ptr<Texture2D> texture(new Texture2D());
+	if (gAssetLoader != nullptr)
+		gAssetLoader->loadTexture(*texture, filename, usage, true);
+	else if (!texture->loadTexture(filename, true, usage))
+		texture.reset();
+
+	Texture2D* result = texture.get();
+	gTextures.emplace(key, std::move(texture));
+	return result;
+}
+
+void TextureLibrary::setAssetLoader(AssetLoader* loader)
+{
+	gAssetLoader = loader;
+}
+
+size_t TextureLibrary::getCount()
+{
+	size_t count = 0;
+	for (const auto& entry : gTextures)
+		count += (entry.second != nullptr && entry.second->isLoaded());
+	return count;
+}
+
+TextureMemoryStats TextureLibrary::getMemoryStats()
+{
+	TextureMemoryStats stats = { 0, 0, 0 };
+	for (const auto& entry : gTextures)
+	{
+		if (entry.second == nullptr || !entry.second->isLoaded())
+			continue;
+		stats.textures++;
+		stats.bytes += entry.second->getMemorySize();
+		stats.rgba8Bytes += entry.second->getRgba8Size();
+	}
+	return stats;
+}
+
+void TextureLibrary::getTextures(std::vector<TextureLibraryEntry>& textures)
+{
+	textures.clear();
+	for (const auto& entry : gTextures)
+	{
+		if (entry.second == nullptr || !entry.second->isLoaded())
+			continue;
+
+		size_t separator = entry.first.rfind('#');
+		TextureUsage usage = (TextureUsage)std::stoi(entry.first.substr(separator + 1));
+		textures.push_back({ entry.second.get(), entry.first.substr(0, separator), usage });
+	}
+}
+
+void TextureLibrary::printMemoryReport()
+{
+	std::vector<std::string> keys;
+	for (const auto& entry : gTextures)
+	{
+		if (entry.second != nullptr && entry.second->isLoaded())
+			keys.push_back(entry.first);
+	}
+	std::sort(keys.begin(), keys.end());
+
+	fmt::println("Texture memory, as picked by usage against all RGBA8:");
+	for (const std::string& key : keys)
+	{
+		const Texture2D& texture = *gTextures[key];
+		fmt::println("  {:<40} {:>4}x{:<4} {:>2} mips {:<12} {:>7.0f} KB, {:>7.0f} KB as RGBA8", key.substr(0, key.rfind('#')),
+			texture.getWidth(), texture.getHeight(), texture.getLevels(), TextureFormat::getName(texture.getInternalFormat()),
+			texture.getMemorySize() / 1024.0, texture.getRgba8Size() / 1024.0);
+	}
+
+	TextureMemoryStats stats = getMemoryStats();
+	fmt::println("  {} textures, {:.0f} KB, {:.0f} KB as RGBA8 ({:.0f}% saved)", stats.textures, stats.bytes / 1024.0,
+		stats.rgba8Bytes / 1024.0, (stats.rgba8Bytes > 0) ? 100.0 * (1.0 - (double)stats.bytes / stats.rgba8Bytes) : 0.0);
+}
+
+//-----------------------------------------------------------------------------
+// Reads every texture's image back the way it was loaded (from the cooked
+// file or the texture cache, so normally without decoding), groups the
+// compatible ones and uploads each group as one array
+//-----------------------------------------------------------------------------
+void TextureLibrary::buildArrays(TextureUsage usage)
+{
+	auto start = std::chrono::steady_clock::now();
+	destroyArrays();
+
+	std::vector<TextureLibraryEntry> textures;
+	getTextures(textures);
+	std::sort(textures.begin(), textures.end(),
+		[](const TextureLibraryEntry& a, const TextureLibraryEntry& b) { return a.filename < b.filename; });
+
+	struct Group
+	{
+		std::vector<TextureImage> images;
+		std::vector<const Texture2D*> textures;
+	};
+	std::vector<Group> groups;
+	int maxLayers = TextureArray::getMaxLayers();
+
+	for (const TextureLibraryEntry& entry : textures)
+	{
+		TextureImage image;
+		if (entry.usage != usage || !Texture2D::readImage(entry.filename, usage, image))
+			continue;
+
+		auto group = std::find_if(groups.begin(), groups.end(), [&image, maxLayers](const Group& group) {
+			return (int)group.images.size() < maxLayers && TextureArray::isCompatible(group.images[0], image);
+		});
+		if (group == groups.end())
+			group = groups.insert(groups.end(), Group());
+
+		group->images.push_back(std::move(image));
+		group->textures.push_back(entry.texture);
+	}
+
+	for (const Group& group : groups)
+	{
+		std::unique_ptr<TextureArray> array(new TextureArray());
+		if (!array->create(group.images))
+			continue;
+
+		for (size_t layer = 0; layer < group.textures.size(); layer++)
+			gLayers[group.textures[layer]] = { array.get(), (int)layer };
+		gArrays.push_back(std::move(array));
+	}
+
+	TextureArrayStats stats = getArrayStats();
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	fmt::println("Texture arrays: {} textures packed into {} arrays, {:.0f} KB, in {:.1f} ms", stats.layers, stats.arrays,
+		stats.bytes / 1024.0, ms);
+}
+
+void TextureLibrary::destroyArrays()
+{
+	for (auto& array : gArrays)
+		array->destroy();
+	gArrays.clear();
+	gLayers.clear();
+}
+
+TextureLayer TextureLibrary::getLayer(const Texture2D* texture)
+{
+	auto found = gLayers.find(texture);
+	return (found != gLayers.end()) ? found->second : TextureLayer{ nullptr, -1 };
+}
+
+TextureArrayStats TextureLibrary::getArrayStats()
+{
+	TextureArrayStats stats = { gArrays.size(), 0, 0 };
+	for (const auto& array : gArrays)
+	{
+		stats.layers += (size_t)array->getLayerCount();
+		stats.bytes += array->getMemorySize();
+	}
+	return stats;
+}
+
+void TextureLibrary::destroyAll()
+{
+	destroyArrays();
+
+	for (auto& entry : gTextures)
+	{
+		if (entry.second)
+			entry.second->destroy();
+	}
+	gTextures.clear();
+}
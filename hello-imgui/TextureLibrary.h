@@ -0,0 +1,88 @@
+//-----------------------------------------------------------------------------
+// TextureLibrary.h
+//
+// Textures shared by file name, so materials of different meshes that use
+// the same image load and bind one GL texture.
+//-----------------------------------------------------------------------------
+#ifndef TEXTURE_LIBRARY_H
+#define TEXTURE_LIBRARY_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "Texture2D.h"
+
+class AssetLoader;
+class TextureArray;
+
+// Video memory of the loaded textures
+struct TextureMemoryStats
+{
+	size_t textures;
+	size_t bytes;
+	size_t rgba8Bytes;		// the same textures all as RGBA8, before formats were picked by usage
+};
+
+// Where a texture was packed by buildArrays
+struct TextureLayer
+{
+	TextureArray* array;		// null if not packed
+	int layer;
+};
+
+// The texture arrays built
+struct TextureArrayStats
+{
+	size_t arrays;
+	size_t layers;
+	size_t bytes;
+};
+
+// A loaded texture and the file and usage it was loaded for
+struct TextureLibraryEntry
+{
+	Texture2D* texture;
+	std::string filename;
+	TextureUsage usage;
+};
+
+class TextureLibrary
+{
+public:
+	// Returns the texture of 'filename' for 'usage', loading it with mipmaps
+	// on first use.  Returns null if it cannot be loaded, without retrying
+	// later.  With an asset loader set the texture is returned at once and
+	// stays empty until the loader has uploaded it (or for good if that
+	// fails).
+	static Texture2D* load(const std::string& filename, TextureUsage usage = TEXTURE_USAGE_COLOR);
+
+	// Loads textures through 'loader' from now on, null to load in place
+	static void setAssetLoader(AssetLoader* loader);
+
+	// Number of textures loaded
+	static size_t getCount();
+
+	static TextureMemoryStats getMemoryStats();
+
+	// Every texture loaded so far, e.g. for ResidencyManager to reload
+	static void getTextures(std::vector<TextureLibraryEntry>& textures);
+
+	// Prints the format and size of every texture, and the totals
+	static void printMemoryReport();
+
+	// Packs the loaded textures of 'usage' into texture arrays, one layer
+	// each, an array per size and format, replacing the arrays built before.
+	// The textures stay loaded for draws that bind them one by one, and the
+	// arrays count against the ResidencyManager budget on top of them.
+	static void buildArrays(TextureUsage usage = TEXTURE_USAGE_COLOR);
+	static void destroyArrays();
+
+	// The array and layer of 'texture', a null array if it was not packed
+	static TextureLayer getLayer(const Texture2D* texture);
+	static TextureArrayStats getArrayStats();
+
+	// Deletes every texture and array, the pointers handed out become invalid
+	static void destroyAll();
+};
+#endif // TEXTURE_LIBRARY_H
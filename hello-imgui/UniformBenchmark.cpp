@@ -0,0 +1,149 @@
+//-----------------------------------------------------------------------------
+// UniformBenchmark.cpp
+//
+// Times setting the uniforms the scene sets for every object: looked up by
+// name in a std::map<std::string> as ShaderProgram used to, by hashed name,
+// and through pre-resolved handles.  Run on the GL thread with a linked
+// program, it blocks while it measures.
+//-----------------------------------------------------------------------------
+#include "UniformBenchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+
+#include <fmt/core.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "ShaderProgram.h"
+
+namespace
+{
+	enum UniformKind { UNIFORM_MAT4, UNIFORM_VEC3, UNIFORM_FLOAT, UNIFORM_INT };
+
+	// What main.cpp sets for each model of the point light pass, with the
+	// same values, so the program is left as the scene expects it
+	struct BenchmarkUniform
+	{
+		const GLchar* name;
+		UniformKind kind;
+		float value;		// every component, or the texture unit
+	};
+
+	const BenchmarkUniform UNIFORMS[] = {
+		{ "model", UNIFORM_MAT4, 1.0f },
+		{ "material.ambient", UNIFORM_VEC3, 1.0f },
+		{ "material.diffuseMap", UNIFORM_INT, 0.0f },
+		{ "material.specular", UNIFORM_VEC3, 0.5f },
+		{ "material.shininess", UNIFORM_FLOAT, 32.0f },
+		{ "shadowMap", UNIFORM_INT, 2.0f }
+	};
+	const size_t UNIFORM_COUNT = sizeof(UNIFORMS) / sizeof(UNIFORMS[0]);
+
+	constexpr UniformName CONST_NAMES[UNIFORM_COUNT] = {
+		"model", "material.ambient", "material.diffuseMap", "material.specular", "material.shininess", "shadowMap"
+	};
+
+	// ShaderProgram::getUniformLocation before the uniform table
+	GLint mapLocation(std::map<std::string, GLint>& locations, GLuint program, const GLchar* name)
+	{
+		std::map<std::string, GLint>::iterator it = locations.find(name);
+		if (it == locations.end())
+			locations[name] = glGetUniformLocation(program, name);
+		return locations[name];
+	}
+
+	void setValue(GLint location, const BenchmarkUniform& uniform)
+	{
+		static const glm::mat4 model(1.0f);
+		switch (uniform.kind)
+		{
+		case UNIFORM_MAT4:	glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(model)); break;
+		case UNIFORM_VEC3:	glUniform3f(location, uniform.value, uniform.value, uniform.value); break;
+		case UNIFORM_FLOAT:	glUniform1f(location, uniform.value); break;
+		case UNIFORM_INT:	glUniform1i(location, (GLint)uniform.value); break;
+		}
+	}
+
+	// Best time of 'repeats' runs of 'body', in ns per call
+	template <typename Body>
+	double timeCalls(size_t calls, int repeats, Body body)
+	{
+		double best = 0.0;
+		for (int r = 0; r < repeats; r++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			body();
+			double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (double)calls;
+			best = (r == 0) ? ns : std::min(best, ns);
+		}
+		return best;
+	}
+}
+
+UniformBenchmarkResult UniformBenchmark::run(ShaderProgram& program, size_t iterations, int repeats)
+{
+	UniformBenchmarkResult result;
+	result.calls = iterations * UNIFORM_COUNT;
+	program.use();
+
+	GLuint handle = program.getProgram();
+	std::map<std::string, GLint> locations;
+	UniformHandle handles[UNIFORM_COUNT];
+	for (size_t u = 0; u < UNIFORM_COUNT; u++)
+	{
+		mapLocation(locations, handle, UNIFORMS[u].name);
+		handles[u] = program.getUniform(UNIFORMS[u].name);
+	}
+
+	// Summed so the lookups are not optimized away
+	volatile GLint sink = 0;
+
+	result.mapLookupNs = timeCalls(result.calls, repeats, [&]() {
+		GLint sum = 0;
+		for (size_t i = 0; i < iterations; i++)
+			for (size_t u = 0; u < UNIFORM_COUNT; u++)
+				sum += mapLocation(locations, handle, UNIFORMS[u].name);
+		sink = sum;
+	});
+	result.hashLookupNs = timeCalls(result.calls, repeats, [&]() {
+		GLint sum = 0;
+		for (size_t i = 0; i < iterations; i++)
+			for (size_t u = 0; u < UNIFORM_COUNT; u++)
+				sum += program.getUniformLocation(UNIFORMS[u].name);
+		sink = sum;
+	});
+	result.constLookupNs = timeCalls(result.calls, repeats, [&]() {
+		GLint sum = 0;
+		for (size_t i = 0; i < iterations; i++)
+			for (size_t u = 0; u < UNIFORM_COUNT; u++)
+				sum += program.getUniformLocation(CONST_NAMES[u]);
+		sink = sum;
+	});
+
+	result.mapSetNs = timeCalls(result.calls, repeats, [&]() {
+		for (size_t i = 0; i < iterations; i++)
+			for (size_t u = 0; u < UNIFORM_COUNT; u++)
+				setValue(mapLocation(locations, handle, UNIFORMS[u].name), UNIFORMS[u]);
+	});
+	result.hashSetNs = timeCalls(result.calls, repeats, [&]() {
+		for (size_t i = 0; i < iterations; i++)
+			for (size_t u = 0; u < UNIFORM_COUNT; u++)
+				setValue(program.getUniformLocation(CONST_NAMES[u]), UNIFORMS[u]);
+	});
+	result.handleSetNs = timeCalls(result.calls, repeats, [&]() {
+		for (size_t i = 0; i < iterations; i++)
+			for (size_t u = 0; u < UNIFORM_COUNT; u++)
+				setValue(handles[u].location, UNIFORMS[u]);
+	});
+
+	// Set behind the program's back, its copy of the values is stale
+	program.invalidateUniforms();
+
+	fmt::println("Uniform lookup per call: std::map {:.1f} ns, hashed name {:.1f} ns, compile time hash {:.1f} ns",
+		result.mapLookupNs, result.hashLookupNs, result.constLookupNs);
+	fmt::println("Uniform set per call: std::map {:.1f} ns, compile time hash {:.1f} ns, handle {:.1f} ns ({} calls)",
+		result.mapSetNs, result.hashSetNs, result.handleSetNs, result.calls);
+	return result;
+}
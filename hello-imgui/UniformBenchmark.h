@@ -0,0 +1,36 @@
+//-----------------------------------------------------------------------------
+// UniformBenchmark.h
+//
+// Times setting the uniforms the scene sets for every object: looked up by
+// name in a std::map<std::string> as ShaderProgram used to, by hashed name,
+// and through pre-resolved handles.  Run on the GL thread with a linked
+// program, it blocks while it measures.
+//-----------------------------------------------------------------------------
+#ifndef UNIFORM_BENCHMARK_H
+#define UNIFORM_BENCHMARK_H
+
+#include <cstddef>
+
+class ShaderProgram;
+
+struct UniformBenchmarkResult
+{
+	size_t calls = 0;			// uniform sets per path
+
+	// Finding the location alone, per call, best of the repeats
+	double mapLookupNs = 0.0;		// std::string built from the name, find and two operator[]
+	double hashLookupNs = 0.0;		// FNV-1a of the name at run time, binary search
+	double constLookupNs = 0.0;		// hash folded at compile time, binary search
+
+	// The whole set, lookup and glUniform call, per call
+	double mapSetNs = 0.0;
+	double hashSetNs = 0.0;
+	double handleSetNs = 0.0;
+};
+
+class UniformBenchmark
+{
+public:
+	static UniformBenchmarkResult run(ShaderProgram& program, size_t iterations = 20000, int repeats = 5);
+};
+#endif // UNIFORM_BENCHMARK_H
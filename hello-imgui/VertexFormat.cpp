@@ -0,0 +1,303 @@
+//-----------------------------------------------------------------------------
+// VertexFormat.cpp
+//
+// Vertex layouts for Mesh.  The packed layouts quantize positions to 16 bits
+// within the mesh bounds, compress normals and store texture coordinates as
+// half floats, halving the size of the full float Vertex.
+//-----------------------------------------------------------------------------
+#include "VertexFormat.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+	//-------------------------------------------------------------------------
+	// IEEE 754 half float conversion, rounding to nearest even
+	//-------------------------------------------------------------------------
+	GLushort floatToHalf(float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+
+		uint32_t sign = (bits >> 16) & 0x8000;
+		uint32_t absBits = bits & 0x7FFFFFFF;
+
+		// Infinity and NaN
+		if (absBits >= 0x7F800000)
+			return (GLushort)(sign | 0x7C00 | (absBits > 0x7F800000 ? 0x200 : 0));
+
+		// Too large, rounds to infinity
+		if (absBits >= 0x477FF000)
+			return (GLushort)(sign | 0x7C00);
+
+		// Too small, rounds to zero
+		if (absBits < 0x33000000)
+			return (GLushort)sign;
+
+		uint32_t half, remainder, halfway;
+		if (absBits < 0x38800000)
+		{
+			// Subnormal half: mantissa with the implicit bit, shifted into place
+			uint32_t shift = 126 - (absBits >> 23);
+			uint32_t mantissa = (absBits & 0x7FFFFF) | 0x800000;
+			half = mantissa >> shift;
+			remainder = mantissa & ((1u << shift) - 1);
+			halfway = 1u << (shift - 1);
+		}
+		else
+		{
+			// Rebias the exponent from 127 to 15, a mantissa carry bumps the exponent
+			uint32_t rebiased = absBits - 0x38000000;
+			half = rebiased >> 13;
+			remainder = rebiased & 0x1FFF;
+			halfway = 0x1000;
+		}
+
+		if (remainder > halfway || (remainder == halfway && (half & 1)))
+			half++;
+
+		return (GLushort)(sign | half);
+	}
+
+	float halfToFloat(GLushort half)
+	{
+		uint32_t exponent = (half >> 10) & 0x1F;
+		uint32_t mantissa = half & 0x3FF;
+
+		float value;
+		if (exponent == 0)
+			value = std::ldexp((float)mantissa, -24);
+		else if (exponent == 31)
+			value = mantissa ? NAN : INFINITY;
+		else
+			value = std::ldexp((float)(mantissa | 0x400), (int)exponent - 25);
+
+		return (half & 0x8000) ? -value : value;
+	}
+
+	//-------------------------------------------------------------------------
+	// Normalized integers.  Decoding follows the GL 4.2+ rule, which is what
+	// current drivers implement for signed values: max(c / (2^(b-1) - 1), -1)
+	//-------------------------------------------------------------------------
+	GLushort toUnorm16(float value)
+	{
+		return (GLushort)std::lround(glm::clamp(value, 0.0f, 1.0f) * 65535.0f);
+	}
+
+	float fromUnorm16(GLushort value)
+	{
+		return value / 65535.0f;
+	}
+
+	int toSnorm(float value, int maxValue)
+	{
+		return (int)std::lround(glm::clamp(value, -1.0f, 1.0f) * maxValue);
+	}
+
+	float fromSnorm(int value, int maxValue)
+	{
+		return glm::max(value / (float)maxValue, -1.0f);
+	}
+
+	//-------------------------------------------------------------------------
+	// Octahedral normal encoding: the unit sphere is projected onto an
+	// octahedron, whose lower half is folded over the upper one.
+	//-------------------------------------------------------------------------
+	glm::vec2 octEncode(glm::vec3 n)
+	{
+		n /= (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+
+		glm::vec2 e(n.x, n.y);
+		if (n.z < 0.0f)
+		{
+			e.x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+			e.y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+		}
+		return e;
+	}
+
+	glm::vec3 octDecode(const glm::vec2& e)
+	{
+		glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+		float t = glm::max(-n.z, 0.0f);
+		n.x += (n.x >= 0.0f) ? -t : t;
+		n.y += (n.y >= 0.0f) ? -t : t;
+		return glm::normalize(n);
+	}
+
+	// Picks the rounding of both components that decodes closest to 'n'
+	void octEncodeSnorm16(const glm::vec3& n, GLshort out[2])
+	{
+		glm::vec2 e = octEncode(n) * 32767.0f;
+
+		float bestDot = -2.0f;
+		for (int i = 0; i < 4; i++)
+		{
+			int x = (int)((i & 1) ? std::ceil(e.x) : std::floor(e.x));
+			int y = (int)((i & 2) ? std::ceil(e.y) : std::floor(e.y));
+			x = glm::clamp(x, -32767, 32767);
+			y = glm::clamp(y, -32767, 32767);
+
+			float d = glm::dot(n, octDecode(glm::vec2(fromSnorm(x, 32767), fromSnorm(y, 32767))));
+			if (d > bestDot)
+			{
+				bestDot = d;
+				out[0] = (GLshort)x;
+				out[1] = (GLshort)y;
+			}
+		}
+	}
+
+	// Sign extends a 10 bit field of a 10:10:10:2 word
+	int snorm10Field(GLuint bits, int shift)
+	{
+		return (int32_t)(bits << (22 - shift)) >> 22;
+	}
+
+	glm::vec3 safeNormalize(const glm::vec3& v)
+	{
+		float len = glm::length(v);
+		return (len > 0.0f) ? v / len : v;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Bytes per vertex of a layout
+//-----------------------------------------------------------------------------
+size_t VertexFormat::getVertexSize(VertexLayout layout)
+{
+	return (layout == VERTEX_LAYOUT_FLOAT) ? sizeof(Vertex) : sizeof(PackedVertex);
+}
+
+const char* VertexFormat::getName(VertexLayout layout)
+{
+	switch (layout)
+	{
+	case VERTEX_LAYOUT_PACKED_OCT16:	return "packed-oct16";
+	case VERTEX_LAYOUT_PACKED_1010102:	return "packed-1010102";
+	default:							return "float";
+	}
+}
+
+size_t VertexFormat::getPositionSize(VertexLayout layout)
+{
+	return (layout == VERTEX_LAYOUT_FLOAT) ? sizeof(glm::vec3) : sizeof(PackedVertex::position);
+}
+
+//-----------------------------------------------------------------------------
+// Gathers the positions of 'count' vertices of 'layout' into a tight array
+//-----------------------------------------------------------------------------
+void VertexFormat::extractPositions(VertexLayout layout, const void* vertices, size_t count, void* positions)
+{
+	const unsigned char* in = static_cast<const unsigned char*>(vertices);
+	unsigned char* out = static_cast<unsigned char*>(positions);
+	size_t stride = getVertexSize(layout);
+	size_t size = getPositionSize(layout);
+
+	// Both vertex structs start with the position
+	for (size_t i = 0; i < count; i++)
+		std::memcpy(out + i * size, in + i * stride, size);
+}
+
+//-----------------------------------------------------------------------------
+// Packs the vertices of a mesh
+//-----------------------------------------------------------------------------
+void VertexFormat::pack(VertexLayout layout, const std::vector<Vertex>& vertices,
+	const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<unsigned char>& packed)
+{
+	packed.resize(vertices.size() * getVertexSize(layout));
+	if (vertices.empty())
+		return;
+
+	if (layout == VERTEX_LAYOUT_FLOAT)
+	{
+		std::memcpy(&packed[0], &vertices[0], packed.size());
+		return;
+	}
+
+	// Flat axes (e.g. a floor plane) have no extent and quantize to 0
+	glm::vec3 scale = boundsMax - boundsMin;
+	glm::vec3 invScale;
+	for (int k = 0; k < 3; k++)
+		invScale[k] = (scale[k] > 0.0f) ? 1.0f / scale[k] : 0.0f;
+
+	PackedVertex* out = reinterpret_cast<PackedVertex*>(&packed[0]);
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		const Vertex& v = vertices[i];
+		PackedVertex& p = out[i];
+
+		glm::vec3 t = (v.position - boundsMin) * invScale;
+		p.position[0] = toUnorm16(t.x);
+		p.position[1] = toUnorm16(t.y);
+		p.position[2] = toUnorm16(t.z);
+		p.position[3] = 0;
+
+		glm::vec3 n = safeNormalize(v.normal);
+		if (layout == VERTEX_LAYOUT_PACKED_OCT16)
+		{
+			if (n == glm::vec3(0.0f))
+				p.normal.octahedral[0] = p.normal.octahedral[1] = 0;
+			else
+				octEncodeSnorm16(n, p.normal.octahedral);
+		}
+		else
+		{
+			GLuint x = (GLuint)toSnorm(n.x, 511) & 0x3FF;
+			GLuint y = (GLuint)toSnorm(n.y, 511) & 0x3FF;
+			GLuint z = (GLuint)toSnorm(n.z, 511) & 0x3FF;
+			p.normal.snorm1010102 = x | (y << 10) | (z << 20);
+		}
+
+		p.texCoords[0] = floatToHalf(v.texCoords.x);
+		p.texCoords[1] = floatToHalf(v.texCoords.y);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Worst-case position, normal and texture coordinate error of packed vertices
+//-----------------------------------------------------------------------------
+VertexPackError VertexFormat::measureError(VertexLayout layout, const std::vector<Vertex>& vertices,
+	const glm::vec3& boundsMin, const glm::vec3& boundsMax, const std::vector<unsigned char>& packed)
+{
+	VertexPackError error = { 0.0f, 0.0f, 0.0f };
+	if (layout == VERTEX_LAYOUT_FLOAT || packed.size() < vertices.size() * sizeof(PackedVertex))
+		return error;
+
+	glm::vec3 scale = boundsMax - boundsMin;
+
+	const PackedVertex* in = reinterpret_cast<const PackedVertex*>(packed.data());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		const Vertex& v = vertices[i];
+		const PackedVertex& p = in[i];
+
+		glm::vec3 position = boundsMin + glm::vec3(fromUnorm16(p.position[0]), fromUnorm16(p.position[1]),
+			fromUnorm16(p.position[2])) * scale;
+		error.position = glm::max(error.position, glm::distance(position, v.position));
+
+		// Vertices without normal data have nothing to lose
+		glm::vec3 n = safeNormalize(v.normal);
+		if (n != glm::vec3(0.0f))
+		{
+			glm::vec3 decoded;
+			if (layout == VERTEX_LAYOUT_PACKED_OCT16)
+				decoded = octDecode(glm::vec2(fromSnorm(p.normal.octahedral[0], 32767), fromSnorm(p.normal.octahedral[1], 32767)));
+			else
+				decoded = safeNormalize(glm::vec3(fromSnorm(snorm10Field(p.normal.snorm1010102, 0), 511),
+					fromSnorm(snorm10Field(p.normal.snorm1010102, 10), 511),
+					fromSnorm(snorm10Field(p.normal.snorm1010102, 20), 511)));
+
+			// atan2 stays accurate for the tiny angles where acos(dot) does not
+			float angle = glm::degrees(std::atan2(glm::length(glm::cross(n, decoded)), glm::dot(n, decoded)));
+			error.normal = glm::max(error.normal, angle);
+		}
+
+		glm::vec2 uv(halfToFloat(p.texCoords[0]), halfToFloat(p.texCoords[1]));
+		error.texCoord = glm::max(error.texCoord, glm::max(std::abs(uv.x - v.texCoords.x), std::abs(uv.y - v.texCoords.y)));
+	}
+
+	return error;
+}
@@ -0,0 +1,79 @@
+//-----------------------------------------------------------------------------
+// VertexFormat.h
+//
+// Vertex layouts for Mesh.  The packed layouts quantize positions to 16 bits
+// within the mesh bounds, compress normals and store texture coordinates as
+// half floats, halving the size of the full float Vertex.
+//-----------------------------------------------------------------------------
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+struct Vertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 texCoords;
+};
+
+enum VertexLayout
+{
+	VERTEX_LAYOUT_FLOAT = 0,			// 32 bytes: float position, normal and uv
+	VERTEX_LAYOUT_PACKED_OCT16 = 1,		// 16 bytes: unorm16 position, octahedral 2 x snorm16 normal, half uv
+	VERTEX_LAYOUT_PACKED_1010102 = 2	// 16 bytes: unorm16 position, snorm 10:10:10:2 normal, half uv
+};
+
+const int VERTEX_LAYOUT_COUNT = 3;
+
+// Vertex of the packed layouts
+struct PackedVertex
+{
+	GLushort position[4];		// unorm16 within the mesh bounds, w unused
+	union
+	{
+		GLshort octahedral[2];	// VERTEX_LAYOUT_PACKED_OCT16
+		GLuint snorm1010102;	// VERTEX_LAYOUT_PACKED_1010102, xyz in the 10 bit fields
+	} normal;
+	GLushort texCoords[2];		// half float
+};
+
+// Generic vertex attributes that are never enabled as arrays.  Mesh::draw sets
+// them as constants so the vertex shaders can undo the quantization:
+//   position = offset.xyz + pos * scale, octahedral normals when offset.w = 1
+const GLuint DEQUANTIZE_OFFSET_ATTRIB = 3;
+const GLuint DEQUANTIZE_SCALE_ATTRIB = 4;
+
+// Largest error introduced by packing a mesh
+struct VertexPackError
+{
+	float position;		// in model units
+	float normal;		// in degrees
+	float texCoord;		// in uv units
+};
+
+class VertexFormat
+{
+public:
+	static size_t getVertexSize(VertexLayout layout);
+	static const char* getName(VertexLayout layout);
+
+	// Position only copy of a layout for depth passes: float xyz, or the
+	// unorm16 xyzw of the packed layouts with the same dequantization
+	static size_t getPositionSize(VertexLayout layout);
+	static void extractPositions(VertexLayout layout, const void* vertices, size_t count, void* positions);
+
+	// Packs 'vertices' into 'layout'.  Positions are quantized relative to
+	// the bounds, which must enclose every vertex.
+	static void pack(VertexLayout layout, const std::vector<Vertex>& vertices,
+		const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<unsigned char>& packed);
+
+	// Decodes 'packed' the way the vertex shaders do and compares it to 'vertices'
+	static VertexPackError measureError(VertexLayout layout, const std::vector<Vertex>& vertices,
+		const glm::vec3& boundsMin, const glm::vec3& boundsMax, const std::vector<unsigned char>& packed);
+};
+#endif // VERTEX_FORMAT_H
@@ -5,6 +5,8 @@
 // - Add another texture
 // - fragment shader blending using GLSL mix()
 //-----------------------------------------------------------------------------
+#include <chrono>
+#include <cmath>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -21,10 +23,21 @@
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 
+#include "AssetLoader.h"
+#include "FrameUniforms.h"
+#include "ProgramCache.h"
 #include "ShaderProgram.h"
+#include "TextureArray.h"
 #include "Texture2D.h"
+#include "TextureLibrary.h"
+#include "UniformBenchmark.h"
 #include "Camera.h"
 #include "Mesh.h"
+#include "FrustumCuller.h"
+#include "GeometryArena.h"
+#include "InstanceBuffer.h"
+#include "MipBenchmark.h"
+#include "ResidencyManager.h"
 #include "Skybox.h"
 
 enum LightType
@@ -54,6 +67,39 @@ int gWindowHeightFull = 1200;
 bool gWireframe = false;
 bool gFlashlightOn = true;
 
+// The default framebuffer encodes linear colors to sRGB on write.  Without
+// it the lit shaders encode themselves (FrameData::encodeSrgb).
+bool gSrgbFramebuffer = false;
+
+// Mesh level of detail
+bool gMeshLod = true;
+float gLodPixelError = 1.0f;		// largest allowed simplification error on screen
+bool gMeshletCulling = true;
+bool gFrustumCulling = true;		// whole models, per pass
+
+// Shadow pass from a position only copy of the vertices
+bool gDepthStream = true;
+
+// Instancing stress test: a field of crates and bunnies, a few draws per pass
+bool gInstancingStress = false;
+int gStressInstanceCount = 10000;
+
+// The stress field's diffuse maps from texture arrays: each instance wears a
+// layer of its model's array, so differently textured copies share a draw
+bool gTextureArrays = false;
+
+// GL upload time per frame while assets stream in
+double gAssetUploadBudgetMs = 2.0;
+
+// Video memory for textures and meshes, 0 for no budget
+int gResidencyBudgetMB = 0;
+
+// Last run of the CPU against driver mipmap benchmark
+MipBenchmarkResult gMipBenchmark;
+
+// Last run of the uniform lookup benchmark
+UniformBenchmarkResult gUniformBenchmark;
+
 // Camera orientation
 double lastMouseX, lastMouseY;
 
@@ -73,6 +119,7 @@ void glfw_onMouseScroll(GLFWwindow* window, double deltaX, double deltaY);
 void update(double elapsedTime);
 void showFPS(GLFWwindow* window);
 bool initOpenGL();
+glm::vec3 srgbToLinear(const glm::vec3& color);
 
 //-----------------------------------------------------------------------------
 // Main Application Entry Point
@@ -105,41 +152,75 @@ int main()
 	bool show_another_window = false;
 	ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
+	// Camera and light uniforms, one buffer for all programs, created first
+	// so the programs bind their FrameData blocks to it as they link
+	FrameUniforms::create();
+
+	// The scene draws with this small program, loaded first, until all the
+	// others are linked
+	ShaderProgram fallbackShader;
+	fallbackShader.loadShaders("shaders/fallback.vert", "shaders/fallback.frag");
+	UniformHandle fallbackModelUniform = fallbackShader.getUniform("model");
+
+	// The others are all submitted before any is waited for, so they compile
+	// side by side, and polled once a frame from the rendering loop
+	double shaderSubmitTime = glfwGetTime();
+
 	// Load meshes and textures
 	ShaderProgram spotLightShader;
 	ShaderProgram pointLightShader;
-	pointLightShader.loadShaders("shaders/lighting_phong_materials.vert", "shaders/lighting_phong_materials.frag");
-	spotLightShader.loadShaders("shaders/lighting_spot.vert", "shaders/lighting_spot.frag");
+	pointLightShader.submitShaders("shaders/lighting_phong_materials.vert", "shaders/lighting_phong_materials.frag");
+	spotLightShader.submitShaders("shaders/lighting_spot.vert", "shaders/lighting_spot.frag");
 
 	// Light shader
 	ShaderProgram lightShader;
-	lightShader.loadShaders("shaders/bulb.vert", "shaders/bulb.frag");
+	lightShader.submitShaders("shaders/bulb.vert", "shaders/bulb.frag");
 
 	// Shadow shader
 	ShaderProgram shadowShader;
-	shadowShader.loadShaders("shaders/shadow.vert", "shaders/shadow.frag");
+	shadowShader.submitShaders("shaders/shadow.vert", "shaders/shadow.frag");
+
+	// Instanced variants, the model matrix comes from the instance attributes
+	ShaderProgram pointLightInstancedShader, spotLightInstancedShader, shadowInstancedShader;
+	pointLightInstancedShader.submitShaders("shaders/lighting_phong_materials_instanced.vert", "shaders/lighting_phong_materials.frag");
+	spotLightInstancedShader.submitShaders("shaders/lighting_spot_instanced.vert", "shaders/lighting_spot.frag");
+	shadowInstancedShader.submitShaders("shaders/shadow_instanced.vert", "shaders/shadow.frag");
+
+	// Skybox
+	ShaderProgram skyboxShader;
+	skyboxShader.submitShaders("shaders/skybox.vert", "shaders/skybox.frag");
+
+	ShaderProgram* const sceneShaders[] = { &pointLightShader, &spotLightShader, &lightShader, &shadowShader,
+		&pointLightInstancedShader, &spotLightInstancedShader, &shadowInstancedShader, &skyboxShader };
+	bool shadersReady = false;
+
+	// Uniforms set for every model, resolved once the programs are linked
+	UniformHandle pointModelUniform, spotModelUniform, shadowModelUniform;
+
+	// A sampler2DArray may not share a texture unit with the sampler2Ds
+	const GLuint DIFFUSE_ARRAY_UNIT = 3;
+
+	// Meshes, their textures (from the .mtl files) and the skybox load in
+	// the background and appear as assetLoader.update() uploads them
+	AssetLoader assetLoader;
+	TextureLibrary::setAssetLoader(&assetLoader);
+
+	// Created with the arenas' buffers, before the first mesh arrives
+	for (int layout = 0; layout < VERTEX_LAYOUT_COUNT; layout++)
+		GeometryArena::get((VertexLayout)layout).setDepthStream(gDepthStream);
 
-	// Load meshes and textures
 	const int numModels = 6;
 	Mesh mesh[numModels];
-	Texture2D texture[numModels];
-
-	mesh[0].loadOBJ("models/crate.obj");
-	mesh[1].loadOBJ("models/woodcrate.obj");
-	mesh[2].loadOBJ("models/robot.obj");
-	mesh[3].loadOBJ("models/floor.obj");
-	mesh[4].loadOBJ("models/bowling_pin.obj");
-	mesh[5].loadOBJ("models/bunny.obj");
-
-	texture[0].loadTexture("textures/crate.jpg", true);
-	texture[1].loadTexture("textures/woodcrate_diffuse.jpg", true);
-	texture[2].loadTexture("textures/robot_diffuse.jpg", true);
-	texture[3].loadTexture("textures/tile_floor.jpg", true);
-	texture[4].loadTexture("textures/AMF.tga", true);
-	texture[5].loadTexture("textures/bunny_diffuse.jpg", true);
+
+	assetLoader.loadMesh(mesh[0], "models/crate.obj");
+	assetLoader.loadMesh(mesh[1], "models/woodcrate.obj");
+	assetLoader.loadMesh(mesh[2], "models/robot.obj");
+	assetLoader.loadMesh(mesh[3], "models/floor.obj");
+	assetLoader.loadMesh(mesh[4], "models/bowling_pin.obj");
+	assetLoader.loadMesh(mesh[5], "models/bunny.obj");
 
 	Mesh lightMesh;
-	lightMesh.loadOBJ("models/light.obj");
+	assetLoader.loadMesh(lightMesh, "models/light.obj");
 
 	// Model positions
 	glm::vec3 modelPos[] = {
@@ -186,14 +267,8 @@ int main()
 	glReadBuffer(GL_NONE);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-	// Skybox
-	ShaderProgram skyboxShader;
-	skyboxShader.loadShaders("shaders/skybox.vert", "shaders/skybox.frag");
-
-	skyboxShader.use();
-	skyboxShader.setUniform("skybox", 0);
-
-	Skybox skybox({
+	Skybox skybox;
+	assetLoader.loadSkybox(skybox, {
 		"textures/skybox/right.jpg",
 		"textures/skybox/left.jpg",
 		"textures/skybox/top.jpg",
@@ -202,8 +277,78 @@ int main()
 		"textures/skybox/back.jpg"
 		});
 
+	// Instancing stress test.  The instances never move, so their bounds go
+	// into a culler once; every frame the visible ones are sorted into one
+	// instance buffer per LOD and pass.
+	const int numStressModels = 2;
+	const int stressModel[numStressModels] = { 0, 5 };			// crate, bunny
+	const float stressScale[numStressModels] = { 0.5f, 0.5f };
+	std::vector<InstanceData> stressInstances[numStressModels];
+	FrustumCuller stressCuller[numStressModels];
+	InstanceBuffer stressShadowBuffers[numStressModels][MAX_MESH_LODS];
+	InstanceBuffer stressCameraBuffers[numStressModels][MAX_MESH_LODS];
+	std::vector<InstanceData> stressLodInstances[MAX_MESH_LODS];
+	std::vector<unsigned char> stressVisible;
+	std::vector<float> stressLodDistances;
+	int stressFieldCount = 0;		// instances in the current field
+	TextureLayer stressLayers[numStressModels] = {};		// the diffuse map of each model in the texture arrays
+	size_t arrayTextureCount = 0;	// textures loaded when the arrays were built
+
+	// Culls one model's instances of the field against 'viewProjection' and
+	// uploads the visible ones to 'buffers' by the LOD their distance calls for
+	auto fillStressBuffers = [&](int s, const glm::mat4& viewProjection, InstanceBuffer* buffers) {
+		const Mesh& stressMesh = mesh[stressModel[s]];
+
+		if (gFrustumCulling)
+			stressCuller[s].cull(viewProjection, stressVisible);
+		else
+			stressVisible.assign(stressInstances[s].size(), 1);
+
+		if (gMeshLod)
+			stressMesh.getLodDistances(stressScale[s], fpsCamera, (float)gWindowHeight, gLodPixelError, stressLodDistances);
+		else
+			stressLodDistances.assign(1, 0.0f);
+
+		for (std::vector<InstanceData>& lodInstances : stressLodInstances)
+			lodInstances.clear();
+
+		glm::vec4 center(stressMesh.getBoundsCenter(), 1.0f);
+		for (size_t i = 0; i < stressInstances[s].size(); i++)
+		{
+			if (!stressVisible[i])
+				continue;
+
+			const InstanceData& instance = stressInstances[s][i];
+			float distance = glm::length(glm::vec3(instance.model * center) - fpsCamera.getPosition());
+			size_t lod = 0;
+			while (lod + 1 < stressLodDistances.size() && distance >= stressLodDistances[lod + 1])
+				lod++;
+			stressLodInstances[lod].push_back(instance);
+
+			// Cycle through the layers of the model's array, starting with its own map
+			if (stressLayers[s].array != nullptr)
+				stressLodInstances[lod].back().layer = (float)((stressLayers[s].layer + (int)i) % stressLayers[s].array->getLayerCount());
+		}
+
+		for (size_t lod = 0; lod < MAX_MESH_LODS; lod++)
+			buffers[lod].upload(stressLodInstances[lod].data(), stressLodInstances[lod].size());
+	};
+
+	// Model visibility per pass, kept for the UI of the next frame
+	FrustumCuller frustumCuller;
+	std::vector<unsigned char> shadowVisible, cameraVisible;
+	FrustumCullStats shadowCullStats = { 0, 0 }, cameraCullStats = { 0, 0 };
+	double cullMs = 0.0;
+
+	// Light and material colors were picked in gamma space, the shaders
+	// light in linear space
+	const glm::vec3 lightAmbient = srgbToLinear(glm::vec3(0.1f, 0.1f, 0.1f));
+	const glm::vec3 spotLightDiffuse = srgbToLinear(glm::vec3(0.8f, 0.8f, 0.8f));
+	const glm::vec3 materialSpecular = srgbToLinear(glm::vec3(0.5f, 0.5f, 0.5f));
+
 	lastTime = glfwGetTime();
 	float angle = 0.0f;
+	bool texturesReported = false;		// once the first assets are loaded
 
 	// Rendering loop
 	while (!glfwWindowShouldClose(gWindow))
@@ -216,9 +361,91 @@ int main()
 		double currentTime = glfwGetTime();
 		double deltaLightTime = currentTime - lastTime;
 
+		// Draw counters of the previous frame, shown in the UI
+		MeshDrawStats drawStats = Mesh::getDrawStats();
+		Mesh::resetDrawStats();
+		UniformStats uniformStats = ShaderProgram::getUniformStats();
+		ShaderProgram::resetUniformStats();
+		ResidencyManager::beginFrame();
+
+		// Once every program is linked, set them up and leave the fallback
+		if (!shadersReady)
+		{
+			shadersReady = true;
+			for (ShaderProgram* shader : sceneShaders)
+				shadersReady = shader->poll() && shadersReady;
+
+			if (shadersReady)
+			{
+				pointModelUniform = pointLightShader.getUniform("model");
+				spotModelUniform = spotLightShader.getUniform("model");
+				shadowModelUniform = shadowShader.getUniform("model");
+
+				for (ShaderProgram* shader : { &pointLightShader, &spotLightShader, &pointLightInstancedShader, &spotLightInstancedShader })
+				{
+					shader->use();
+					shader->setUniformSampler("diffuseArray", DIFFUSE_ARRAY_UNIT);
+				}
+
+				skyboxShader.use();
+				skyboxShader.setUniform("skybox", 0);
+
+				// The shaders' FrameData block against the C++ structs
+				bool frameLayoutMatches = true;
+				frameLayoutMatches &= FrameUniforms::checkLayout(fallbackShader, "fallback");
+				frameLayoutMatches &= FrameUniforms::checkLayout(pointLightShader, "lighting_phong_materials");
+				frameLayoutMatches &= FrameUniforms::checkLayout(spotLightShader, "lighting_spot");
+				frameLayoutMatches &= FrameUniforms::checkLayout(lightShader, "bulb");
+				frameLayoutMatches &= FrameUniforms::checkLayout(shadowShader, "shadow");
+				frameLayoutMatches &= FrameUniforms::checkLayout(pointLightInstancedShader, "lighting_phong_materials_instanced");
+				frameLayoutMatches &= FrameUniforms::checkLayout(spotLightInstancedShader, "lighting_spot_instanced");
+				frameLayoutMatches &= FrameUniforms::checkLayout(shadowInstancedShader, "shadow_instanced");
+				frameLayoutMatches &= FrameUniforms::checkLayout(skyboxShader, "skybox");
+				if (!frameLayoutMatches)
+					fmt::println("Frame uniforms: FrameUniforms.h and shaders/frame_data.glsl disagree, the scene will draw wrong");
+
+				// Compiled against program cache load times, and the batch's wall time
+				ShaderProgram::printLoadReport();
+				fmt::println("Shader programs: all linked {:.2f} ms after they were submitted", (glfwGetTime() - shaderSubmitTime) * 1000.0);
+			}
+		}
+
 		// Poll for and process events
 		glfwPollEvents();
 
+		// Create the GL objects of assets the workers have finished
+		assetLoader.update(gAssetUploadBudgetMs);
+		AssetLoadStats loadStats = assetLoader.getStats();
+
+		if (!texturesReported && loadStats.loaded > 0 && loadStats.pending == 0)
+		{
+			TextureLibrary::printMemoryReport();
+			texturesReported = true;
+		}
+
+		// Pack the diffuse maps once they are all in, again if more arrive
+		size_t textureCount = gTextureArrays ? TextureLibrary::getCount() : 0;
+		if (textureCount != arrayTextureCount && loadStats.pending == 0)
+		{
+			if (gTextureArrays)
+				TextureLibrary::buildArrays();
+			else
+				TextureLibrary::destroyArrays();
+
+			for (int i = 0; i < numModels; i++)
+				mesh[i].resolveTextureLayers();
+
+			// One layer per instance means one map for the whole model
+			for (int s = 0; s < numStressModels; s++)
+			{
+				const Mesh& stressMesh = mesh[stressModel[s]];
+				stressLayers[s] = { nullptr, -1 };
+				if (stressMesh.getMaterialCount() == 1 && stressMesh.getMaterial(0).diffuseArray != nullptr)
+					stressLayers[s] = { stressMesh.getMaterial(0).diffuseArray, stressMesh.getMaterial(0).diffuseLayer };
+			}
+			arrayTextureCount = textureCount;
+		}
+
 		if (glfwGetWindowAttrib(gWindow, GLFW_ICONIFIED) != 0)
 		{
 			ImGui_ImplGlfw_Sleep(10);
@@ -242,6 +469,102 @@ int main()
             ImGui::RadioButton("Point Light", reinterpret_cast<int*>(&lightType), 0); ImGui::SameLine();
             ImGui::RadioButton("Spot Light", reinterpret_cast<int*>(&lightType), 1);
 
+			ImGui::Checkbox("Mesh LOD", &gMeshLod);
+			ImGui::SliderFloat("LOD pixel error", &gLodPixelError, 0.25f, 8.0f);
+			ImGui::Text("Triangles: %zu of %zu (%.0f%%), %zu draws, %zu texture binds", drawStats.triangles, drawStats.fullDetailTriangles,
+				drawStats.fullDetailTriangles ? 100.0 * drawStats.triangles / drawStats.fullDetailTriangles : 100.0, drawStats.drawCalls,
+				drawStats.textureBinds);
+			ImGui::Checkbox("Meshlet culling", &gMeshletCulling);
+			ImGui::Text("Meshlets: %zu visible, %zu frustum culled, %zu backface culled", drawStats.meshlets.visible,
+				drawStats.meshlets.frustumCulled, drawStats.meshlets.backfaceCulled);
+			ImGui::Checkbox("Frustum culling", &gFrustumCulling);
+			ImGui::Checkbox("Instancing stress test", &gInstancingStress);
+			ImGui::SliderInt("Instances", &gStressInstanceCount, 1000, 100000);
+			ImGui::Checkbox("Texture arrays", &gTextureArrays);
+			if (gTextureArrays)
+			{
+				TextureArrayStats arrayStats = TextureLibrary::getArrayStats();
+				ImGui::SameLine();
+				ImGui::Text("%zu maps in %zu arrays, %.0f KB", arrayStats.layers, arrayStats.arrays, arrayStats.bytes / 1024.0);
+			}
+			ImGui::Text("Objects drawn: %zu", drawStats.instances);
+			ImGui::Text("Models: shadow %zu visible / %zu culled, camera %zu visible / %zu culled (%.3f ms)",
+				shadowCullStats.visible, shadowCullStats.culled, cameraCullStats.visible, cameraCullStats.culled, cullMs);
+
+			GeometryArenaStats arenaStats = GeometryArena::getTotalStats();
+			ImGui::Text("Geometry arena: %zu meshes, vertices %.0f of %.0f KB, indices %.0f of %.0f KB",
+				arenaStats.allocations, arenaStats.vertexBytesUsed / 1024.0, arenaStats.vertexBytes / 1024.0,
+				arenaStats.indexBytesUsed / 1024.0, arenaStats.indexBytes / 1024.0);
+			ImGui::Text("  %zu free ranges, %.0f%% fragmented, %zu rebuilds", arenaStats.freeRanges,
+				100.0f * arenaStats.fragmentation, arenaStats.defragmentations);
+			if (ImGui::Button("Defragment"))
+			{
+				for (int layout = 0; layout < VERTEX_LAYOUT_COUNT; layout++)
+					GeometryArena::get((VertexLayout)layout).defragment();
+			}
+			if (ImGui::Checkbox("Depth only position stream", &gDepthStream))
+			{
+				for (int layout = 0; layout < VERTEX_LAYOUT_COUNT; layout++)
+					GeometryArena::get((VertexLayout)layout).setDepthStream(gDepthStream);
+			}
+			ImGui::SameLine();
+			ImGui::Text("%.0f KB", arenaStats.depthBytes / 1024.0);
+
+			if (loadStats.pending > 0)
+				ImGui::Text("Loading: %zu assets loaded, %zu pending (%.0f ms)", loadStats.loaded, loadStats.pending, loadStats.wallMs);
+			else
+				ImGui::Text("Assets: %zu loaded in %.0f ms, %.0f ms one by one (%.0f ms uploads, %.0f ms image decoding)", loadStats.loaded,
+					loadStats.wallMs, loadStats.serialMs, loadStats.uploadMs, loadStats.decodeMs);
+
+			TextureMemoryStats textureStats = TextureLibrary::getMemoryStats();
+			ImGui::Text("Textures: %zu, %.0f KB, %.0f KB as RGBA8", textureStats.textures, textureStats.bytes / 1024.0,
+				textureStats.rgba8Bytes / 1024.0);
+			ImGui::SameLine();
+			if (ImGui::Button("Print"))
+				TextureLibrary::printMemoryReport();
+
+			ResidencyStats residency = ResidencyManager::getStats();
+			ImGui::SliderInt("VRAM budget (MB)", &gResidencyBudgetMB, 0, 256);
+			ResidencyManager::setBudget((size_t)gResidencyBudgetMB * 1024 * 1024);
+			ImGui::Text("Resident: %.0f KB, textures %.0f KB (%zu at low mip), arrays %.0f KB, meshes %.0f KB (%zu evicted)",
+				residency.residentBytes / 1024.0, residency.textureBytes / 1024.0, residency.demotedTextures,
+				residency.arrayBytes / 1024.0, residency.meshBytes / 1024.0, residency.evictedMeshes);
+			ImGui::Text("  %zu evictions, %zu reloads, %zu reload stalls (%.1f ms)", residency.evictions, residency.reloads,
+				residency.stalls, residency.stallMs);
+			ImGui::SameLine();
+			if (ImGui::Button("Print##residency"))
+				ResidencyManager::printReport();
+
+			const ProgramLoadStats& programStats = ShaderProgram::getLoadStats();
+			ImGui::Text("Shaders: %zu programs, %zu from cache in %.1f ms (%.1f ms compiled), %zu compiled in %.1f ms",
+				programStats.programs, programStats.cacheHits, programStats.cacheLoadMs, programStats.cachedCompileMs,
+				programStats.programs - programStats.cacheHits, programStats.compileMs);
+
+			bool skipRedundantUniforms = ShaderProgram::getSkipRedundant();
+			if (ImGui::Checkbox("Skip redundant uniforms", &skipRedundantUniforms))
+				ShaderProgram::setSkipRedundant(skipRedundantUniforms);
+			ImGui::SameLine();
+			ImGui::Text("%zu sent, %zu skipped", uniformStats.issued, uniformStats.skipped);
+
+			if (shadersReady && ImGui::Button("Uniform benchmark"))
+				gUniformBenchmark = UniformBenchmark::run(pointLightShader);
+			if (gUniformBenchmark.calls > 0)
+			{
+				ImGui::Text("Uniform lookup: std::map %.1f ns, hashed name %.1f ns, compile time hash %.1f ns",
+					gUniformBenchmark.mapLookupNs, gUniformBenchmark.hashLookupNs, gUniformBenchmark.constLookupNs);
+				ImGui::Text("  set: std::map %.1f ns, compile time hash %.1f ns, handle %.1f ns", gUniformBenchmark.mapSetNs,
+					gUniformBenchmark.hashSetNs, gUniformBenchmark.handleSetNs);
+			}
+
+			if (ImGui::Button("Mipmap benchmark"))
+				gMipBenchmark = MipBenchmark::run();
+			if (gMipBenchmark.size > 0)
+			{
+				ImGui::Text("Mipmaps of %d^2: CPU box %.1f ms, scalar %.1f ms, sRGB %.1f ms, Kaiser %.1f ms", gMipBenchmark.size,
+					gMipBenchmark.simdMs, gMipBenchmark.scalarMs, gMipBenchmark.srgbMs, gMipBenchmark.kaiserMs);
+				ImGui::Text("  GL thread: glGenerateMipmap %.1f ms, CPU levels upload %.1f ms", gMipBenchmark.driverMs, gMipBenchmark.uploadMs);
+			}
+
 			ImGui::Checkbox("Demo Window", &show_demo_window);      // Edit bools storing our window open/close state
 			ImGui::Checkbox("Another Window", &show_another_window);
 
@@ -323,35 +646,154 @@ int main()
 		glm::vec3 lightColor(1.0f, 1.0f, 1.0f);
 		glm::mat4 lightSpaceMatrix = lightProjection * lightView;
 
-		// Render the scene to the depth buffer (shadow map)
-		shadowShader.use();
-		shadowShader.setUniform("lightSpaceMatrix", lightSpaceMatrix);
+		// Spot light
+		glm::vec3 spotlightPos = fpsCamera.getPosition();
+		spotlightPos.y -= 0.5f;
+
+		// Everything the passes share, written once for all programs
+		FrameData frameData = {};
+		frameData.view = view;
+		frameData.projection = projection;
+		frameData.skyboxView = glm::mat4(glm::mat3(view));
+		frameData.lightSpaceMatrix = lightSpaceMatrix;
+		frameData.viewPos = viewPos;
+		frameData.encodeSrgb = gSrgbFramebuffer ? 0 : 1;
+
+		frameData.light.position = lightPos;
+		frameData.light.ambient = lightAmbient;
+		frameData.light.diffuse = lightColor;
+		frameData.light.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+
+		frameData.spotLight.ambient = lightAmbient;
+		frameData.spotLight.diffuse = spotLightDiffuse;
+		frameData.spotLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+		frameData.spotLight.position = spotlightPos;
+		frameData.spotLight.direction = fpsCamera.getLook();
+		frameData.spotLight.cosInnerCone = glm::cos(glm::radians(15.0f));
+		frameData.spotLight.cosOuterCone = glm::cos(glm::radians(20.0f));
+		frameData.spotLight.constant = 1.0f;
+		frameData.spotLight.linear = 0.07f;
+		frameData.spotLight.exponent = 0.017f;
+		frameData.spotLight.on = gFlashlightOn ? 1 : 0;
+
+		FrameUniforms::update(frameData);
+
+		// Pick each model's LOD once from the main camera, used by both passes
+		int modelLod[numModels];
+		for (int i = 0; i < numModels; i++)
+		{
+			model = glm::translate(glm::mat4(1.0), modelPos[i]) * glm::scale(glm::mat4(1.0), modelScale[i]);
+			modelLod[i] = gMeshLod ? mesh[i].selectLod(model, fpsCamera, (float)gWindowHeight, gLodPixelError) : 0;
+		}
+
+		// Cull whole models against the light and the camera frustums
+		auto cullStart = std::chrono::steady_clock::now();
+		frustumCuller.clear();
+		for (int i = 0; i < numModels; i++)
+		{
+			model = glm::translate(glm::mat4(1.0), modelPos[i]) * glm::scale(glm::mat4(1.0), modelScale[i]);
+			frustumCuller.addInstance(mesh[i].getBoundsCenter(), (mesh[i].getBoundsMax() - mesh[i].getBoundsMin()) * 0.5f,
+				mesh[i].getBoundsRadius(), model);
+		}
+		if (gFrustumCulling)
+		{
+			shadowCullStats = frustumCuller.cull(lightSpaceMatrix, shadowVisible);
+			cameraCullStats = frustumCuller.cull(projection * view, cameraVisible);
+		}
+		else
+		{
+			shadowVisible.assign(numModels, 1);
+			cameraVisible.assign(numModels, 1);
+			shadowCullStats = cameraCullStats = { (size_t)numModels, 0 };
+		}
 
+		// Lay out the stress field once its meshes are loaded, rows of
+		// alternating crates and bunnies behind the scene
+		bool stressReady = shadersReady && gInstancingStress && mesh[stressModel[0]].isLoaded() && mesh[stressModel[1]].isLoaded();
+		if (stressReady && stressFieldCount != gStressInstanceCount)
+		{
+			int columns = (int)std::ceil(std::sqrt((float)gStressInstanceCount));
+			for (int s = 0; s < numStressModels; s++)
+			{
+				stressInstances[s].clear();
+				stressCuller[s].clear();
+			}
+
+			for (int i = 0; i < gStressInstanceCount; i++)
+			{
+				int s = i % numStressModels;
+				const Mesh& stressMesh = mesh[stressModel[s]];
+				unsigned int hash = (unsigned int)i * 2654435761u;
+
+				glm::vec3 position((float)(i % columns - columns / 2) * 2.0f, -stressMesh.getBoundsMin().y * stressScale[s],
+					-12.0f - (float)(i / columns) * 2.0f);
+				InstanceData instance;
+				instance.model = glm::translate(glm::mat4(1.0), position) *
+					glm::rotate(glm::mat4(1.0), (float)(hash % 360) * 0.0174533f, glm::vec3(0.0f, 1.0f, 0.0f)) *
+					glm::scale(glm::mat4(1.0), glm::vec3(stressScale[s]));
+				instance.color = glm::vec4(0.6f + 0.4f * (float)((hash >> 8) & 255) / 255.0f, 0.6f + 0.4f * (float)((hash >> 16) & 255) / 255.0f,
+					0.6f + 0.4f * (float)((hash >> 24) & 255) / 255.0f, 1.0f);
+
+				stressInstances[s].push_back(instance);
+				stressCuller[s].addInstance(stressMesh.getBoundsCenter(), (stressMesh.getBoundsMax() - stressMesh.getBoundsMin()) * 0.5f,
+					stressMesh.getBoundsRadius(), instance.model);
+			}
+			stressFieldCount = gStressInstanceCount;
+		}
+
+		if (stressReady)
+		{
+			for (int s = 0; s < numStressModels; s++)
+			{
+				fillStressBuffers(s, lightSpaceMatrix, stressShadowBuffers[s]);
+				fillStressBuffers(s, projection * view, stressCameraBuffers[s]);
+			}
+		}
+		cullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cullStart).count();
+
+		// Render the scene to the depth buffer (shadow map), left cleared
+		// while the fallback draws
 		glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
 		glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
 		glClear(GL_DEPTH_BUFFER_BIT);
 
+		if (shadersReady)
+			shadowShader.use();
+
 		// Render the scene
-		for (int i = 0; i < numModels; i++)
+		for (int i = 0; shadersReady && i < numModels; i++)
 		{
+			if (!shadowVisible[i])
+				continue;
+
 			model = glm::translate(glm::mat4(1.0), modelPos[i]) * glm::scale(glm::mat4(1.0), modelScale[i]);
-			shadowShader.setUniform("model", model);
+			shadowShader.setUniform(shadowModelUniform, model);
 
-			texture[i].bind(0);		// set the texture before drawing.
-			mesh[i].draw();
-			texture[i].unbind(0);
+			// Depth only, positions and no textures
+			if (gMeshletCulling)
+				mesh[i].drawDepthCulled(modelLod[i], model, lightSpaceMatrix);
+			else
+				mesh[i].drawDepth(modelLod[i]);
 		}
 
-		if (LightType::POINT_LIGHT == lightType)
+		if (stressReady)
+		{
+			shadowInstancedShader.use();
+			for (int s = 0; s < numStressModels; s++)
+			{
+				for (size_t lod = 0; lod < MAX_MESH_LODS; lod++)
+					mesh[stressModel[s]].drawDepthInstanced((int)lod, stressShadowBuffers[s][lod]);
+			}
+		}
+
+		if (shadersReady && LightType::POINT_LIGHT == lightType)
 		{
 			// Render the light bulb geometry
 			model = glm::translate(glm::mat4(1.0), lightPos);
 			lightShader.use();
 			lightShader.setUniform("lightColor", lightColor);
 			lightShader.setUniform("model", model);
-			lightShader.setUniform("view", view);
-			lightShader.setUniform("projection", projection);
-			lightMesh.draw();
+			lightMesh.draw(0, false);
 		}
 
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -362,105 +804,112 @@ int main()
 		else
 			glViewport(0, 0, gWindowWidth, gWindowHeight);
 
+		// The scene is lit in linear space, written out as sRGB by the
+		// framebuffer or else by the shaders
+		if (gSrgbFramebuffer)
+			glEnable(GL_FRAMEBUFFER_SRGB);
+
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// Render the scene
-		if (LightType::POINT_LIGHT == lightType)
-		{
+		// Render the scene, camera and lights come from the frame uniforms
+		if (!shadersReady)
+			fallbackShader.use();
+		else if (LightType::POINT_LIGHT == lightType)
 			pointLightShader.use();
-
-			// Point light
-			pointLightShader.setUniform("view", view);
-			pointLightShader.setUniform("projection", projection);
-			pointLightShader.setUniform("viewPos", viewPos);
-
-			pointLightShader.setUniform("light.position", lightPos);
-			pointLightShader.setUniform("light.ambient", glm::vec3(0.1f, 0.1f, 0.1f));
-			pointLightShader.setUniform("light.diffuse", lightColor);
-			pointLightShader.setUniform("light.specular", glm::vec3(1.0f, 1.0f, 1.0f));
-		
-			pointLightShader.setUniform("lightSpaceMatrix", lightSpaceMatrix);
-
-		}
 		else if (LightType::SPOT_LIGHT == lightType)
-		{
 			spotLightShader.use();
 
-			// Spot light
-			glm::vec3 spotlightPos = fpsCamera.getPosition();
-			spotlightPos.y -= 0.5f;
-
-			spotLightShader.setUniform("view", view);
-			spotLightShader.setUniform("projection", projection);
-			spotLightShader.setUniform("viewPos", viewPos);
-
-			spotLightShader.setUniform("spotLight.ambient", glm::vec3(0.1f, 0.1f, 0.1f));
-			spotLightShader.setUniform("spotLight.diffuse", glm::vec3(0.8f, 0.8f, 0.8f));
-			spotLightShader.setUniform("spotLight.specular", glm::vec3(1.0f, 1.0f, 1.0f));
-			spotLightShader.setUniform("spotLight.position", spotlightPos);
-			spotLightShader.setUniform("spotLight.direction", fpsCamera.getLook());
-			spotLightShader.setUniform("spotLight.cosInnerCone", glm::cos(glm::radians(15.0f)));
-			spotLightShader.setUniform("spotLight.cosOuterCone", glm::cos(glm::radians(20.0f)));
-			spotLightShader.setUniform("spotLight.constant", 1.0f);
-			spotLightShader.setUniform("spotLight.linear", 0.07f);
-			spotLightShader.setUniform("spotLight.exponent", 0.017f);
-			spotLightShader.setUniform("spotLight.on", gFlashlightOn);
-
-			spotLightShader.setUniform("lightSpaceMatrix", lightSpaceMatrix);
-		}
-
 
 		// Render the scene
 		for (int i = 0; i < numModels; i++)
 		{
+			if (!cameraVisible[i])
+				continue;
+
 			model = glm::translate(glm::mat4(1.0), modelPos[i]) * glm::scale(glm::mat4(1.0), modelScale[i]);
 			
-			if (LightType::POINT_LIGHT == lightType)
+			if (!shadersReady)
 			{
-				pointLightShader.setUniform("model", model);
+				fallbackShader.setUniform(fallbackModelUniform, model);
+			}
+			else if (LightType::POINT_LIGHT == lightType)
+			{
+				pointLightShader.setUniform(pointModelUniform, model);
 
 				// Set material properties
 				pointLightShader.setUniform("material.ambient", glm::vec3(1.0f, 1.0f, 1.0f));
 				pointLightShader.setUniformSampler("material.diffuseMap", 0);
-				pointLightShader.setUniform("material.specular", glm::vec3(0.5f, 0.5f, 0.5f));
+				pointLightShader.setUniform("material.specular", materialSpecular);
 				pointLightShader.setUniform("material.shininess", 32.0f);
 			}
 			else if (LightType::SPOT_LIGHT == lightType)
 			{
-				spotLightShader.setUniform("model", model);
+				spotLightShader.setUniform(spotModelUniform, model);
 
 				// Set material properties
 				spotLightShader.setUniform("material.ambient", glm::vec3(1.0f, 1.0f, 1.0f));
 				spotLightShader.setUniformSampler("material.diffuseMap", 0);
-				spotLightShader.setUniform("material.specular", glm::vec3(0.5f, 0.5f, 0.5f));
+				spotLightShader.setUniform("material.specular", materialSpecular);
 				spotLightShader.setUniform("material.shininess", 32.0f);
 			}
-			texture[i].bind(0);		// set the texture before drawing.
-
 			// Render the shadow
 			glActiveTexture(GL_TEXTURE0 + 2);
 			glBindTexture(GL_TEXTURE_2D, depthMap);
 
-			pointLightShader.setUniform("shadowMap", 2);
-			spotLightShader.setUniform("shadowMap", 2);
+			if (shadersReady && LightType::POINT_LIGHT == lightType)
+				pointLightShader.setUniform("shadowMap", 2);
+			else if (shadersReady && LightType::SPOT_LIGHT == lightType)
+				spotLightShader.setUniform("shadowMap", 2);
 
-			mesh[i].draw();			// Render the OBJ mesh
-			texture[i].unbind(0);
+			// Render the OBJ mesh
+			if (gMeshletCulling)
+				mesh[i].drawCulled(modelLod[i], model, projection * view, viewPos, true);
+			else
+				mesh[i].draw(modelLod[i]);
 		}
 
-		if (LightType::POINT_LIGHT == lightType)
+		if (stressReady)
+		{
+			// Same material settings as the scene shader above
+			ShaderProgram& instancedShader = (LightType::POINT_LIGHT == lightType) ? pointLightInstancedShader : spotLightInstancedShader;
+			instancedShader.use();
+			instancedShader.setUniform("material.ambient", glm::vec3(1.0f, 1.0f, 1.0f));
+			instancedShader.setUniformSampler("material.diffuseMap", 0);
+			instancedShader.setUniform("material.specular", materialSpecular);
+			instancedShader.setUniform("material.shininess", 32.0f);
+			instancedShader.setUniform("shadowMap", 2);
+
+			for (int s = 0; s < numStressModels; s++)
+			{
+				// From an array the instances pick their own maps, the materials bind none
+				TextureArray* diffuseArray = stressLayers[s].array;
+				if (diffuseArray != nullptr)
+					diffuseArray->bind(DIFFUSE_ARRAY_UNIT);
+
+				for (size_t lod = 0; lod < MAX_MESH_LODS; lod++)
+					mesh[stressModel[s]].drawInstanced((int)lod, stressCameraBuffers[s][lod], diffuseArray == nullptr);
+			}
+		}
+
+		if (shadersReady && LightType::POINT_LIGHT == lightType)
 		{
 			// Render the light bulb geometry
 			model = glm::translate(glm::mat4(1.0), lightPos);
 			lightShader.use();
 			lightShader.setUniform("lightColor", lightColor);
 			lightShader.setUniform("model", model);
-			lightShader.setUniform("view", view);
-			lightShader.setUniform("projection", projection);
-			lightMesh.draw();
+			lightMesh.draw(0, false);
 		}
 
-		skybox.render(skyboxShader, view, projection);
+		if (shadersReady)
+			skybox.render(skyboxShader);
+
+		// Back under the VRAM budget, with what this frame drew marked used
+		ResidencyManager::update();
+
+		// ImGui's colors are already sRGB
+		if (gSrgbFramebuffer)
+			glDisable(GL_FRAMEBUFFER_SRGB);
 
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
@@ -470,12 +919,8 @@ int main()
 		lastTime = currentTime;
 	}
 
-	texture[0].destroy();
-	texture[1].destroy();
-	texture[2].destroy();
-	texture[3].destroy();
-	texture[4].destroy();
-	texture[5].destroy();
+	TextureLibrary::setAssetLoader(nullptr);
+	TextureLibrary::destroyAll();
 
 	mesh[0].destroy();
 	mesh[1].destroy();
@@ -484,11 +929,25 @@ int main()
 	mesh[4].destroy();
 	mesh[5].destroy();
 	lightMesh.destroy();
+	for (int s = 0; s < numStressModels; s++)
+	{
+		for (size_t lod = 0; lod < MAX_MESH_LODS; lod++)
+		{
+			stressShadowBuffers[s][lod].destroy();
+			stressCameraBuffers[s][lod].destroy();
+		}
+	}
+	GeometryArena::destroyAll();
 
+	fallbackShader.destroy();
 	pointLightShader.destroy();
 	spotLightShader.destroy();
 	shadowShader.destroy();
+	pointLightInstancedShader.destroy();
+	spotLightInstancedShader.destroy();
+	shadowInstancedShader.destroy();
 	skyboxShader.destroy();
+	FrameUniforms::destroy();
 	
 	skybox.destroy();
 
@@ -540,6 +999,7 @@ bool initOpenGL()
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);			// diffuse textures are sRGB, so lighting is done in linear space and encoded on write (a hint, checked below)
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);	// forward compatible with newer versions of OpenGL as they become available but not backward compatible (it will not run on devices that do not support OpenGL 3.3
 
 	// Create a window
@@ -565,6 +1025,19 @@ bool initOpenGL()
 
 	gladLoadGL();
 
+	// SRGB_CAPABLE is only a hint, ask what the back buffer really is
+	GLint colorEncoding = GL_LINEAR;
+	glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_BACK_LEFT, GL_FRAMEBUFFER_ATTACHMENT_COLOR_ENCODING, &colorEncoding);
+	gSrgbFramebuffer = (colorEncoding == GL_SRGB);
+	if (!gSrgbFramebuffer)
+		fmt::println("Default framebuffer is not sRGB, shaders encode their output");
+
+	// Programs compile on the driver's threads where it supports that
+	ShaderProgram::initParallelCompile((GLADloadproc)glfwGetProcAddress);
+
+	// Linked programs are kept between runs where the driver can hand them out
+	ProgramCache::init((GLADloadproc)glfwGetProcAddress);
+
 	// Set the required callback functions
 	glfwSetMouseButtonCallback(gWindow, mouse_button_callback);
 	glfwSetKeyCallback(gWindow, glfw_onKey);
@@ -578,7 +1051,11 @@ bool initOpenGL()
 	else
 		glfwSetCursorPos(gWindow, gWindowWidth / 2.0, gWindowHeight / 2.0);
 
-	glClearColor(0.23f, 0.38f, 0.47f, 1.0f);
+	// Picked in gamma space; an sRGB framebuffer encodes the clear as well
+	glm::vec3 clearColor(0.23f, 0.38f, 0.47f);
+	if (gSrgbFramebuffer)
+		clearColor = srgbToLinear(clearColor);
+	glClearColor(clearColor.r, clearColor.g, clearColor.b, 1.0f);
 
 	glEnable(GL_DEPTH_TEST);
 
@@ -693,3 +1170,14 @@ void showFPS(GLFWwindow* window) {
 
 	frameCount++;
 }
+
+//-----------------------------------------------------------------------------
+// Decodes a color picked in gamma (sRGB) space for lighting in linear space
+//-----------------------------------------------------------------------------
+glm::vec3 srgbToLinear(const glm::vec3& color)
+{
+	glm::vec3 linear;
+	for (int i = 0; i < 3; i++)
+		linear[i] = (color[i] <= 0.04045f) ? color[i] / 12.92f : std::pow((color[i] + 0.055f) / 1.055f, 2.4f);
+	return linear;
+}
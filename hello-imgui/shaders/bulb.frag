@@ -6,11 +6,13 @@
 //-----------------------------------------------------------------------------
 #version 330 core
 
+#include "frame_data.glsl"
+
 uniform vec3 lightColor;
 
 out vec4 frag_color;
 
 void main()
 {
-	frag_color = vec4(lightColor, 1.0f);
+	frag_color = framebufferColor(lightColor, 1.0f);
 };
@@ -6,18 +6,23 @@
 //-----------------------------------------------------------------------------
 #version 330 core
 
+#include "frame_data.glsl"
+
 layout (location = 0) in vec3 pos;			
-layout (location = 1) in vec3 normal;	
+layout (location = 1) in vec4 normal;	
 layout (location = 2) in vec2 texCoord;
 
+// Dequantization constants set by Mesh::draw, see VertexFormat.h
+layout (location = 3) in vec4 dequantOffset;	// xyz: position offset, w: 1 = octahedral normals
+layout (location = 4) in vec3 dequantScale;		// position scale
+
 uniform mat4 model;			// model matrix
-uniform mat4 view;			// view matrix
-uniform mat4 projection;	// projection matrix
 
 out vec2 TexCoord;
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(pos, 1.0f);
+	vec3 position = dequantOffset.xyz + pos * dequantScale;
+	gl_Position = projection * view * model * vec4(position, 1.0f);
 	TexCoord = texCoord;
 };
\ No newline at end of file
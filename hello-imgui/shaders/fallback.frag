@@ -0,0 +1,18 @@
+//-----------------------------------------------------------------------------
+// fallback.frag
+//
+// Plain gray, shaded from above, while the lighting programs compile
+//-----------------------------------------------------------------------------
+#version 330 core
+
+#include "frame_data.glsl"
+
+in vec3 Normal;
+
+out vec4 frag_color;
+
+void main()
+{
+	float shade = 0.35 + 0.65 * max(dot(normalize(Normal), normalize(vec3(0.3, 1.0, 0.5))), 0.0);
+	frag_color = framebufferColor(vec3(0.5) * shade, 1.0);
+}
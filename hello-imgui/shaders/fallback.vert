@@ -0,0 +1,38 @@
+//-----------------------------------------------------------------------------
+// fallback.vert
+//
+// Vertex shader the scene draws with while the lighting programs compile,
+// see ShaderProgram::submitShaders
+//-----------------------------------------------------------------------------
+#version 330 core
+
+#include "frame_data.glsl"
+
+layout (location = 0) in vec3 pos;			
+layout (location = 1) in vec4 normal;	
+
+// Dequantization constants set by Mesh::draw, see VertexFormat.h
+layout (location = 3) in vec4 dequantOffset;	// xyz: position offset, w: 1 = octahedral normals
+layout (location = 4) in vec3 dequantScale;		// position scale
+
+uniform mat4 model;			// model matrix
+
+out vec3 Normal;
+
+// Unfolds an octahedral encoded normal
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+void main()
+{
+	vec3 position = dequantOffset.xyz + pos * dequantScale;
+	vec3 objectNormal = (dequantOffset.w > 0.5) ? octDecode(normal.xy) : normal.xyz;
+
+	Normal = mat3(model) * objectNormal;
+	gl_Position = projection * view * model * vec4(position, 1.0f);
+}
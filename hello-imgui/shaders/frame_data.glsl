@@ -0,0 +1,55 @@
+//-----------------------------------------------------------------------------
+// frame_data.glsl
+//
+// The per-frame uniforms every program reads from one std140 uniform buffer
+// (FrameUniforms.h), included by ShaderProgram::loadShaders.  The C++
+// structs mirror this layout, FrameUniforms::checkLayout compares them.
+//-----------------------------------------------------------------------------
+
+struct Light
+{
+	vec3 position;
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+};
+
+struct SpotLight
+{
+	vec3 position;
+	vec3 direction;
+	float cosInnerCone;
+	float cosOuterCone;
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+	int on;
+
+	float constant;
+	float linear;
+	float exponent;
+};
+
+layout (std140) uniform FrameData
+{
+	mat4 view;				// view matrix
+	mat4 projection;		// projection matrix
+	mat4 skyboxView;		// view matrix without the translation
+	mat4 lightSpaceMatrix;
+	vec3 viewPos;
+	int encodeSrgb;			// 1 when the default framebuffer is linear
+	Light light;
+	SpotLight spotLight;
+};
+
+// A linear color as written to the default framebuffer: as is when the
+// framebuffer encodes to sRGB, else encoded here
+vec4 framebufferColor(vec3 color, float alpha)
+{
+	if (encodeSrgb == 0)
+		return vec4(color, alpha);
+
+	color = clamp(color, 0.0, 1.0);
+	vec3 encoded = mix(1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055, color * 12.92, lessThanEqual(color, vec3(0.0031308)));
+	return vec4(encoded, alpha);
+}
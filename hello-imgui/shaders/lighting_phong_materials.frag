@@ -6,6 +6,8 @@
 //-----------------------------------------------------------------------------
 #version 330 core
 
+#include "frame_data.glsl"
+
 struct Material 
 {
     vec3 ambient;
@@ -14,26 +16,19 @@ struct Material
     float shininess;
 };
 
-struct Light
-{
-	vec3 position;
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-};
-  
 in vec2 TexCoord;
 in vec3 FragPos;
 in vec3 Normal;
+in vec3 Tint;		// instance color, white when not instanced
+flat in float DiffuseLayer;		// of diffuseArray, negative for material.diffuseMap
 
 in vec4 FragPosLightSpace;
 
 uniform sampler2D texture_map;
+uniform sampler2DArray diffuseArray;
 uniform sampler2D shadowMap;
 
-uniform Light light;
 uniform Material material;
-uniform vec3 viewPos;
 
 out vec4 frag_color;
 
@@ -61,6 +56,15 @@ float ShadowCalculation(vec4 fragPosLightSpace)
     return shadow;
 }
 
+// The diffuse color, from the instance's layer of the texture array or
+// from the material's own map
+vec3 diffuseTexel()
+{
+    if (DiffuseLayer >= 0.0)
+        return texture(diffuseArray, vec3(TexCoord, DiffuseLayer)).rgb;
+    return texture(material.diffuseMap, TexCoord).rgb;
+}
+
 void main()
 { 
     // Ambient -------------------------------------------------------------------------
@@ -70,7 +74,7 @@ void main()
     vec3 normal = normalize(Normal); 
     vec3 lightDir = normalize(light.position - FragPos);
     float NdotL = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = light.diffuse * NdotL * vec3(texture(material.diffuseMap, TexCoord));
+    vec3 diffuse = light.diffuse * NdotL * diffuseTexel();
     
     // Specular - Blinn-Phong ----------------------------------------------------------
 	vec3 viewDir = normalize(viewPos - FragPos);
@@ -83,8 +87,8 @@ void main()
     // calculate shadow
     float shadow = ShadowCalculation(FragPosLightSpace);  
 
-    vec3 color = texture(texture_map, TexCoord).rgb;
+    vec3 color = diffuseTexel();
     vec3 lighting = (ambient + (1.0 - shadow) * (diffuse + specular)) * color;    
 
-    frag_color = vec4(lighting, 1.0);
+    frag_color = framebufferColor(lighting * Tint, 1.0);
 }
@@ -6,29 +6,47 @@
 //-----------------------------------------------------------------------------
 #version 330 core
 
+#include "frame_data.glsl"
+
 layout (location = 0) in vec3 pos;			
-layout (location = 1) in vec3 normal;	
+layout (location = 1) in vec4 normal;	
 layout (location = 2) in vec2 texCoord;
 
-uniform mat4 model;			// model matrix
-uniform mat4 view;			// view matrix
-uniform mat4 projection;	// projection matrix
+// Dequantization constants set by Mesh::draw, see VertexFormat.h
+layout (location = 3) in vec4 dequantOffset;	// xyz: position offset, w: 1 = octahedral normals
+layout (location = 4) in vec3 dequantScale;		// position scale
 
-uniform mat4 lightSpaceMatrix;
+uniform mat4 model;			// model matrix
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoord;
+out vec3 Tint;
+flat out float DiffuseLayer;
 
 out vec4 FragPosLightSpace;
 
+// Unfolds an octahedral encoded normal
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
 void main()
 {
-    FragPos = vec3(model * vec4(pos, 1.0f));			// vertex position in world space
-	Normal = normal;
+	vec3 position = dequantOffset.xyz + pos * dequantScale;
+	vec3 objectNormal = (dequantOffset.w > 0.5) ? octDecode(normal.xy) : normal.xyz;
+
+    FragPos = vec3(model * vec4(position, 1.0f));			// vertex position in world space
+	Normal = objectNormal;
 	
 	TexCoord = texCoord;
+	Tint = vec3(1.0);
+	DiffuseLayer = -1.0;
 	FragPosLightSpace = lightSpaceMatrix * vec4(FragPos, 1.0);
 
-	gl_Position = projection * view *  model * vec4(pos, 1.0f);
+	gl_Position = projection * view *  model * vec4(position, 1.0f);
 }
@@ -0,0 +1,54 @@
+//-----------------------------------------------------------------------------
+// lighting_phong_materials_instanced.vert
+//
+// Vertex shader for Blinn-Phong lighting with materials, instanced: the
+// model matrix and a color come from per-instance attributes (InstanceBuffer.h)
+//-----------------------------------------------------------------------------
+#version 330 core
+
+#include "frame_data.glsl"
+
+layout (location = 0) in vec3 pos;			
+layout (location = 1) in vec4 normal;	
+layout (location = 2) in vec2 texCoord;
+
+// Dequantization constants set by Mesh::draw, see VertexFormat.h
+layout (location = 3) in vec4 dequantOffset;	// xyz: position offset, w: 1 = octahedral normals
+layout (location = 4) in vec3 dequantScale;		// position scale
+
+layout (location = 5) in mat4 model;			// model matrix, locations 5-8
+layout (location = 9) in vec4 instanceColor;
+layout (location = 10) in float instanceLayer;	// diffuse map layer, see InstanceData
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoord;
+out vec3 Tint;
+flat out float DiffuseLayer;
+
+out vec4 FragPosLightSpace;
+
+// Unfolds an octahedral encoded normal
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+void main()
+{
+	vec3 position = dequantOffset.xyz + pos * dequantScale;
+	vec3 objectNormal = (dequantOffset.w > 0.5) ? octDecode(normal.xy) : normal.xyz;
+
+    FragPos = vec3(model * vec4(position, 1.0f));			// vertex position in world space
+	Normal = mat3(model) * objectNormal;		// rotation and uniform scale only
+	
+	TexCoord = texCoord;
+	Tint = instanceColor.rgb;
+	DiffuseLayer = instanceLayer;
+	FragPosLightSpace = lightSpaceMatrix * vec4(FragPos, 1.0);
+
+	gl_Position = projection * view *  model * vec4(position, 1.0f);
+}
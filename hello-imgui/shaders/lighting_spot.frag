@@ -6,6 +6,8 @@
 //-----------------------------------------------------------------------------
 #version 330 core
 
+#include "frame_data.glsl"
+
 struct Material 
 {
     vec3 ambient;
@@ -14,32 +16,17 @@ struct Material
     float shininess;
 };
 
-struct SpotLight
-{
-	vec3 position;
-	vec3 direction;
-	float cosInnerCone;
-	float cosOuterCone;
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-	int on;
-
-	float constant;
-	float linear;
-	float exponent;
-};
-
 in vec2 TexCoord;
 in vec3 FragPos;
 in vec3 Normal;
+in vec3 Tint;		// instance color, white when not instanced
+flat in float DiffuseLayer;		// of diffuseArray, negative for material.diffuseMap
 in vec4 FragPosLightSpace;
 
-uniform SpotLight spotLight;
 uniform Material material;
-uniform vec3 viewPos;
 
 uniform sampler2D texture_map;
+uniform sampler2DArray diffuseArray;
 uniform sampler2D shadowMap;
 
 out vec4 frag_color;
@@ -70,10 +57,19 @@ float ShadowCalculation(vec4 fragPosLightSpace)
     return shadow;
 }
 
+// The diffuse color, from the instance's layer of the texture array or
+// from the material's own map
+vec3 diffuseTexel()
+{
+    if (DiffuseLayer >= 0.0)
+        return texture(diffuseArray, vec3(TexCoord, DiffuseLayer)).rgb;
+    return texture(material.diffuseMap, TexCoord).rgb;
+}
+
 void main()
 {
     // Ambient -------------------------------------------------------------------------
-	vec3 ambient = spotLight.ambient * material.ambient * vec3(texture(material.diffuseMap, TexCoord));
+	vec3 ambient = spotLight.ambient * material.ambient * diffuseTexel();
 	
 	vec3 spotColor = vec3(0.0f);
 
@@ -83,10 +79,10 @@ void main()
 
     // calculate shadow
     float shadow = ShadowCalculation(FragPosLightSpace);  
-    vec3 color = texture(texture_map, TexCoord).rgb;
+    vec3 color = diffuseTexel();
     vec3 lighting = (ambient + (1.0 - shadow) * spotColor) * color;    
 
-    frag_color = vec4(lighting, 1.0);
+    frag_color = framebufferColor(lighting * Tint, 1.0);
 }; 
 
 //--------------------------------------------------------------
@@ -104,7 +100,7 @@ vec3 calcSpotLight()
 	// Diffuse ------------------------------------------------------------------------- 
     vec3 normal = normalize(Normal);  
     float NdotL = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = spotLight.diffuse * NdotL * vec3(texture(material.diffuseMap, TexCoord));
+    vec3 diffuse = spotLight.diffuse * NdotL * diffuseTexel();
     
      // Specular - Blinn-Phong ----------------------------------------------------------
 	vec3 viewDir = normalize(viewPos - FragPos);
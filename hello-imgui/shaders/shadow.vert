@@ -1,10 +1,16 @@
 #version 330 core
+
+#include "frame_data.glsl"
+
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 lightSpaceMatrix;
+// Dequantization constants set by Mesh::draw, see VertexFormat.h
+layout (location = 3) in vec4 dequantOffset;
+layout (location = 4) in vec3 dequantScale;
+
 uniform mat4 model;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    gl_Position = lightSpaceMatrix * model * vec4(dequantOffset.xyz + aPos * dequantScale, 1.0);
 }
@@ -0,0 +1,17 @@
+#version 330 core
+
+#include "frame_data.glsl"
+
+layout (location = 0) in vec3 aPos;
+
+// Dequantization constants set by Mesh::draw, see VertexFormat.h
+layout (location = 3) in vec4 dequantOffset;
+layout (location = 4) in vec3 dequantScale;
+
+// Per-instance model matrix, see InstanceBuffer.h
+layout (location = 5) in mat4 model;
+
+void main()
+{
+    gl_Position = lightSpaceMatrix * model * vec4(dequantOffset.xyz + aPos * dequantScale, 1.0);
+}
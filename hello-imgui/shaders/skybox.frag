@@ -1,4 +1,7 @@
 #version 330 core
+
+#include "frame_data.glsl"
+
 out vec4 FragColor;
 
 in vec3 TexCoords;
@@ -7,5 +10,6 @@ uniform samplerCube skybox;
 
 void main()
 {    
-    FragColor = texture(skybox, TexCoords);
+    vec4 texel = texture(skybox, TexCoords);
+    FragColor = framebufferColor(texel.rgb, texel.a);
 }
@@ -32,12 +32,17 @@ public:
 	void draw();
 	void destroy();
 
+	size_t getVertexCount() const { return mVertices.size(); }
+	size_t getIndexCount() const  { return mIndices.size(); }
+
 private:
 
 	void initBuffers();
 
 	bool mLoaded;
 	std::vector<Vertex> mVertices;
-	GLuint mVBO, mVAO;
+	std::vector<GLuint> mIndices;
+	GLenum mIndexType;		// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, whichever is narrowest
+	GLuint mVBO, mIBO, mVAO;
 };
 #endif //MESH_H
@@ -9,17 +9,78 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
 
 #include <fmt/core.h>
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
+namespace
+{
+	//-------------------------------------------------------------------------
+	// Hash of the position/normal/texcoord index triple of an OBJ face corner
+	//-------------------------------------------------------------------------
+	struct ObjIndexHash
+	{
+		size_t operator()(const tinyobj::index_t& idx) const
+		{
+			size_t h = std::hash<int>()(idx.vertex_index);
+			h ^= std::hash<int>()(idx.normal_index) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			h ^= std::hash<int>()(idx.texcoord_index) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			return h;
+		}
+	};
+
+	struct ObjIndexEqual
+	{
+		bool operator()(const tinyobj::index_t& a, const tinyobj::index_t& b) const
+		{
+			return a.vertex_index == b.vertex_index &&
+				a.normal_index == b.normal_index &&
+				a.texcoord_index == b.texcoord_index;
+		}
+	};
+
+	//-------------------------------------------------------------------------
+	// FNV-1a hash of the vertex attributes.  Catches corners that reference
+	// different OBJ indices but end up with bit-identical attributes.
+	//-------------------------------------------------------------------------
+	struct VertexHash
+	{
+		size_t operator()(const Vertex& v) const
+		{
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&v);
+			uint64_t h = 14695981039346656037ull;
+			for (size_t i = 0; i < sizeof(Vertex); i++)
+			{
+				h ^= bytes[i];
+				h *= 1099511628211ull;
+			}
+			return (size_t)h;
+		}
+	};
+
+	struct VertexEqual
+	{
+		bool operator()(const Vertex& a, const Vertex& b) const
+		{
+			return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+		}
+	};
+}
+
 //-----------------------------------------------------------------------------
 // Constructor
 //-----------------------------------------------------------------------------
 Mesh::Mesh()
-	:mLoaded(false)
+	:mLoaded(false),
+	 mIndexType(GL_UNSIGNED_INT),
+	 mVBO(0),
+	 mIBO(0),
+	 mVAO(0)
 {
 }
 
@@ -37,6 +98,7 @@ void Mesh::destroy()
 {
 	glDeleteVertexArrays(1, &mVAO);
 	glDeleteBuffers(1, &mVBO);
+	glDeleteBuffers(1, &mIBO);
 }
 
 //-----------------------------------------------------------------------------
@@ -65,6 +127,15 @@ bool Mesh::loadOBJ(const std::string& filename)
 	auto& shapes = reader.GetShapes();
 	auto& materials = reader.GetMaterials();
 
+	// Weld face corners into unique vertices.  Corners are first matched on
+	// their OBJ index triple, then on the resulting attributes.
+	std::unordered_map<tinyobj::index_t, GLuint, ObjIndexHash, ObjIndexEqual> cornerToIndex;
+	std::unordered_map<Vertex, GLuint, VertexHash, VertexEqual> vertexToIndex;
+	size_t numCorners = 0;
+
+	mVertices.clear();
+	mIndices.clear();
+
 	// Loop over shapes
 	for (size_t s = 0; s < shapes.size(); s++) {
 		// Loop over faces(polygon)
@@ -74,10 +145,18 @@ bool Mesh::loadOBJ(const std::string& filename)
 
 			// Loop over vertices in the face.
 			for (size_t v = 0; v < fv; v++) {
-				Vertex meshVertex;
+				tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
+				numCorners++;
+
+				auto corner = cornerToIndex.find(idx);
+				if (corner != cornerToIndex.end()) {
+					mIndices.push_back(corner->second);
+					continue;
+				}
+
+				Vertex meshVertex{};
 
 				// access to vertex
-				tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
 				tinyobj::real_t vx = attrib.vertices[3 * size_t(idx.vertex_index) + 0];
 				tinyobj::real_t vy = attrib.vertices[3 * size_t(idx.vertex_index) + 1];
 				tinyobj::real_t vz = attrib.vertices[3 * size_t(idx.vertex_index) + 2];
@@ -91,7 +170,7 @@ bool Mesh::loadOBJ(const std::string& filename)
 					tinyobj::real_t nz = attrib.normals[3 * size_t(idx.normal_index) + 2];
 				}
 
-				glm::vec2 uv;
+				glm::vec2 uv(0.0f);
 				// Check if texcoord data exists
 				if (idx.texcoord_index >= 0) {
 					tinyobj::real_t tx = attrib.texcoords[2 * size_t(idx.texcoord_index) + 0];
@@ -103,12 +182,41 @@ bool Mesh::loadOBJ(const std::string& filename)
 				// Save the OBJ data
 				meshVertex.position = vertex;
 				meshVertex.texCoords = uv;
-				mVertices.push_back(meshVertex);
+
+				auto existing = vertexToIndex.find(meshVertex);
+				GLuint index;
+				if (existing != vertexToIndex.end()) {
+					index = existing->second;
+				}
+				else {
+					index = (GLuint)mVertices.size();
+					mVertices.push_back(meshVertex);
+					vertexToIndex.emplace(meshVertex, index);
+				}
+
+				cornerToIndex.emplace(idx, index);
+				mIndices.push_back(index);
 			}
 			index_offset += fv;
 		}
 	}
 
+	if (mIndices.empty()) {
+		fmt::println("Mesh '{}' has no faces", filename);
+		return false;
+	}
+
+	// Use 16-bit indices whenever every vertex is addressable with them
+	mIndexType = (mVertices.size() <= 0xFFFF) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+	size_t indexSize = (mIndexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+	long long flatBytes = (long long)(numCorners * sizeof(Vertex));
+	long long indexedBytes = (long long)(mVertices.size() * sizeof(Vertex) + mIndices.size() * indexSize);
+
+	fmt::println("Mesh '{}': {} corners -> {} vertices, {} indices ({}-bit), {} bytes saved ({} -> {})",
+		filename, numCorners, mVertices.size(), mIndices.size(), indexSize * 8,
+		flatBytes - indexedBytes, flatBytes, indexedBytes);
+
 	// Create and initialize the buffers
 	initBuffers();
 
@@ -116,18 +224,31 @@ bool Mesh::loadOBJ(const std::string& filename)
 }
 
 //-----------------------------------------------------------------------------
-// Create and initialize the vertex buffer and vertex array object
-// Must have valid, non-empty std::vector of Vertex objects.
+// Create and initialize the vertex/index buffers and vertex array object
+// Must have valid, non-empty std::vector of Vertex objects and indices.
 //-----------------------------------------------------------------------------
 void Mesh::initBuffers()
 {
 	glGenVertexArrays(1, &mVAO);
 	glGenBuffers(1, &mVBO);
+	glGenBuffers(1, &mIBO);
 
 	glBindVertexArray(mVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, mVBO);
 	glBufferData(GL_ARRAY_BUFFER, mVertices.size() * sizeof(Vertex), &mVertices[0], GL_STATIC_DRAW);
 
+	// The element array binding is part of the VAO state
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIBO);
+	if (mIndexType == GL_UNSIGNED_SHORT)
+	{
+		std::vector<GLushort> shortIndices(mIndices.begin(), mIndices.end());
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), &shortIndices[0], GL_STATIC_DRAW);
+	}
+	else
+	{
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndices.size() * sizeof(GLuint), &mIndices[0], GL_STATIC_DRAW);
+	}
+
 	// Vertex Positions
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
@@ -148,7 +269,7 @@ void Mesh::draw()
 	if (!mLoaded) return;
 
 	glBindVertexArray(mVAO);
-	glDrawArrays(GL_TRIANGLES, 0, mVertices.size());
+	glDrawElements(GL_TRIANGLES, (GLsizei)mIndices.size(), mIndexType, (GLvoid*)0);
 	glBindVertexArray(0);
 }
 
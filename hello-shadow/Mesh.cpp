@@ -5,21 +5,89 @@
 // Basic Mesh class
 //-----------------------------------------------------------------------------
 #include "Mesh.h"
+#include "MeshOptimizer.h"
 
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
 
 #include <fmt/core.h>
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
+namespace
+{
+	//-------------------------------------------------------------------------
+	// Hash of the position/normal/texcoord index triple of an OBJ face corner
+	//-------------------------------------------------------------------------
+	struct ObjIndexHash
+	{
+		size_t operator()(const tinyobj::index_t& idx) const
+		{
+			size_t h = std::hash<int>()(idx.vertex_index);
+			h ^= std::hash<int>()(idx.normal_index) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			h ^= std::hash<int>()(idx.texcoord_index) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			return h;
+		}
+	};
+
+	struct ObjIndexEqual
+	{
+		bool operator()(const tinyobj::index_t& a, const tinyobj::index_t& b) const
+		{
+			return a.vertex_index == b.vertex_index &&
+				a.normal_index == b.normal_index &&
+				a.texcoord_index == b.texcoord_index;
+		}
+	};
+
+	//-------------------------------------------------------------------------
+	// FNV-1a hash of the vertex attributes.  Catches corners that reference
+	// different OBJ indices but end up with bit-identical attributes.
+	//-------------------------------------------------------------------------
+	struct VertexHash
+	{
+		size_t operator()(const Vertex& v) const
+		{
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&v);
+			uint64_t h = 14695981039346656037ull;
+			for (size_t i = 0; i < sizeof(Vertex); i++)
+			{
+				h ^= bytes[i];
+				h *= 1099511628211ull;
+			}
+			return (size_t)h;
+		}
+	};
+
+	struct VertexEqual
+	{
+		bool operator()(const Vertex& a, const Vertex& b) const
+		{
+			return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+		}
+	};
+}
+
 //-----------------------------------------------------------------------------
 // Constructor
 //-----------------------------------------------------------------------------
 Mesh::Mesh()
-	:mLoaded(false)
+	:mLoaded(false),
+	 mIndexType(GL_UNSIGNED_INT),
+	 mBoundsMin(0.0f),
+	 mBoundsMax(0.0f),
+	 mBoundsRadius(0.0f),
+	 mDepthStream(DEPTH_STREAM_NONE),
+	 mVBO(0),
+	 mIBO(0),
+	 mVAO(0),
+	 mDepthVBO(0),
+	 mDepthVAO(0)
 {
 }
 
@@ -37,12 +105,15 @@ void Mesh::destroy()
 {
 	glDeleteVertexArrays(1, &mVAO);
 	glDeleteBuffers(1, &mVBO);
+	glDeleteBuffers(1, &mIBO);
+	glDeleteVertexArrays(1, &mDepthVAO);
+	glDeleteBuffers(1, &mDepthVBO);
 }
 
 //-----------------------------------------------------------------------------
 // Loads a Wavefront OBJ model
 //-----------------------------------------------------------------------------
-bool Mesh::loadOBJ(const std::string& filename)
+bool Mesh::loadOBJ(const std::string& filename, DepthStream depthStream)
 {
 	std::vector<unsigned int> vertexIndices, uvIndices;
 	std::vector<glm::vec3> tempVertices;
@@ -69,6 +140,15 @@ bool Mesh::loadOBJ(const std::string& filename)
 	auto& shapes = reader.GetShapes();
 	auto& materials = reader.GetMaterials();
 
+	// Weld face corners into unique vertices.  Corners are first matched on
+	// their OBJ index triple, then on the resulting attributes.
+	std::unordered_map<tinyobj::index_t, GLuint, ObjIndexHash, ObjIndexEqual> cornerToIndex;
+	std::unordered_map<Vertex, GLuint, VertexHash, VertexEqual> vertexToIndex;
+	size_t numCorners = 0;
+
+	mVertices.clear();
+	mIndices.clear();
+
 	// Loop over shapes
 	for (size_t s = 0; s < shapes.size(); s++) {
 		// Loop over faces(polygon)
@@ -78,10 +158,18 @@ bool Mesh::loadOBJ(const std::string& filename)
 
 			// Loop over vertices in the face.
 			for (size_t v = 0; v < fv; v++) {
-				Vertex meshVertex;
+				tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
+				numCorners++;
+
+				auto corner = cornerToIndex.find(idx);
+				if (corner != cornerToIndex.end()) {
+					mIndices.push_back(corner->second);
+					continue;
+				}
+
+				Vertex meshVertex{};
 
 				// access to vertex
-				tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
 				tinyobj::real_t vx = attrib.vertices[3 * size_t(idx.vertex_index) + 0];
 				tinyobj::real_t vy = attrib.vertices[3 * size_t(idx.vertex_index) + 1];
 				tinyobj::real_t vz = attrib.vertices[3 * size_t(idx.vertex_index) + 2];
@@ -108,32 +196,100 @@ bool Mesh::loadOBJ(const std::string& filename)
 					meshVertex.texCoords = uv;
 				}
 
-				mVertices.push_back(meshVertex);
+				auto existing = vertexToIndex.find(meshVertex);
+				GLuint index;
+				if (existing != vertexToIndex.end()) {
+					index = existing->second;
+				}
+				else {
+					index = (GLuint)mVertices.size();
+					mVertices.push_back(meshVertex);
+					vertexToIndex.emplace(meshVertex, index);
+				}
+
+				cornerToIndex.emplace(idx, index);
+				mIndices.push_back(index);
 			}
 			index_offset += fv;
 
 		}
 	}
 
+	if (mIndices.empty()) {
+		fmt::println("Mesh '{}' has no faces", filename);
+		return false;
+	}
+
+	// Reorder triangles for the post-transform cache and front-to-back
+	// overdraw, then vertices in order of first use
+	VertexCacheStats before = MeshOptimizer::analyzeVertexCache(mIndices, mVertices.size());
+
+	MeshOptimizer::optimizeVertexCache(mIndices, mVertices.size());
+	MeshOptimizer::optimizeOverdraw(mIndices, &mVertices[0].position.x, sizeof(Vertex), mVertices.size());
+	MeshOptimizer::optimizeVertexFetch(&mVertices[0], mVertices.size(), sizeof(Vertex), mIndices);
+
+	VertexCacheStats after = MeshOptimizer::analyzeVertexCache(mIndices, mVertices.size());
+
+	fmt::println("Mesh '{}': ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+		filename, before.acmr, after.acmr, before.atvr, after.atvr);
+
+	mBoundsMin = mBoundsMax = mVertices[0].position;
+	for (const Vertex& vertex : mVertices)
+	{
+		mBoundsMin = glm::min(mBoundsMin, vertex.position);
+		mBoundsMax = glm::max(mBoundsMax, vertex.position);
+	}
+
+	// Tighter than half the diagonal for anything but a box
+	mBoundsRadius = 0.0f;
+	for (const Vertex& vertex : mVertices)
+		mBoundsRadius = glm::max(mBoundsRadius, glm::distance(getBoundsCenter(), vertex.position));
+
+	// Use 16-bit indices whenever every vertex is addressable with them
+	mIndexType = (mVertices.size() <= 0xFFFF) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+	size_t indexSize = (mIndexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+	long long flatBytes = (long long)(numCorners * sizeof(Vertex));
+	long long indexedBytes = (long long)(mVertices.size() * sizeof(Vertex) + mIndices.size() * indexSize);
+
+	fmt::println("Mesh '{}': {} corners -> {} vertices, {} indices ({}-bit), {} bytes saved ({} -> {})",
+		filename, numCorners, mVertices.size(), mIndices.size(), indexSize * 8,
+		flatBytes - indexedBytes, flatBytes, indexedBytes);
+
 	// Create and initialize the buffers
+	mDepthStream = depthStream;
 	initBuffers();
+	initDepthBuffers();
 
 	return (mLoaded = true);
 }
 
 //-----------------------------------------------------------------------------
-// Create and initialize the vertex buffer and vertex array object
-// Must have valid, non-empty std::vector of Vertex objects.
+// Create and initialize the vertex/index buffers and vertex array object
+// Must have valid, non-empty std::vector of Vertex objects and indices.
 //-----------------------------------------------------------------------------
 void Mesh::initBuffers()
 {
 	glGenVertexArrays(1, &mVAO);
 	glGenBuffers(1, &mVBO);
+	glGenBuffers(1, &mIBO);
 
 	glBindVertexArray(mVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, mVBO);
 	glBufferData(GL_ARRAY_BUFFER, mVertices.size() * sizeof(Vertex), &mVertices[0], GL_STATIC_DRAW);
 
+	// The element array binding is part of the VAO state
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIBO);
+	if (mIndexType == GL_UNSIGNED_SHORT)
+	{
+		std::vector<GLushort> shortIndices(mIndices.begin(), mIndices.end());
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), &shortIndices[0], GL_STATIC_DRAW);
+	}
+	else
+	{
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndices.size() * sizeof(GLuint), &mIndices[0], GL_STATIC_DRAW);
+	}
+
 	// Vertex Positions
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
@@ -150,6 +306,87 @@ void Mesh::initBuffers()
 	glBindVertexArray(0);
 }
 
+//-----------------------------------------------------------------------------
+// Positions only, in their own buffer at the same vertex indices, so the
+// depth VAO draws from the same index buffer.  Attribute 0 as in the full
+// VAO, the depth shaders read nothing else.
+//-----------------------------------------------------------------------------
+void Mesh::initDepthBuffers()
+{
+	if (mDepthStream == DEPTH_STREAM_NONE)
+		return;
+
+	glGenVertexArrays(1, &mDepthVAO);
+	glGenBuffers(1, &mDepthVBO);
+
+	glBindVertexArray(mDepthVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, mDepthVBO);
+
+	size_t streamBytes;
+	if (mDepthStream == DEPTH_STREAM_UNORM16)
+	{
+		// 0..65535 across the bounds on each axis, a flat axis stays 0
+		glm::vec3 extent = mBoundsMax - mBoundsMin;
+		std::vector<GLushort> positions(mVertices.size() * 4, 0);
+		for (size_t i = 0; i < mVertices.size(); i++)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				float t = (extent[axis] > 0.0f) ? (mVertices[i].position[axis] - mBoundsMin[axis]) / extent[axis] : 0.0f;
+				positions[i * 4 + axis] = (GLushort)(glm::clamp(t, 0.0f, 1.0f) * 65535.0f + 0.5f);
+			}
+		}
+		streamBytes = positions.size() * sizeof(GLushort);
+		glBufferData(GL_ARRAY_BUFFER, streamBytes, &positions[0], GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 4 * sizeof(GLushort), (GLvoid*)0);
+	}
+	else
+	{
+		std::vector<glm::vec3> positions(mVertices.size());
+		for (size_t i = 0; i < mVertices.size(); i++)
+			positions[i] = mVertices[i].position;
+		streamBytes = positions.size() * sizeof(glm::vec3);
+		glBufferData(GL_ARRAY_BUFFER, streamBytes, &positions[0], GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+	}
+	glEnableVertexAttribArray(0);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIBO);
+
+	glBindVertexArray(0);
+
+	fmt::println("  depth stream {} bytes/vertex instead of {}, {} bytes", streamBytes / mVertices.size(), sizeof(Vertex), streamBytes);
+}
+
+//-----------------------------------------------------------------------------
+// Maps the depth stream's positions to model space: the UNORM16 ones are
+// 0..1 across the bounds
+//-----------------------------------------------------------------------------
+glm::mat4 Mesh::getDepthTransform() const
+{
+	if (mDepthStream != DEPTH_STREAM_UNORM16)
+		return glm::mat4(1.0f);
+
+	glm::mat4 transform(1.0f);
+	transform[0][0] = mBoundsMax.x - mBoundsMin.x;
+	transform[1][1] = mBoundsMax.y - mBoundsMin.y;
+	transform[2][2] = mBoundsMax.z - mBoundsMin.z;
+	transform[3] = glm::vec4(mBoundsMin, 1.0f);
+	return transform;
+}
+
+//-----------------------------------------------------------------------------
+// Render the mesh's depth
+//-----------------------------------------------------------------------------
+void Mesh::drawDepth()
+{
+	if (!mLoaded) return;
+
+	glBindVertexArray((mDepthVAO != 0) ? mDepthVAO : mVAO);
+	glDrawElements(GL_TRIANGLES, (GLsizei)mIndices.size(), mIndexType, (GLvoid*)0);
+	glBindVertexArray(0);
+}
+
 //-----------------------------------------------------------------------------
 // Render the mesh
 //-----------------------------------------------------------------------------
@@ -158,7 +395,7 @@ void Mesh::draw()
 	if (!mLoaded) return;
 
 	glBindVertexArray(mVAO);
-	glDrawArrays(GL_TRIANGLES, 0, mVertices.size());
+	glDrawElements(GL_TRIANGLES, (GLsizei)mIndices.size(), mIndexType, (GLvoid*)0);
 	glBindVertexArray(0);
 }
 
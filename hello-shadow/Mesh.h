@@ -21,6 +21,15 @@ struct Vertex
 	glm::vec2 texCoords;
 };
 
+// A second vertex stream with positions only, for passes that write depth
+// alone.  UNORM16 stores them relative to the bounds, see getDepthTransform.
+enum DepthStream
+{
+	DEPTH_STREAM_NONE,
+	DEPTH_STREAM_FLOAT,		// xyz, 12 bytes
+	DEPTH_STREAM_UNORM16	// xyz + pad, 8 bytes
+};
+
 class Mesh
 {
 public:
@@ -28,16 +37,36 @@ public:
 	 Mesh();
 	~Mesh();
 
-	bool loadOBJ(const std::string& filename);
+	bool loadOBJ(const std::string& filename, DepthStream depthStream = DEPTH_STREAM_UNORM16);
 	void draw();
 	void destroy();
 
+	// Draws positions only, from the depth stream if there is one, and binds
+	// no textures.  The model matrix must be multiplied by getDepthTransform.
+	void drawDepth();
+	glm::mat4 getDepthTransform() const;
+
+	size_t getVertexCount() const { return mVertices.size(); }
+	size_t getIndexCount() const  { return mIndices.size(); }
+
+	const glm::vec3& getBoundsMin() const { return mBoundsMin; }
+	const glm::vec3& getBoundsMax() const { return mBoundsMax; }
+	glm::vec3 getBoundsCenter() const     { return (mBoundsMin + mBoundsMax) * 0.5f; }
+	float getBoundsRadius() const         { return mBoundsRadius; }		// around getBoundsCenter()
+
 private:
 
 	void initBuffers();
+	void initDepthBuffers();
 
 	bool mLoaded;
 	std::vector<Vertex> mVertices;
-	GLuint mVBO, mVAO;
+	std::vector<GLuint> mIndices;
+	GLenum mIndexType;		// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, whichever is narrowest
+	glm::vec3 mBoundsMin, mBoundsMax;
+	float mBoundsRadius;
+	DepthStream mDepthStream;
+	GLuint mVBO, mIBO, mVAO;
+	GLuint mDepthVBO, mDepthVAO;		// share mIBO
 };
 #endif //MESH_H
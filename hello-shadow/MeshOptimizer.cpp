@@ -0,0 +1,373 @@
+//-----------------------------------------------------------------------------
+// MeshOptimizer.cpp
+//
+// Load-time triangle and vertex reordering for indexed triangle lists:
+// post-transform vertex cache (Forsyth), overdraw (sorted clusters) and
+// vertex fetch locality.
+//-----------------------------------------------------------------------------
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+namespace
+{
+	// Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"
+	const int FORSYTH_CACHE_SIZE = 32;
+	const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+	const float FORSYTH_LAST_TRI_SCORE = 0.75f;
+	const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+	const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+	// Cache size used to find cluster boundaries for the overdraw pass
+	const size_t OVERDRAW_CLUSTER_CACHE_SIZE = 16;
+
+	float forsythScore(int cachePosition, unsigned int remainingValence)
+	{
+		// Vertex has no triangles left to emit
+		if (remainingValence == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+			{
+				// Used by the last triangle, a fixed score discourages
+				// immediately reusing the same edge
+				score = FORSYTH_LAST_TRI_SCORE;
+			}
+			else
+			{
+				const float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+				score = std::pow(1.0f - (cachePosition - 3) * scaler, FORSYTH_CACHE_DECAY_POWER);
+			}
+		}
+
+		// Boost vertices with few triangles left so lone triangles are not stranded
+		score += FORSYTH_VALENCE_BOOST_SCALE * std::pow((float)remainingValence, -FORSYTH_VALENCE_BOOST_POWER);
+		return score;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Greedy triangle ordering after Forsyth.  Each step emits the triangle with
+// the best summed vertex score, where vertices score higher the more recently
+// they entered a simulated LRU cache and the fewer triangles they have left.
+//-----------------------------------------------------------------------------
+void MeshOptimizer::optimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Vertex -> triangle adjacency in compressed rows
+	std::vector<unsigned int> valence(vertexCount, 0);
+	for (GLuint index : indices)
+		valence[index]++;
+
+	std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + valence[v];
+
+	std::vector<unsigned int> adjacency(indices.size());
+	std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+	for (size_t t = 0; t < triangleCount; t++)
+		for (int k = 0; k < 3; k++)
+			adjacency[fill[indices[t * 3 + k]]++] = (unsigned int)t;
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		vertexScore[v] = forsythScore(-1, valence[v]);
+
+	std::vector<bool> emitted(triangleCount, false);
+
+	std::vector<GLuint> cache, newCache;
+	cache.reserve(FORSYTH_CACHE_SIZE + 3);
+	newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+	std::vector<GLuint> result;
+	result.reserve(indices.size());
+
+	size_t scanCursor = 0;
+	long long bestTriangle = -1;
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		// Nothing good in the cache, take the next unemitted triangle in order
+		if (bestTriangle < 0)
+		{
+			while (emitted[scanCursor])
+				scanCursor++;
+			bestTriangle = (long long)scanCursor;
+		}
+
+		size_t t = (size_t)bestTriangle;
+		emitted[t] = true;
+
+		const GLuint* tri = &indices[t * 3];
+		result.insert(result.end(), tri, tri + 3);
+
+		// Remove the triangle from its vertices' remaining adjacency
+		for (int k = 0; k < 3; k++)
+		{
+			GLuint v = tri[k];
+			unsigned int* begin = &adjacency[adjacencyOffset[v]];
+			unsigned int* end = begin + valence[v];
+			unsigned int* found = std::find(begin, end, (unsigned int)t);
+			if (found != end)
+			{
+				*found = *(end - 1);
+				valence[v]--;
+			}
+		}
+
+		// Move the triangle's vertices to the front of the LRU cache
+		newCache.assign(tri, tri + 3);
+		for (GLuint v : cache)
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				newCache.push_back(v);
+
+		for (size_t i = 0; i < newCache.size(); i++)
+			cachePosition[newCache[i]] = (i < (size_t)FORSYTH_CACHE_SIZE) ? (int)i : -1;
+
+		// Rescore the vertices that moved and pick the best of the triangles
+		// touching them; triangles outside the cache are not tracked
+		float bestScore = 0.0f;
+		bestTriangle = -1;
+		for (GLuint v : newCache)
+		{
+			vertexScore[v] = forsythScore(cachePosition[v], valence[v]);
+
+			const unsigned int* adj = &adjacency[adjacencyOffset[v]];
+			for (unsigned int a = 0; a < valence[v]; a++)
+			{
+				unsigned int other = adj[a];
+				const GLuint* otherTri = &indices[other * 3];
+				float score = vertexScore[otherTri[0]] + vertexScore[otherTri[1]] + vertexScore[otherTri[2]];
+
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = other;
+				}
+			}
+		}
+
+		if (newCache.size() > (size_t)FORSYTH_CACHE_SIZE)
+			newCache.resize(FORSYTH_CACHE_SIZE);
+		cache.swap(newCache);
+	}
+
+	indices.swap(result);
+}
+
+//-----------------------------------------------------------------------------
+// Overdraw ordering after Sander et al, "Fast Triangle Reordering for Vertex
+// Locality and Reduced Overdraw".  The cache-optimized triangle order is cut
+// into clusters where a FIFO cache would be flushed anyway, plus wherever a
+// split costs little cache efficiency.  Clusters facing away from the mesh
+// centroid (likely occluders of the rest) are then drawn first.
+//-----------------------------------------------------------------------------
+void MeshOptimizer::optimizeOverdraw(std::vector<GLuint>& indices, const float* positions, size_t positionStride,
+	size_t vertexCount, float threshold)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount < 2)
+		return;
+
+	const unsigned char* base = reinterpret_cast<const unsigned char*>(positions);
+	auto position = [&](GLuint v) {
+		const float* p = reinterpret_cast<const float*>(base + v * positionStride);
+		return glm::vec3(p[0], p[1], p[2]);
+	};
+
+	// Hard cluster boundaries: triangles that miss the cache on all three vertices
+	std::vector<size_t> timestamp(vertexCount, 0);
+	size_t time = 0;
+
+	auto cacheMisses = [&](size_t t) {
+		int misses = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			GLuint v = indices[t * 3 + k];
+			if (time - timestamp[v] > OVERDRAW_CLUSTER_CACHE_SIZE)
+			{
+				timestamp[v] = time++;
+				misses++;
+			}
+		}
+		return misses;
+	};
+
+	auto flushCache = [&]() { time += OVERDRAW_CLUSTER_CACHE_SIZE + 1; };
+
+	std::vector<size_t> hardStart;
+	flushCache();
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (cacheMisses(t) == 3 || t == 0)
+			hardStart.push_back(t);
+	}
+	hardStart.push_back(triangleCount);
+
+	// Soft boundaries: split each hard cluster further wherever the running
+	// ACMR since the last split gets within 'threshold' of the cluster's ACMR
+	std::vector<size_t> clusterStart;
+	for (size_t h = 0; h + 1 < hardStart.size(); h++)
+	{
+		size_t start = hardStart[h], end = hardStart[h + 1];
+
+		flushCache();
+		size_t clusterMisses = 0;
+		for (size_t t = start; t < end; t++)
+			clusterMisses += cacheMisses(t);
+		float clusterThreshold = threshold * (float)clusterMisses / (float)(end - start);
+
+		clusterStart.push_back(start);
+		flushCache();
+		size_t runningMisses = 0, runningTriangles = 0;
+		for (size_t t = start; t < end; t++)
+		{
+			runningMisses += cacheMisses(t);
+			runningTriangles++;
+
+			if (t + 1 < end && (float)runningMisses / (float)runningTriangles <= clusterThreshold)
+			{
+				clusterStart.push_back(t + 1);
+				flushCache();
+				runningMisses = runningTriangles = 0;
+			}
+		}
+	}
+
+	size_t clusterCount = clusterStart.size();
+	if (clusterCount < 2)
+		return;
+	clusterStart.push_back(triangleCount);
+
+	// Area weighted mesh centroid
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		glm::vec3 p0 = position(indices[t * 3]), p1 = position(indices[t * 3 + 1]), p2 = position(indices[t * 3 + 2]);
+		float area = glm::length(glm::cross(p1 - p0, p2 - p0));
+		meshCentroid += (p0 + p1 + p2) * (area / 3.0f);
+		meshArea += area;
+	}
+	meshCentroid = (meshArea > 0.0f) ? meshCentroid / meshArea : glm::vec3(0.0f);
+
+	// Sort key per cluster: how far the cluster faces away from the centroid
+	std::vector<float> sortKey(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+
+		for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+		{
+			glm::vec3 p0 = position(indices[t * 3]), p1 = position(indices[t * 3 + 1]), p2 = position(indices[t * 3 + 2]);
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float a = glm::length(n);
+			centroid += (p0 + p1 + p2) * (a / 3.0f);
+			normal += n;
+			area += a;
+		}
+
+		centroid = (area > 0.0f) ? centroid / area : position(indices[clusterStart[c] * 3]);
+		float normalLength = glm::length(normal);
+		normal = (normalLength > 0.0f) ? normal / normalLength : glm::vec3(0.0f);
+
+		sortKey[c] = glm::dot(centroid - meshCentroid, normal);
+	}
+
+	std::vector<size_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+		order[c] = c;
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+	std::vector<GLuint> result;
+	result.reserve(indices.size());
+	for (size_t c : order)
+		result.insert(result.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+
+	// Only keep the new order if it does not undo the vertex cache work
+	float before = analyzeVertexCache(indices, vertexCount).acmr;
+	float after = analyzeVertexCache(result, vertexCount).acmr;
+	if (after <= before * threshold)
+		indices.swap(result);
+}
+
+//-----------------------------------------------------------------------------
+// Renumbers vertices in the order the index buffer first references them so
+// the vertex fetch walks memory mostly linearly.  Unreferenced vertices are
+// moved to the end.
+//-----------------------------------------------------------------------------
+void MeshOptimizer::optimizeVertexFetch(void* vertices, size_t vertexCount, size_t vertexSize, std::vector<GLuint>& indices)
+{
+	const GLuint UNUSED = 0xFFFFFFFFu;
+	std::vector<GLuint> remap(vertexCount, UNUSED);
+	GLuint next = 0;
+
+	for (GLuint& index : indices)
+	{
+		if (remap[index] == UNUSED)
+			remap[index] = next++;
+		index = remap[index];
+	}
+
+	for (size_t v = 0; v < vertexCount; v++)
+		if (remap[v] == UNUSED)
+			remap[v] = next++;
+
+	unsigned char* data = static_cast<unsigned char*>(vertices);
+	std::vector<unsigned char> reordered(vertexCount * vertexSize);
+	for (size_t v = 0; v < vertexCount; v++)
+		std::memcpy(&reordered[remap[v] * vertexSize], &data[v * vertexSize], vertexSize);
+
+	std::memcpy(data, reordered.data(), reordered.size());
+}
+
+//-----------------------------------------------------------------------------
+// ACMR/ATVR of an index buffer on a FIFO post-transform cache
+//-----------------------------------------------------------------------------
+VertexCacheStats MeshOptimizer::analyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, size_t cacheSize)
+{
+	VertexCacheStats stats = { 0.0f, 0.0f };
+	if (indices.empty() || vertexCount == 0)
+		return stats;
+
+	std::vector<size_t> timestamp(vertexCount, 0);
+	size_t time = cacheSize + 1;
+	size_t transformed = 0;
+
+	for (GLuint v : indices)
+	{
+		if (time - timestamp[v] > cacheSize)
+		{
+			timestamp[v] = time++;
+			transformed++;
+		}
+	}
+
+	// Count only vertices that are actually referenced for ATVR
+	std::vector<bool> used(vertexCount, false);
+	size_t usedCount = 0;
+	for (GLuint v : indices)
+	{
+		if (!used[v])
+		{
+			used[v] = true;
+			usedCount++;
+		}
+	}
+
+	stats.acmr = (float)transformed / (float)(indices.size() / 3);
+	stats.atvr = (float)transformed / (float)usedCount;
+	return stats;
+}
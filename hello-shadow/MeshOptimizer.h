@@ -0,0 +1,41 @@
+//-----------------------------------------------------------------------------
+// MeshOptimizer.h
+//
+// Load-time triangle and vertex reordering for indexed triangle lists:
+// post-transform vertex cache (Forsyth), overdraw (sorted clusters) and
+// vertex fetch locality.
+//-----------------------------------------------------------------------------
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+
+// Post-transform cache statistics of an index buffer
+struct VertexCacheStats
+{
+	float acmr;		// average cache miss ratio: transformed vertices per triangle (0.5 .. 3)
+	float atvr;		// average transformed vertex ratio: transformed per unique vertex (>= 1)
+};
+
+class MeshOptimizer
+{
+public:
+	// Reorders triangles for post-transform vertex cache reuse
+	static void optimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount);
+
+	// Reorders clusters of triangles front-to-back as seen from outside the
+	// mesh.  Keeps the result only if ACMR grows by less than 'threshold'.
+	static void optimizeOverdraw(std::vector<GLuint>& indices, const float* positions, size_t positionStride,
+		size_t vertexCount, float threshold = 1.05f);
+
+	// Reorders 'vertices' (an array of 'vertexCount' elements of 'vertexSize'
+	// bytes) in order of first use and remaps the indices to match
+	static void optimizeVertexFetch(void* vertices, size_t vertexCount, size_t vertexSize, std::vector<GLuint>& indices);
+
+	// Simulates a FIFO post-transform cache of 'cacheSize' entries
+	static VertexCacheStats analyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, size_t cacheSize = 16);
+};
+#endif // MESH_OPTIMIZER_H
@@ -1,9 +1,11 @@
 //-----------------------------------------------------------------------------
 // Copyright (c) 2015-2019 Game Institute. All Rights Reserved.
 //-----------------------------------------------------------------------------
+#include <chrono>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -18,6 +20,7 @@
 #include "Texture2D.h"
 #include "Camera.h"
 #include "Mesh.h"
+#include "FrustumCuller.h"
 #include "Skybox.h"
 
 #include <glm/gtc/type_ptr.hpp>
@@ -38,6 +41,11 @@ int gWindowHeightFull = 1200;
 
 bool gWireframe = false;
 
+// Whole models per pass, toggled with 2; the counts go to the window title
+bool gFrustumCulling = true;
+FrustumCullStats gShadowCullStats = { 0, 0 }, gCameraCullStats = { 0, 0 };
+double gCullMs = 0.0;
+
 FPSCamera fpsCamera(glm::vec3(0.0f, 5.0f, 20.0f), -180, -10);
 const double ZOOM_SENSITIVITY = -3.0;
 const float MOVE_SPEED = 5.0; // units per second
@@ -93,7 +101,7 @@ int main()
 	texture[5].loadTexture("textures/bunny_diffuse.jpg", true);
 
 	Mesh lightMesh;
-	lightMesh.loadOBJ("models/light.obj");
+	lightMesh.loadOBJ("models/light.obj", DEPTH_STREAM_NONE);		// only drawn with the bulb shader
 
 	// Model positions
 	glm::vec3 modelPos[] = {
@@ -155,6 +163,10 @@ int main()
 		"textures/skybox/back.jpg"
 		});
 
+	// Model visibility per pass
+	FrustumCuller frustumCuller;
+	std::vector<unsigned char> shadowVisible, cameraVisible;
+
 	double lastTime = glfwGetTime();
 	float angle = 0.0f;
 
@@ -207,6 +219,28 @@ int main()
 		lightView = glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
 		lightSpaceMatrix = lightProjection * lightView;
 
+		// Cull whole models against the light and the camera frustums
+		auto cullStart = std::chrono::steady_clock::now();
+		frustumCuller.clear();
+		for (int i = 0; i < numModels; i++)
+		{
+			model = glm::translate(glm::mat4(1.0), modelPos[i]) * glm::scale(glm::mat4(1.0), modelScale[i]);
+			frustumCuller.addInstance(mesh[i].getBoundsCenter(), (mesh[i].getBoundsMax() - mesh[i].getBoundsMin()) * 0.5f,
+				mesh[i].getBoundsRadius(), model);
+		}
+		if (gFrustumCulling)
+		{
+			gShadowCullStats = frustumCuller.cull(lightSpaceMatrix, shadowVisible);
+			gCameraCullStats = frustumCuller.cull(projection * view, cameraVisible);
+		}
+		else
+		{
+			shadowVisible.assign(numModels, 1);
+			cameraVisible.assign(numModels, 1);
+			gShadowCullStats = gCameraCullStats = { (size_t)numModels, 0 };
+		}
+		gCullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cullStart).count();
+
 		// Render the scene to the depth buffer (shadow map)
 		shadowShader.use();
 		shadowShader.setUniform("lightSpaceMatrix", lightSpaceMatrix);
@@ -218,12 +252,14 @@ int main()
 		// Render the scene
 		for (int i = 0; i < numModels; i++)
 		{
+			if (!shadowVisible[i])
+				continue;
+
 			model = glm::translate(glm::mat4(1.0), modelPos[i]) * glm::scale(glm::mat4(1.0), modelScale[i]);
-			shadowShader.setUniform("model", model);
+			shadowShader.setUniform("model", model * mesh[i].getDepthTransform());
 
-			texture[i].bind(0);		// set the texture before drawing.
-			mesh[i].draw();
-			texture[i].unbind(0);
+			// Depth only, positions and no textures
+			mesh[i].drawDepth();
 		}
 
 		// Render the light bulb geometry
@@ -262,6 +298,9 @@ int main()
 		// Render the scene
 		for (int i = 0; i < numModels; i++)
 		{
+			if (!cameraVisible[i])
+				continue;
+
 			model = glm::translate(glm::mat4(1.0), modelPos[i]) * glm::scale(glm::mat4(1.0), modelScale[i]);
 			shaderProgram.setUniform("model", model);
 
@@ -394,6 +433,9 @@ void glfw_onKey(GLFWwindow* window, int key, int scancode, int action, int mode)
 		else
 			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 	}
+
+	if (key == GLFW_KEY_2 && action == GLFW_PRESS)
+		gFrustumCulling = !gFrustumCulling;
 }
 
 //-----------------------------------------------------------------------------
@@ -473,8 +515,10 @@ void showFPS(GLFWwindow* window) {
 		double fps = (double)frameCount / elapsedSeconds;
 		double msPerFrame = 1000.0 / fps;
 
-		char title[80];
-		std::snprintf(title, sizeof(title), "Hello Shadow @ fps: %.2f, ms/frame: %.2f", fps, msPerFrame);
+		char title[192];
+		std::snprintf(title, sizeof(title), "Hello Shadow @ fps: %.2f, ms/frame: %.2f, culling %s: shadow %zu/%zu, camera %zu/%zu visible (%.3f ms)",
+			fps, msPerFrame, gFrustumCulling ? "on" : "off", gShadowCullStats.visible, gShadowCullStats.visible + gShadowCullStats.culled,
+			gCameraCullStats.visible, gCameraCullStats.visible + gCameraCullStats.culled, gCullMs);
 		glfwSetWindowTitle(window, title);
 
 		frameCount = 0;
@@ -2,7 +2,7 @@
 layout (location = 0) in vec3 aPos;
 
 uniform mat4 lightSpaceMatrix;
-uniform mat4 model;
+uniform mat4 model;		// times Mesh::getDepthTransform, aPos may be unorm16
 
 void main()
 {